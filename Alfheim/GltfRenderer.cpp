@@ -29,7 +29,7 @@ void GltfRenderer::Initialize()
 	m_RootSig[0].InitAsConstantBuffer(0, D3D12_SHADER_VISIBILITY_ALL);
 	m_RootSig[1].InitAsConstantBuffer(1, D3D12_SHADER_VISIBILITY_ALL);
 	m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, static_cast<UINT>(5), D3D12_SHADER_VISIBILITY_PIXEL);
-	m_RootSig[3].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 0, static_cast<UINT>(5), D3D12_SHADER_VISIBILITY_PIXEL);
+	m_RootSig[3].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 0, Graphics::kNumSharedSamplers, D3D12_SHADER_VISIBILITY_PIXEL);
 	m_RootSig[4].InitAsDescriptorTable(1);
 	m_RootSig[4].SetTableRange(0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 2, 1);
 	m_RootSig[5].InitAsBufferSRV(11, D3D12_SHADER_VISIBILITY_VERTEX);
@@ -56,7 +56,8 @@ void GltfRenderer::Initialize()
 
 	m_WireframePSO = m_SurfacePSO;
 	m_WireframePSO.SetRasterizerState(Graphics::RasterizerWireframe);
-	m_WireframePSO.Finalize();
+	m_WireframePSO.SetFallback(m_SurfacePSO);
+	m_WireframePSO.FinalizeAsync();
 
 	m_InstanceBuffer.Create(L"Model instance buffer", ms_MaximumInstances);
 }
@@ -75,15 +76,14 @@ void GltfRenderer::Render(GraphicsContext& gfxContext, const Math::Camera& camer
 	ASSERT(instances.size() < ms_MaximumInstances);
 	ASSERT(m_SimpleLights.size() <= ms_MaximumLights);
 
+	model.UpdateGeometryViews();
+
 	gfxContext.SetRootSignature(m_RootSig);
 	gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	gfxContext.TransitionResource(model.m_Buffers[0], D3D12_RESOURCE_STATE_GENERIC_READ);
+	gfxContext.TransitionResource(Graphics::g_GeometryPool.GetBuffer(), D3D12_RESOURCE_STATE_GENERIC_READ);
 
-	switch (PSOOption)
-	{
-	case kNormal: gfxContext.SetPipelineState(m_SurfacePSO); break;
-	case kWireframe: gfxContext.SetPipelineState(m_WireframePSO); break;
-	}
+	const auto& pso = PSOOption == kWireframe ? m_WireframePSO : m_SurfacePSO;
+	gfxContext.SetPipelineState(pso);
 	gfxContext.SetViewportAndScissor(0, 0, Graphics::g_SceneColorBuffer.GetWidth(), Graphics::g_SceneColorBuffer.GetHeight());
 
 	__declspec(align(16)) struct {
@@ -111,69 +111,170 @@ void GltfRenderer::Render(GraphicsContext& gfxContext, const Math::Camera& camer
 
 	auto srvs = std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>();
 	srvs.reserve(model.m_Textures.size());
-	std::ranges::transform(model.m_Textures, std::back_inserter(srvs), [](const auto& texture) {
+	// The textures may be evicted while unused, see ModelReader
+	std::ranges::transform(model.m_Textures, std::back_inserter(srvs), [&gfxContext](const auto& texture) {
+		gfxContext.MarkUsed(texture);
 		return texture.GetSRV();
 		});
 	gfxContext.SetDynamicDescriptors(2, 0, static_cast<UINT>(srvs.size()), srvs.data());
-	gfxContext.SetDynamicSamplers(3, 0, static_cast<UINT>(model.m_Samplers.size()), model.m_Samplers.data());
+	gfxContext.SetDescriptorTable(3, Graphics::GetSharedSamplerTable());
 	gfxContext.SetDynamicDescriptor(4, 0, model.m_Materials.GetSRV());
 
 	memcpy(&m_SimpleLightsBuffer[0], m_SimpleLights.data(), m_SimpleLights.size() * sizeof(m_SimpleLights[0]));
 	gfxContext.SetDynamicDescriptor(4, 1, m_SimpleLightsBuffer.GetSRV());
 
-	const auto& scene = model.m_Scenes[model.defaultScene];
-	for (const auto& nodeId : scene.m_Nodes)
+	if (!model.IsStatic())
 	{
-		DrawNode(gfxContext, model, nodeId, Matrix4{kIdentity}, static_cast<int>(instanceData.size()));
+		DrawScene(gfxContext, model, static_cast<int>(instanceData.size()));
+		return;
 	}
+
+	ReleaseRetiredBundles();
+
+	// Resolved before recording, so a compile finishing in between costs one extra re-record at worst
+	auto pipelineState = pso.ResolvePipelineState();
+	auto& staticBundle = m_StaticBundles[&model];
+	if (staticBundle == nullptr || !staticBundle->Bundle.IsValid() || staticBundle->ModelRevision != model.GetRevision() ||
+		staticBundle->InstanceCount != instanceData.size() || staticBundle->Scene != model.defaultScene ||
+		staticBundle->PipelineState != pipelineState)
+	{
+		// The previous recording may still be in flight, it's released by fence instead of waited for
+		if (staticBundle != nullptr)
+		{
+			staticBundle->RetiredFrame = Graphics::GetFrameCount();
+			m_RetiredBundles.push_back(std::move(staticBundle));
+		}
+
+		staticBundle = std::make_unique<StaticBundle>();
+		RecordStaticBundle(*staticBundle, model, static_cast<int>(instanceData.size()));
+		staticBundle->ModelRevision = model.GetRevision();
+		staticBundle->InstanceCount = instanceData.size();
+		staticBundle->Scene = model.defaultScene;
+		staticBundle->PipelineState = pipelineState;
+	}
+
+	gfxContext.ExecuteBundle(staticBundle->Bundle);
 }
 
-void GltfRenderer::DrawMesh(GraphicsContext& gfxContext, const Model::Mesh& mesh, Matrix4 transformation, int instances)
+void GltfRenderer::Forget(const Model& model)
 {
-	__declspec(align(16)) struct {
-		XMFLOAT4X4 worldTransformation;
-		XMFLOAT4X4 normalTransformation;
-		int materialId;
-	} vsConstants;
+	ReleaseRetiredBundles();
 
-	XMStoreFloat4x4(&vsConstants.worldTransformation, transformation);
-	XMStoreFloat4x4(&vsConstants.normalTransformation, InverseTranspose(transformation));
+	const auto staticBundle = m_StaticBundles.find(&model);
+	if (staticBundle == m_StaticBundles.end())
+		return;
 
-	for (const auto& primitive : mesh.m_Primitives)
+	// The GPU may still be executing the bundle, it is released like a replaced one
+	if (staticBundle->second != nullptr)
 	{
-		vsConstants.materialId = primitive.m_MaterialId;
-		gfxContext.SetDynamicConstantBufferView(0, sizeof(vsConstants), &vsConstants);
+		staticBundle->second->RetiredFrame = Graphics::GetFrameCount();
+		m_RetiredBundles.push_back(std::move(staticBundle->second));
+	}
+	m_StaticBundles.erase(staticBundle);
+}
 
+void GltfRenderer::ReleaseRetiredBundles()
+{
+	// A bundle retired this frame may have been executed by a context that isn't finished yet, so
+	// its fence value isn't final
+	const auto frame = Graphics::GetFrameCount();
+	std::erase_if(m_RetiredBundles, [frame](const auto& staticBundle) {
+		return staticBundle->RetiredFrame < frame && Graphics::g_CommandManager.IsFenceComplete(staticBundle->Bundle.GetLastFenceValue());
+	});
+}
+
+template <typename Visitor>
+void GltfRenderer::VisitNode(const Model& model, int nodeId, Matrix4 transformation, Visitor&& visitor)
+{
+	const auto& node = model.GetNodes()[nodeId];
+
+	transformation = node.m_Transformation * OrthogonalTransform{ node.m_Rotation, node.m_Translation } * Matrix4::MakeScale(node.m_Scale) * transformation;
+
+	if (node.m_MeshId >= 0 && node.m_MeshId < model.GetMeshes().size())
+	{
+		for (const auto& primitive : model.GetMeshes()[node.m_MeshId].m_Primitives)
+			visitor(primitive, transformation);
+	}
+	for (const auto& childId : node.m_Children)
+	{
+		VisitNode(model, childId, transformation, visitor);
+	}
+}
+
+namespace
+{
+	template <typename Context>
+	void SetPrimitiveBuffers(Context& context, const Model::Primitive& primitive)
+	{
 		if (const auto it = primitive.m_VertexBufferViews.find("POSITION"); it != primitive.m_VertexBufferViews.end())
-			gfxContext.SetVertexBuffer(0, it->second);
+			context.SetVertexBuffer(0, it->second);
 
 		if (const auto it = primitive.m_VertexBufferViews.find("NORMAL"); it != primitive.m_VertexBufferViews.end())
-			gfxContext.SetVertexBuffer(1, it->second);
+			context.SetVertexBuffer(1, it->second);
 
 		if (const auto it = primitive.m_VertexBufferViews.find("TEXCOORD_0"); it != primitive.m_VertexBufferViews.end())
-			gfxContext.SetVertexBuffer(2, it->second);
+			context.SetVertexBuffer(2, it->second);
 
 		if (const auto it = primitive.m_VertexBufferViews.find("TANGENT"); it != primitive.m_VertexBufferViews.end())
-			gfxContext.SetVertexBuffer(3, it->second);
+			context.SetVertexBuffer(3, it->second);
 
-		gfxContext.SetIndexBuffer(primitive.m_IndexBufferView);
-
-		gfxContext.DrawIndexedInstanced(primitive.m_IndexCount, instances, 0, 0, 0);
+		context.SetIndexBuffer(primitive.m_IndexBufferView);
 	}
 }
 
-void GltfRenderer::DrawNode(GraphicsContext& gfxContext, const Model& model, int nodeId, Matrix4 transformation, int instances)
+void GltfRenderer::DrawScene(GraphicsContext& gfxContext, const Model& model, int instances)
 {
-	const auto& node = model.m_Nodes[nodeId];
+	const auto& scene = model.GetScenes()[model.defaultScene];
+	for (const auto& nodeId : scene.m_Nodes)
+	{
+		VisitNode(model, nodeId, Matrix4{ kIdentity }, [&](const Model::Primitive& primitive, const Matrix4& transformation) {
+			MeshConstants vsConstants;
+			XMStoreFloat4x4(&vsConstants.WorldTransformation, transformation);
+			XMStoreFloat4x4(&vsConstants.NormalTransformation, InverseTranspose(transformation));
+			vsConstants.MaterialId = primitive.m_MaterialId;
+			gfxContext.SetDynamicConstantBufferView(0, sizeof(vsConstants), &vsConstants);
 
-	transformation = node.m_Transformation * OrthogonalTransform{ node.m_Rotation, node.m_Translation } * Matrix4::MakeScale(node.m_Scale) * transformation;
+			SetPrimitiveBuffers(gfxContext, primitive);
+
+			gfxContext.DrawIndexedInstanced(primitive.m_IndexCount, instances, 0, 0, 0);
+		});
+	}
+}
 
-	if (node.m_MeshId >= 0 && node.m_MeshId < model.m_Meshes.size())
+void GltfRenderer::RecordStaticBundle(StaticBundle& staticBundle, const Model& model, int instances)
+{
+	auto meshConstants = std::vector<MeshConstants>();
+	const auto& scene = model.GetScenes()[model.defaultScene];
+	for (const auto& nodeId : scene.m_Nodes)
 	{
-		DrawMesh(gfxContext, model.m_Meshes[node.m_MeshId], transformation, instances);
+		VisitNode(model, nodeId, Matrix4{ kIdentity }, [&](const Model::Primitive& primitive, const Matrix4& transformation) {
+			auto& vsConstants = meshConstants.emplace_back();
+			XMStoreFloat4x4(&vsConstants.WorldTransformation, transformation);
+			XMStoreFloat4x4(&vsConstants.NormalTransformation, InverseTranspose(transformation));
+			vsConstants.MaterialId = primitive.m_MaterialId;
+		});
 	}
-	for (const auto& childId : node.m_Children)
+
+	if (meshConstants.size() > 0)
+	{
+		staticBundle.MeshConstantsBuffer.Create(L"Static mesh constants", meshConstants.size());
+		memcpy(&staticBundle.MeshConstantsBuffer[0], meshConstants.data(), meshConstants.size() * sizeof(meshConstants[0]));
+	}
+
+	auto& bundle = staticBundle.Bundle;
+	bundle.Begin(PSOOption == kWireframe ? m_WireframePSO : m_SurfacePSO);
+	bundle.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	size_t drawIndex = 0;
+	for (const auto& nodeId : scene.m_Nodes)
 	{
-		DrawNode(gfxContext, model, childId, transformation, instances);
+		VisitNode(model, nodeId, Matrix4{ kIdentity }, [&](const Model::Primitive& primitive, const Matrix4&) {
+			bundle.SetConstantBuffer(0, staticBundle.MeshConstantsBuffer.GetGpuPointer(static_cast<uint32_t>(drawIndex++ * sizeof(MeshConstants))));
+
+			SetPrimitiveBuffers(bundle, primitive);
+
+			bundle.DrawIndexedInstanced(primitive.m_IndexCount, instances, 0, 0, 0);
+		});
 	}
+	bundle.End();
 }
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <unordered_map>
+
 #include <CommandContext.h>
+#include <CommandBundle.h>
+#include <DynamicUploadBuffer.h>
 #include <Camera.h>
 #include <GpuBuffer.h>
 #include <tiny_gltf.h>
@@ -25,17 +29,47 @@ class GltfRenderer
 		DirectX::XMFLOAT4X4 NormalTransformation;
 	};
 
+	// Aligned to constant buffer placement so a static bundle can point each draw at its own element
+	__declspec(align(256)) struct MeshConstants
+	{
+		DirectX::XMFLOAT4X4 WorldTransformation;
+		DirectX::XMFLOAT4X4 NormalTransformation;
+		int MaterialId;
+	};
+
+	// Draws of a model flagged as static, recorded once and replayed until the model or instance count changes
+	struct StaticBundle
+	{
+		CommandBundle Bundle;
+		StructuredUploadBuffer<MeshConstants> MeshConstantsBuffer;
+		uint64_t ModelRevision = 0;
+		size_t InstanceCount = 0;
+		int Scene = -1;
+		// What the bundle's PSO resolved to when recorded; changes once a background compile completes
+		ID3D12PipelineState* PipelineState = nullptr;
+		// Frame the bundle was replaced in, a retired bundle is released once the GPU is done with it
+		uint64_t RetiredFrame = 0;
+	};
+
 public:
 	void Initialize();
-	void Shutdown() {}
+	void Shutdown() { m_StaticBundles.clear(); m_RetiredBundles.clear(); }
 
 	void Update([[maybe_unused]] float deltaT) {}
 
+	// Static models (see Model::IsStatic) have their draws recorded into a bundle once; the bundle is re-recorded when the model is invalidated
 	void Render(GraphicsContext& gfxContext, const Math::Camera& camera, const std::vector<SimpleLight>& m_SimpleLights, Model& model, const std::vector<Math::Matrix4>& instances);
 
+	// Releases what was kept for drawing the model, to be called before the model is unloaded or moved
+	void Forget(const Model& model);
+
 private:
-	void DrawNode(GraphicsContext& gfxContext, const Model& model, int nodeId, Math::Matrix4 transformation, int instances);
-	void DrawMesh(GraphicsContext& gfxContext, const Model::Mesh& mesh, Math::Matrix4 transformation, int instances);
+	template <typename Visitor>
+	void VisitNode(const Model& model, int nodeId, Math::Matrix4 transformation, Visitor&& visitor);
+
+	void DrawScene(GraphicsContext& gfxContext, const Model& model, int instances);
+	void RecordStaticBundle(StaticBundle& staticBundle, const Model& model, int instances);
+	void ReleaseRetiredBundles();
 
 	RootSignature m_RootSig;
 
@@ -46,6 +80,10 @@ private:
 
 	StructuredUploadBuffer<SimpleLight> m_SimpleLightsBuffer;
 
+	std::unordered_map<const Model*, std::unique_ptr<StaticBundle>> m_StaticBundles;
+	// Replaced bundles the GPU may still be executing, re-recording never waits for them
+	std::vector<std::unique_ptr<StaticBundle>> m_RetiredBundles;
+
 	static const int ms_MaximumLights = 16;
 	static const int ms_MaximumInstances = 128;
 };
\ No newline at end of file
@@ -19,7 +19,13 @@ public:
 	Alfheim() {}
 
 	virtual void Startup(void) override;
-	virtual void Cleanup(void) override {};
+	virtual void Cleanup(void) override
+	{
+		m_Gltf.Forget(m_Model);
+		m_Model = Model{};
+		m_Gltf.Shutdown();
+		m_PrimitiveRenderer.Shutdown();
+	};
 
 	virtual void Update(float deltaT) override;
 	virtual void RenderScene(void) override;
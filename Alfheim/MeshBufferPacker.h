@@ -1,35 +1,34 @@
 #pragma once
 
+#include <span>
+#include <functional>
+
 #include "GpuBuffer.h"
+#include "GeometryPool.h"
 
 struct Foo
 {
 	int IndexCount;
 	int StartIndexLocation;
 	int BaseVertexLocation;
+	bool Uses32BitIndices = true;
 };
 
-template <typename VertexDataType, typename IndexDataType = uint32_t,
-	typename = std::enable_if_t<std::is_same_v<IndexDataType, uint32_t> || std::is_same_v<IndexDataType, uint16_t>>>
+// Uploads meshes into the geometry pool. Indices stay local to each mesh, draws combine them with
+// BaseVertexLocation and StartIndexLocation over the views spanning the whole pool, so every mesh
+// packed this way shares a single vertex buffer binding. Indices are stored as uint16_t whenever all
+// meshes pushed together have few enough vertices; IndexBufferView(Foo) picks the matching format.
+template <typename VertexDataType>
 class MeshBufferPacker
 {
 public:
+	explicit MeshBufferPacker(GeometryPool& Pool = Graphics::g_GeometryPool) : m_Pool(Pool) {}
+
 	template <typename VDT, typename IDT, typename = std::enable_if_t<std::is_integral_v<IDT> || std::is_convertible_v<VDT, VertexDataType>>>
 	auto Push(const std::vector<VDT>& Vertices, const std::vector<IDT>& Indices) -> Foo
 	{
-		auto foo = Foo{
-			.IndexCount = static_cast<int>(Indices.size()),
-			.StartIndexLocation = static_cast<int>(m_Indices.size())
-		};
-
-		m_Indices.insert(m_Indices.end(), Indices.begin(), Indices.end());
-		std::for_each(m_Indices.end() - Indices.size(), m_Indices.end(), [base = m_Vertices.size()](auto& index) {
-			index += static_cast<int>(base);
-		});
-
-		m_Vertices.insert(m_Vertices.end(), Vertices.begin(), Vertices.end());
-
-		return foo;
+		const auto MeshData = std::pair{ std::cref(Vertices), std::cref(Indices) };
+		return Push(std::span(&MeshData, 1)).front();
 	}
 	
 	template <typename VDT, typename IDT, typename = std::enable_if_t<std::is_integral_v<IDT> || std::is_convertible_v<VDT, VertexDataType>>>
@@ -38,28 +37,80 @@ public:
 		return Push(MeshData.first, MeshData.second);
 	}
 
-	auto Finalize(const std::wstring name)
+	// Packs all meshes into one vertex and one index allocation, reserving the staging storage once
+	template <typename MeshDataType>
+	auto Push(std::span<const MeshDataType> Meshes) -> std::vector<Foo>
 	{
-		StructuredBuffer VertexBuffer;
-		ByteAddressBuffer IndexBuffer;
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		size_t maxMeshVertexCount = 0;
+		for (const auto& [vertices, indices] : Meshes)
+		{
+			vertexCount += std::size(Unwrap(vertices));
+			indexCount += std::size(Unwrap(indices));
+			maxMeshVertexCount = std::max(maxMeshVertexCount, std::size(Unwrap(vertices)));
+		}
 
-		Finalize(name, VertexBuffer, IndexBuffer);
-
-		return  std::tuple{ std::move(VertexBuffer), std::move(IndexBuffer) };
+		// 0xffff is left out as it doubles as the strip cut value
+		return maxMeshVertexCount < 0xffff
+			? Pack<uint16_t>(Meshes, vertexCount, indexCount)
+			: Pack<uint32_t>(Meshes, vertexCount, indexCount);
 	}
-	
-	void Finalize(const std::wstring name, GpuBuffer& VertexBuffer, GpuBuffer& IndexBuffer)
-	{
-		VertexBuffer.Create(name + L" vertex buffer", std::size(m_Vertices), sizeof(m_Vertices[0]), m_Vertices.data());
-		IndexBuffer.Create(name + L" index buffer", std::size(m_Indices), sizeof(m_Indices[0]), m_Indices.data());
 
-		Reset();
+	template <typename MeshDataType>
+	auto Push(const std::vector<MeshDataType>& Meshes)
+	{
+		return Push(std::span<const MeshDataType>(Meshes));
 	}
 
-	void Reset() { m_Vertices.clear(); m_Indices.clear(); }
+	auto VertexBufferView() const { return m_Pool.VertexBufferView(sizeof(VertexDataType)); }
+	auto IndexBufferView(const Foo& Mesh) const { return m_Pool.IndexBufferView(Mesh.Uses32BitIndices); }
+	GpuBuffer& GetBuffer() { return m_Pool.GetBuffer(); }
+
+	// Returns all packed meshes to the pool
+	void Reset() { m_Allocations.clear(); }
 
 private:
-	std::vector<VertexDataType> m_Vertices;
-	std::vector<IndexDataType> m_Indices;
-};
+	template <typename T>
+	static const T& Unwrap(const T& Value) { return Value; }
+	template <typename T>
+	static const T& Unwrap(const std::reference_wrapper<const T>& Value) { return Value.get(); }
+
+	template <typename IndexDataType, typename MeshDataType>
+	auto Pack(std::span<const MeshDataType> Meshes, size_t VertexCount, size_t IndexCount) -> std::vector<Foo>
+	{
+		auto vertices = std::vector<VertexDataType>();
+		auto indices = std::vector<IndexDataType>();
+		vertices.reserve(VertexCount);
+		indices.reserve(IndexCount);
+
+		auto meshes = std::vector<Foo>();
+		meshes.reserve(Meshes.size());
+		for (const auto& [meshVertices, meshIndices] : Meshes)
+		{
+			meshes.push_back(Foo{
+				.IndexCount = static_cast<int>(std::size(Unwrap(meshIndices))),
+				.StartIndexLocation = static_cast<int>(indices.size()),
+				.BaseVertexLocation = static_cast<int>(vertices.size()),
+				.Uses32BitIndices = std::is_same_v<IndexDataType, uint32_t>
+			});
+			vertices.insert(vertices.end(), std::begin(Unwrap(meshVertices)), std::end(Unwrap(meshVertices)));
+			std::ranges::transform(Unwrap(meshIndices), std::back_inserter(indices), [](auto index) { return static_cast<IndexDataType>(index); });
+		}
 
+		// Aligning to the element size lets the offsets be expressed in vertices and indices. The offsets
+		// are read right away, the next emplace_back may reallocate m_Allocations.
+		const auto baseVertex = m_Allocations.emplace_back(m_Pool.Upload(vertices.data(), std::size(vertices) * sizeof(VertexDataType), sizeof(VertexDataType))).GetOffset() / sizeof(VertexDataType);
+		const auto startIndex = m_Allocations.emplace_back(m_Pool.Upload(indices.data(), std::size(indices) * sizeof(IndexDataType), sizeof(IndexDataType))).GetOffset() / sizeof(IndexDataType);
+
+		for (auto& mesh : meshes)
+		{
+			mesh.StartIndexLocation += static_cast<int>(startIndex);
+			mesh.BaseVertexLocation += static_cast<int>(baseVertex);
+		}
+		return meshes;
+	}
+
+	GeometryPool& m_Pool;
+	std::vector<GeometryAllocation> m_Allocations;
+};
@@ -86,10 +86,10 @@
 
 Math::BoundingSphere BuildNodeBoundingSphere(const Model& model, int nodeId)
 {
-	const auto& node = model.m_Nodes[nodeId];
+	const auto& node = model.GetNodes()[nodeId];
 	if (node.m_MeshId != -1)
 	{
-		return model.m_Meshes[node.m_MeshId].m_BoundingSphere;
+		return model.GetMeshes()[node.m_MeshId].m_BoundingSphere;
 	}
 	else
 	{
@@ -108,29 +108,47 @@ Model ModelReader::Load(const std::filesystem::path filename)
 
 	model.m_Buffers.reserve(model.buffers.size());
 	std::ranges::transform(model.buffers, std::back_inserter(model.m_Buffers), [](const tinygltf::Buffer& buffer) {
-		auto dxBuffer = ByteAddressBuffer{};
-		dxBuffer.Create(L"", buffer.data.size(), sizeof(buffer.data[0]), buffer.data.data());
-		return dxBuffer;
+		return Graphics::g_GeometryPool.Upload(buffer.data.data(), buffer.data.size(), 4, true);
 	});
+	std::ranges::transform(model.m_Buffers, std::back_inserter(model.m_BufferOffsets), [](const auto& buffer) { return buffer.GetOffset(); });
 
 	model.m_Textures.reserve(model.images.size());
 	std::ranges::transform(model.images, std::back_inserter(model.m_Textures), [](const tinygltf::Image& image) {
 		auto texture = Texture{};
 		texture.Create(image.width, image.height, GetDxgiFormat(image.component, image.pixel_type), image.image.data());
+		// GltfRenderer marks the textures of every model it draws
+		texture.AllowEviction();
 		return texture;
 	});
 
-	model.m_Samplers.reserve(model.samplers.size());
-	std::ranges::transform(model.samplers, std::back_inserter(model.m_Samplers), [](const tinygltf::Sampler& sampler) {
+	model.m_SamplerTableIndices.reserve(model.samplers.size());
+	std::ranges::transform(model.samplers, std::back_inserter(model.m_SamplerTableIndices), [](const tinygltf::Sampler& sampler) {
 		auto desc = SamplerDesc{};
 		desc.AddressU = GetAddressMode(sampler.wrapS);
 		desc.AddressV = GetAddressMode(sampler.wrapT);
 		desc.AddressW = GetAddressMode(sampler.wrapR);
 		desc.Filter = GetFilter(sampler.minFilter, sampler.magFilter);
-		return desc.CreateDescriptor();
+		return desc.GetSharedTableIndex();
 	});
 
-	const auto materials = ProcessMaterials(model);
+	// Materials index the shared sampler table; textures without a sampler get the default one
+	const auto defaultSampler = SamplerDesc{}.GetSharedTableIndex();
+	const auto toSharedSampler = [&](int samplerId) {
+		return samplerId >= 0 && samplerId < static_cast<int>(model.m_SamplerTableIndices.size()) ? model.m_SamplerTableIndices[samplerId] : defaultSampler;
+	};
+
+	auto materials = ProcessMaterials(model);
+	for (auto& material : materials)
+	{
+		material.NormalSamplerId = toSharedSampler(material.NormalSamplerId);
+		material.OcclusionSamplerId = toSharedSampler(material.OcclusionSamplerId);
+		for (auto* accessor : { &material.SpectralGlossiness.DiffuseTexture, &material.SpectralGlossiness.SpecularGlossinessTexture })
+		{
+			if (accessor->TextureId != 0xffff)
+				accessor->SamplerId = static_cast<uint16_t>(toSharedSampler(accessor->SamplerId == 0xffff ? -1 : accessor->SamplerId));
+		}
+	}
+
 	model.m_Materials.Create(fmt::format(L"{} - materials", filename.c_str()), materials.size(), sizeof(materials[0]), materials.data());
 
 	model.m_Meshes.reserve(model.meshes.size());
@@ -142,12 +160,15 @@ Model ModelReader::Load(const std::filesystem::path filename)
 				const auto& accessor = model.accessors[accessorId];
 				const auto& bufferView = model.bufferViews[accessor.bufferView];
 				const auto stride = accessor.ByteStride(bufferView);
-				primitive.m_VertexBufferViews.insert({ name, model.m_Buffers[bufferView.buffer].VertexBufferView(bufferView.byteOffset, accessor.count * stride, stride) });
+				primitive.m_VertexBufferViews.insert({ name, model.m_Buffers[bufferView.buffer].VertexBufferView(bufferView.byteOffset + accessor.byteOffset, accessor.count * stride, stride) });
+				primitive.m_VertexBufferIds.insert({ name, bufferView.buffer });
 			}
 			{
 				const auto& accessor = model.accessors[gltfPrimitive.indices];
 				const auto& bufferView = model.bufferViews[accessor.bufferView];
-				primitive.m_IndexBufferView = model.m_Buffers[bufferView.buffer].IndexBufferView(bufferView.byteOffset);
+				const auto is32Bit = accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+				primitive.m_IndexBufferView = model.m_Buffers[bufferView.buffer].IndexBufferView(bufferView.byteOffset + accessor.byteOffset, accessor.count * (is32Bit ? 4 : 2), is32Bit);
+				primitive.m_IndexBufferId = bufferView.buffer;
 				primitive.m_IndexCount = accessor.count;
 			}
 			primitive.m_MaterialId = gltfPrimitive.material;
@@ -209,9 +230,42 @@ Model ModelReader::Load(const std::filesystem::path filename)
 		return scene;
 	});
 
+	model.m_IsStatic = model.animations.empty() && model.skins.empty();
+
 	return model;
 }
 
+void Model::UpdateGeometryViews()
+{
+	bool relocated = false;
+	for (int bufferId = 0; bufferId < m_Buffers.size(); ++bufferId)
+	{
+		const auto offset = m_Buffers[bufferId].GetOffset();
+		if (offset == m_BufferOffsets[bufferId]) continue;
+
+		const auto delta = static_cast<int64_t>(offset) - static_cast<int64_t>(m_BufferOffsets[bufferId]);
+		for (auto& mesh : m_Meshes)
+		{
+			for (auto& primitive : mesh.m_Primitives)
+			{
+				for (auto& [name, view] : primitive.m_VertexBufferViews)
+				{
+					if (primitive.m_VertexBufferIds.at(name) == bufferId)
+						view.BufferLocation += delta;
+				}
+				if (primitive.m_IndexBufferId == bufferId)
+					primitive.m_IndexBufferView.BufferLocation += delta;
+			}
+		}
+
+		m_BufferOffsets[bufferId] = offset;
+		relocated = true;
+	}
+
+	// Recorded bundles still point to the old location
+	if (relocated) Invalidate();
+}
+
 std::vector<Material> ModelReader::ProcessMaterials(const tinygltf::Model& model) noexcept
 {
 	auto materials = std::vector<Material>();
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <filesystem>
+#include <atomic>
 #include <tiny_gltf.h>
 
 #include "TextureManager.h"
+#include "GeometryPool.h"
 #include <Math/Matrix4.h>
 
 
@@ -63,6 +65,9 @@ public:
 	struct Primitive {
 		std::unordered_map<std::string, D3D12_VERTEX_BUFFER_VIEW> m_VertexBufferViews;
 		D3D12_INDEX_BUFFER_VIEW m_IndexBufferView;
+		// Indices into m_Buffers the views point into, to patch them when the geometry pool moves a buffer
+		std::unordered_map<std::string, int> m_VertexBufferIds;
+		int m_IndexBufferId;
 		size_t m_IndexCount;
 		int m_MaterialId;
 		// Ignore topology
@@ -87,12 +92,45 @@ public:
 		Math::BoundingSphere m_BoundingSphere;
 	};
 
-	std::vector<ByteAddressBuffer> m_Buffers;
+	// glTF buffers suballocated from the global geometry pool
+	std::vector<GeometryAllocation> m_Buffers;
 	std::vector<Texture> m_Textures;
-	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_Samplers;
+	// Slots of the glTF samplers in the shared sampler table
+	std::vector<uint32_t> m_SamplerTableIndices;
 	StructuredBuffer m_Materials;
+
+	const std::vector<Mesh>& GetMeshes() const noexcept { return m_Meshes; }
+	const std::vector<Node>& GetNodes() const noexcept { return m_Nodes; }
+	const std::vector<Scene>& GetScenes() const noexcept { return m_Scenes; }
+
+	// Mutable access invalidates anything recorded from the model
+	Mesh& EditMesh(int meshId) noexcept { Invalidate(); return m_Meshes[meshId]; }
+	Node& EditNode(int nodeId) noexcept { Invalidate(); return m_Nodes[nodeId]; }
+	Scene& EditScene(int sceneId) noexcept { Invalidate(); return m_Scenes[sceneId]; }
+	void SetDefaultScene(int sceneId) noexcept { Invalidate(); defaultScene = sceneId; }
+
+	// Static models never change between frames and get their draws recorded into a bundle. Set on
+	// load for models without animations or skins.
+	bool IsStatic() const noexcept { return m_IsStatic; }
+	void SetStatic(bool isStatic) noexcept { m_IsStatic = isStatic; }
+
+	// Anything caching GPU commands for this model (e.g. static bundles) compares revisions to detect changes
+	void Invalidate() noexcept { m_Revision = ++s_RevisionCounter; }
+	auto GetRevision() const noexcept { return m_Revision; }
+
+	// Patches buffer views after the geometry pool compaction moved any of the buffers. Has to be
+	// called before recording draws of the model.
+	void UpdateGeometryViews();
+
+private:
 	std::vector<Mesh> m_Meshes;
 	std::vector<Node> m_Nodes;
 	std::vector<Scene> m_Scenes;
+	bool m_IsStatic = false;
+
+	std::vector<size_t> m_BufferOffsets;
+
+	inline static std::atomic<uint64_t> s_RevisionCounter = 0;
+	uint64_t m_Revision = ++s_RevisionCounter;
 };
 
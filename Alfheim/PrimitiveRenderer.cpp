@@ -1,12 +1,15 @@
 #include "pch.h"
 #include "PrimitiveRenderer.h"
 
+#include <unordered_map>
+
 #include "GraphicsCommon.h"
 #include "BufferManager.h"
 #include "CommandContext.h"
 
 #include "CompiledShaders/PrimitiveVS.h"
 #include "CompiledShaders/PrimitivePS.h"
+#include "CompiledShaders/LineVS.h"
 
 #include "Camera.h"
 
@@ -15,7 +18,8 @@
 using namespace DirectX;
 
 namespace {
-	constexpr int max_instances = 1024;
+	// Sphere LOD is picked from the projected radius (in NDC units, screen height is 2)
+	NumVar SphereLodScreenSize("Primitives/Sphere LOD screen size", 0.1f, 0.001f, 1.0f, 0.01f);
 }
 
 struct VertexData
@@ -23,31 +27,9 @@ struct VertexData
 	XMFLOAT3 Position;
 };
 
-namespace DirectX
-{
-	auto operator ==(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b) noexcept
-	{
-		return a.x == b.x && a.y == b.y && a.z == b.z;
-
-		// non-default spaceship operator does not generate comparison operator
-		// https://stackoverflow.com/a/58780963/2551034
-		// operator overloaded outside the class can't be defaulted
-		//return a.x != b.x ? a.x <=> b.x : (a.y != b.y ? a.y <=> b.y : a.z <=> b.z);
-	}
-}
-
-template <typename Container, typename Value>
-auto append_unique(Container& container, const Value& value) -> typename Container::iterator
-{
-	if (auto it = std::find(container.begin(), container.end(), value); it == container.end())
-		return container.insert(it, value);
-	else
-		return it;
-}
-
 // Generate sphere by bisecting icosahedron `lod` time.
 // Returns icosahedron by default
-[[nodiscard]] constexpr auto GenerateSphereMesh(int lod = 0) -> std::pair<std::vector<XMFLOAT3>, std::vector<int>>
+[[nodiscard]] auto GenerateSphereMesh(int lod = 0) -> std::pair<std::vector<XMFLOAT3>, std::vector<int>>
 {
 	using namespace Math;
 
@@ -75,15 +57,29 @@ auto append_unique(Container& container, const Value& value) -> typename Contain
 		return XMFLOAT3{ V.x / length, V.y / length, V.z / length };
 	};
 
-	auto midpoint = [&](const XMFLOAT3& A, const XMFLOAT3& B) {
-		auto mid = XMFLOAT3{ A.x + B.x, A.y + B.y, A.z + B.z };
-		return normalize(mid);
+	// Every edge is shared by two triangles, so its midpoint is looked up by the (ordered) pair of
+	// end vertex indices instead of searching all vertices
+	auto midpoints = std::unordered_map<uint64_t, int>();
+
+	auto midpoint = [&](int iA, int iB) {
+		const auto key = (static_cast<uint64_t>(std::min(iA, iB)) << 32) | static_cast<uint32_t>(std::max(iA, iB));
+		if (const auto [it, inserted] = midpoints.try_emplace(key, static_cast<int>(vertices.size())); !inserted)
+			return it->second;
+
+		const auto& A = vertices[iA];
+		const auto& B = vertices[iB];
+		vertices.push_back(normalize(XMFLOAT3{ A.x + B.x, A.y + B.y, A.z + B.z }));
+		return static_cast<int>(vertices.size() - 1);
 	};
 
 	for (int i = 0; i < lod; ++i)
 	{
 		const auto triangleCount = indices.size() / 3;
 		indices.reserve(indices.size() * 4);
+		// Euler's formula for a closed triangle mesh: E = 3F / 2 new vertices per subdivision
+		vertices.reserve(vertices.size() + triangleCount * 3 / 2);
+		midpoints.clear();
+		midpoints.reserve(triangleCount * 3 / 2);
 
 		for (int j = 0; j < triangleCount; ++j)
 		{
@@ -91,18 +87,9 @@ auto append_unique(Container& container, const Value& value) -> typename Contain
 			auto iB = indices[3 * j + 1];
 			auto iC = indices[3 * j + 2];
 
-			auto iAB = static_cast<int>(std::distance(
-				vertices.begin(),
-				append_unique(vertices, midpoint(vertices[iA], vertices[iB]))
-			));
-			auto iBC = static_cast<int>(std::distance(
-				vertices.begin(),
-				append_unique(vertices, midpoint(vertices[iB], vertices[iC]))
-			));
-			auto iAC = static_cast<int>(std::distance(
-				vertices.begin(),
-				append_unique(vertices, midpoint(vertices[iA], vertices[iC]))
-			));
+			auto iAB = midpoint(iA, iB);
+			auto iBC = midpoint(iB, iC);
+			auto iAC = midpoint(iA, iC);
 
 			indices[3 * j + 0] = iA;
 			indices[3 * j + 1] = iAB;
@@ -213,36 +200,50 @@ void PrimitiveRenderer::Initialize()
 	m_WireframePSO.SetPixelShader(g_pPrimitivePS, sizeof(g_pPrimitivePS));
 	m_WireframePSO.Finalize();
 
-	MeshBufferPacker<XMFLOAT3> packer;
-	m_PrimitivesIndices[0] = packer.Push(GenerateSphereMesh(1));
-	m_PrimitivesIndices[1] = packer.Push(GenerateCubeMesh());
-	m_PrimitivesIndices[2] = packer.Push(GeneratePlaneMesh());
-	// Representing line as a degenerate triangle (allows to keep the rest of the logic the same)
-	m_PrimitivesIndices[3] = packer.Push(std::pair{
-		std::vector{
-			XMFLOAT3{0.0f, 0.0f, 0.0f},
-			XMFLOAT3{1.0f, 1.0f, 1.0f},
-			XMFLOAT3{1.0f, 1.0f, 1.0f},
-		}, std::vector{0, 1, 1} });
-	packer.Finalize(L"Primitives", m_VertexBuffer, m_IndexBuffer);
-
-	m_InstanceBuffer.Create(L"Sphere instance buffer", max_instances);
+	D3D12_INPUT_ELEMENT_DESC LineInputLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "COLOR",    0, DXGI_FORMAT_R8G8B8A8_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+
+	m_LinePSO = m_WireframePSO;
+	m_LinePSO.SetRasterizerState(Graphics::RasterizerDefault);
+	m_LinePSO.SetInputLayout(_countof(LineInputLayout), LineInputLayout);
+	m_LinePSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE);
+	m_LinePSO.SetVertexShader(g_pLineVS, sizeof(g_pLineVS));
+	m_LinePSO.Finalize();
+
+	// Packed in one batch, so all primitives share the index format and a single index buffer binding
+	auto meshes = std::vector<std::pair<std::vector<XMFLOAT3>, std::vector<int>>>();
+	meshes.reserve(ms_SphereLodCount + 2);
+	for (int lod = 0; lod < ms_SphereLodCount; ++lod)
+		meshes.push_back(GenerateSphereMesh(lod));
+	meshes.push_back(GenerateCubeMesh());
+	meshes.push_back(GeneratePlaneMesh());
+
+	const auto packed = m_Geometry.Push(meshes);
+	std::copy_n(packed.begin(), ms_SphereLodCount, m_SphereLods.begin());
+	m_PrimitivesIndices[0] = m_SphereLods[1];
+	m_PrimitivesIndices[1] = packed[ms_SphereLodCount];
+	m_PrimitivesIndices[2] = packed[ms_SphereLodCount + 1];
 }
 
 void PrimitiveRenderer::Render(GraphicsContext& gfxContext, const Math::Camera& camera)
 {
+	auto instanceCounts = std::array<size_t, static_cast<size_t>(PrimitiveType::kCount)>{};
+	size_t lineCount = 0;
+	m_Queues.ForEach([&](const PrimitiveQueue& Queue) {
+		for (int type = 0; type < instanceCounts.size(); ++type)
+			instanceCounts[type] += Queue.Primitives[type].size();
+		lineCount += Queue.Lines.size();
+	});
+
 	// skip completely if there is nothing queued
-	if (std::none_of(m_PrimitiveQueues.begin(), m_PrimitiveQueues.end(), std::size<decltype(m_PrimitiveQueues)::value_type>)) return;
+	if (lineCount == 0 && std::ranges::all_of(instanceCounts, [](auto count) { return count == 0; })) return;
 
 	ScopedTimer _prof(L"Primitives", gfxContext);
 
 	gfxContext.SetRootSignature(m_RootSig);
-	gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	gfxContext.SetIndexBuffer(m_IndexBuffer.IndexBufferView());
-	gfxContext.TransitionResource(m_VertexBuffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-	gfxContext.SetVertexBuffer(0, m_VertexBuffer.VertexBufferView());
-
-	gfxContext.SetPipelineState(m_WireframePSO);
 	gfxContext.SetViewportAndScissor(0, 0, Graphics::g_SceneColorBuffer.GetWidth(), Graphics::g_SceneColorBuffer.GetHeight());
 
 	__declspec(align(16)) struct {
@@ -252,18 +253,92 @@ void PrimitiveRenderer::Render(GraphicsContext& gfxContext, const Math::Camera&
 	XMStoreFloat4x4(&vsConstants.viewProjMatrix, camera.GetViewProjMatrix());
 	gfxContext.SetDynamicConstantBufferView(0, sizeof(vsConstants), &vsConstants);
 
-	gfxContext.SetVertexBuffer(1, m_InstanceBuffer.VertexBufferView(max_instances, sizeof(InstanceData)));
+	if (lineCount > 0)
+	{
+		gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
+		gfxContext.SetPipelineState(m_LinePSO);
+
+		m_Queues.ForEach([&](const PrimitiveQueue& Queue) { RenderLines(gfxContext, Queue.Lines); });
+	}
+
+	if (std::ranges::all_of(instanceCounts, [](auto count) { return count == 0; })) return;
+
+	gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	gfxContext.TransitionResource(m_Geometry.GetBuffer(), D3D12_RESOURCE_STATE_GENERIC_READ);
+	gfxContext.SetIndexBuffer(m_Geometry.IndexBufferView(m_PrimitivesIndices[0]));
+	gfxContext.SetVertexBuffer(0, m_Geometry.VertexBufferView());
 
-	size_t instance = 0;
-	for (int type = 0; type < m_PrimitiveQueues.size(); ++type)
+	gfxContext.SetPipelineState(m_WireframePSO);
+
+	for (int type = 0; type < instanceCounts.size(); ++type)
 	{
-		auto& queue = m_PrimitiveQueues[type];
 		// don't draw empty queues
-		if (queue.size() == 0) continue;
+		if (instanceCounts[type] == 0) continue;
+
+		if (type == static_cast<int>(PrimitiveType::kSphere))
+		{
+			RenderSpheres(gfxContext, camera);
+			continue;
+		}
+
+		m_Queues.ForEach([&](const PrimitiveQueue& Queue) { RenderInstances(gfxContext, m_PrimitivesIndices[type], Queue.Primitives[type]); });
+	}
+}
+
+void PrimitiveRenderer::RenderInstances(GraphicsContext& gfxContext, const Foo& Mesh, std::span<const InstanceData> Instances)
+{
+	// Instance data is copied into the context's upload memory, which is only recycled once the GPU
+	// is done with the frame, one draw per upload page
+	constexpr size_t maxInstancesPerDraw = kCpuAllocatorPageSize / sizeof(InstanceData);
+
+	for (size_t first = 0; first < Instances.size(); first += maxInstancesPerDraw)
+	{
+		const auto count = std::min(maxInstancesPerDraw, Instances.size() - first);
+		gfxContext.SetDynamicVB(1, count, sizeof(InstanceData), &Instances[first]);
+		gfxContext.DrawIndexedInstanced(Mesh.IndexCount, count, Mesh.StartIndexLocation, Mesh.BaseVertexLocation, 0);
+	}
+}
+
+void PrimitiveRenderer::RenderSpheres(GraphicsContext& gfxContext, const Math::Camera& camera)
+{
+	// Projected radius of a unit sphere at unit distance, i.e. cot(fovY / 2)
+	const float projectionScale = camera.GetProjMatrix().GetY().GetY();
+	XMFLOAT3 eye;
+	XMStoreFloat3(&eye, camera.GetPosition());
+
+	auto selectLod = [&](const InstanceData& sphere) {
+		const auto& world = sphere.WorldTransformation;
+		const float dx = world._41 - eye.x, dy = world._42 - eye.y, dz = world._43 - eye.z;
+		const float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), 1e-4f);
+		const float screenSize = world._11 * projectionScale / distance;
+
+		int lod = 0;
+		for (float threshold = SphereLodScreenSize; lod < ms_SphereLodCount - 1 && screenSize > threshold; threshold *= 2.f)
+			++lod;
+		return lod;
+	};
+
+	const auto type = static_cast<int>(PrimitiveType::kSphere);
 
-		ASSERT(instance + queue.size() < max_instances, "Run out of primitives' instance buffer");
-		memcpy(&m_InstanceBuffer[instance], queue.data(), queue.size() * sizeof(InstanceData));
-		gfxContext.DrawIndexedInstanced(m_PrimitivesIndices[type].IndexCount, queue.size(), m_PrimitivesIndices[type].StartIndexLocation, m_PrimitivesIndices[type].BaseVertexLocation, instance);
-		instance += queue.size();
+	std::ranges::for_each(m_SphereLodInstances, [](auto& instances) { instances.clear(); });
+	m_Queues.ForEach([&](const PrimitiveQueue& Queue) {
+		for (const auto& sphere : Queue.Primitives[type])
+			m_SphereLodInstances[selectLod(sphere)].push_back(sphere);
+	});
+
+	for (int lod = 0; lod < ms_SphereLodCount; ++lod)
+		RenderInstances(gfxContext, m_SphereLods[lod], m_SphereLodInstances[lod]);
+}
+
+void PrimitiveRenderer::RenderLines(GraphicsContext& gfxContext, const std::vector<std::array<LineVertex, 2>>& Lines)
+{
+	// Keep each batch within a single upload page of the context's linear allocator
+	constexpr size_t maxLinesPerDraw = kCpuAllocatorPageSize / sizeof(Lines[0]);
+
+	for (size_t first = 0; first < Lines.size(); first += maxLinesPerDraw)
+	{
+		const auto count = std::min(maxLinesPerDraw, Lines.size() - first);
+		gfxContext.SetDynamicVB(0, 2 * count, sizeof(LineVertex), Lines[first].data());
+		gfxContext.DrawInstanced(2 * count, 1);
 	}
 }
@@ -5,7 +5,7 @@
 #include <array>
 
 #include "GpuBuffer.h"
-#include "DynamicUploadBuffer.h"
+#include "ThreadLocalQueues.h"
 #include "MeshBufferPacker.h"
 #include "Color.h"
 #include "Math/Frustum.h"
@@ -23,19 +23,37 @@ class PrimitiveRenderer
 		DirectX::XMFLOAT4X4 WorldTransformation;
 	};
 
+	// Two vertices per line, 32 bytes in total, streamed through a dynamic vertex buffer
+	struct LineVertex
+	{
+		DirectX::XMFLOAT3 Position;
+		uint32_t Colour;
+	};
+
 	enum class PrimitiveType
 	{
 		kSphere,
 		kCuboid,
 		kPlane,
-		kLine,
 
 		kCount,
 	};
 
+	// Every producing thread appends to its own queue, so queueing never contends with other threads
+	struct PrimitiveQueue
+	{
+		std::array<std::vector<InstanceData>, static_cast<size_t>(PrimitiveType::kCount)> Primitives;
+		std::vector<std::array<LineVertex, 2>> Lines;
+	};
+
 public:
+	PrimitiveRenderer() = default;
+
+	PrimitiveRenderer(const PrimitiveRenderer&) = delete;
+	PrimitiveRenderer& operator=(const PrimitiveRenderer&) = delete;
+
 	void Initialize();
-	void Shutdown() {};
+	void Shutdown() { m_Geometry.Reset(); };
 
 	void QueueSphere(const Math::Vector3& Position, const float Radius, const Color Color = Color{})
 	{
@@ -73,22 +91,29 @@ public:
 	}
 	void QueueLine(const Math::Vector3& From, const Math::Vector3 To, const Color Color = Color{})
 	{
-		const auto vector = To - From;
-		const auto transformation = Math::AffineTransform::MakeTranslation(From) * Math::AffineTransform::MakeScale(vector);
-		QueuePrimitive(PrimitiveType::kLine, transformation, Color);
+		const auto Colour = Color.R8G8B8A8();
+		auto& Line = m_Queues.Local().Lines.emplace_back();
+		DirectX::XMStoreFloat3(&Line[0].Position, From);
+		Line[0].Colour = Colour;
+		DirectX::XMStoreFloat3(&Line[1].Position, To);
+		Line[1].Colour = Colour;
 	}
 
+	// Queue* may be called from any thread, but not while Render or Reset is running
 	void Render(GraphicsContext& gfxContext, const Math::Camera& camera);
 
 	void Reset()
 	{
-		std::ranges::for_each(m_PrimitiveQueues, [](auto& data) { data.clear(); });
+		m_Queues.ForEach([](PrimitiveQueue& Queue) {
+			std::ranges::for_each(Queue.Primitives, [](auto& data) { data.clear(); });
+			Queue.Lines.clear();
+		});
 	}
 
 private:
 	void QueuePrimitive(PrimitiveType Type, const DirectX::XMFLOAT4X4& WorldMatrix, const DirectX::XMFLOAT4 Color)
 	{
-		m_PrimitiveQueues[static_cast<int>(Type)].emplace_back(Color, WorldMatrix);
+		m_Queues.Local().Primitives[static_cast<int>(Type)].emplace_back(Color, WorldMatrix);
 	}
 	void QueuePrimitive(PrimitiveType Type, DirectX::CXMMATRIX WorldMatrix, const Color Color)
 	{
@@ -99,16 +124,24 @@ private:
 		QueuePrimitive(Type, Float4x4, Float4);
 	}
 
+	void RenderSpheres(GraphicsContext& gfxContext, const Math::Camera& camera);
+	void RenderLines(GraphicsContext& gfxContext, const std::vector<std::array<LineVertex, 2>>& Lines);
+	void RenderInstances(GraphicsContext& gfxContext, const Foo& Mesh, std::span<const InstanceData> Instances);
+
 	RootSignature m_RootSig;
 	GraphicsPSO m_WireframePSO;
+	GraphicsPSO m_LinePSO;
 
-	StructuredBuffer m_VertexBuffer;
-	ByteAddressBuffer m_IndexBuffer;
+	MeshBufferPacker<DirectX::XMFLOAT3> m_Geometry;
 	
 	std::array<Foo, static_cast<size_t>(PrimitiveType::kCount)> m_PrimitivesIndices;
 
-	std::array<std::vector<InstanceData>, static_cast<size_t>(PrimitiveType::kCount)> m_PrimitiveQueues;
+	// Spheres are drawn with a LOD picked per instance from its projected size
+	static const int ms_SphereLodCount = 4;
+	std::array<Foo, ms_SphereLodCount> m_SphereLods;
+	// Spheres bucketed by LOD, kept between frames so the vectors keep their capacity
+	std::array<std::vector<InstanceData>, ms_SphereLodCount> m_SphereLodInstances;
 
-	StructuredUploadBuffer<InstanceData> m_InstanceBuffer;
+	ThreadLocalQueues<PrimitiveQueue> m_Queues;
 };
 
@@ -0,0 +1,30 @@
+#include "PrimitiveRS.hlsli"
+
+cbuffer VSConstants : register(b0)
+{
+	float4x4 viewProj;
+}
+
+struct VSInput
+{
+	float3 position : POSITION;
+	float4 color : COLOR;
+};
+
+struct VSOutput
+{
+	float4 color : COLOR;
+	float4 position : SV_POSITION;
+};
+
+// Lines are already in world space, so only the view-projection is applied
+[RootSignature(Primitive_RootSig)]
+VSOutput main(VSInput vin)
+{
+	VSOutput vout;
+
+	vout.position = mul(viewProj, float4(vin.position, 1.0f));
+	vout.color = vin.color;
+
+	return vout;
+}
\ No newline at end of file
@@ -51,6 +51,18 @@ void ColorBuffer::CreateFromSwapChain(const std::wstring& Name, ID3D12Resource*
 	Graphics::g_Device->CreateRenderTargetView(m_pResource.Get(), nullptr, m_RTVHandle);
 }
 
+void ColorBuffer::Destroy(void)
+{
+	PixelBuffer::Destroy();
+
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, m_RTVHandle);
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_SRVHandle);
+	for (auto& UAVHandle : m_UAVHandle)
+		Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, UAVHandle);
+
+	ResetViews();
+}
+
 void ColorBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, uint32_t ArraySize, uint32_t NumMips)
 {
 	ASSERT(ArraySize == 1 || NumMips == 1, "We don't support auto-mips on texture arrays");
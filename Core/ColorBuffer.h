@@ -9,9 +9,23 @@ public:
 	ColorBuffer(Color ClearColor = Color(0.0f, 0.0f, 0.0f, 0.0f))
 		: m_ClearColor(ClearColor)
 	{
-		m_SRVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
-		m_RTVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
-		std::memset(m_UAVHandle, 0xFF, sizeof(m_UAVHandle));
+		ResetViews();
+	}
+
+	virtual ~ColorBuffer() { Destroy(); }
+
+	// The views travel with the resource; whatever the target held is released by the source
+	ColorBuffer(ColorBuffer&& Other) noexcept : PixelBuffer(std::move(Other)), m_ClearColor(Other.m_ClearColor)
+	{
+		ResetViews();
+		SwapContents(Other);
+	}
+	ColorBuffer& operator=(ColorBuffer&& Other) noexcept
+	{
+		PixelBuffer::operator=(std::move(Other));
+		m_ClearColor = Other.m_ClearColor;
+		SwapContents(Other);
+		return *this;
 	}
 
 	void Create(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t NumMips,
@@ -22,6 +36,8 @@ public:
 
 	void CreateFromSwapChain(const std::wstring& Name, ID3D12Resource* BaseResource);
 
+	void Destroy(void) override;
+
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV(void) const { return m_SRVHandle; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetRTV(void) const { return m_RTVHandle; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetUAV(void) const { return m_UAVHandle[0]; }
@@ -47,6 +63,23 @@ protected:
 
 	void CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, uint32_t ArraySize, uint32_t NumMips = 1);
 
+	void ResetViews(void)
+	{
+		m_SRVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+		m_RTVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+		std::memset(m_UAVHandle, 0xFF, sizeof(m_UAVHandle));
+	}
+
+	void SwapContents(ColorBuffer& Other) noexcept
+	{
+		std::swap(m_SRVHandle, Other.m_SRVHandle);
+		std::swap(m_RTVHandle, Other.m_RTVHandle);
+		std::swap(m_UAVHandle, Other.m_UAVHandle);
+		std::swap(m_NumMipMaps, Other.m_NumMipMaps);
+		std::swap(m_FragmentCount, Other.m_FragmentCount);
+		std::swap(m_SampleCount, Other.m_SampleCount);
+	}
+
 	Color m_ClearColor;
 	D3D12_CPU_DESCRIPTOR_HANDLE m_SRVHandle;
 	D3D12_CPU_DESCRIPTOR_HANDLE m_RTVHandle;
@@ -1,6 +1,53 @@
 #include "pch.h"
 #include "CommandAllocatorPool.h"
 
+namespace
+{
+	// Allocators a thread keeps to itself before handing the oldest to other threads
+	constexpr size_t kThreadCacheSize = 8;
+
+	std::atomic<uint64_t> s_NextGeneration = 1;
+
+	// Pools that have been created and not shut down, by generation, so an exiting thread can tell
+	// whether the pool its cache belongs to still exists
+	std::mutex& GetLivePoolsMutex(void)
+	{
+		static std::mutex s_Mutex;
+		return s_Mutex;
+	}
+
+	std::map<uint64_t, CommandAllocatorPool*>& GetLivePools(void)
+	{
+		static std::map<uint64_t, CommandAllocatorPool*> s_Pools;
+		return s_Pools;
+	}
+}
+
+struct CommandAllocatorPool::ThreadCache
+{
+	uint64_t Generation = 0;
+	std::deque<ReadyAllocator> Allocators;
+
+	// A thread that stops recording would otherwise strand its allocators until shutdown
+	~ThreadCache() { ReturnAll(); }
+
+	// Hands the allocators back to their pool, if it still exists
+	void ReturnAll(void)
+	{
+		if (!Allocators.empty())
+		{
+			// Held while sharing, so the pool can't be shut down underneath
+			auto lg = std::lock_guard{ GetLivePoolsMutex() };
+			if (auto Pool = GetLivePools().find(Generation); Pool != GetLivePools().end())
+			{
+				for (const auto& Ready : Allocators)
+					Pool->second->ShareAllocator(Ready);
+			}
+		}
+		Allocators.clear();
+	}
+};
+
 CommandAllocatorPool::CommandAllocatorPool(D3D12_COMMAND_LIST_TYPE Type) :
 	m_cCommandListType(Type)
 {
@@ -14,49 +61,170 @@ CommandAllocatorPool::~CommandAllocatorPool()
 void CommandAllocatorPool::Create(ID3D12Device* pDevice)
 {
 	m_Device = pDevice;
+	m_Generation = s_NextGeneration.fetch_add(1, std::memory_order_relaxed);
+
+	auto lg = std::lock_guard{ GetLivePoolsMutex() };
+	GetLivePools().emplace(m_Generation, this);
 }
 
 void CommandAllocatorPool::Shutdown()
 {
+	// Thread caches of the old generation are dropped by their threads, every allocator is released here
+	{
+		auto lg = std::lock_guard{ GetLivePoolsMutex() };
+		GetLivePools().erase(m_Generation);
+	}
+	m_Generation = 0;
+
+	auto Ready = ReadyAllocator{};
+	while (m_ReadyAllocators.TryPop(Ready))
+		;
+
+	auto lg = std::lock_guard{ m_AllocatorMutex };
+
 	for (auto& allocator : m_AllocatorPool)
 		allocator->Release();
 
 	m_AllocatorPool.clear();
+	m_OverflowAllocators.clear();
+}
+
+CommandAllocatorPool::ThreadCache& CommandAllocatorPool::GetThreadCache(void)
+{
+	// One cache per command list type, as there is one pool per queue
+	thread_local ThreadCache t_Caches[4];
+
+	auto& Cache = t_Caches[m_cCommandListType];
+	if (Cache.Generation != m_Generation)
+	{
+		// The thread moved on from another pool of the same type
+		Cache.ReturnAll();
+		Cache.Generation = m_Generation;
+	}
+	return Cache;
 }
 
 ID3D12CommandAllocator* CommandAllocatorPool::RequestAllocator(uint64_t CompletedFenceValue)
 {
-	auto lg = std::lock_guard{ m_AllocatorMutex };
+	auto& Cache = GetThreadCache();
 
 	ID3D12CommandAllocator* pAllocator = nullptr;
 
-	if (!m_ReadyAllocators.empty())
+	if (!Cache.Allocators.empty() && Cache.Allocators.front().first <= CompletedFenceValue)
 	{
-		auto& AllocatorPair = m_ReadyAllocators.front();
-
-		if (AllocatorPair.first <= CompletedFenceValue)
+		pAllocator = Cache.Allocators.front().second;
+		Cache.Allocators.pop_front();
+	}
+	else
+	{
+		// An allocator taken from the shared queue that is still in flight is kept by this thread
+		// rather than pushed back behind newer ones
+		auto Ready = ReadyAllocator{};
+		if (m_ReadyAllocators.TryPop(Ready))
 		{
-			pAllocator = AllocatorPair.second;
-			ASSERT_SUCCEEDED(pAllocator->Reset());
-			m_ReadyAllocators.pop();
+			if (Ready.first <= CompletedFenceValue)
+				pAllocator = Ready.second;
+			else
+				DiscardAllocator(Ready.first, Ready.second);
 		}
 	}
 
-	if (pAllocator == nullptr)
+	if (pAllocator != nullptr)
 	{
-		ASSERT_SUCCEEDED(m_Device->CreateCommandAllocator(m_cCommandListType, IID_PPV_ARGS(&pAllocator)));
-		auto AllocatorName = fmt::format(L"CommandAllocator {}", m_AllocatorPool.size());
-		pAllocator->SetName(AllocatorName.c_str());
-		m_AllocatorPool.push_back(pAllocator);
+		ASSERT_SUCCEEDED(pAllocator->Reset());
+		return pAllocator;
 	}
 
+	auto lg = std::lock_guard{ m_AllocatorMutex };
+
+	if (!m_OverflowAllocators.empty() && m_OverflowAllocators.front().first <= CompletedFenceValue)
+	{
+		pAllocator = m_OverflowAllocators.front().second;
+		m_OverflowAllocators.pop_front();
+		ASSERT_SUCCEEDED(pAllocator->Reset());
+		return pAllocator;
+	}
+
+	ASSERT_SUCCEEDED(m_Device->CreateCommandAllocator(m_cCommandListType, IID_PPV_ARGS(&pAllocator)));
+	auto AllocatorName = fmt::format(L"CommandAllocator {}", m_AllocatorPool.size());
+	pAllocator->SetName(AllocatorName.c_str());
+	m_AllocatorPool.push_back(pAllocator);
+
 	return pAllocator;
 }
 
 void CommandAllocatorPool::DiscardAllocator(uint64_t FenceValue, ID3D12CommandAllocator* Allocator)
 {
-	auto lg = std::lock_guard{ m_AllocatorMutex };
+	auto& Cache = GetThreadCache();
 
 	// That fence value indicates we are free to reset the allocator
-	m_ReadyAllocators.push(std::make_pair(FenceValue, Allocator));
+	Cache.Allocators.push_back(std::make_pair(FenceValue, Allocator));
+
+	if (Cache.Allocators.size() > kThreadCacheSize)
+	{
+		ShareAllocator(Cache.Allocators.front());
+		Cache.Allocators.pop_front();
+	}
+}
+
+void CommandAllocatorPool::ShareAllocator(const ReadyAllocator& Ready)
+{
+	if (m_ReadyAllocators.TryPush(Ready))
+		return;
+
+	auto lg = std::lock_guard{ m_AllocatorMutex };
+	m_OverflowAllocators.push_back(Ready);
+}
+
+BundleAllocatorPool::~BundleAllocatorPool()
+{
+	Shutdown();
+}
+
+void BundleAllocatorPool::Create(ID3D12Device* pDevice)
+{
+	m_Device = pDevice;
+}
+
+void BundleAllocatorPool::Shutdown()
+{
+	for (auto& bundle : m_BundlePool)
+	{
+		bundle.List->Release();
+		bundle.Allocator->Release();
+	}
+
+	m_BundlePool.clear();
+	m_ReadyBundles = {};
+}
+
+void BundleAllocatorPool::RequestBundle(uint64_t CompletedFenceValue, ID3D12PipelineState* InitialState, ID3D12GraphicsCommandList** List, ID3D12CommandAllocator** Allocator)
+{
+	auto lg = std::lock_guard{ m_BundleMutex };
+
+	if (!m_ReadyBundles.empty() && m_ReadyBundles.front().first <= CompletedFenceValue)
+	{
+		auto& bundle = m_ReadyBundles.front().second;
+		ASSERT_SUCCEEDED(bundle.Allocator->Reset());
+		ASSERT_SUCCEEDED(bundle.List->Reset(bundle.Allocator, InitialState));
+		*List = bundle.List;
+		*Allocator = bundle.Allocator;
+		m_ReadyBundles.pop();
+		return;
+	}
+
+	ASSERT_SUCCEEDED(m_Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_BUNDLE, IID_PPV_ARGS(Allocator)));
+	ASSERT_SUCCEEDED(m_Device->CreateCommandList(1, D3D12_COMMAND_LIST_TYPE_BUNDLE, *Allocator, InitialState, IID_PPV_ARGS(List)));
+	auto BundleName = fmt::format(L"Bundle {}", m_BundlePool.size());
+	(*Allocator)->SetName(BundleName.c_str());
+	(*List)->SetName(BundleName.c_str());
+	m_BundlePool.push_back({ *List, *Allocator });
+}
+
+void BundleAllocatorPool::DiscardBundle(uint64_t FenceValue, ID3D12GraphicsCommandList* List, ID3D12CommandAllocator* Allocator)
+{
+	auto lg = std::lock_guard{ m_BundleMutex };
+
+	// Neither the list nor its allocator may be reset until every command list that executed the bundle has retired
+	m_ReadyBundles.push(std::make_pair(FenceValue, Bundle{ List, Allocator }));
 }
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <deque>
 #include <vector>
 #include <queue>
 #include <mutex>
 
+#include "LockFreeQueue.h"
+
+// Allocators are recycled through a small cache on the thread that discarded them, since that
+// thread usually records the next command list of the same type, and spill over to a lock-free
+// queue shared by all threads. A thread's cache is handed back to the pool when the thread exits.
+// The mutex is only taken when the shared queue is full or empty, to use the overflow list or
+// create a new allocator.
 class CommandAllocatorPool
 {
 public:
@@ -19,10 +27,50 @@ public:
 	inline size_t Size() { return m_AllocatorPool.size(); }
 
 private:
+	using ReadyAllocator = std::pair<uint64_t, ID3D12CommandAllocator*>;
+	struct ThreadCache;
+
+	ThreadCache& GetThreadCache(void);
+	// Makes an allocator available to every thread
+	void ShareAllocator(const ReadyAllocator& Ready);
+
 	const D3D12_COMMAND_LIST_TYPE m_cCommandListType;
+	// Distinguishes this pool's allocators in thread caches from those of a pool that was shut down
+	uint64_t m_Generation = 0;
 
 	ID3D12Device* m_Device = nullptr;
 	std::vector<ID3D12CommandAllocator*> m_AllocatorPool;
-	std::queue<std::pair<uint64_t, ID3D12CommandAllocator*>> m_ReadyAllocators;
+	LockFreeQueue<ReadyAllocator, 4096> m_ReadyAllocators;
+	// Allocators shared while the lock-free queue was full
+	std::deque<ReadyAllocator> m_OverflowAllocators;
 	std::mutex m_AllocatorMutex;
+};
+
+// Bundles outlive the frame they were recorded in, so unlike direct allocators they are handed out
+// together with their command list and only come back once the bundle is thrown away.
+class BundleAllocatorPool
+{
+public:
+	BundleAllocatorPool() = default;
+	~BundleAllocatorPool();
+
+	void Create(ID3D12Device* pDevice);
+	void Shutdown();
+
+	void RequestBundle(uint64_t CompletedFenceValue, ID3D12PipelineState* InitialState, ID3D12GraphicsCommandList** List, ID3D12CommandAllocator** Allocator);
+	void DiscardBundle(uint64_t FenceValue, ID3D12GraphicsCommandList* List, ID3D12CommandAllocator* Allocator);
+
+	inline size_t Size() { return m_BundlePool.size(); }
+
+private:
+	struct Bundle
+	{
+		ID3D12GraphicsCommandList* List;
+		ID3D12CommandAllocator* Allocator;
+	};
+
+	ID3D12Device* m_Device = nullptr;
+	std::vector<Bundle> m_BundlePool;
+	std::queue<std::pair<uint64_t, Bundle>> m_ReadyBundles;
+	std::mutex m_BundleMutex;
 };
\ No newline at end of file
@@ -0,0 +1,44 @@
+#include "pch.h"
+#include "CommandBundle.h"
+#include "CommandListManager.h"
+#include "GraphicsCore.h"
+
+using namespace Graphics;
+
+void CommandBundle::Begin(const PSO& InitialState)
+{
+	ASSERT(!m_IsRecording, "Bundle is already being recorded");
+
+	Invalidate();
+
+	m_CurPipelineState = InitialState.ResolvePipelineState();
+	m_SkipDraws = m_CurPipelineState == nullptr;
+	g_CommandManager.CreateNewBundle(m_CurPipelineState, &m_CommandList, &m_Allocator);
+	m_IsRecording = true;
+}
+
+void CommandBundle::End(void)
+{
+	ASSERT(m_IsRecording, "Bundle was not begun");
+
+	ASSERT_SUCCEEDED(m_CommandList->Close());
+	m_IsRecording = false;
+}
+
+void CommandBundle::Invalidate(void)
+{
+	if (m_CommandList == nullptr)
+		return;
+
+	if (m_IsRecording)
+	{
+		m_CommandList->Close();
+		m_IsRecording = false;
+	}
+
+	g_CommandManager.DiscardBundle(m_LastFenceValue, m_CommandList, m_Allocator);
+	m_CommandList = nullptr;
+	m_Allocator = nullptr;
+	m_CurPipelineState = nullptr;
+	m_LastFenceValue = 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "pch.h"
+#include "PipelineState.h"
+
+class CommandContext;
+class GraphicsContext;
+
+// A bundle is recorded once and replayed with GraphicsContext::ExecuteBundle for as many frames as
+// its content stays valid. It inherits the root signature, root arguments, viewports and render
+// targets of the executing context, so only state that doesn't change between frames belongs in it.
+// Every root argument set here must point to memory that outlives the bundle (no DynAlloc).
+// A PSO that is still compiling is recorded as its fallback, so re-record the bundle once
+// PSO::ResolvePipelineState changes if the final pipeline matters.
+class CommandBundle
+{
+	friend CommandContext;
+	friend GraphicsContext;
+
+public:
+	CommandBundle() = default;
+	~CommandBundle() { Invalidate(); }
+
+	CommandBundle(const CommandBundle&) = delete;
+	CommandBundle& operator=(const CommandBundle&) = delete;
+
+	void Begin(const PSO& InitialState);
+	void End(void);
+
+	// Returns the bundle to the pool once the last frame that executed it has completed
+	void Invalidate(void);
+
+	bool IsValid(void) const { return m_CommandList != nullptr && !m_IsRecording; }
+	uint64_t GetLastFenceValue(void) const { return m_LastFenceValue; }
+
+	void SetPipelineState(const PSO& PSO);
+	void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY Topology);
+	void SetConstantBuffer(UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS CBV);
+	void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& IBView);
+	void SetVertexBuffer(UINT Slot, const D3D12_VERTEX_BUFFER_VIEW& VBView);
+
+	void DrawInstanced(size_t VertexCountPerInstance, size_t InstanceCount,
+		size_t StartVertexLocation = 0, size_t StartInstanceLocation = 0);
+	void DrawIndexedInstanced(size_t IndexCountPerInstance, size_t InstanceCount, size_t StartIndexLocation,
+		size_t BaseVertexLocation, size_t StartInstanceLocation);
+
+private:
+	ID3D12GraphicsCommandList* m_CommandList = nullptr;
+	ID3D12CommandAllocator* m_Allocator = nullptr;
+	ID3D12PipelineState* m_CurPipelineState = nullptr;
+	bool m_SkipDraws = false;
+
+	// Fence of the most recent context that executed the bundle (set on GraphicsContext::Finish)
+	uint64_t m_LastFenceValue = 0;
+	bool m_IsRecording = false;
+};
+
+inline void CommandBundle::SetPipelineState(const PSO& PSO)
+{
+	ASSERT(m_IsRecording);
+	ID3D12PipelineState* PipelineState = PSO.ResolvePipelineState();
+	m_SkipDraws = PipelineState == nullptr;
+	if (m_SkipDraws || PipelineState == m_CurPipelineState)
+		return;
+
+	m_CommandList->SetPipelineState(PipelineState);
+	m_CurPipelineState = PipelineState;
+}
+
+inline void CommandBundle::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY Topology)
+{
+	ASSERT(m_IsRecording);
+	m_CommandList->IASetPrimitiveTopology(Topology);
+}
+
+inline void CommandBundle::SetConstantBuffer(UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS CBV)
+{
+	ASSERT(m_IsRecording);
+	m_CommandList->SetGraphicsRootConstantBufferView(RootIndex, CBV);
+}
+
+inline void CommandBundle::SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& IBView)
+{
+	ASSERT(m_IsRecording);
+	m_CommandList->IASetIndexBuffer(&IBView);
+}
+
+inline void CommandBundle::SetVertexBuffer(UINT Slot, const D3D12_VERTEX_BUFFER_VIEW& VBView)
+{
+	ASSERT(m_IsRecording);
+	m_CommandList->IASetVertexBuffers(Slot, 1, &VBView);
+}
+
+inline void CommandBundle::DrawInstanced(size_t VertexCountPerInstance, size_t InstanceCount, size_t StartVertexLocation, size_t StartInstanceLocation)
+{
+	ASSERT(m_IsRecording);
+	if (m_SkipDraws)
+		return;
+	m_CommandList->DrawInstanced((UINT)VertexCountPerInstance, (UINT)InstanceCount, (UINT)StartVertexLocation, (UINT)StartInstanceLocation);
+}
+
+inline void CommandBundle::DrawIndexedInstanced(size_t IndexCountPerInstance, size_t InstanceCount, size_t StartIndexLocation, size_t BaseVertexLocation, size_t StartInstanceLocation)
+{
+	ASSERT(m_IsRecording);
+	if (m_SkipDraws)
+		return;
+	m_CommandList->DrawIndexedInstanced((UINT)IndexCountPerInstance, (UINT)InstanceCount, (UINT)StartIndexLocation, (INT)BaseVertexLocation, (UINT)StartInstanceLocation);
+}
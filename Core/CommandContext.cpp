@@ -4,6 +4,10 @@
 #include "DepthBuffer.h"
 #include "GraphicsCore.h"
 #include "EngineProfiling.h"
+#include "UploadManager.h"
+#include "ResidencyManager.h"
+
+#include <algorithm>
 
 #ifndef RELEASE
 	#pragma warning(push)
@@ -15,6 +19,33 @@
 
 using namespace Graphics;
 
+namespace
+{
+	UINT GetSubresourceCount(GpuResource& Resource)
+	{
+		const auto Desc = Resource->GetDesc();
+		if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			return 1;
+
+		const UINT ArraySize = Desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : Desc.DepthOrArraySize;
+		return Desc.MipLevels * ArraySize * D3D12GetFormatPlaneCount(g_Device, Desc.Format);
+	}
+
+	D3D12_RESOURCE_BARRIER TransitionBarrier(ID3D12Resource* Resource, UINT Subresource, D3D12_RESOURCE_STATES OldState, D3D12_RESOURCE_STATES NewState,
+		D3D12_RESOURCE_BARRIER_FLAGS Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE)
+	{
+		D3D12_RESOURCE_BARRIER BarrierDesc;
+
+		BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		BarrierDesc.Flags = Flags;
+		BarrierDesc.Transition.pResource = Resource;
+		BarrierDesc.Transition.Subresource = Subresource;
+		BarrierDesc.Transition.StateBefore = OldState;
+		BarrierDesc.Transition.StateAfter = NewState;
+		return BarrierDesc;
+	}
+}
+
 CommandContext::CommandContext(D3D12_COMMAND_LIST_TYPE Type) :
 	m_Type(Type),
 	m_DynamicViewDescriptorHeap(*this, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV),
@@ -23,18 +54,23 @@ CommandContext::CommandContext(D3D12_COMMAND_LIST_TYPE Type) :
 
 void CommandContext::Reset(void)
 {
-	// We only call Reset() on previously freed contexts.  The command list persists, but we must
-	// request a new allocator.
-	ASSERT(m_CommandList != nullptr && m_CurrentAllocator == nullptr);
-	m_CurrentAllocator = g_CommandManager.GetQueue(m_Type).RequestAllocator();
-	m_CommandList->Reset(m_CurrentAllocator, nullptr);
+	// We only call Reset() on previously freed contexts.  The command list was handed over to the
+	// queue on Finish(), so we must request a new one along with a new allocator.
+	ASSERT(m_CommandList == nullptr && m_CurrentAllocator == nullptr);
+	CommandQueue& Queue = g_CommandManager.GetQueue(m_Type);
+	m_CurrentAllocator = Queue.RequestAllocator();
+	m_CommandList = Queue.RequestCommandList(m_CurrentAllocator);
 
 	m_CurGraphicsRootSignature = nullptr;
 	m_CurPipelineState = nullptr;
 	m_CurComputeRootSignature = nullptr;
-	m_NumBarriersToFlush = 0;
+	m_SkipDraws = false;
+	m_ResourceBarrierBuffer.clear();
+	m_PendingTransitions.clear();
+	m_TrackedResources.clear();
+	m_ResidencySet.clear();
 
-	BindDescriptorHeaps();
+	BindDynamicDescriptorHeaps();
 }
 
 CommandContext::~CommandContext(void)
@@ -54,6 +90,7 @@ CommandContext& CommandContext::Begin(const std::wstring ID)
 {
 	CommandContext* NewContext = g_ContextManager.AllocateContext(D3D12_COMMAND_LIST_TYPE_DIRECT);
 	NewContext->SetID(ID);
+	NewContext->m_IsTracing = ID.length() > 0 && g_CommandTrace.IsCapturing();
 	if (ID.length() > 0)
 		EngineProfiling::BeginBlock(ID, NewContext);
 	return *NewContext;
@@ -64,6 +101,7 @@ ComputeContext& ComputeContext::Begin(const std::wstring& ID, bool Async)
 	ComputeContext& NewContext = g_ContextManager.AllocateContext(
 		Async ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_DIRECT)->GetComputeContext();
 	NewContext.SetID(ID);
+	NewContext.m_IsTracing = ID.length() > 0 && g_CommandTrace.IsCapturing();
 	if (ID.length() > 0)
 		EngineProfiling::BeginBlock(ID, &NewContext);
 	return NewContext;
@@ -72,12 +110,18 @@ ComputeContext& ComputeContext::Begin(const std::wstring& ID, bool Async)
 void CommandContext::Initialize(void)
 {
 	g_CommandManager.CreateNewCommandList(m_Type, &m_CommandList, &m_CurrentAllocator);
+	BindDynamicDescriptorHeaps();
 }
 
 uint64_t CommandContext::Finish(bool WaitForCompletion)
 {
 	ASSERT(m_Type == D3D12_COMMAND_LIST_TYPE_DIRECT || m_Type == D3D12_COMMAND_LIST_TYPE_COMPUTE);
 
+	// Split transitions begun here end in this command list, so that no resource is left mid-transition
+	// for whichever command list is submitted next
+	while (!m_PendingTransitions.empty())
+		CompletePendingTransition(*m_PendingTransitions.back().Resource);
+
 	FlushResourceBarriers();
 
 	if (m_ID.length() > 0)
@@ -87,10 +131,32 @@ uint64_t CommandContext::Finish(bool WaitForCompletion)
 
 	CommandQueue& Queue = g_CommandManager.GetQueue(m_Type);
 
-	uint64_t FenceValue = Queue.ExecuteCommandList(m_CommandList);
+	// Copies of resources this list may use have to be submitted ahead of it. Compute queue work waits
+	// for the tickets of the uploads it reads instead.
+	if (m_Type == D3D12_COMMAND_LIST_TYPE_DIRECT)
+		g_UploadManager.Flush();
+
+	// Anything evicted since it was marked has to be paged back in before the list can run
+	g_ResidencyManager.MakeResident(m_ResidencySet);
+	m_ResidencySet.clear();
+
+	// The list is executed together with the others finished before the queue's next flush
+	uint64_t FenceValue = Queue.SubmitCommandList(m_CommandList,
+		[this](std::vector<D3D12_RESOURCE_BARRIER>& FixupBarriers) { ResolveResourceStates(FixupBarriers); });
+	m_CommandList = nullptr;
 	Queue.DiscardAllocator(FenceValue, m_CurrentAllocator);
 	m_CurrentAllocator = nullptr;
 
+	for (auto Bundle : m_ExecutedBundles)
+		Bundle->m_LastFenceValue = FenceValue;
+	m_ExecutedBundles.clear();
+
+	if (m_IsTracing)
+	{
+		g_CommandTrace.Submit(m_Type, m_ID, m_Trace);
+		m_IsTracing = false;
+	}
+
 	m_CpuLinearAllocator.CleanupUsedPages(FenceValue);
 	m_GpuLinearAllocator.CleanupUsedPages(FenceValue);
 	m_DynamicViewDescriptorHeap.CleanupUsedHeaps(FenceValue);
@@ -104,87 +170,254 @@ uint64_t CommandContext::Finish(bool WaitForCompletion)
 	return FenceValue;
 }
 
-void CommandContext::InitializeTexture(GpuResource& Dest, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[])
+uint64_t CommandContext::InitializeTexture(GpuResource& Dest, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[])
 {
-	UINT64 uploadBufferSize = GetRequiredIntermediateSize(Dest.GetResource(), 0, NumSubresources);
+	return g_UploadManager.UploadTexture(Dest, 0, NumSubresources, SubData);
+}
 
-	CommandContext& InitContext = CommandContext::Begin();
+uint64_t CommandContext::InitializeBuffer(GpuResource& Dest, const void* BufferData, size_t NumBytes, size_t Offset)
+{
+	return g_UploadManager.UploadBuffer(Dest, Offset, BufferData, NumBytes);
+}
 
-	// copy data to the intermediate upload heap and then schedule a copy from the upload heap to the default texture
-	DynAlloc mem = InitContext.ReserveUploadMemory(uploadBufferSize);
-	UpdateSubresources(InitContext.m_CommandList, Dest.GetResource(), mem.Buffer.GetResource(), 0, 0, NumSubresources, SubData);
-	InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_GENERIC_READ);
+void CommandContext::WriteBuffer(GpuResource& Dest, size_t DestOffset, const void* BufferData, size_t NumBytes)
+{
+	auto mem = ReserveUploadMemory(NumBytes);
+	SIMDMemCopy(mem.DataPtr, BufferData, Math::DivideByMultiple(NumBytes, 16));
 
-	// Execute the command list and wait for it to finish so we can release the upload buffer
-	//? can't we not wait?
-	InitContext.Finish(true);
+	TransitionResource(Dest, D3D12_RESOURCE_STATE_COPY_DEST, true);
+	m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, mem.Buffer.GetResource(), mem.Offset, NumBytes);
 }
 
-void CommandContext::InitializeBuffer(GpuResource& Dest, const void* BufferData, size_t NumBytes, size_t Offset)
+void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
 {
-	auto& InitContext = CommandContext::Begin();
+	TraceCommand(CommandTrace::Op::TransitionResource, &Resource, NewState, FlushImmediate);
+	MarkUsed(Resource);
 
-	auto mem = InitContext.ReserveUploadMemory(NumBytes);
-	SIMDMemCopy(mem.DataPtr, BufferData, Math::DivideByMultiple(NumBytes, 16));
+	if (m_Type == D3D12_COMMAND_LIST_TYPE_COMPUTE)
+	{
+		const D3D12_RESOURCE_STATES UsageState = GetTrackedState(Resource).UsageState;
+		ASSERT((UsageState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == UsageState);
+		ASSERT((NewState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == NewState);
+	}
 
-	// copy data to the intermediate uplod heap and then schedule a copy from the upload heap to the default texture
-	InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_COPY_DEST, true);
-	InitContext.m_CommandList->CopyBufferRegion(Dest.GetResource(), Offset, mem.Buffer.GetResource(), 0, NumBytes);
-	InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_GENERIC_READ, true);
+	AddResourceTransition(Resource, NewState);
 
-	// Execute the command list and wait for it to finish so we can release the uplaod buffer
-	InitContext.Finish(true);
+	if (FlushImmediate)
+		FlushResourceBarriers();
 }
 
-void CommandContext::TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
+void CommandContext::TransitionSubresource(GpuResource& Resource, UINT Subresource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
 {
-	D3D12_RESOURCE_STATES OldState = Resource.m_UsageState;
+	TraceCommand(CommandTrace::Op::TransitionSubresource, &Resource, Subresource, NewState, FlushImmediate);
+	MarkUsed(Resource);
 
 	if (m_Type == D3D12_COMMAND_LIST_TYPE_COMPUTE)
-	{
-		ASSERT((OldState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == OldState);
 		ASSERT((NewState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == NewState);
+
+	CompletePendingTransition(Resource);
+
+	auto& State = GetTrackedState(Resource);
+	auto& States = State.SubresourceStates;
+
+	if (States.empty() && State.UsageState != NewState)
+		States.assign(GetSubresourceCount(Resource), State.UsageState);
+
+	if (States.empty())
+	{
+		// The whole resource is already in NewState
+		if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+			AddUAVBarrier(Resource);
+	}
+	else
+	{
+		ASSERT(Subresource < States.size(), "Subresource index out of range");
+
+		if (States[Subresource] != NewState)
+		{
+			AddTransitionBarrier(Resource, Subresource, States[Subresource], NewState);
+			States[Subresource] = NewState;
+
+			// Go back to tracking a single state once all subresources agree again
+			if (std::all_of(States.begin(), States.end(), [NewState](auto SubresourceState) { return SubresourceState == NewState; }))
+			{
+				State.UsageState = NewState;
+				States.clear();
+			}
+		}
+		else if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+			AddUAVBarrier(Resource);
 	}
 
-	if (OldState != NewState)
+	if (FlushImmediate)
+		FlushResourceBarriers();
+}
+
+void CommandContext::BeginResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate)
+{
+	TraceCommand(CommandTrace::Op::BeginResourceTransition, &Resource, NewState, FlushImmediate);
+	MarkUsed(Resource);
+
+	// If it's already transitioning, finish that transition
+	CompletePendingTransition(Resource);
+
+	const auto& State = GetTrackedState(Resource);
+	if (!State.SubresourceStates.empty())
+	{
+		// Subresources in different states can't share one split barrier, fall back to a regular transition
+		AddResourceTransition(Resource, NewState);
+	}
+	else if (State.UsageState != NewState)
 	{
-		ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
-		D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+		AddTransitionBarrier(Resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, State.UsageState, NewState,
+			D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+		m_PendingTransitions.push_back({ &Resource, NewState });
+	}
 
-		BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		BarrierDesc.Transition.pResource = Resource.GetResource();
-		BarrierDesc.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		BarrierDesc.Transition.StateBefore = OldState;
-		BarrierDesc.Transition.StateAfter = NewState;
+	if (FlushImmediate)
+		FlushResourceBarriers();
+}
+
+void CommandContext::InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate)
+{
+	TraceCommand(CommandTrace::Op::InsertUAVBarrier, &Resource, FlushImmediate);
+	MarkUsed(Resource);
+
+	AddUAVBarrier(Resource);
+
+	if (FlushImmediate)
+		FlushResourceBarriers();
+}
+
+void CommandContext::AddResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState)
+{
+	// A split transition towards NewState ends here, one towards another state has to end before the
+	// resource can move on
+	const bool EndedSplitTransition = CompletePendingTransition(Resource);
 
-		if (NewState == Resource.m_TransitioningState)
+	auto& State = GetTrackedState(Resource);
+	if (EndedSplitTransition && State.UsageState == NewState)
+		return;
+
+	auto& States = State.SubresourceStates;
+
+	if (!States.empty())
+	{
+		bool AnyUnordered = false;
+		for (UINT i = 0; i < (UINT)States.size(); ++i)
 		{
-			BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
-			Resource.m_TransitioningState = (D3D12_RESOURCE_STATES)-1;
+			if (States[i] != NewState)
+				AddTransitionBarrier(Resource, i, States[i], NewState);
+			else
+				AnyUnordered |= NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
 		}
-		else
-			BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
 
-		Resource.m_UsageState = NewState;
+		if (AnyUnordered)
+			AddUAVBarrier(Resource);
+
+		State.UsageState = NewState;
+		States.clear();
+	}
+	else if (State.UsageState != NewState)
+	{
+		AddTransitionBarrier(Resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, State.UsageState, NewState);
+		State.UsageState = NewState;
 	}
 	else if (NewState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
-		InsertUAVBarrier(Resource, FlushImmediate);
+		AddUAVBarrier(Resource);
+}
 
-	if (FlushImmediate || m_NumBarriersToFlush == 16)
-		FlushResourceBarriers();
+void CommandContext::AddTransitionBarrier(GpuResource& Resource, UINT Subresource, D3D12_RESOURCE_STATES OldState, D3D12_RESOURCE_STATES NewState,
+	D3D12_RESOURCE_BARRIER_FLAGS Flags)
+{
+	m_ResourceBarrierBuffer.push_back(TransitionBarrier(Resource.GetResource(), Subresource, OldState, NewState, Flags));
 }
 
-void CommandContext::InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate)
+void CommandContext::AddUAVBarrier(GpuResource& Resource)
 {
-	ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
-	D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+	D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer.emplace_back();
 
 	BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
 	BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
 	BarrierDesc.UAV.pResource = Resource.GetResource();
+}
 
-	if (FlushImmediate)
-		FlushResourceBarriers();
+bool CommandContext::CompletePendingTransition(GpuResource& Resource)
+{
+	auto Pending = std::find_if(m_PendingTransitions.begin(), m_PendingTransitions.end(),
+		[&Resource](const PendingTransition& Transition) { return Transition.Resource == &Resource; });
+	if (Pending == m_PendingTransitions.end())
+		return false;
+
+	const D3D12_RESOURCE_STATES NewState = Pending->NewState;
+	*Pending = m_PendingTransitions.back();
+	m_PendingTransitions.pop_back();
+
+	auto& State = GetTrackedState(Resource);
+	AddTransitionBarrier(Resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, State.UsageState, NewState,
+		D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+	State.UsageState = NewState;
+	return true;
+}
+
+CommandContext::ResourceState& CommandContext::GetTrackedState(GpuResource& Resource)
+{
+	auto [Tracked, Inserted] = m_TrackedResources.try_emplace(&Resource);
+	if (Inserted)
+	{
+		// Assume the state the lists finished so far leave the resource in
+		Tracked->second.Expected = { Resource.m_UsageState, Resource.m_SubresourceStates };
+		Tracked->second.Current = Tracked->second.Expected;
+	}
+	return Tracked->second.Current;
+}
+
+D3D12_RESOURCE_STATES CommandContext::GetUsageState(const GpuResource& Resource) const
+{
+	auto Tracked = m_TrackedResources.find(const_cast<GpuResource*>(&Resource));
+	return Tracked != m_TrackedResources.end() ? Tracked->second.Current.UsageState : Resource.m_UsageState;
+}
+
+void CommandContext::ResolveResourceStates(std::vector<D3D12_RESOURCE_BARRIER>& FixupBarriers)
+{
+	for (auto& [Resource, Tracked] : m_TrackedResources)
+	{
+		// Another context finished since this one first used the resource, e.g. one recorded later on
+		// another thread
+		const size_t FirstFixup = FixupBarriers.size();
+		const auto& States = Resource->m_SubresourceStates;
+		const auto& Expected = Tracked.Expected;
+		if (States.empty() && Expected.SubresourceStates.empty())
+		{
+			if (Resource->m_UsageState != Expected.UsageState)
+			{
+				FixupBarriers.push_back(TransitionBarrier(Resource->GetResource(), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+					Resource->m_UsageState, Expected.UsageState));
+			}
+		}
+		else
+		{
+			ASSERT(States.empty() || Expected.SubresourceStates.empty() || States.size() == Expected.SubresourceStates.size());
+
+			const size_t Count = std::max(States.size(), Expected.SubresourceStates.size());
+			for (UINT i = 0; i < (UINT)Count; ++i)
+			{
+				const auto Before = States.empty() ? Resource->m_UsageState : States[i];
+				const auto After = Expected.SubresourceStates.empty() ? Expected.UsageState : Expected.SubresourceStates[i];
+				if (Before != After)
+					FixupBarriers.push_back(TransitionBarrier(Resource->GetResource(), i, Before, After));
+			}
+		}
+
+		ASSERT(m_Type != D3D12_COMMAND_LIST_TYPE_COMPUTE || FixupBarriers.size() == FirstFixup ||
+			(Resource->m_UsageState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == Resource->m_UsageState,
+			"The compute queue can't move a resource out of a graphics-only state");
+
+		Resource->m_UsageState = Tracked.Current.UsageState;
+		Resource->m_SubresourceStates = std::move(Tracked.Current.SubresourceStates);
+	}
+
+	m_TrackedResources.clear();
 }
 
 void CommandContext::PIXBeginEvent([[maybe_unused]] const wchar_t* label)
@@ -222,25 +455,42 @@ void CommandContext::BindDescriptorHeaps(void)
 		m_CommandList->SetDescriptorHeaps(NonNullHeaps, HeapsToBind);
 }
 
-CommandContext* ContextManager::AllocateContext(D3D12_COMMAND_LIST_TYPE Type)
+void CommandContext::BindDynamicDescriptorHeaps(void)
 {
-	auto lg = std::lock_guard{ sm_ContextAllocationMutex };
+	// The dynamic heaps are shared by every context, so binding them up front means a command list
+	// normally sets descriptor heaps exactly once. Copy lists can't bind any.
+	if (m_Type == D3D12_COMMAND_LIST_TYPE_COPY)
+		return;
 
-	auto& AvailableContexts = sm_AvailableContexts[Type];
+	m_CurrentDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV] = m_DynamicViewDescriptorHeap.GetHeapPointer();
+	m_CurrentDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER] = m_DynamicSamplerDescriptorHeap.GetHeapPointer();
+	BindDescriptorHeaps();
+}
 
+CommandContext* ContextManager::AllocateContext(D3D12_COMMAND_LIST_TYPE Type)
+{
 	CommandContext* ret = nullptr;
-	if (AvailableContexts.empty())
+	bool IsNew = false;
+	if (!sm_AvailableContexts[Type].TryPop(ret))
 	{
-		ret = new CommandContext(Type);
-		sm_ContextPool[Type].emplace_back(ret);
-		ret->Initialize();
+		auto lg = std::lock_guard{ sm_ContextAllocationMutex };
+		if (!sm_OverflowContexts[Type].empty())
+		{
+			ret = sm_OverflowContexts[Type].back();
+			sm_OverflowContexts[Type].pop_back();
+		}
+		else
+		{
+			ret = new CommandContext(Type);
+			sm_ContextPool[Type].emplace_back(ret);
+			IsNew = true;
+		}
 	}
+
+	if (IsNew)
+		ret->Initialize();
 	else
-	{
-		ret = AvailableContexts.front();
-		AvailableContexts.pop();
 		ret->Reset();
-	}
 	ASSERT(ret != nullptr);
 
 	ASSERT(ret->m_Type == Type);
@@ -251,45 +501,71 @@ CommandContext* ContextManager::AllocateContext(D3D12_COMMAND_LIST_TYPE Type)
 void ContextManager::FreeContext(CommandContext* UsedContext)
 {
 	ASSERT(UsedContext != nullptr);
+	if (sm_AvailableContexts[UsedContext->m_Type].TryPush(UsedContext))
+		return;
+
 	auto lg = std::lock_guard{ sm_ContextAllocationMutex };
-	sm_AvailableContexts[UsedContext->m_Type].push(UsedContext);
+	sm_OverflowContexts[UsedContext->m_Type].push_back(UsedContext);
 }
 
 void ContextManager::DestroyAllContexts()
 {
+	CommandContext* Available = nullptr;
+	for (auto& Contexts : sm_AvailableContexts)
+	{
+		while (Contexts.TryPop(Available))
+			;
+	}
+
+	for (auto& Contexts : sm_OverflowContexts)
+		Contexts.clear();
+
 	for (auto& pool : sm_ContextPool)
 		pool.clear();
 }
 
 void GraphicsContext::ClearColor(ColorBuffer& Target)
 {
+	TraceCommand(CommandTrace::Op::ClearColor, &Target);
+	MarkUsed(Target);
 	m_CommandList->ClearRenderTargetView(Target.GetRTV(), Target.GetClearColor().GetPtr(), 0, nullptr);
 }
 
 void GraphicsContext::ClearDepth(DepthBuffer& Target)
 {
+	TraceCommand(CommandTrace::Op::ClearDepth, &Target);
+	MarkUsed(Target);
 	m_CommandList->ClearDepthStencilView(Target.GetDSV(), D3D12_CLEAR_FLAG_DEPTH, Target.GetClearDepth(), Target.GetClearStencil(), 0, nullptr);
 }
 
 void GraphicsContext::SetRenderTargets(UINT NumRTVs, const D3D12_CPU_DESCRIPTOR_HANDLE RTVs[], D3D12_CPU_DESCRIPTOR_HANDLE DSV)
 {
+	TraceCommand(CommandTrace::Op::SetRenderTargets);
+	TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, &DSV, 1);
+	TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, RTVs, NumRTVs);
 	m_CommandList->OMSetRenderTargets(NumRTVs, RTVs, FALSE, &DSV);
 }
 
 void GraphicsContext::SetRenderTargets(UINT NumRTVs, const D3D12_CPU_DESCRIPTOR_HANDLE RTVs[])
 {
+	TraceCommand(CommandTrace::Op::SetRenderTargets);
+	TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, nullptr, 0);
+	TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, RTVs, NumRTVs);
 	m_CommandList->OMSetRenderTargets(NumRTVs, RTVs, FALSE, nullptr);
 }
 
 void GraphicsContext::SetViewportAndScissor(const D3D12_VIEWPORT& vp, const D3D12_RECT& rect)
 {
 	ASSERT(rect.left < rect.right&& rect.top < rect.bottom);
+	TraceCommand(CommandTrace::Op::SetViewport, vp);
+	TraceCommand(CommandTrace::Op::SetScissor, rect);
 	m_CommandList->RSSetViewports(1, &vp);
 	m_CommandList->RSSetScissorRects(1, &rect);
 }
 
 void GraphicsContext::SetViewport(const D3D12_VIEWPORT& vp)
 {
+	TraceCommand(CommandTrace::Op::SetViewport, vp);
 	m_CommandList->RSSetViewports(1, &vp);
 }
 
@@ -302,11 +578,13 @@ void GraphicsContext::SetViewport(FLOAT x, FLOAT y, FLOAT w, FLOAT h, FLOAT minD
 	vp.MaxDepth = maxDepth;
 	vp.TopLeftX = x;
 	vp.TopLeftY = y;
+	TraceCommand(CommandTrace::Op::SetViewport, vp);
 	m_CommandList->RSSetViewports(1, &vp);
 }
 
 void GraphicsContext::SetScissor(const D3D12_RECT& rect)
 {
 	ASSERT(rect.left < rect.right&& rect.top < rect.bottom);
+	TraceCommand(CommandTrace::Op::SetScissor, rect);
 	m_CommandList->RSSetScissorRects(1, &rect);
 }
@@ -9,6 +9,11 @@
 #include "DynamicUploadBuffer.h"
 #include "DynamicDescriptorHeap.h"
 #include "LinearAllocator.h"
+#include "CommandBundle.h"
+#include "CommandTrace.h"
+#include "LockFreeQueue.h"
+
+#include <unordered_map>
 
 class ColorBuffer;
 class DepthBuffer;
@@ -50,8 +55,13 @@ public:
 	void DestroyAllContexts();
 
 private:
+	static constexpr size_t kMaxContextsPerType = 1024;
+
 	std::vector<std::unique_ptr<CommandContext>> sm_ContextPool[4]; //? sm_ so static?
-	std::queue<CommandContext*> sm_AvailableContexts[4];
+	// Recycling is lock-free, the mutex only guards creating new contexts and the overflow lists
+	LockFreeQueue<CommandContext*, kMaxContextsPerType> sm_AvailableContexts[4];
+	// Contexts freed while the lock-free queue was full
+	std::vector<CommandContext*> sm_OverflowContexts[4];
 	std::mutex sm_ContextAllocationMutex;
 };
 
@@ -65,6 +75,7 @@ struct NonCopyable
 class CommandContext : NonCopyable
 {
 	friend ContextManager;
+	friend CommandTrace;
 private:
 	CommandContext(D3D12_COMMAND_LIST_TYPE Type);
 
@@ -95,13 +106,33 @@ public:
 		return m_CpuLinearAllocator.Allocate(SizeInBytes);
 	}
 
-	static void InitializeTexture(GpuResource& Dest, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[]);
-	static void InitializeBuffer(GpuResource& Dest, const void* Data, size_t NumBytes, size_t Offset = 0);
+	// Initial data of resources the GPU isn't using yet goes through the upload manager on the copy
+	// queue; the returned ticket can be passed to UploadManager::WaitForUpload
+	static uint64_t InitializeTexture(GpuResource& Dest, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[]);
+	static uint64_t InitializeBuffer(GpuResource& Dest, const void* Data, size_t NumBytes, size_t Offset = 0);
+
+	// Updates part of a buffer in order with the rest of this context's work
+	void WriteBuffer(GpuResource& Dest, size_t DestOffset, const void* Data, size_t NumBytes);
+
+	void CopyBufferRegion(GpuResource& Dest, size_t DestOffset, GpuResource& Src, size_t SrcOffset, size_t NumBytes);
+
+	// Leaves the resource's contents undefined. Render targets and depth buffers placed in a heap
+	// need this or a full clear before any other use, since their compression metadata is garbage.
+	void DiscardResource(GpuResource& Resource);
 
 	void TransitionResource(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
+	void TransitionSubresource(GpuResource& Resource, UINT Subresource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
+	// Starts a split transition that is completed by the next transition of the resource, or at the
+	// latest when this context finishes. Use it when the next state is known well ahead of its use.
+	void BeginResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
 	void InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate = false);
 	inline void FlushResourceBarriers(void);
 
+	// Records that the command list uses the resource, so its memory is made resident before the list
+	// is submitted. Transitions, barriers, copies and root buffer views mark their resources already;
+	// resources that allow eviction and are only bound through descriptors have to be marked here.
+	void MarkUsed(const GpuResource& Resource);
+
 	void InsertTimeStamp(ID3D12QueryHeap* pQueryHeap, uint32_t QueryIdx);
 	void ResolveTimeStamps(ID3D12Resource* pReadbackHeap, ID3D12QueryHeap* pQueryHeap, uint32_t NumQueries);
 	void PIXBeginEvent(const wchar_t* label);
@@ -115,6 +146,54 @@ public:
 protected:
 
 	void BindDescriptorHeaps(void);
+	void BindDynamicDescriptorHeaps(void);
+
+	void AddResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState);
+	void AddTransitionBarrier(GpuResource& Resource, UINT Subresource, D3D12_RESOURCE_STATES OldState, D3D12_RESOURCE_STATES NewState,
+		D3D12_RESOURCE_BARRIER_FLAGS Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE);
+	void AddUAVBarrier(GpuResource& Resource);
+	// Ends the split transition this context began on the resource, returns false if there is none
+	bool CompletePendingTransition(GpuResource& Resource);
+
+	// States of a resource as in GpuResource, UsageState is only meaningful while SubresourceStates is empty
+	struct ResourceState
+	{
+		D3D12_RESOURCE_STATES UsageState;
+		std::vector<D3D12_RESOURCE_STATES> SubresourceStates;
+	};
+	// The state this context's commands have left the resource in so far
+	ResourceState& GetTrackedState(GpuResource& Resource);
+	D3D12_RESOURCE_STATES GetUsageState(const GpuResource& Resource) const;
+	// Called on submission under the queue lock. Adds the barriers from each resource's current state
+	// to the one this context expected, and hands the resources the states the context left them in.
+	void ResolveResourceStates(std::vector<D3D12_RESOURCE_BARRIER>& FixupBarriers);
+
+	// Records a call into the command trace while this context is being captured. Commands shared
+	// by graphics and compute contexts pass whether a compute context issued them first.
+	template <typename... Args>
+	void TraceCommand(CommandTrace::Op Op, const Args&... Arguments)
+	{
+		if (m_IsTracing)
+			m_Trace.Write(Op, Arguments...);
+	}
+
+	void TraceData(const void* Data, size_t Size)
+	{
+		if (m_IsTracing)
+			m_Trace.WriteData(Data, Size);
+	}
+
+	void TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE Type, const D3D12_CPU_DESCRIPTOR_HANDLE* Handles, UINT Count)
+	{
+		if (m_IsTracing)
+			m_Trace.WriteDescriptors(Type, Handles, Count);
+	}
+
+	void TraceConstants(bool IsCompute, UINT RootIndex, std::initializer_list<DWParam> Values)
+	{
+		TraceCommand(CommandTrace::Op::SetConstantArray, IsCompute, RootIndex);
+		TraceData(Values.begin(), Values.size() * sizeof(DWParam));
+	}
 
 	CommandListManager* m_OwningManager = nullptr;
 	ID3D12GraphicsCommandList* m_CommandList = nullptr;
@@ -123,18 +202,44 @@ protected:
 	ID3D12RootSignature* m_CurGraphicsRootSignature = nullptr;
 	ID3D12PipelineState* m_CurPipelineState = nullptr;
 	ID3D12RootSignature* m_CurComputeRootSignature = nullptr;
+	// The last PSO set is still compiling and has no fallback; draws and dispatches are dropped
+	bool m_SkipDraws = false;
 
 	DynamicDescriptorHeap m_DynamicViewDescriptorHeap;
 	DynamicDescriptorHeap m_DynamicSamplerDescriptorHeap;
 
-	D3D12_RESOURCE_BARRIER m_ResourceBarrierBuffer[16];
-	UINT m_NumBarriersToFlush = 0;
+	std::vector<D3D12_RESOURCE_BARRIER> m_ResourceBarrierBuffer;
+	// Split transitions this context began and has yet to end. They are kept per context, not per
+	// resource, so that the END_ONLY half is always recorded in the same command list as its BEGIN_ONLY.
+	struct PendingTransition
+	{
+		GpuResource* Resource;
+		D3D12_RESOURCE_STATES NewState;
+	};
+	std::vector<PendingTransition> m_PendingTransitions;
+	// Resources transitioned by this context. Their own state only changes on Finish(): contexts
+	// recorded in parallel can be finished in a different order, so the state a resource was in when
+	// this context first used it is only a guess, checked again on submission.
+	struct TrackedResource
+	{
+		ResourceState Expected;
+		ResourceState Current;
+	};
+	std::unordered_map<GpuResource*, TrackedResource> m_TrackedResources;
+	// Heaps and committed resources the recorded commands use, see MarkUsed
+	std::vector<ID3D12Pageable*> m_ResidencySet;
 
 	ID3D12DescriptorHeap* m_CurrentDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES] = { nullptr };
 
 	LinearAllocator m_CpuLinearAllocator = { kCpuWritable };
 	LinearAllocator m_GpuLinearAllocator = { kGpuExclusive };
 
+	// Bundles replayed by this context; they get stamped with its fence value on Finish()
+	std::vector<CommandBundle*> m_ExecutedBundles;
+
+	CommandTrace::Stream m_Trace;
+	bool m_IsTracing = false;
+
 	std::wstring m_ID;
 	void SetID(const std::wstring& ID) { m_ID = ID; }
 
@@ -201,6 +306,8 @@ public:
 		size_t StartVertexLocation = 0, size_t StartInstanceLocation = 0);
 	void DrawIndexedInstanced(size_t IndexCountPerInstance, size_t InstanceCount, size_t StartIndexLocation,
 		size_t BaseVertexLocation, size_t StartInstanceLocation);
+
+	void ExecuteBundle(CommandBundle& Bundle);
 };
 
 class ComputeContext : public CommandContext
@@ -234,17 +341,50 @@ public:
 
 inline void CommandContext::FlushResourceBarriers(void)
 {
-	if (m_NumBarriersToFlush > 0)
+	if (!m_ResourceBarrierBuffer.empty())
 	{
-		m_CommandList->ResourceBarrier(m_NumBarriersToFlush, m_ResourceBarrierBuffer);
-		m_NumBarriersToFlush = 0;
+		m_CommandList->ResourceBarrier((UINT)m_ResourceBarrierBuffer.size(), m_ResourceBarrierBuffer.data());
+		m_ResourceBarrierBuffer.clear();
 	}
 }
 
+inline void CommandContext::MarkUsed(const GpuResource& Resource)
+{
+	// Repeated uses of a resource, or of resources placed in the same heap, are mostly back to back
+	ID3D12Pageable* Pageable = Resource.m_Allocation.Pageable;
+	if (Pageable != nullptr && (m_ResidencySet.empty() || m_ResidencySet.back() != Pageable))
+		m_ResidencySet.push_back(Pageable);
+}
+
+inline void CommandContext::CopyBufferRegion(GpuResource& Dest, size_t DestOffset, GpuResource& Src, size_t SrcOffset, size_t NumBytes)
+{
+	MarkUsed(Src);
+	TransitionResource(Dest, D3D12_RESOURCE_STATE_COPY_DEST);
+	FlushResourceBarriers();
+	m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, Src.GetResource(), SrcOffset, NumBytes);
+}
+
+inline void CommandContext::DiscardResource(GpuResource& Resource)
+{
+	// Render targets and depth buffers can only be discarded in the state they are written in
+	const auto Flags = Resource->GetDesc().Flags;
+	if (Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+		TransitionResource(Resource, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	else if (Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+		TransitionResource(Resource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	MarkUsed(Resource);
+	FlushResourceBarriers();
+	m_CommandList->DiscardResource(Resource.GetResource(), nullptr);
+}
+
 inline void CommandContext::SetPipelineState(const PSO& PSO)
 {
-	ID3D12PipelineState* PipelineState = PSO.GetPipelineStateObject();
-	if (PipelineState == m_CurPipelineState)
+	TraceCommand(CommandTrace::Op::SetPipelineState, &PSO);
+
+	ID3D12PipelineState* PipelineState = PSO.ResolvePipelineState();
+	m_SkipDraws = PipelineState == nullptr;
+	if (m_SkipDraws || PipelineState == m_CurPipelineState)
 		return;
 
 	m_CommandList->SetPipelineState(PipelineState);
@@ -279,6 +419,8 @@ inline void CommandContext::SetDescriptorHeaps(UINT HeapCount, D3D12_DESCRIPTOR_
 
 inline void GraphicsContext::SetRootSignature(const RootSignature& RootSig)
 {
+	TraceCommand(CommandTrace::Op::SetRootSignature, false, &RootSig);
+
 	if (RootSig.GetSignature() == m_CurGraphicsRootSignature)
 		return;
 
@@ -290,6 +432,8 @@ inline void GraphicsContext::SetRootSignature(const RootSignature& RootSig)
 
 inline void ComputeContext::SetRootSignature(const RootSignature& RootSig)
 {
+	TraceCommand(CommandTrace::Op::SetRootSignature, true, &RootSig);
+
 	if (RootSig.GetSignature() == m_CurComputeRootSignature)
 		return;
 
@@ -307,11 +451,13 @@ inline void GraphicsContext::SetViewportAndScissor(UINT x, UINT y, UINT w, UINT
 
 inline void GraphicsContext::SetStencilRef(UINT StencilRef)
 {
+	TraceCommand(CommandTrace::Op::SetStencilRef, StencilRef);
 	m_CommandList->OMSetStencilRef(StencilRef);
 }
 
 inline void GraphicsContext::SetBlendFactor(Color BlendFactor)
 {
+	TraceCommand(CommandTrace::Op::SetBlendFactor, DirectX::XMFLOAT4(BlendFactor.GetPtr()));
 	m_CommandList->OMSetBlendFactor(BlendFactor.GetPtr());
 }
 
@@ -322,53 +468,65 @@ inline void GraphicsContext::SetScissor(UINT left, UINT top, UINT right, UINT bo
 
 inline void GraphicsContext::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY Topology)
 {
+	TraceCommand(CommandTrace::Op::SetPrimitiveTopology, Topology);
 	m_CommandList->IASetPrimitiveTopology(Topology);
 }
 
 inline void GraphicsContext::SetConstantArray(UINT RootIndex, UINT NumConstants, const void* pConstants)
 {
+	TraceCommand(CommandTrace::Op::SetConstantArray, false, RootIndex);
+	TraceData(pConstants, NumConstants * sizeof(UINT));
 	m_CommandList->SetGraphicsRoot32BitConstants(RootIndex, NumConstants, pConstants, 0);
 }
 
 inline void ComputeContext::SetConstantArray(UINT RootIndex, UINT NumConstants, const void* pConstants)
 {
+	TraceCommand(CommandTrace::Op::SetConstantArray, true, RootIndex);
+	TraceData(pConstants, NumConstants * sizeof(UINT));
 	m_CommandList->SetComputeRoot32BitConstants(RootIndex, NumConstants, pConstants, 0);
 }
 
 inline void GraphicsContext::SetConstant(UINT RootIndex, DWParam Val, UINT Offset)
 {
+	TraceCommand(CommandTrace::Op::SetConstant, false, RootIndex, Val.Uint, Offset);
 	m_CommandList->SetGraphicsRoot32BitConstant(RootIndex, Val.Uint, Offset);
 }
 
 inline void ComputeContext::SetConstant(UINT RootIndex, DWParam Val, UINT Offset)
 {
+	TraceCommand(CommandTrace::Op::SetConstant, true, RootIndex, Val.Uint, Offset);
 	m_CommandList->SetComputeRoot32BitConstant(RootIndex, Val.Uint, Offset);
 }
 
 inline void GraphicsContext::SetConstants(UINT RootEntry, DWParam X)
 {
+	TraceConstants(false, RootEntry, { X });
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, X.Uint, 0);
 }
 
 inline void ComputeContext::SetConstants(UINT RootEntry, DWParam X)
 {
+	TraceConstants(true, RootEntry, { X });
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, X.Uint, 0);
 }
 
 inline void GraphicsContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y)
 {
+	TraceConstants(false, RootEntry, { X, Y });
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, X.Uint, 0);
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, Y.Uint, 1);
 }
 
 inline void ComputeContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y)
 {
+	TraceConstants(true, RootEntry, { X, Y });
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, X.Uint, 0);
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, Y.Uint, 1);
 }
 
 inline void GraphicsContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y, DWParam Z)
 {
+	TraceConstants(false, RootEntry, { X, Y, Z });
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, X.Uint, 0);
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, Y.Uint, 1);
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, Z.Uint, 2);
@@ -376,6 +534,7 @@ inline void GraphicsContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y,
 
 inline void ComputeContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y, DWParam Z)
 {
+	TraceConstants(true, RootEntry, { X, Y, Z });
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, X.Uint, 0);
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, Y.Uint, 1);
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, Z.Uint, 2);
@@ -383,6 +542,7 @@ inline void ComputeContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y, D
 
 inline void GraphicsContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y, DWParam Z, DWParam W)
 {
+	TraceConstants(false, RootEntry, { X, Y, Z, W });
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, X.Uint, 0);
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, Y.Uint, 1);
 	m_CommandList->SetGraphicsRoot32BitConstant(RootEntry, Z.Uint, 2);
@@ -391,6 +551,7 @@ inline void GraphicsContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y,
 
 inline void ComputeContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y, DWParam Z, DWParam W)
 {
+	TraceConstants(true, RootEntry, { X, Y, Z, W });
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, X.Uint, 0);
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, Y.Uint, 1);
 	m_CommandList->SetComputeRoot32BitConstant(RootEntry, Z.Uint, 2);
@@ -399,17 +560,21 @@ inline void ComputeContext::SetConstants(UINT RootEntry, DWParam X, DWParam Y, D
 
 inline void GraphicsContext::SetConstantBuffer(UINT RootEntry, D3D12_GPU_VIRTUAL_ADDRESS CBV)
 {
+	TraceCommand(CommandTrace::Op::SetConstantBuffer, false, RootEntry, CBV);
 	m_CommandList->SetGraphicsRootConstantBufferView(RootEntry, CBV);
 }
 
 inline void ComputeContext::SetConstantBuffer(UINT RootEntry, D3D12_GPU_VIRTUAL_ADDRESS CBV)
 {
+	TraceCommand(CommandTrace::Op::SetConstantBuffer, true, RootEntry, CBV);
 	m_CommandList->SetComputeRootConstantBufferView(RootEntry, CBV);
 }
 
 inline void GraphicsContext::SetDynamicConstantBufferView(UINT RootIndex, size_t BufferSize, const void* BufferData)
 {
 	ASSERT(BufferData != nullptr && Math::IsAligned(BufferData, 16));
+	TraceCommand(CommandTrace::Op::SetDynamicConstantBufferView, false, RootIndex);
+	TraceData(BufferData, BufferSize);
 	DynAlloc cb = m_CpuLinearAllocator.Allocate(BufferSize);
 	//SIMDMemCopy(cb.DataPtr, BufferData, Math::AlignUp(BufferSize, 16) >> 4);
 	memcpy(cb.DataPtr, BufferData, BufferSize);
@@ -419,6 +584,8 @@ inline void GraphicsContext::SetDynamicConstantBufferView(UINT RootIndex, size_t
 inline void ComputeContext::SetDynamicConstantBufferView(UINT RootIndex, size_t BufferSize, const void* BufferData)
 {
 	ASSERT(BufferData != nullptr && Math::IsAligned(BufferData, 16));
+	TraceCommand(CommandTrace::Op::SetDynamicConstantBufferView, true, RootIndex);
+	TraceData(BufferData, BufferSize);
 	DynAlloc cb = m_CpuLinearAllocator.Allocate(BufferSize);
 	memcpy(cb.DataPtr, BufferData, BufferSize);
 	m_CommandList->SetComputeRootConstantBufferView(RootIndex, cb.GpuAddress);
@@ -427,6 +594,8 @@ inline void ComputeContext::SetDynamicConstantBufferView(UINT RootIndex, size_t
 inline void GraphicsContext::SetDynamicSRV(UINT RootIndex, size_t BufferSize, const void* BufferData)
 {
 	ASSERT(BufferData != nullptr && Math::IsAligned(BufferData, 16));
+	TraceCommand(CommandTrace::Op::SetDynamicSRV, false, RootIndex, BufferSize);
+	TraceData(BufferData, Math::AlignUp(BufferSize, 16));
 	DynAlloc cb = m_CpuLinearAllocator.Allocate(BufferSize);
 	SIMDMemCopy(cb.DataPtr, BufferData, Math::AlignUp(BufferSize, 16) >> 4);
 	m_CommandList->SetGraphicsRootShaderResourceView(RootIndex, cb.GpuAddress);
@@ -435,6 +604,8 @@ inline void GraphicsContext::SetDynamicSRV(UINT RootIndex, size_t BufferSize, co
 inline void ComputeContext::SetDynamicSRV(UINT RootIndex, size_t BufferSize, const void* BufferData)
 {
 	ASSERT(BufferData != nullptr && Math::IsAligned(BufferData, 16));
+	TraceCommand(CommandTrace::Op::SetDynamicSRV, true, RootIndex, BufferSize);
+	TraceData(BufferData, Math::AlignUp(BufferSize, 16));
 	DynAlloc cb = m_CpuLinearAllocator.Allocate(BufferSize);
 	SIMDMemCopy(cb.DataPtr, BufferData, Math::AlignUp(BufferSize, 16) >> 4);
 	m_CommandList->SetComputeRootShaderResourceView(RootIndex, cb.GpuAddress);
@@ -442,40 +613,51 @@ inline void ComputeContext::SetDynamicSRV(UINT RootIndex, size_t BufferSize, con
 
 inline void GraphicsContext::SetBufferSRV(UINT RootIndex, const GpuBuffer& SRV, UINT64 Offset)
 {
-	ASSERT((SRV.m_UsageState & (D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)) != 0);
+	TraceCommand(CommandTrace::Op::SetBufferSRV, false, RootIndex, SRV.GetGpuVirtualAddress() + Offset);
+	MarkUsed(SRV);
+	ASSERT((GetUsageState(SRV) & (D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE)) != 0);
 	m_CommandList->SetGraphicsRootShaderResourceView(RootIndex, SRV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void GraphicsContext::SetBufferSRV(UINT RootIndex, const DynamicUploadBuffer& SRV, UINT64 Offset)
 {
+	TraceCommand(CommandTrace::Op::SetBufferSRV, false, RootIndex, SRV.GetGpuVirtualAddress() + Offset);
 	m_CommandList->SetGraphicsRootShaderResourceView(RootIndex, SRV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void ComputeContext::SetBufferSRV(UINT RootIndex, const GpuBuffer& SRV, UINT64 Offset)
 {
-	ASSERT((SRV.m_UsageState & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) != 0);
+	TraceCommand(CommandTrace::Op::SetBufferSRV, true, RootIndex, SRV.GetGpuVirtualAddress() + Offset);
+	MarkUsed(SRV);
+	ASSERT((GetUsageState(SRV) & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) != 0);
 	m_CommandList->SetComputeRootShaderResourceView(RootIndex, SRV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void GraphicsContext::SetBufferUAV(UINT RootIndex, const GpuBuffer& UAV, UINT64 Offset)
 {
-	ASSERT((UAV.m_UsageState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
+	TraceCommand(CommandTrace::Op::SetBufferUAV, false, RootIndex, UAV.GetGpuVirtualAddress() + Offset);
+	MarkUsed(UAV);
+	ASSERT((GetUsageState(UAV) & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
 	m_CommandList->SetGraphicsRootUnorderedAccessView(RootIndex, UAV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void ComputeContext::SetBufferUAV(UINT RootIndex, const GpuBuffer& UAV, UINT64 Offset)
 {
-	ASSERT((UAV.m_UsageState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
+	TraceCommand(CommandTrace::Op::SetBufferUAV, true, RootIndex, UAV.GetGpuVirtualAddress() + Offset);
+	MarkUsed(UAV);
+	ASSERT((GetUsageState(UAV) & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) != 0);
 	m_CommandList->SetComputeRootUnorderedAccessView(RootIndex, UAV.GetGpuVirtualAddress() + Offset);
 }
 
 inline void GraphicsContext::SetDescriptorTable(UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle)
 {
+	TraceCommand(CommandTrace::Op::SetDescriptorTable, false, RootIndex, FirstHandle);
 	m_CommandList->SetGraphicsRootDescriptorTable(RootIndex, FirstHandle);
 }
 
 inline void ComputeContext::SetDescriptorTable(UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle)
 {
+	TraceCommand(CommandTrace::Op::SetDescriptorTable, true, RootIndex, FirstHandle);
 	m_CommandList->SetComputeRootDescriptorTable(RootIndex, FirstHandle);
 }
 
@@ -491,11 +673,15 @@ inline void ComputeContext::SetDynamicDescriptor(UINT RootIndex, UINT Offset, D3
 
 inline void GraphicsContext::SetDynamicDescriptors(UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[])
 {
+	TraceCommand(CommandTrace::Op::SetDynamicDescriptors, false, RootIndex, Offset);
+	TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Handles, Count);
 	m_DynamicViewDescriptorHeap.SetGraphicsDescriptorHandles(RootIndex, Offset, Count, Handles);
 }
 
 inline void ComputeContext::SetDynamicDescriptors(UINT RootIndex, UINT Offset, UINT Count, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[])
 {
+	TraceCommand(CommandTrace::Op::SetDynamicDescriptors, true, RootIndex, Offset);
+	TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Handles, Count);
 	m_DynamicViewDescriptorHeap.SetComputeDescriptorHandles(RootIndex, Offset, Count, Handles);
 }
 
@@ -506,11 +692,14 @@ inline void GraphicsContext::SetDynamicSampler(UINT RootIndex, UINT Offset, D3D1
 
 inline void GraphicsContext::SetDynamicSamplers(UINT RootIndex, UINT Offset, UINT Count, D3D12_CPU_DESCRIPTOR_HANDLE Handles[])
 {
+	TraceCommand(CommandTrace::Op::SetDynamicSamplers, RootIndex, Offset);
+	TraceDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, Handles, Count);
 	m_DynamicSamplerDescriptorHeap.SetGraphicsDescriptorHandles(RootIndex, Offset, Count, Handles);
 }
 
 inline void GraphicsContext::SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& IBView)
 {
+	TraceCommand(CommandTrace::Op::SetIndexBuffer, IBView);
 	m_CommandList->IASetIndexBuffer(&IBView);
 }
 
@@ -521,6 +710,8 @@ inline void GraphicsContext::SetVertexBuffer(UINT Slot, const D3D12_VERTEX_BUFFE
 
 inline void GraphicsContext::SetVertexBuffers(UINT StartSlot, UINT Count, const D3D12_VERTEX_BUFFER_VIEW VBViews[])
 {
+	TraceCommand(CommandTrace::Op::SetVertexBuffers, StartSlot);
+	TraceData(VBViews, Count * sizeof(D3D12_VERTEX_BUFFER_VIEW));
 	m_CommandList->IASetVertexBuffers(StartSlot, Count, VBViews);
 }
 
@@ -529,6 +720,9 @@ inline void GraphicsContext::SetDynamicVB(UINT Slot, size_t NumVertices, size_t
 	ASSERT(VBData != nullptr && Math::IsAligned(VBData, 16));
 
 	size_t BufferSize = Math::AlignUp(NumVertices * VertexStride, 16);
+	TraceCommand(CommandTrace::Op::SetDynamicVB, Slot, NumVertices, VertexStride);
+	TraceData(VBData, BufferSize);
+
 	DynAlloc vb = m_CpuLinearAllocator.Allocate(BufferSize);
 
 	SIMDMemCopy(vb.DataPtr, VBData, BufferSize >> 4);
@@ -546,6 +740,9 @@ inline void GraphicsContext::SetDynamicIB(size_t IndexCount, const uint16_t* Ind
 	ASSERT(IndexData != nullptr && Math::IsAligned(IndexData, 16));
 
 	const auto BufferSize = Math::AlignUp(IndexCount * sizeof(uint16_t), 16);
+	TraceCommand(CommandTrace::Op::SetDynamicIB, IndexCount);
+	TraceData(IndexData, BufferSize);
+
 	const auto ib = m_CpuLinearAllocator.Allocate(BufferSize);
 
 	SIMDMemCopy(ib.DataPtr, IndexData, BufferSize >> 4);
@@ -571,6 +768,9 @@ inline void GraphicsContext::DrawIndexed(size_t IndexCount, size_t StartIndexLoc
 
 inline void GraphicsContext::DrawInstanced(size_t VertexCountPerInstance, size_t InstanceCount, size_t StartVertexLocation, size_t StartInstanceLocation)
 {
+	TraceCommand(CommandTrace::Op::DrawInstanced, D3D12_DRAW_ARGUMENTS{ (UINT)VertexCountPerInstance, (UINT)InstanceCount, (UINT)StartVertexLocation, (UINT)StartInstanceLocation });
+	if (m_SkipDraws)
+		return;
 	FlushResourceBarriers();
 	m_DynamicViewDescriptorHeap.CommitGraphicsRootDescriptorTables(m_CommandList);
 	m_DynamicSamplerDescriptorHeap.CommitGraphicsRootDescriptorTables(m_CommandList);
@@ -579,12 +779,29 @@ inline void GraphicsContext::DrawInstanced(size_t VertexCountPerInstance, size_t
 
 inline void GraphicsContext::DrawIndexedInstanced(size_t IndexCountPerInstance, size_t InstanceCount, size_t StartIndexLocation, size_t BaseVertexLocation, size_t StartInstanceLocation)
 {
+	TraceCommand(CommandTrace::Op::DrawIndexedInstanced, D3D12_DRAW_INDEXED_ARGUMENTS{ (UINT)IndexCountPerInstance, (UINT)InstanceCount, (UINT)StartIndexLocation, (INT)BaseVertexLocation, (UINT)StartInstanceLocation });
+	if (m_SkipDraws)
+		return;
 	FlushResourceBarriers();
 	m_DynamicViewDescriptorHeap.CommitGraphicsRootDescriptorTables(m_CommandList);
 	m_DynamicSamplerDescriptorHeap.CommitGraphicsRootDescriptorTables(m_CommandList);
 	m_CommandList->DrawIndexedInstanced((UINT)IndexCountPerInstance, (UINT)InstanceCount, (UINT)StartIndexLocation, (INT)BaseVertexLocation, (UINT)StartInstanceLocation);
 }
 
+inline void GraphicsContext::ExecuteBundle(CommandBundle& Bundle)
+{
+	ASSERT(Bundle.IsValid(), "Executing a bundle that wasn't recorded");
+	TraceCommand(CommandTrace::Op::ExecuteBundle, &Bundle);
+	FlushResourceBarriers();
+	m_DynamicViewDescriptorHeap.CommitGraphicsRootDescriptorTables(m_CommandList);
+	m_DynamicSamplerDescriptorHeap.CommitGraphicsRootDescriptorTables(m_CommandList);
+	m_CommandList->ExecuteBundle(Bundle.m_CommandList);
+	m_ExecutedBundles.push_back(&Bundle);
+
+	// Pipeline state set inside the bundle leaks into this command list
+	m_CurPipelineState = Bundle.m_CurPipelineState;
+}
+
 inline void CommandContext::InsertTimeStamp(ID3D12QueryHeap* pQueryHeap, uint32_t QueryIdx)
 {
 	m_CommandList->EndQuery(pQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, QueryIdx);
@@ -599,6 +816,9 @@ inline void CommandContext::ResolveTimeStamps(ID3D12Resource* pReadbackHeap, ID3
 
 inline void ComputeContext::Dispatch(size_t GroupCountX, size_t GroupCountY, size_t GroupCountZ)
 {
+	TraceCommand(CommandTrace::Op::Dispatch, D3D12_DISPATCH_ARGUMENTS{ (UINT)GroupCountX, (UINT)GroupCountY, (UINT)GroupCountZ });
+	if (m_SkipDraws)
+		return;
 	FlushResourceBarriers();
 	m_DynamicViewDescriptorHeap.CommitComputeRootDescriptorTables(m_CommandList);
 	m_DynamicSamplerDescriptorHeap.CommitComputeRootDescriptorTables(m_CommandList);
@@ -1,6 +1,16 @@
 #include "pch.h"
 #include "CommandListManager.h"
 
+namespace Graphics
+{
+	extern CommandListManager g_CommandManager;
+}
+
+namespace
+{
+	BoolVar BatchCommandLists("Graphics/Batch Command Lists", true);
+}
+
 CommandQueue::CommandQueue(D3D12_COMMAND_LIST_TYPE Type) :
 	m_Type(Type),
 	m_NextFenceValue((uint64_t)Type << 56 | 1),
@@ -20,6 +30,8 @@ void CommandQueue::Create(ID3D12Device* pDevice)
 	ASSERT(!IsReady());
 	ASSERT(m_AllocatorPool.Size() == 0);
 
+	m_Device = pDevice;
+
 	D3D12_COMMAND_QUEUE_DESC QueueDesc = {};
 	QueueDesc.Type = m_Type;
 	QueueDesc.NodeMask = 1;
@@ -35,6 +47,12 @@ void CommandQueue::Create(ID3D12Device* pDevice)
 
 	m_AllocatorPool.Create(pDevice);
 
+	m_WatcherFenceEvent = CreateEvent(nullptr, false, false, nullptr);
+	m_WatcherWakeEvent = CreateEvent(nullptr, false, false, nullptr);
+	ASSERT(m_WatcherFenceEvent != NULL && m_WatcherWakeEvent != NULL);
+	m_StopWatcher = false;
+	m_WatcherThread = std::thread(&CommandQueue::WatchFences, this);
+
 	ASSERT(IsReady());
 }
 
@@ -43,6 +61,34 @@ void CommandQueue::Shutdown()
 	if (m_CommandQueue == nullptr)
 		return;
 
+	ASSERT(m_PendingLists.empty(), "Shutting down a queue with unsubmitted command lists");
+
+	{
+		auto lg = std::lock_guard{ m_CallbackMutex };
+		m_StopWatcher = true;
+	}
+	SetEvent(m_WatcherWakeEvent);
+	m_WatcherThread.join();
+
+	// Pending callbacks return memory such as large pages, so they run instead of being dropped.
+	// Waiting for idle signals every fence value handed out so far, and callbacks may register more.
+	for (;;)
+	{
+		{
+			auto lg = std::lock_guard{ m_CallbackMutex };
+			if (m_FenceCallbacks.empty())
+				break;
+		}
+		WaitForIdle();
+		RunCompletedCallbacks();
+	}
+	CloseHandle(m_WatcherFenceEvent);
+	CloseHandle(m_WatcherWakeEvent);
+
+	for (auto List : m_AvailableLists)
+		List->Release();
+	m_AvailableLists.clear();
+
 	m_AllocatorPool.Shutdown();
 
 	CloseHandle(m_FenceEventHandle);
@@ -54,26 +100,60 @@ void CommandQueue::Shutdown()
 	m_CommandQueue = nullptr;
 }
 
+uint64_t CommandQueue::Flush(void)
+{
+	auto lg = std::lock_guard{ m_FenceMutex };
+	return FlushPendingLists();
+}
+
 uint64_t CommandQueue::IncrementFence(void)
 {
 	auto lg = std::lock_guard{ m_FenceMutex };
+
+	// Lists waiting for a flush already hold the next fence value, which covers everything
+	// submitted up to now
+	if (!m_PendingLists.empty())
+		return m_NextFenceValue;
+
 	m_CommandQueue->Signal(m_pFence, m_NextFenceValue);
 	return m_NextFenceValue++;
 }
 
+uint64_t CommandQueue::GetNextFenceValue(void)
+{
+	auto lg = std::lock_guard{ m_FenceMutex };
+	return m_NextFenceValue;
+}
+
 bool CommandQueue::IsFenceComplete(uint64_t FenceValue)
 {
-	// Avoid querying the fence value by testing against the last one seen.
-	// The max() is to protect against an unlikely race condition that could cause the last
-	// completed fence value to regress.
-	if (FenceValue > m_LastCompletedFenceValue)
-		m_LastCompletedFenceValue = std::max(m_LastCompletedFenceValue, m_pFence->GetCompletedValue());
-	
-	return FenceValue <= m_LastCompletedFenceValue;
+	// Avoid querying the fence value by testing against the last one seen
+	uint64_t LastCompletedFenceValue = m_LastCompletedFenceValue.load(std::memory_order_acquire);
+	if (FenceValue > LastCompletedFenceValue)
+		LastCompletedFenceValue = UpdateLastCompletedFence(m_pFence->GetCompletedValue());
+
+	return FenceValue <= LastCompletedFenceValue;
+}
+
+uint64_t CommandQueue::UpdateLastCompletedFence(uint64_t FenceValue)
+{
+	// Threads may race to update it with values read at different times, it must never regress
+	uint64_t LastCompletedFenceValue = m_LastCompletedFenceValue.load(std::memory_order_relaxed);
+	while (LastCompletedFenceValue < FenceValue &&
+		!m_LastCompletedFenceValue.compare_exchange_weak(LastCompletedFenceValue, FenceValue, std::memory_order_acq_rel))
+		;
+	return std::max(LastCompletedFenceValue, FenceValue);
 }
 
 void CommandQueue::WaitForFence(uint64_t FenceValue)
 {
+	// The fence value may belong to command lists that haven't been flushed yet
+	{
+		auto lg = std::lock_guard{ m_FenceMutex };
+		if (FenceValue >= m_NextFenceValue)
+			FlushPendingLists();
+	}
+
 	if (IsFenceComplete(FenceValue))
 		return;
 
@@ -86,29 +166,200 @@ void CommandQueue::WaitForFence(uint64_t FenceValue)
 
 		m_pFence->SetEventOnCompletion(FenceValue, m_FenceEventHandle);
 		WaitForSingleObject(m_FenceEventHandle, INFINITE);
-		m_LastCompletedFenceValue = FenceValue;
+		UpdateLastCompletedFence(FenceValue);
 	}
 }
 
-uint64_t CommandQueue::ExecuteCommandList(ID3D12CommandList* List)
+void CommandQueue::WaitForQueue(CommandQueue& Producer, uint64_t FenceValue)
 {
+	ASSERT(&Producer != this, "A queue can't wait for itself");
+	ASSERT((D3D12_COMMAND_LIST_TYPE)(FenceValue >> 56) == Producer.m_Type, "Fence value belongs to another queue");
+
+	if (Producer.IsFenceComplete(FenceValue))
+		return;
+
+	// The producing work has to be submitted before anything can wait for it
+	{
+		auto lg = std::lock_guard{ Producer.m_FenceMutex };
+		if (FenceValue >= Producer.m_NextFenceValue)
+			Producer.FlushPendingLists();
+	}
+
 	auto lg = std::lock_guard{ m_FenceMutex };
 
-	ASSERT_SUCCEEDED(((ID3D12GraphicsCommandList*)List)->Close());
+	// Waits are ordered on the producer's timeline, so an earlier wait for a later value covers this one
+	uint64_t& WaitedFenceValue = m_WaitedFenceValues[Producer.m_Type];
+	if (FenceValue <= WaitedFenceValue)
+		return;
 
-	// Kickoff the command list
-	m_CommandQueue->ExecuteCommandLists(1, &List);
+	// Lists queued before the wait mustn't be held back by it
+	FlushPendingLists();
+
+	m_CommandQueue->Wait(Producer.m_pFence, FenceValue);
+	WaitedFenceValue = FenceValue;
+}
+
+void CommandQueue::StallForFence(uint64_t FenceValue)
+{
+	WaitForQueue(Graphics::g_CommandManager.GetQueue((D3D12_COMMAND_LIST_TYPE)(FenceValue >> 56)), FenceValue);
+}
+
+void CommandQueue::OnFenceComplete(uint64_t FenceValue, std::function<void()> Callback)
+{
+	ASSERT((D3D12_COMMAND_LIST_TYPE)(FenceValue >> 56) == m_Type, "Fence value belongs to another queue");
+
+	bool IsEarliest;
+	{
+		auto lg = std::lock_guard{ m_CallbackMutex };
+		IsEarliest = m_FenceCallbacks.empty() || FenceValue < m_FenceCallbacks.begin()->first;
+		m_FenceCallbacks.emplace(FenceValue, std::move(Callback));
+	}
+
+	// The watcher is only waiting for a later fence value, or for nothing at all
+	if (IsEarliest)
+		SetEvent(m_WatcherWakeEvent);
+}
+
+void CommandQueue::WatchFences(void)
+{
+	for (;;)
+	{
+		uint64_t NextFenceValue = 0;
+		{
+			auto lg = std::lock_guard{ m_CallbackMutex };
+			if (m_StopWatcher)
+				break;
+			if (!m_FenceCallbacks.empty())
+				NextFenceValue = m_FenceCallbacks.begin()->first;
+		}
+
+		if (NextFenceValue == 0)
+		{
+			WaitForSingleObject(m_WatcherWakeEvent, INFINITE);
+		}
+		else if (!IsFenceComplete(NextFenceValue))
+		{
+			// An event set for a value superseded by a wake-up only causes a spurious pass later
+			ASSERT_SUCCEEDED(m_pFence->SetEventOnCompletion(NextFenceValue, m_WatcherFenceEvent));
+			HANDLE Events[] = { m_WatcherWakeEvent, m_WatcherFenceEvent };
+			WaitForMultipleObjects(_countof(Events), Events, FALSE, INFINITE);
+		}
+
+		RunCompletedCallbacks();
+	}
+
+	RunCompletedCallbacks();
+}
+
+void CommandQueue::RunCompletedCallbacks(void)
+{
+	const uint64_t CompletedFenceValue = UpdateLastCompletedFence(m_pFence->GetCompletedValue());
+
+	auto Ready = std::vector<std::function<void()>>();
+	{
+		auto lg = std::lock_guard{ m_CallbackMutex };
+		const auto End = m_FenceCallbacks.upper_bound(CompletedFenceValue);
+		for (auto it = m_FenceCallbacks.begin(); it != End; ++it)
+			Ready.push_back(std::move(it->second));
+		m_FenceCallbacks.erase(m_FenceCallbacks.begin(), End);
+	}
+
+	// Run outside the lock, so callbacks can register further callbacks
+	for (auto& Callback : Ready)
+		Callback();
+}
+
+uint64_t CommandQueue::SubmitCommandList(ID3D12GraphicsCommandList* List,
+	const std::function<void(std::vector<D3D12_RESOURCE_BARRIER>&)>& ResolveStates)
+{
+	auto lg = std::lock_guard{ m_FenceMutex };
+
+	if (ResolveStates)
+	{
+		m_FixupBarriers.clear();
+		ResolveStates(m_FixupBarriers);
+
+		if (!m_FixupBarriers.empty())
+		{
+			ID3D12GraphicsCommandList* FixupList = nullptr;
+			if (!m_AvailableLists.empty())
+			{
+				FixupList = m_AvailableLists.back();
+				m_AvailableLists.pop_back();
+			}
+
+			auto Allocator = RequestAllocator();
+			FixupList = ResetCommandList(FixupList, Allocator);
+			FixupList->ResourceBarrier((UINT)m_FixupBarriers.size(), m_FixupBarriers.data());
+			ASSERT_SUCCEEDED(FixupList->Close());
+			m_PendingLists.push_back(FixupList);
+			DiscardAllocator(m_NextFenceValue, Allocator);
+		}
+	}
+
+	ASSERT_SUCCEEDED(List->Close());
+	m_PendingLists.push_back(List);
+
+	if (!BatchCommandLists)
+		return FlushPendingLists();
+
+	return m_NextFenceValue;
+}
+
+ID3D12GraphicsCommandList* CommandQueue::RequestCommandList(ID3D12CommandAllocator* Allocator)
+{
+	ID3D12GraphicsCommandList* List = nullptr;
+
+	{
+		auto lg = std::lock_guard{ m_FenceMutex };
+		if (!m_AvailableLists.empty())
+		{
+			List = m_AvailableLists.back();
+			m_AvailableLists.pop_back();
+		}
+	}
+
+	return ResetCommandList(List, Allocator);
+}
+
+ID3D12GraphicsCommandList* CommandQueue::ResetCommandList(ID3D12GraphicsCommandList* List, ID3D12CommandAllocator* Allocator)
+{
+	if (List != nullptr)
+	{
+		ASSERT_SUCCEEDED(List->Reset(Allocator, nullptr));
+	}
+	else
+	{
+		ASSERT_SUCCEEDED(m_Device->CreateCommandList(1, m_Type, Allocator, nullptr, IID_PPV_ARGS(&List)));
+		List->SetName(L"CommandList");
+	}
+
+	return List;
+}
+
+uint64_t CommandQueue::FlushPendingLists(void)
+{
+	if (m_PendingLists.empty())
+		return m_NextFenceValue - 1;
+
+	// Kickoff the command lists
+	m_CommandQueue->ExecuteCommandLists((UINT)m_PendingLists.size(), m_PendingLists.data());
 
 	// Signal the next fence value (with the GPU)
 	m_CommandQueue->Signal(m_pFence, m_NextFenceValue);
 
+	// A command list can be reset as soon as it has been submitted, only its allocator has to wait
+	for (auto List : m_PendingLists)
+		m_AvailableLists.push_back(static_cast<ID3D12GraphicsCommandList*>(List));
+	m_PendingLists.clear();
+
 	// And increment the fence value;
 	return m_NextFenceValue++;
 }
 
 ID3D12CommandAllocator* CommandQueue::RequestAllocator(void)
 {
-	uint64_t CompletedFence = m_pFence->GetCompletedValue();
+	uint64_t CompletedFence = UpdateLastCompletedFence(m_pFence->GetCompletedValue());
 
 	return m_AllocatorPool.RequestAllocator(CompletedFence);
 }
@@ -132,10 +383,13 @@ void CommandListManager::Create(ID3D12Device* pDevice)
 	m_GraphicsQueue.Create(pDevice);
 	m_ComputeQueue.Create(pDevice);
 	m_CopyQueue.Create(pDevice);
+
+	m_BundlePool.Create(pDevice);
 }
 
 void CommandListManager::Shutdown()
 {
+	m_BundlePool.Shutdown();
 	m_GraphicsQueue.Shutdown();
 	m_ComputeQueue.Shutdown();
 	m_CopyQueue.Shutdown();
@@ -143,7 +397,7 @@ void CommandListManager::Shutdown()
 
 void CommandListManager::CreateNewCommandList(D3D12_COMMAND_LIST_TYPE Type, ID3D12GraphicsCommandList** List, ID3D12CommandAllocator** Allocator)
 {
-	ASSERT(Type != D3D12_COMMAND_LIST_TYPE_BUNDLE, "Bundles are not yet supprted");
+	ASSERT(Type != D3D12_COMMAND_LIST_TYPE_BUNDLE, "Bundles are created with CreateNewBundle");
 	switch (Type)
 	{
 		case D3D12_COMMAND_LIST_TYPE_DIRECT: *Allocator = m_GraphicsQueue.RequestAllocator(); break;
@@ -156,9 +410,15 @@ void CommandListManager::CreateNewCommandList(D3D12_COMMAND_LIST_TYPE Type, ID3D
 	(*List)->SetName(L"CommandList");
 }
 
-namespace Graphics
+void CommandListManager::CreateNewBundle(ID3D12PipelineState* InitialState, ID3D12GraphicsCommandList** List, ID3D12CommandAllocator** Allocator)
 {
-	extern CommandListManager g_CommandManager;
+	ASSERT(m_Device != nullptr);
+	m_BundlePool.RequestBundle(m_GraphicsQueue.m_pFence->GetCompletedValue(), InitialState, List, Allocator);
+}
+
+void CommandListManager::DiscardBundle(uint64_t FenceValueForReset, ID3D12GraphicsCommandList* List, ID3D12CommandAllocator* Allocator)
+{
+	m_BundlePool.DiscardBundle(FenceValueForReset, List, Allocator);
 }
 
 void CommandListManager::WaitForFence(uint64_t FenceValue)
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <map>
 #include <mutex>
+#include <thread>
 #include "CommandAllocatorPool.h"
 
 class CommandQueue
 {
 	friend class CommandListManager;
 	friend class CommandContext;
+	friend class UploadManager;
 
 public:
 	CommandQueue(D3D12_COMMAND_LIST_TYPE Type);
@@ -20,30 +25,77 @@ public:
 		return m_CommandQueue != nullptr;
 	}
 
+	// Submits all command lists queued since the last flush with a single ExecuteCommandLists call
+	// and signals the fence value they were handed out.  Returns that fence value.
+	uint64_t Flush(void);
+
 	uint64_t IncrementFence(void);
+	// The fence value the next flush or IncrementFence will signal, which covers everything submitted
+	// so far. Unlike IncrementFence, doesn't signal anything itself.
+	uint64_t GetNextFenceValue(void);
 	bool IsFenceComplete(uint64_t FenceValue);
 	void WaitForFence(uint64_t FenceValue);
 	void WaitForIdle(void) { WaitForFence(IncrementFence()); }
 
+	// Makes command lists submitted to this queue from now on wait on the GPU until Producer has
+	// reached FenceValue.  Doesn't block the CPU.
+	void WaitForQueue(CommandQueue& Producer, uint64_t FenceValue);
+	// Same as above, with the producing queue taken from the fence value
+	void StallForFence(uint64_t FenceValue);
+
+	// Runs Callback on this queue's fence watcher thread once the GPU has reached FenceValue, instead
+	// of the caller polling or blocking on it. Callbacks should be short and must not wait on the GPU.
+	void OnFenceComplete(uint64_t FenceValue, std::function<void()> Callback);
+
 	ID3D12CommandQueue* GetCommandQueue() { return m_CommandQueue; }
 
 private:
-	uint64_t ExecuteCommandList(ID3D12CommandList* List);
+	// Closes the list and queues it for the next flush.  Returns the fence value that is signaled
+	// once it has completed.  ResolveStates runs under the queue lock, so it sees the resource states
+	// left by the lists submitted before; the barriers it adds run in a list of their own ahead of List.
+	uint64_t SubmitCommandList(ID3D12GraphicsCommandList* List,
+		const std::function<void(std::vector<D3D12_RESOURCE_BARRIER>&)>& ResolveStates = nullptr);
+	ID3D12GraphicsCommandList* RequestCommandList(ID3D12CommandAllocator* Allocator);
+	// Resets a list taken from m_AvailableLists, or creates one if there was none
+	ID3D12GraphicsCommandList* ResetCommandList(ID3D12GraphicsCommandList* List, ID3D12CommandAllocator* Allocator);
+	uint64_t FlushPendingLists(void);
 	ID3D12CommandAllocator* RequestAllocator(void);
 	void DiscardAllocator(uint64_t FenceValueForReset, ID3D12CommandAllocator* Allocator);
+	// Raises the last completed fence value to at least FenceValue and returns the new one
+	uint64_t UpdateLastCompletedFence(uint64_t FenceValue);
+	void WatchFences(void);
+	void RunCompletedCallbacks(void);
 
+	ID3D12Device* m_Device = nullptr;
 	ID3D12CommandQueue* m_CommandQueue = nullptr;
 	
 	const D3D12_COMMAND_LIST_TYPE m_Type;
 
+	// Highest fence value of each queue, by list type, this queue has already been told to wait for
+	uint64_t m_WaitedFenceValues[4] = {};
+
+	// Closed lists waiting for the next flush, and executed ones that can be reset right away
+	std::vector<ID3D12CommandList*> m_PendingLists;
+	std::vector<ID3D12GraphicsCommandList*> m_AvailableLists;
+	std::vector<D3D12_RESOURCE_BARRIER> m_FixupBarriers;
+
 	CommandAllocatorPool m_AllocatorPool;
 	std::mutex m_FenceMutex;
 	std::mutex m_EventMutex;
 
 	ID3D12Fence* m_pFence = nullptr;
 	uint64_t m_NextFenceValue;
-	uint64_t m_LastCompletedFenceValue;
+	std::atomic<uint64_t> m_LastCompletedFenceValue;
 	HANDLE m_FenceEventHandle;
+
+	// The watcher sleeps until the earliest callback's fence value is reached or a callback for an
+	// earlier one is registered
+	std::thread m_WatcherThread;
+	std::mutex m_CallbackMutex;
+	std::multimap<uint64_t, std::function<void()>> m_FenceCallbacks;
+	HANDLE m_WatcherFenceEvent;
+	HANDLE m_WatcherWakeEvent;
+	bool m_StopWatcher = false;
 };
 
 class CommandListManager
@@ -74,6 +126,10 @@ public:
 
 	void CreateNewCommandList(D3D12_COMMAND_LIST_TYPE Type, ID3D12GraphicsCommandList** List, ID3D12CommandAllocator** Allocator);
 
+	// Bundles are always executed from the graphics queue, so they are recycled against its fence
+	void CreateNewBundle(ID3D12PipelineState* InitialState, ID3D12GraphicsCommandList** List, ID3D12CommandAllocator** Allocator);
+	void DiscardBundle(uint64_t FenceValueForReset, ID3D12GraphicsCommandList* List, ID3D12CommandAllocator* Allocator);
+
 	bool IsFenceComplete(uint64_t FenceValue)
 	{
 		return GetQueue(D3D12_COMMAND_LIST_TYPE(FenceValue >> 56)).IsFenceComplete(FenceValue);
@@ -81,6 +137,18 @@ public:
 
 	void WaitForFence(uint64_t FenceValue);
 
+	void OnFenceComplete(uint64_t FenceValue, std::function<void()> Callback)
+	{
+		GetQueue(D3D12_COMMAND_LIST_TYPE(FenceValue >> 56)).OnFenceComplete(FenceValue, std::move(Callback));
+	}
+
+	void FlushAll(void)
+	{
+		m_GraphicsQueue.Flush();
+		m_ComputeQueue.Flush();
+		m_CopyQueue.Flush();
+	}
+
 	void IdleGPU(void)
 	{
 		m_GraphicsQueue.WaitForIdle();
@@ -94,4 +162,6 @@ private:
 	CommandQueue m_GraphicsQueue = { D3D12_COMMAND_LIST_TYPE_DIRECT };
 	CommandQueue m_ComputeQueue = { D3D12_COMMAND_LIST_TYPE_COMPUTE };
 	CommandQueue m_CopyQueue = { D3D12_COMMAND_LIST_TYPE_COPY };
+
+	BundleAllocatorPool m_BundlePool;
 };
\ No newline at end of file
@@ -0,0 +1,947 @@
+#include "pch.h"
+#include "CommandTrace.h"
+#include "CommandContext.h"
+#include "ColorBuffer.h"
+#include "DepthBuffer.h"
+#include "GraphicsCore.h"
+#include "GraphicsBackend.h"
+#include "FileUtility.h"
+#include "SystemTime.h"
+#include "EngineTuning.h"
+
+#include <fstream>
+
+namespace Graphics
+{
+	CommandTrace g_CommandTrace;
+}
+
+using namespace Graphics;
+
+namespace
+{
+	BoolVar CaptureFrame("Graphics/Command Trace/Capture Frame", false);
+	BoolVar ReplayTrace("Graphics/Command Trace/Replay", false);
+	BoolVar SaveTrace("Graphics/Command Trace/Save", false);
+	NumVar ReplayLoops("Graphics/Command Trace/Replay Loops", 100.0f, 1.0f, 10000.0f, 100.0f);
+
+	const wchar_t* kTraceFileName = L"commandTrace.bin";
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t NumObjects;
+		uint32_t NumRecords;
+	};
+
+	constexpr uint32_t kMagic = 'ATRC';
+	// Bump whenever the encoding of a command or an object description changes
+	constexpr uint32_t kVersion = 1;
+
+	constexpr uint32_t kNoObject = ~0u;
+
+	class StreamReader
+	{
+	public:
+		StreamReader(const uint8_t* Data, size_t Size) : m_Data(Data), m_Size(Size) {}
+		StreamReader(const std::vector<uint8_t>& Data) : StreamReader(Data.data(), Data.size()) {}
+
+		bool IsDone(void) const { return m_Offset >= m_Size; }
+		bool CanRead(size_t Size) const { return m_Offset <= m_Size && Size <= m_Size - m_Offset; }
+
+		// Reading past the end yields zeroes and marks the reader as overrun
+		template <typename T>
+		T Read(void)
+		{
+			T Value = {};
+			if (Check(sizeof(T)))
+				memcpy(&Value, m_Data + m_Offset, sizeof(T));
+			m_Offset += sizeof(T);
+			return Value;
+		}
+
+		template <typename T = void>
+		const T* ReadData(size_t& Size)
+		{
+			Size = Read<size_t>();
+			m_Offset = Math::AlignUp(m_Offset, 16);
+			if (!Check(Size))
+				Size = 0;
+			const auto Data = reinterpret_cast<const T*>(m_Data + std::min(m_Offset, m_Size));
+			m_Offset += Size;
+			return Data;
+		}
+
+		const uint8_t* Skip(size_t Size)
+		{
+			const auto Data = m_Data + std::min(m_Offset, m_Size);
+			m_Offset += Check(Size) ? Size : 0;
+			return Data;
+		}
+
+		bool IsOverrun(void) const { return m_Overrun; }
+
+	private:
+		bool Check(size_t Size)
+		{
+			if (!CanRead(Size))
+			{
+				m_Overrun = true;
+				m_Offset = m_Size;
+				return false;
+			}
+			return true;
+		}
+
+		const uint8_t* m_Data;
+		size_t m_Size;
+		size_t m_Offset = 0;
+		bool m_Overrun = false;
+	};
+
+	template <typename T>
+	void Append(std::vector<uint8_t>& Data, const T& Value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		const auto Bytes = reinterpret_cast<const uint8_t*>(&Value);
+		Data.insert(Data.end(), Bytes, Bytes + sizeof(T));
+	}
+
+	template <typename T>
+	void AppendArray(std::vector<uint8_t>& Data, const T* Values, uint32_t Count)
+	{
+		Append(Data, Count);
+		for (uint32_t i = 0; i < Count; ++i)
+			Append(Data, Values[i]);
+	}
+
+	// Description shared by all resources: enough to create one with the same layout in the same state
+	struct ResourceDescription
+	{
+		D3D12_RESOURCE_DESC Desc;
+		D3D12_HEAP_TYPE HeapType;
+		D3D12_RESOURCE_STATES State;
+	};
+
+	// Pixel buffers are recreated through their own Create so they get their views
+	struct PixelBufferDescription
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t ArraySize;
+		uint32_t NumMips;
+		DXGI_FORMAT Format;
+		DirectX::XMFLOAT4 ClearColor;
+		float ClearDepth;
+		uint8_t ClearStencil;
+	};
+}
+
+struct CommandTrace::LoadedObjects
+{
+	std::vector<std::unique_ptr<RootSignature>> RootSignatures;
+	std::vector<std::unique_ptr<ComputePSO>> Pipelines;
+	// Pipelines are created with their ID as the shader, which keeps them distinct in the PSO cache
+	std::vector<uint32_t> PipelineShaders;
+	std::vector<std::unique_ptr<GpuResource>> Resources;
+	std::vector<std::unique_ptr<ColorBuffer>> ColorBuffers;
+	std::vector<std::unique_ptr<DepthBuffer>> DepthBuffers;
+	std::vector<std::unique_ptr<CommandBundle>> Bundles;
+	std::vector<std::pair<D3D12_DESCRIPTOR_HEAP_TYPE, D3D12_CPU_DESCRIPTOR_HANDLE>> Descriptors;
+
+	~LoadedObjects()
+	{
+		for (auto& Resource : Resources)
+			Resource->Destroy();
+		for (auto& Buffer : ColorBuffers)
+			Buffer->Destroy();
+		for (auto& Buffer : DepthBuffers)
+			Buffer->Destroy();
+		for (auto& [Type, Handle] : Descriptors)
+			FreeDescriptor(Type, Handle);
+	}
+};
+
+CommandTrace::CommandTrace() = default;
+CommandTrace::~CommandTrace() = default;
+
+void CommandTrace::Stream::WriteData(const void* Data, size_t Size)
+{
+	WriteValue(Size);
+	m_Data.resize(Math::AlignUp(m_Data.size(), 16));
+	const auto Bytes = reinterpret_cast<const uint8_t*>(Data);
+	m_Data.insert(m_Data.end(), Bytes, Bytes + Size);
+}
+
+void CommandTrace::Stream::WriteDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE Type, const D3D12_CPU_DESCRIPTOR_HANDLE* Handles, UINT Count)
+{
+	auto lg = std::lock_guard{ g_CommandTrace.m_Mutex };
+	WriteValue(Count);
+	for (UINT i = 0; i < Count; ++i)
+		WriteValue(g_CommandTrace.GetObjectId(Type, Handles[i]));
+}
+
+void CommandTrace::Stream::WriteValue(const RootSignature* Object)
+{
+	auto lg = std::lock_guard{ g_CommandTrace.m_Mutex };
+	WriteValue(g_CommandTrace.GetObjectId(*Object));
+}
+
+void CommandTrace::Stream::WriteValue(const PSO* Object)
+{
+	auto lg = std::lock_guard{ g_CommandTrace.m_Mutex };
+	WriteValue(g_CommandTrace.GetObjectId(*Object));
+}
+
+void CommandTrace::Stream::WriteValue(GpuResource* Object)
+{
+	auto lg = std::lock_guard{ g_CommandTrace.m_Mutex };
+	WriteValue(g_CommandTrace.GetObjectId(*Object, ObjectType::Resource));
+}
+
+void CommandTrace::Stream::WriteValue(ColorBuffer* Object)
+{
+	auto lg = std::lock_guard{ g_CommandTrace.m_Mutex };
+	WriteValue(g_CommandTrace.GetObjectId(*Object, ObjectType::ColorBuffer));
+}
+
+void CommandTrace::Stream::WriteValue(DepthBuffer* Object)
+{
+	auto lg = std::lock_guard{ g_CommandTrace.m_Mutex };
+	WriteValue(g_CommandTrace.GetObjectId(*Object, ObjectType::DepthBuffer));
+}
+
+void CommandTrace::Stream::WriteValue(CommandBundle* Object)
+{
+	auto lg = std::lock_guard{ g_CommandTrace.m_Mutex };
+	WriteValue(g_CommandTrace.GetObjectId(*Object));
+}
+
+uint32_t CommandTrace::GetObjectId(const RootSignature& Signature)
+{
+	auto [It, Inserted] = m_ObjectIds.try_emplace(&Signature, static_cast<uint32_t>(m_Objects.size()));
+	if (!Inserted)
+		return It->second;
+
+	auto& Entry = m_Objects.emplace_back();
+	Entry.Type = ObjectType::RootSignature;
+	Entry.Signature = &Signature;
+
+	auto& Data = Entry.Description;
+	Append(Data, Signature.m_NumParameters);
+	Append(Data, Signature.m_NumSamplers);
+	for (UINT i = 0; i < Signature.m_NumParameters; ++i)
+	{
+		const D3D12_ROOT_PARAMETER& Param = Signature.m_ParamArray[i]();
+		Append(Data, Param.ParameterType);
+		Append(Data, Param.ShaderVisibility);
+		if (Param.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+			AppendArray(Data, Param.DescriptorTable.pDescriptorRanges, Param.DescriptorTable.NumDescriptorRanges);
+		else if (Param.ParameterType == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+			Append(Data, Param.Constants);
+		else
+			Append(Data, Param.Descriptor);
+	}
+	for (UINT i = 0; i < Signature.m_NumSamplers; ++i)
+		Append(Data, Signature.m_SamplerArray[i]);
+
+	return It->second;
+}
+
+uint32_t CommandTrace::GetObjectId(const PSO& Pipeline)
+{
+	if (auto It = m_ObjectIds.find(&Pipeline); It != m_ObjectIds.end())
+		return It->second;
+
+	// The root signature goes first, so Load always finds it created
+	const uint32_t SignatureId = Pipeline.GetRootSignature() != nullptr ? GetObjectId(*Pipeline.GetRootSignature()) : kNoObject;
+
+	const auto Id = static_cast<uint32_t>(m_Objects.size());
+	m_ObjectIds.emplace(&Pipeline, Id);
+
+	auto& Entry = m_Objects.emplace_back();
+	Entry.Type = ObjectType::PipelineState;
+	Entry.Pipeline = &Pipeline;
+	Append(Entry.Description, SignatureId);
+
+	return Id;
+}
+
+uint32_t CommandTrace::GetObjectId(GpuResource& Resource, ObjectType Type)
+{
+	auto [It, Inserted] = m_ObjectIds.try_emplace(&Resource, static_cast<uint32_t>(m_Objects.size()));
+
+	// A pixel buffer may have been recorded as a plain resource first, it is described again as what it is
+	if (!Inserted && (Type == ObjectType::Resource || m_Objects[It->second].Type == Type))
+		return It->second;
+
+	auto& Entry = Inserted ? m_Objects.emplace_back() : m_Objects[It->second];
+	Entry.Type = Type;
+	Entry.Resource = &Resource;
+
+	auto& Data = Entry.Description;
+	Data.clear();
+
+	ResourceDescription Description = { Resource->GetDesc(), D3D12_HEAP_TYPE_DEFAULT, Resource.m_UsageState };
+	D3D12_HEAP_PROPERTIES HeapProperties;
+	if (SUCCEEDED(Resource->GetHeapProperties(&HeapProperties, nullptr)))
+		Description.HeapType = HeapProperties.Type;
+	Append(Data, Description);
+	AppendArray(Data, Resource.m_SubresourceStates.data(), static_cast<uint32_t>(Resource.m_SubresourceStates.size()));
+
+	if (Type != ObjectType::Resource)
+	{
+		const auto& Buffer = static_cast<const PixelBuffer&>(Resource);
+		PixelBufferDescription PixelDescription = { Buffer.GetWidth(), Buffer.GetHeight(), Buffer.GetDepth(),
+			Description.Desc.MipLevels, Buffer.GetFormat(), {}, 0.0f, 0 };
+
+		if (Type == ObjectType::ColorBuffer)
+		{
+			const Color ClearColor = static_cast<const ColorBuffer&>(Resource).GetClearColor();
+			PixelDescription.ClearColor = DirectX::XMFLOAT4(ClearColor.R(), ClearColor.G(), ClearColor.B(), ClearColor.A());
+		}
+		else
+		{
+			const auto& Depth = static_cast<const DepthBuffer&>(Resource);
+			PixelDescription.ClearDepth = Depth.GetClearDepth();
+			PixelDescription.ClearStencil = Depth.GetClearStencil();
+		}
+		Append(Data, PixelDescription);
+	}
+
+	return It->second;
+}
+
+uint32_t CommandTrace::GetObjectId(CommandBundle& Bundle)
+{
+	auto [It, Inserted] = m_ObjectIds.try_emplace(&Bundle, static_cast<uint32_t>(m_Objects.size()));
+	if (Inserted)
+	{
+		auto& Entry = m_Objects.emplace_back();
+		Entry.Type = ObjectType::CommandBundle;
+		Entry.Bundle = &Bundle;
+	}
+	return It->second;
+}
+
+uint32_t CommandTrace::GetObjectId(D3D12_DESCRIPTOR_HEAP_TYPE Type, D3D12_CPU_DESCRIPTOR_HANDLE Descriptor)
+{
+	auto [It, Inserted] = m_DescriptorIds.try_emplace(Descriptor.ptr, static_cast<uint32_t>(m_Objects.size()));
+	if (Inserted)
+	{
+		auto& Entry = m_Objects.emplace_back();
+		Entry.Type = ObjectType::Descriptor;
+		Entry.Descriptor = Descriptor;
+		Append(Entry.Description, Type);
+	}
+	return It->second;
+}
+
+void CommandTrace::CaptureNextFrame(void)
+{
+	auto Expected = State::Idle;
+	m_State.compare_exchange_strong(Expected, State::Armed);
+}
+
+bool CommandTrace::HasTrace(void) const
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	return !m_Records.empty();
+}
+
+void CommandTrace::EndFrame(void)
+{
+	switch (m_State.load())
+	{
+	case State::Armed:
+		Clear();
+		m_State = State::Capturing;
+		return;
+
+	case State::Capturing:
+	{
+		m_State = State::Idle;
+		auto lg = std::lock_guard{ m_Mutex };
+		Utility::Printf("Captured command trace of {} contexts and {} objects\n", m_Records.size(), m_Objects.size());
+		return;
+	}
+
+	case State::Idle:
+		break;
+	}
+
+	if (CaptureFrame)
+	{
+		CaptureFrame = false;
+		CaptureNextFrame();
+	}
+	else if (ReplayTrace)
+	{
+		ReplayTrace = false;
+		Replay(static_cast<uint32_t>(static_cast<float>(ReplayLoops)));
+	}
+	else if (SaveTrace)
+	{
+		SaveTrace = false;
+		if (Save(kTraceFileName))
+			Utility::Printf(L"Saved command trace to {}\n", kTraceFileName);
+	}
+}
+
+void CommandTrace::Submit(D3D12_COMMAND_LIST_TYPE Type, const std::wstring& ID, Stream& Commands)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	m_Records.push_back({ Type, ID, std::move(Commands) });
+	Commands.Clear();
+}
+
+void CommandTrace::Clear(void)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	m_Records.clear();
+	m_Objects.clear();
+	m_ObjectIds.clear();
+	m_DescriptorIds.clear();
+
+	// Replayed command lists may still reference the objects
+	if (m_LoadedObjects != nullptr)
+	{
+		g_CommandManager.IdleGPU();
+		m_LoadedObjects.reset();
+	}
+}
+
+void CommandTrace::Replay(uint32_t Loops)
+{
+	ASSERT(m_State.load() == State::Idle, "Can't replay a command trace while capturing one");
+
+	auto lg = std::lock_guard{ m_Mutex };
+
+	if (m_Records.empty())
+	{
+		Utility::Print("No command trace to replay\n");
+		return;
+	}
+
+	const auto StartTick = SystemTime::GetCurrentTick();
+
+	for (uint32_t Loop = 0; Loop < Loops; ++Loop)
+	{
+		for (const auto& Record : m_Records)
+			ReplayRecord(Record);
+	}
+
+	const auto Milliseconds = SystemTime::TimeBetweenTicks(StartTick, SystemTime::GetCurrentTick()) * 1000.0;
+	Utility::Printf("Replayed command trace {} times: {:.3f} ms per frame\n", Loops, Milliseconds / std::max(Loops, 1u));
+}
+
+bool CommandTrace::Save(const std::wstring& FileName) const
+{
+	ASSERT(m_State.load() == State::Idle, "Can't save a command trace while capturing one");
+
+	auto lg = std::lock_guard{ m_Mutex };
+
+	if (m_Records.empty())
+	{
+		Utility::Print("No command trace to save\n");
+		return false;
+	}
+
+	auto Data = std::vector<uint8_t>();
+	Append(Data, FileHeader{ kMagic, kVersion, static_cast<uint32_t>(m_Objects.size()), static_cast<uint32_t>(m_Records.size()) });
+
+	for (const auto& Entry : m_Objects)
+	{
+		Append(Data, Entry.Type);
+		AppendArray(Data, Entry.Description.data(), static_cast<uint32_t>(Entry.Description.size()));
+	}
+
+	for (const auto& Record : m_Records)
+	{
+		Append(Data, Record.Type);
+		AppendArray(Data, Record.ID.data(), static_cast<uint32_t>(Record.ID.size()));
+		// Arrays in the stream are aligned relative to its start, which Load keeps
+		Append(Data, static_cast<uint64_t>(Record.Commands.GetSize()));
+		Data.insert(Data.end(), Record.Commands.m_Data.begin(), Record.Commands.m_Data.end());
+	}
+
+	std::ofstream File(FileName, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (File)
+		File.write(reinterpret_cast<const char*>(Data.data()), Data.size());
+	if (!File)
+	{
+		Utility::Printf(L"Couldn't write command trace {}\n", FileName);
+		return false;
+	}
+	return true;
+}
+
+bool CommandTrace::Load(const std::wstring& FileName)
+{
+	ASSERT(g_BackendType == eBackend::kRecording, "Command trace files are replayed on the recording backend");
+	ASSERT(m_State.load() == State::Idle, "Can't load a command trace while capturing one");
+
+	Clear();
+
+	const auto File = Utility::ReadFileSync(FileName);
+	auto Reader = StreamReader(*File);
+
+	auto Fail = [&FileName](const char* Reason)
+	{
+		Utility::Printf(L"Couldn't load command trace {}: ", FileName);
+		Utility::Printf("{}\n", Reason);
+		return false;
+	};
+
+	if (!Reader.CanRead(sizeof(FileHeader)))
+		return Fail("missing header");
+	const auto Header = Reader.Read<FileHeader>();
+	if (Header.Magic != kMagic || Header.Version != kVersion)
+		return Fail("not a command trace of this version");
+
+	auto Objects = std::vector<Object>(Header.NumObjects);
+	for (auto& Entry : Objects)
+	{
+		if (!Reader.CanRead(sizeof(ObjectType) + sizeof(uint32_t)))
+			return Fail("truncated object table");
+		Entry.Type = Reader.Read<ObjectType>();
+		const auto Size = Reader.Read<uint32_t>();
+		if (Entry.Type > ObjectType::Descriptor || !Reader.CanRead(Size))
+			return Fail("corrupt object table");
+		const auto Data = Reader.Skip(Size);
+		Entry.Description.assign(Data, Data + Size);
+	}
+
+	auto Records = std::vector<Record>(Header.NumRecords);
+	for (auto& Record : Records)
+	{
+		if (!Reader.CanRead(sizeof(D3D12_COMMAND_LIST_TYPE) + sizeof(uint32_t)))
+			return Fail("truncated record");
+		Record.Type = Reader.Read<D3D12_COMMAND_LIST_TYPE>();
+		const auto IDLength = Reader.Read<uint32_t>();
+		if (!Reader.CanRead(IDLength * sizeof(wchar_t) + sizeof(uint64_t)))
+			return Fail("truncated record");
+		for (uint32_t i = 0; i < IDLength; ++i)
+			Record.ID.push_back(Reader.Read<wchar_t>());
+		const auto Size = static_cast<size_t>(Reader.Read<uint64_t>());
+		if (!Reader.CanRead(Size))
+			return Fail("truncated record");
+		const auto Data = Reader.Skip(Size);
+		Record.Commands.m_Data.assign(Data, Data + Size);
+	}
+
+	// Recreate the objects, every object only refers to ones recorded before it
+	auto Loaded = std::make_unique<LoadedObjects>();
+	Loaded->PipelineShaders.reserve(Objects.size());
+	const PSO* BundlePipeline = nullptr;
+
+	for (uint32_t Id = 0; Id < Objects.size(); ++Id)
+	{
+		auto& Entry = Objects[Id];
+		auto Description = StreamReader(Entry.Description);
+		const auto Name = L"Command trace object " + std::to_wstring(Id);
+
+		switch (Entry.Type)
+		{
+		case ObjectType::RootSignature:
+		{
+			auto& Signature = *Loaded->RootSignatures.emplace_back(std::make_unique<RootSignature>());
+			const auto NumParameters = Description.Read<UINT>();
+			const auto NumSamplers = Description.Read<UINT>();
+			if (Description.IsOverrun() || NumParameters > 16 || NumSamplers > 2032)
+				return Fail("corrupt root signature");
+
+			Signature.Reset(NumParameters, NumSamplers);
+			for (UINT i = 0; i < NumParameters; ++i)
+			{
+				auto& Param = Signature[i];
+				const auto Type = Description.Read<D3D12_ROOT_PARAMETER_TYPE>();
+				const auto Visibility = Description.Read<D3D12_SHADER_VISIBILITY>();
+				if (Type == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+				{
+					const auto NumRanges = std::min(Description.Read<uint32_t>(), 64u);
+					Param.InitAsDescriptorTable(NumRanges, Visibility);
+					for (uint32_t r = 0; r < NumRanges; ++r)
+					{
+						const auto Range = Description.Read<D3D12_DESCRIPTOR_RANGE>();
+						Param.SetTableRange(r, Range.RangeType, Range.BaseShaderRegister, Range.NumDescriptors, Range.RegisterSpace);
+					}
+				}
+				else if (Type == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+				{
+					const auto Constants = Description.Read<D3D12_ROOT_CONSTANTS>();
+					Param.InitAsConstants(Constants.ShaderRegister, Constants.Num32BitValues, Visibility);
+				}
+				else
+				{
+					const auto Descriptor = Description.Read<D3D12_ROOT_DESCRIPTOR>();
+					if (Type == D3D12_ROOT_PARAMETER_TYPE_CBV)
+						Param.InitAsConstantBuffer(Descriptor.ShaderRegister, Visibility);
+					else if (Type == D3D12_ROOT_PARAMETER_TYPE_SRV)
+						Param.InitAsBufferSRV(Descriptor.ShaderRegister, Visibility);
+					else
+						Param.InitAsBufferUAV(Descriptor.ShaderRegister, Visibility);
+				}
+			}
+
+			for (UINT i = 0; i < NumSamplers; ++i)
+				Signature.m_SamplerArray[i] = Description.Read<D3D12_STATIC_SAMPLER_DESC>();
+			Signature.m_NumInitializedStaticSamplers = NumSamplers;
+
+			if (Description.IsOverrun())
+				return Fail("corrupt root signature");
+			Signature.Finalize(Name);
+			Entry.Signature = &Signature;
+			break;
+		}
+
+		case ObjectType::PipelineState:
+		{
+			// The recording device doesn't run shaders, so every pipeline is recreated as a compute
+			// pipeline; binding it costs the engine the same as binding the original
+			const auto SignatureId = Description.Read<uint32_t>();
+			if (Description.IsOverrun() || SignatureId >= Id || Objects[SignatureId].Type != ObjectType::RootSignature)
+				return Fail("pipeline without a root signature");
+
+			auto& Pipeline = *Loaded->Pipelines.emplace_back(std::make_unique<ComputePSO>());
+			const auto& Shader = Loaded->PipelineShaders.emplace_back(Id);
+			Pipeline.SetRootSignature(*Objects[SignatureId].Signature);
+			Pipeline.SetComputeShader(&Shader, sizeof(Shader));
+			Pipeline.Finalize();
+			Entry.Pipeline = &Pipeline;
+			BundlePipeline = &Pipeline;
+			break;
+		}
+
+		case ObjectType::Resource:
+		case ObjectType::ColorBuffer:
+		case ObjectType::DepthBuffer:
+		{
+			const auto Resource = Description.Read<ResourceDescription>();
+			const auto NumSubresourceStates = Description.Read<uint32_t>();
+			if (!Description.CanRead(size_t(NumSubresourceStates) * sizeof(D3D12_RESOURCE_STATES)))
+				return Fail("corrupt resource");
+			auto SubresourceStates = std::vector<D3D12_RESOURCE_STATES>(NumSubresourceStates);
+			for (auto& State : SubresourceStates)
+				State = Description.Read<D3D12_RESOURCE_STATES>();
+			const auto Pixel = Entry.Type != ObjectType::Resource ? Description.Read<PixelBufferDescription>() : PixelBufferDescription{};
+			if (Description.IsOverrun())
+				return Fail("corrupt resource");
+
+			GpuResource* Created = nullptr;
+			if (Entry.Type == ObjectType::Resource)
+			{
+				Microsoft::WRL::ComPtr<ID3D12Resource> pResource;
+				const auto HeapProperties = CD3DX12_HEAP_PROPERTIES(Resource.HeapType);
+				ASSERT_SUCCEEDED(g_Device->CreateCommittedResource(&HeapProperties, D3D12_HEAP_FLAG_NONE, &Resource.Desc,
+					Resource.State, nullptr, IID_PPV_ARGS(&pResource)));
+
+				Created = Loaded->Resources.emplace_back(std::make_unique<GpuResource>(pResource.Get(), Resource.State)).get();
+				if (Resource.Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+					Created->m_GpuVirtualAddress = pResource->GetGPUVirtualAddress();
+			}
+			else
+			{
+				if (Entry.Type == ObjectType::ColorBuffer)
+				{
+					auto& Buffer = *Loaded->ColorBuffers.emplace_back(std::make_unique<ColorBuffer>(
+						Color(Pixel.ClearColor.x, Pixel.ClearColor.y, Pixel.ClearColor.z, Pixel.ClearColor.w)));
+					if (Pixel.ArraySize > 1)
+						Buffer.CreateArray(Name, Pixel.Width, Pixel.Height, Pixel.ArraySize, Pixel.Format);
+					else
+						Buffer.Create(Name, Pixel.Width, Pixel.Height, Pixel.NumMips, Pixel.Format);
+					Created = &Buffer;
+				}
+				else
+				{
+					auto& Buffer = *Loaded->DepthBuffers.emplace_back(std::make_unique<DepthBuffer>(Pixel.ClearDepth, Pixel.ClearStencil));
+					Buffer.Create(Name, Pixel.Width, Pixel.Height, Pixel.Format);
+					Created = &Buffer;
+				}
+			}
+
+			// Replayed transitions start from the states the resource was in when it was captured
+			Created->m_UsageState = Resource.State;
+			Created->m_SubresourceStates = std::move(SubresourceStates);
+			Entry.Resource = Created;
+			break;
+		}
+
+		case ObjectType::CommandBundle:
+		case ObjectType::Descriptor:
+			break;
+		}
+	}
+
+	// Bundles only have to be executable, what the original recorded isn't part of the trace
+	for (auto& Entry : Objects)
+	{
+		if (Entry.Type == ObjectType::CommandBundle)
+		{
+			if (BundlePipeline == nullptr)
+				return Fail("bundle without a pipeline");
+			auto& Bundle = *Loaded->Bundles.emplace_back(std::make_unique<CommandBundle>());
+			Bundle.Begin(*BundlePipeline);
+			Bundle.End();
+			Entry.Bundle = &Bundle;
+		}
+		else if (Entry.Type == ObjectType::Descriptor)
+		{
+			const auto Type = StreamReader(Entry.Description).Read<D3D12_DESCRIPTOR_HEAP_TYPE>();
+			if (Type < 0 || Type >= D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES)
+				return Fail("corrupt descriptor");
+			Entry.Descriptor = AllocateDescriptor(Type);
+			Loaded->Descriptors.emplace_back(Type, Entry.Descriptor);
+		}
+	}
+
+	auto lg = std::lock_guard{ m_Mutex };
+	m_Objects = std::move(Objects);
+	m_Records = std::move(Records);
+	m_LoadedObjects = std::move(Loaded);
+
+	Utility::Printf(L"Loaded command trace {}: ", FileName);
+	Utility::Printf("{} contexts and {} objects\n", m_Records.size(), m_Objects.size());
+	return true;
+}
+
+void CommandTrace::ReplayRecord(const Record& Record)
+{
+	auto& Context = Record.Type == D3D12_COMMAND_LIST_TYPE_DIRECT
+		? CommandContext::Begin(Record.ID)
+		: ComputeContext::Begin(Record.ID, true);
+
+	// Draws only ever come from graphics contexts and dispatches from compute ones, so the context
+	// can be viewed as either without checking the queue type
+	auto& GfxContext = reinterpret_cast<GraphicsContext&>(Context);
+	auto& CptContext = reinterpret_cast<ComputeContext&>(Context);
+
+	StreamReader Reader(Record.Commands.m_Data);
+	size_t Size = 0;
+
+	auto ReadObject = [&](ObjectType Type) -> const Object&
+	{
+		const auto Id = Reader.Read<uint32_t>();
+		ASSERT(Id < m_Objects.size() && m_Objects[Id].Type == Type, "Invalid object in command trace");
+		return m_Objects[Id];
+	};
+
+	// Pixel buffers can be used wherever a resource is expected
+	auto ReadResource = [&](void) -> GpuResource&
+	{
+		const auto Id = Reader.Read<uint32_t>();
+		ASSERT(Id < m_Objects.size() && m_Objects[Id].Type >= ObjectType::Resource && m_Objects[Id].Type <= ObjectType::DepthBuffer,
+			"Invalid resource in command trace");
+		return *m_Objects[Id].Resource;
+	};
+
+	auto ReadDescriptors = [&](void) -> UINT
+	{
+		const auto Count = Reader.Read<UINT>();
+		m_ReplayHandles.resize(Count);
+		for (auto& Handle : m_ReplayHandles)
+			Handle = ReadObject(ObjectType::Descriptor).Descriptor;
+		return Count;
+	};
+
+	while (!Reader.IsDone() && !Reader.IsOverrun())
+	{
+		const auto Command = Reader.Read<Op>();
+		bool IsCompute = false;
+		if (Command <= Op::LastSharedCommand)
+			IsCompute = Reader.Read<bool>();
+
+		switch (Command)
+		{
+		case Op::SetRootSignature:
+		{
+			const auto& RootSig = *ReadObject(ObjectType::RootSignature).Signature;
+			IsCompute ? CptContext.SetRootSignature(RootSig) : GfxContext.SetRootSignature(RootSig);
+			break;
+		}
+		case Op::SetPipelineState:
+			Context.SetPipelineState(*ReadObject(ObjectType::PipelineState).Pipeline);
+			break;
+		case Op::SetConstantArray:
+		{
+			const auto RootIndex = Reader.Read<UINT>();
+			const auto Constants = Reader.ReadData(Size);
+			IsCompute
+				? CptContext.SetConstantArray(RootIndex, static_cast<UINT>(Size / 4), Constants)
+				: GfxContext.SetConstantArray(RootIndex, static_cast<UINT>(Size / 4), Constants);
+			break;
+		}
+		case Op::SetConstant:
+		{
+			const auto RootIndex = Reader.Read<UINT>();
+			const auto Value = Reader.Read<UINT>();
+			const auto Offset = Reader.Read<UINT>();
+			IsCompute ? CptContext.SetConstant(RootIndex, Value, Offset) : GfxContext.SetConstant(RootIndex, Value, Offset);
+			break;
+		}
+		case Op::SetConstantBuffer:
+		case Op::SetBufferSRV:
+		case Op::SetBufferUAV:
+		{
+			// Root views are replayed by address, the buffer they were bound from isn't recorded
+			const auto RootIndex = Reader.Read<UINT>();
+			const auto Address = Reader.Read<D3D12_GPU_VIRTUAL_ADDRESS>();
+			auto CommandList = Context.m_CommandList;
+			if (Command == Op::SetConstantBuffer)
+				IsCompute ? CommandList->SetComputeRootConstantBufferView(RootIndex, Address) : CommandList->SetGraphicsRootConstantBufferView(RootIndex, Address);
+			else if (Command == Op::SetBufferSRV)
+				IsCompute ? CommandList->SetComputeRootShaderResourceView(RootIndex, Address) : CommandList->SetGraphicsRootShaderResourceView(RootIndex, Address);
+			else
+				IsCompute ? CommandList->SetComputeRootUnorderedAccessView(RootIndex, Address) : CommandList->SetGraphicsRootUnorderedAccessView(RootIndex, Address);
+			break;
+		}
+		case Op::SetDynamicConstantBufferView:
+		{
+			const auto RootIndex = Reader.Read<UINT>();
+			const auto Data = Reader.ReadData(Size);
+			IsCompute ? CptContext.SetDynamicConstantBufferView(RootIndex, Size, Data) : GfxContext.SetDynamicConstantBufferView(RootIndex, Size, Data);
+			break;
+		}
+		case Op::SetDynamicSRV:
+		{
+			const auto RootIndex = Reader.Read<UINT>();
+			const auto BufferSize = Reader.Read<size_t>();
+			const auto Data = Reader.ReadData(Size);
+			IsCompute ? CptContext.SetDynamicSRV(RootIndex, BufferSize, Data) : GfxContext.SetDynamicSRV(RootIndex, BufferSize, Data);
+			break;
+		}
+		case Op::SetDescriptorTable:
+		{
+			const auto RootIndex = Reader.Read<UINT>();
+			const auto Handle = Reader.Read<D3D12_GPU_DESCRIPTOR_HANDLE>();
+			IsCompute ? CptContext.SetDescriptorTable(RootIndex, Handle) : GfxContext.SetDescriptorTable(RootIndex, Handle);
+			break;
+		}
+		case Op::SetDynamicDescriptors:
+		case Op::SetDynamicSamplers:
+		{
+			const auto RootIndex = Reader.Read<UINT>();
+			const auto Offset = Reader.Read<UINT>();
+			const auto Count = ReadDescriptors();
+			const auto Handles = m_ReplayHandles.data();
+			if (Command == Op::SetDynamicSamplers)
+				GfxContext.SetDynamicSamplers(RootIndex, Offset, Count, Handles);
+			else
+				IsCompute ? CptContext.SetDynamicDescriptors(RootIndex, Offset, Count, Handles) : GfxContext.SetDynamicDescriptors(RootIndex, Offset, Count, Handles);
+			break;
+		}
+		case Op::SetIndexBuffer:
+			GfxContext.SetIndexBuffer(Reader.Read<D3D12_INDEX_BUFFER_VIEW>());
+			break;
+		case Op::SetVertexBuffers:
+		{
+			const auto StartSlot = Reader.Read<UINT>();
+			const auto Views = Reader.ReadData<D3D12_VERTEX_BUFFER_VIEW>(Size);
+			GfxContext.SetVertexBuffers(StartSlot, static_cast<UINT>(Size / sizeof(D3D12_VERTEX_BUFFER_VIEW)), Views);
+			break;
+		}
+		case Op::SetDynamicVB:
+		{
+			const auto Slot = Reader.Read<UINT>();
+			const auto NumVertices = Reader.Read<size_t>();
+			const auto VertexStride = Reader.Read<size_t>();
+			GfxContext.SetDynamicVB(Slot, NumVertices, VertexStride, Reader.ReadData(Size));
+			break;
+		}
+		case Op::SetDynamicIB:
+		{
+			const auto IndexCount = Reader.Read<size_t>();
+			GfxContext.SetDynamicIB(IndexCount, Reader.ReadData<uint16_t>(Size));
+			break;
+		}
+		case Op::SetRenderTargets:
+		{
+			const bool HasDSV = ReadDescriptors() > 0;
+			const auto DSV = HasDSV ? m_ReplayHandles[0] : D3D12_CPU_DESCRIPTOR_HANDLE{};
+			const auto NumRTVs = ReadDescriptors();
+			HasDSV ? GfxContext.SetRenderTargets(NumRTVs, m_ReplayHandles.data(), DSV) : GfxContext.SetRenderTargets(NumRTVs, m_ReplayHandles.data());
+			break;
+		}
+		case Op::SetViewport:
+			GfxContext.SetViewport(Reader.Read<D3D12_VIEWPORT>());
+			break;
+		case Op::SetScissor:
+			GfxContext.SetScissor(Reader.Read<D3D12_RECT>());
+			break;
+		case Op::SetStencilRef:
+			GfxContext.SetStencilRef(Reader.Read<UINT>());
+			break;
+		case Op::SetBlendFactor:
+		{
+			const auto Factor = Reader.Read<DirectX::XMFLOAT4>();
+			GfxContext.SetBlendFactor(Color(Factor.x, Factor.y, Factor.z, Factor.w));
+			break;
+		}
+		case Op::SetPrimitiveTopology:
+			GfxContext.SetPrimitiveTopology(Reader.Read<D3D12_PRIMITIVE_TOPOLOGY>());
+			break;
+		case Op::ClearColor:
+			GfxContext.ClearColor(static_cast<ColorBuffer&>(*ReadObject(ObjectType::ColorBuffer).Resource));
+			break;
+		case Op::ClearDepth:
+			GfxContext.ClearDepth(static_cast<DepthBuffer&>(*ReadObject(ObjectType::DepthBuffer).Resource));
+			break;
+		case Op::TransitionResource:
+		{
+			auto& Resource = ReadResource();
+			const auto NewState = Reader.Read<D3D12_RESOURCE_STATES>();
+			Context.TransitionResource(Resource, NewState, Reader.Read<bool>());
+			break;
+		}
+		case Op::TransitionSubresource:
+		{
+			auto& Resource = ReadResource();
+			const auto Subresource = Reader.Read<UINT>();
+			const auto NewState = Reader.Read<D3D12_RESOURCE_STATES>();
+			Context.TransitionSubresource(Resource, Subresource, NewState, Reader.Read<bool>());
+			break;
+		}
+		case Op::BeginResourceTransition:
+		{
+			auto& Resource = ReadResource();
+			const auto NewState = Reader.Read<D3D12_RESOURCE_STATES>();
+			Context.BeginResourceTransition(Resource, NewState, Reader.Read<bool>());
+			break;
+		}
+		case Op::InsertUAVBarrier:
+		{
+			auto& Resource = ReadResource();
+			Context.InsertUAVBarrier(Resource, Reader.Read<bool>());
+			break;
+		}
+		case Op::DrawInstanced:
+		{
+			const auto Args = Reader.Read<D3D12_DRAW_ARGUMENTS>();
+			GfxContext.DrawInstanced(Args.VertexCountPerInstance, Args.InstanceCount, Args.StartVertexLocation, Args.StartInstanceLocation);
+			break;
+		}
+		case Op::DrawIndexedInstanced:
+		{
+			const auto Args = Reader.Read<D3D12_DRAW_INDEXED_ARGUMENTS>();
+			GfxContext.DrawIndexedInstanced(Args.IndexCountPerInstance, Args.InstanceCount, Args.StartIndexLocation, Args.BaseVertexLocation, Args.StartInstanceLocation);
+			break;
+		}
+		case Op::Dispatch:
+		{
+			const auto Args = Reader.Read<D3D12_DISPATCH_ARGUMENTS>();
+			CptContext.Dispatch(Args.ThreadGroupCountX, Args.ThreadGroupCountY, Args.ThreadGroupCountZ);
+			break;
+		}
+		case Op::ExecuteBundle:
+			GfxContext.ExecuteBundle(*ReadObject(ObjectType::CommandBundle).Bundle);
+			break;
+		default:
+			ASSERT(false, "Unknown command in trace");
+			break;
+		}
+	}
+
+	ASSERT(!Reader.IsOverrun(), "Truncated command trace");
+	Context.Finish();
+}
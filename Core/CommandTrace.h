@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+
+class RootSignature;
+class PSO;
+class GpuResource;
+class ColorBuffer;
+class DepthBuffer;
+class CommandBundle;
+
+// Captures the high-level calls made on command contexts during one frame, so the CPU side of
+// submitting that frame (state filtering, dynamic descriptor commits, barrier batching) can be
+// re-issued in a loop and profiled deterministically.
+//
+// Only contexts begun with an ID while a capture is running are traced; unnamed contexts are
+// one-off uploads and readbacks whose raw command list work can't be replayed. Root signatures,
+// PSOs, resources, bundles and CPU descriptors are recorded as IDs into an object table, which
+// also keeps what is needed to recreate them. In the capturing session IDs resolve to the captured
+// objects, which must still be alive; a trace loaded from a file resolves them to objects created
+// from the table on the recording backend (see TraceReplay). Data passed by value (constants,
+// dynamic vertex/index/constant buffers) is copied into the trace. GPU virtual addresses and GPU
+// descriptor handles are kept as they were, they are only passed through to the command list.
+class CommandTrace
+{
+public:
+	// Commands up to LastSharedCommand exist on both graphics and compute contexts and record
+	// which of the two issued them, since a compute context can also run on the direct queue
+	enum class Op : uint8_t
+	{
+		SetRootSignature,
+		SetConstantArray,
+		SetConstant,
+		SetConstantBuffer,
+		SetBufferSRV,
+		SetBufferUAV,
+		SetDynamicConstantBufferView,
+		SetDynamicSRV,
+		SetDescriptorTable,
+		SetDynamicDescriptors,
+		LastSharedCommand = SetDynamicDescriptors,
+
+		SetPipelineState,
+		SetDynamicSamplers,
+		SetIndexBuffer,
+		SetVertexBuffers,
+		SetDynamicVB,
+		SetDynamicIB,
+		SetRenderTargets,
+		SetViewport,
+		SetScissor,
+		SetStencilRef,
+		SetBlendFactor,
+		SetPrimitiveTopology,
+		ClearColor,
+		ClearDepth,
+		TransitionResource,
+		TransitionSubresource,
+		BeginResourceTransition,
+		InsertUAVBarrier,
+		DrawInstanced,
+		DrawIndexedInstanced,
+		Dispatch,
+		ExecuteBundle,
+	};
+
+	enum class ObjectType : uint8_t
+	{
+		RootSignature,
+		PipelineState,
+		Resource,
+		ColorBuffer,
+		DepthBuffer,
+		CommandBundle,
+		Descriptor,
+	};
+
+	// Compact binary encoding of the commands of one context. Arguments are stored as their raw
+	// bytes and objects as their ID; arrays are prefixed with their size and 16-byte aligned so they
+	// can be handed back to the SIMD copies in CommandContext without another copy.
+	class Stream
+	{
+	public:
+		template <typename... Args>
+		void Write(Op Command, const Args&... Arguments)
+		{
+			WriteValue(Command);
+			(WriteValue(Arguments), ...);
+		}
+
+		void WriteData(const void* Data, size_t Size);
+		void WriteDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE Type, const D3D12_CPU_DESCRIPTOR_HANDLE* Handles, UINT Count);
+
+		bool IsEmpty(void) const { return m_Data.empty(); }
+		size_t GetSize(void) const { return m_Data.size(); }
+		void Clear(void) { m_Data.clear(); }
+
+	private:
+		friend CommandTrace;
+
+		template <typename T>
+		void WriteValue(const T& Value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			static_assert(!std::is_pointer_v<T>, "Objects are recorded by ID, add an overload for the type");
+			const auto Bytes = reinterpret_cast<const uint8_t*>(&Value);
+			m_Data.insert(m_Data.end(), Bytes, Bytes + sizeof(T));
+		}
+
+		void WriteValue(const RootSignature* Object);
+		void WriteValue(const PSO* Object);
+		void WriteValue(GpuResource* Object);
+		void WriteValue(ColorBuffer* Object);
+		void WriteValue(DepthBuffer* Object);
+		void WriteValue(CommandBundle* Object);
+
+		std::vector<uint8_t> m_Data;
+	};
+
+	CommandTrace();
+	~CommandTrace();
+
+	// Starts capturing at the next frame boundary; the capture ends at the one after
+	void CaptureNextFrame(void);
+	bool IsCapturing(void) const { return m_State.load(std::memory_order_relaxed) == State::Capturing; }
+	bool HasTrace(void) const;
+
+	// Called by Graphics::Present at the end of every frame
+	void EndFrame(void);
+
+	// Called by CommandContext::Finish with the commands of a traced context, in submission order
+	void Submit(D3D12_COMMAND_LIST_TYPE Type, const std::wstring& ID, Stream& Commands);
+
+	// Re-issues the captured frame Loops times and prints the average CPU time per frame
+	void Replay(uint32_t Loops);
+
+	// Writes the trace and its object table. Returns false if there is no trace or the file can't be written.
+	bool Save(const std::wstring& FileName) const;
+	// Replaces the trace with one read from a file and recreates the objects it uses. Only
+	// available on the recording backend, see Graphics::eBackend.
+	bool Load(const std::wstring& FileName);
+
+	void Clear(void);
+
+private:
+	enum class State { Idle, Armed, Capturing };
+
+	struct Record
+	{
+		D3D12_COMMAND_LIST_TYPE Type;
+		std::wstring ID;
+		Stream Commands;
+	};
+
+	struct Object
+	{
+		ObjectType Type;
+		union
+		{
+			const RootSignature* Signature;
+			const PSO* Pipeline;
+			// Color and depth buffers too
+			GpuResource* Resource;
+			CommandBundle* Bundle;
+			D3D12_CPU_DESCRIPTOR_HANDLE Descriptor;
+		};
+		// What Load needs to recreate the object, written when the object is first recorded
+		std::vector<uint8_t> Description;
+	};
+
+	// Objects created by Load, see CommandTrace.cpp
+	struct LoadedObjects;
+
+	// Return the ID of an object, adding it to the table on first use. m_Mutex must be held.
+	uint32_t GetObjectId(const RootSignature& Signature);
+	uint32_t GetObjectId(const PSO& Pipeline);
+	uint32_t GetObjectId(GpuResource& Resource, ObjectType Type);
+	uint32_t GetObjectId(CommandBundle& Bundle);
+	uint32_t GetObjectId(D3D12_DESCRIPTOR_HEAP_TYPE Type, D3D12_CPU_DESCRIPTOR_HANDLE Descriptor);
+
+	void ReplayRecord(const Record& Record);
+
+	std::atomic<State> m_State = State::Idle;
+	mutable std::mutex m_Mutex;
+	std::vector<Record> m_Records;
+
+	std::vector<Object> m_Objects;
+	std::unordered_map<const void*, uint32_t> m_ObjectIds;
+	std::unordered_map<SIZE_T, uint32_t> m_DescriptorIds;
+	std::unique_ptr<LoadedObjects> m_LoadedObjects;
+	// Descriptor IDs resolved to handles for the context call being replayed
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_ReplayHandles;
+};
+
+namespace Graphics
+{
+	extern CommandTrace g_CommandTrace;
+}
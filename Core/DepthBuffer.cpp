@@ -13,6 +13,23 @@ void DepthBuffer::Create(const std::wstring& Name, uint32_t Width, uint32_t Heig
 	CreateDerivedViews(Graphics::g_Device, Format);
 }
 
+void DepthBuffer::Destroy(void)
+{
+	PixelBuffer::Destroy();
+
+	// Without a stencil the read-only stencil views alias the depth ones
+	const uint32_t NumDSVs = m_hDSV[2].ptr == m_hDSV[0].ptr ? 2 : 4;
+	for (uint32_t i = 0; i < NumDSVs; ++i)
+		Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, m_hDSV[i]);
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hDepthSRV);
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hStencilSRV);
+
+	for (auto& DSV : m_hDSV)
+		DSV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	m_hDepthSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	m_hStencilSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+}
+
 void DepthBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format)
 {
 	auto Resource = m_pResource.Get();
@@ -9,10 +9,29 @@ public:
 		: m_ClearDepth(ClearDepth), m_ClearStencil(ClearStencil)
 	{}
 
+	virtual ~DepthBuffer() { Destroy(); }
+
+	// The views travel with the resource; whatever the target held is released by the source
+	DepthBuffer(DepthBuffer&& Other) noexcept
+		: PixelBuffer(std::move(Other)), m_ClearDepth(Other.m_ClearDepth), m_ClearStencil(Other.m_ClearStencil)
+	{
+		SwapContents(Other);
+	}
+	DepthBuffer& operator=(DepthBuffer&& Other) noexcept
+	{
+		PixelBuffer::operator=(std::move(Other));
+		m_ClearDepth = Other.m_ClearDepth;
+		m_ClearStencil = Other.m_ClearStencil;
+		SwapContents(Other);
+		return *this;
+	}
+
 	// Create a depth buffer.  If an address is supplied, memory will not be allocated.
 	void Create(const std::wstring& Name, uint32_t Width, uint32_t Height, DXGI_FORMAT Format,
 		D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN);
 
+	void Destroy(void) override;
+
 	auto& GetDSV() const { return m_hDSV[0]; }
 	auto& GetDSV_DepthReadOnly() const { return m_hDSV[1]; }
 	auto& GetDSV_StencilRealOnly() const { return m_hDSV[2]; }
@@ -26,9 +45,17 @@ public:
 private:
 	void CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format);
 
+	void SwapContents(DepthBuffer& Other) noexcept
+	{
+		std::swap(m_hDSV, Other.m_hDSV);
+		std::swap(m_hDepthSRV, Other.m_hDepthSRV);
+		std::swap(m_hStencilSRV, Other.m_hStencilSRV);
+	}
+
 	float m_ClearDepth;
 	uint8_t m_ClearStencil;
-	D3D12_CPU_DESCRIPTOR_HANDLE m_hDSV[4] = { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN };
+	D3D12_CPU_DESCRIPTOR_HANDLE m_hDSV[4] = { { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN }, { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN },
+		{ D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN }, { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN } };
 	D3D12_CPU_DESCRIPTOR_HANDLE m_hDepthSRV = { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN };
 	D3D12_CPU_DESCRIPTOR_HANDLE m_hStencilSRV = { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN };
 };
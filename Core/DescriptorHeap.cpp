@@ -1,14 +1,17 @@
 #include "pch.h"
 #include "DescriptorHeap.h"
 #include "GraphicsCore.h"
+#include "CommandListManager.h"
 
 using namespace Graphics;
 
 std::mutex DescriptorAllocator::sm_AllocationMutex;
 std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DescriptorAllocator::sm_DescriptorHeapPool;
+bool DescriptorAllocator::sm_Destroyed = false;
 
 void DescriptorAllocator::DestroyAll(void)
 {
+    sm_Destroyed = true;
     sm_DescriptorHeapPool.clear();
 }
 
@@ -30,18 +33,98 @@ ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(D3D12_DESCRIPTOR_HEAP_
 
 D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate(uint32_t Count)
 {
-    if (m_CurrentHeap == nullptr || m_RemainingFreeHandles < Count)
+    ASSERT(Count > 0 && Count <= sm_NumDescriptorsPerHeap);
+
+    const uint32_t SizeClass = GetSizeClass(Count);
+    const uint32_t BlockSize = 1u << SizeClass;
+
+    auto lg = std::lock_guard{ m_Mutex };
+
+    m_Stats.NumAllocated += BlockSize;
+
+    auto& FreeList = m_FreeLists[SizeClass];
+    if (!FreeList.empty())
     {
-        m_CurrentHeap = RequestNewHeap(m_Type);
-        m_CurrentHandle = m_CurrentHeap->GetCPUDescriptorHandleForHeapStart();
-        m_RemainingFreeHandles = sm_NumDescriptorsPerHeap;
+        D3D12_CPU_DESCRIPTOR_HANDLE ret = FreeList.back();
+        FreeList.pop_back();
+        m_Stats.NumFree -= BlockSize;
+        return ret;
+    }
 
+    if (m_CurrentHeap == nullptr || m_RemainingFreeHandles < BlockSize)
+    {
         if (m_DescriptorSize == 0)
             m_DescriptorSize = Graphics::g_Device->GetDescriptorHandleIncrementSize(m_Type);
+
+        // Whatever is left of the current heap goes to the smaller size classes
+        while (m_RemainingFreeHandles > 0)
+        {
+            unsigned long TailClass;
+            _BitScanReverse(&TailClass, m_RemainingFreeHandles);
+            AddFreeBlock(m_CurrentHandle, TailClass);
+            m_CurrentHandle.ptr += (1ull << TailClass) * m_DescriptorSize;
+            m_RemainingFreeHandles -= 1u << TailClass;
+        }
+
+        m_CurrentHeap = RequestNewHeap(m_Type);
+        m_CurrentHandle = m_CurrentHeap->GetCPUDescriptorHandleForHeapStart();
+        m_RemainingFreeHandles = sm_NumDescriptorsPerHeap;
+        ++m_Stats.NumHeaps;
     }
 
     D3D12_CPU_DESCRIPTOR_HANDLE ret = m_CurrentHandle;
-    m_CurrentHandle.ptr += Count * m_DescriptorSize;
-    m_RemainingFreeHandles -= Count;
+    m_CurrentHandle.ptr += BlockSize * m_DescriptorSize;
+    m_RemainingFreeHandles -= BlockSize;
     return ret;
 }
+
+void DescriptorAllocator::Free(D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count)
+{
+    if (Handle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN || sm_Destroyed)
+        return;
+
+    const uint32_t SizeClass = GetSizeClass(Count);
+
+    auto lg = std::lock_guard{ m_Mutex };
+    m_PendingFrees.emplace_back(Handle, SizeClass);
+    m_Stats.NumAllocated -= 1u << SizeClass;
+    m_Stats.NumPendingFree += 1u << SizeClass;
+}
+
+void DescriptorAllocator::EndFrame(uint64_t FrameFenceValue)
+{
+    auto lg = std::lock_guard{ m_Mutex };
+
+    if (m_PendingFrees.empty())
+        return;
+
+    g_CommandManager.OnFenceComplete(FrameFenceValue, [this, Frees = std::move(m_PendingFrees)]
+    {
+        auto lg = std::lock_guard{ m_Mutex };
+        for (const auto& [Handle, SizeClass] : Frees)
+        {
+            AddFreeBlock(Handle, SizeClass);
+            m_Stats.NumPendingFree -= 1u << SizeClass;
+        }
+    });
+    m_PendingFrees.clear();
+}
+
+DescriptorAllocator::Stats DescriptorAllocator::GetStats(void) const
+{
+    auto lg = std::lock_guard{ m_Mutex };
+    return m_Stats;
+}
+
+uint32_t DescriptorAllocator::GetSizeClass(uint32_t Count)
+{
+    unsigned long HighBit;
+    _BitScanReverse(&HighBit, Count);
+    return (Count & (Count - 1)) == 0 ? HighBit : HighBit + 1;
+}
+
+void DescriptorAllocator::AddFreeBlock(D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t SizeClass)
+{
+    m_FreeLists[SizeClass].push_back(Handle);
+    m_Stats.NumFree += 1u << SizeClass;
+}
@@ -5,27 +5,58 @@
 #include <queue>
 #include <string>
 
+// Hands out CPU-only descriptors from a growing set of heaps. Freed ranges go on a free-list per
+// power-of-two size class, but only once the frame that freed them has completed: until then a
+// context may still copy from them into a shader-visible heap.
 class DescriptorAllocator
 {
 public:
+	// In descriptors, blocks are counted at their size class
+	struct Stats
+	{
+		uint32_t NumHeaps;
+		uint32_t NumAllocated;
+		uint32_t NumFree;
+		uint32_t NumPendingFree;
+	};
+
 	DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type) : m_Type(Type) {}
 
 	D3D12_CPU_DESCRIPTOR_HANDLE Allocate(uint32_t Count);
+	// Count must match the allocation; unassigned handles are ignored
+	void Free(D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count);
+
+	// Called by Graphics::Present: frees made during the frame become reusable once FrameFenceValue is reached
+	void EndFrame(uint64_t FrameFenceValue);
+
+	Stats GetStats(void) const;
 
 	static void DestroyAll(void);
 
 protected:
 
 	static const uint32_t sm_NumDescriptorsPerHeap = 256;
+	// Size classes of 1, 2, 4 ... sm_NumDescriptorsPerHeap descriptors
+	static const uint32_t sm_NumSizeClasses = 9;
 	static std::mutex sm_AllocationMutex;
 	static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool;
+	// Resources destroyed after DestroyAll have nothing left to return their handles to
+	static bool sm_Destroyed;
 	static ID3D12DescriptorHeap* RequestNewHeap(D3D12_DESCRIPTOR_HEAP_TYPE Type);
 
+	static uint32_t GetSizeClass(uint32_t Count);
+	void AddFreeBlock(D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t SizeClass);
+
 	D3D12_DESCRIPTOR_HEAP_TYPE m_Type;
 	ID3D12DescriptorHeap* m_CurrentHeap = nullptr;
 	D3D12_CPU_DESCRIPTOR_HANDLE m_CurrentHandle;
-	uint32_t m_DescriptorSize;
-	uint32_t m_RemainingFreeHandles;
+	uint32_t m_DescriptorSize = 0;
+	uint32_t m_RemainingFreeHandles = 0;
+
+	mutable std::mutex m_Mutex;
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_FreeLists[sm_NumSizeClasses];
+	std::vector<std::pair<D3D12_CPU_DESCRIPTOR_HANDLE, uint32_t>> m_PendingFrees;
+	Stats m_Stats = {};
 };
 
 class DescriptorHandle
@@ -4,122 +4,172 @@
 #include "GraphicsCore.h"
 #include "CommandListManager.h"
 
+#include <cstdlib>
+
 using namespace Graphics;
 
 std::mutex DynamicDescriptorHeap::sm_Mutex;
-std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DynamicDescriptorHeap::sm_DescriptorHeapPool[2];
-std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> DynamicDescriptorHeap::sm_RetiredDescriptorHeaps[2];
-std::queue<ID3D12DescriptorHeap*> DynamicDescriptorHeap::sm_AvailableDescriptorHeaps[2];
+std::condition_variable DynamicDescriptorHeap::sm_ChunkReleased;
+Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> DynamicDescriptorHeap::sm_DescriptorHeap[2];
+std::queue<uint32_t> DynamicDescriptorHeap::sm_AvailableChunks[2];
+uint32_t DynamicDescriptorHeap::sm_ReleasingChunks[2];
 
 DynamicDescriptorHeap::DynamicDescriptorHeap(CommandContext& OwningContext, D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
 	: m_OwningContext(OwningContext), m_DescriptorType(HeapType)
 {
 	m_DescriptorSize = Graphics::g_Device->GetDescriptorHandleIncrementSize(HeapType);
+	m_ChunkSize = HeapType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? kSamplerChunkSize : kViewChunkSize;
+	m_HeapPtr = GetOrCreateDescriptorHeap(HeapType);
+	m_FirstDescriptor = DescriptorHandle(
+		m_HeapPtr->GetCPUDescriptorHandleForHeapStart(),
+		m_HeapPtr->GetGPUDescriptorHandleForHeapStart());
+}
+
+void DynamicDescriptorHeap::DestroyAll(void)
+{
+	auto lg = std::lock_guard{ sm_Mutex };
+
+	for (uint32_t idx = 0; idx < 2; ++idx)
+	{
+		sm_DescriptorHeap[idx] = nullptr;
+		sm_AvailableChunks[idx] = {};
+		sm_ReleasingChunks[idx] = 0;
+	}
 }
 
 void DynamicDescriptorHeap::CleanupUsedHeaps(uint64_t fenceValue)
 {
-	RetireCurrentHeap();
-	RetireUsedHeaps(fenceValue);
+	RetireCurrentChunk();
+	RetireUsedChunks(fenceValue);
 	m_GraphicsHandleCache.ClearCache();
 	m_ComputeHandleCache.ClearCache();
 }
 
-ID3D12DescriptorHeap* DynamicDescriptorHeap::RequestDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
+ID3D12DescriptorHeap* DynamicDescriptorHeap::GetOrCreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
 {
 	auto lg = std::lock_guard{ sm_Mutex };
 
 	uint32_t idx = HeapType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
 
-	while (!sm_RetiredDescriptorHeaps[idx].empty() && g_CommandManager.IsFenceComplete(sm_RetiredDescriptorHeaps[idx].front().first))
+	if (sm_DescriptorHeap[idx] == nullptr)
 	{
-		sm_AvailableDescriptorHeaps[idx].push(sm_RetiredDescriptorHeaps[idx].front().second);
-		sm_RetiredDescriptorHeaps[idx].pop();
-	}
+		const uint32_t NumDescriptors = idx == 1 ? kNumSamplerDescriptors : kNumViewDescriptors;
+		const uint32_t ChunkSize = idx == 1 ? kSamplerChunkSize : kViewChunkSize;
 
-	if (!sm_AvailableDescriptorHeaps[idx].empty())
-	{
-		ID3D12DescriptorHeap* HeapPtr = sm_AvailableDescriptorHeaps[idx].front();
-		sm_AvailableDescriptorHeaps[idx].pop();
-		return HeapPtr;
-	}
-	else
-	{
 		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
 		HeapDesc.Type = HeapType;
-		HeapDesc.NumDescriptors = kNumDescriptorsPerHeap;
+		HeapDesc.NumDescriptors = NumDescriptors;
 		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 		HeapDesc.NodeMask = 1;
-		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> HeapPtr;
-		ASSERT_SUCCEEDED(g_Device->CreateDescriptorHeap(&HeapDesc, IID_PPV_ARGS(&HeapPtr)));
-		sm_DescriptorHeapPool[idx].emplace_back(HeapPtr);
-		return HeapPtr.Get();
+		ASSERT_SUCCEEDED(g_Device->CreateDescriptorHeap(&HeapDesc, IID_PPV_ARGS(&sm_DescriptorHeap[idx])));
+		sm_DescriptorHeap[idx]->SetName(idx == 1 ? L"Dynamic Sampler Heap" : L"Dynamic CBV/SRV/UAV Heap");
+
+		const uint32_t FirstChunk = idx == 1 ? Math::DivideByMultiple(kNumSharedSamplers, ChunkSize) : 0;
+		for (uint32_t Chunk = FirstChunk; Chunk < NumDescriptors / ChunkSize; ++Chunk)
+			sm_AvailableChunks[idx].push(Chunk);
 	}
+
+	return sm_DescriptorHeap[idx].Get();
 }
 
-void DynamicDescriptorHeap::DiscardDescriptorHeaps(D3D12_DESCRIPTOR_HEAP_TYPE HeapType, uint64_t FenceValue, const std::vector<ID3D12DescriptorHeap*>& UsedHeaps)
+DescriptorHandle DynamicDescriptorHeap::GetSharedSamplerTable(void)
 {
-	uint32_t idx = HeapType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
-	auto lg = std::lock_guard{ sm_Mutex };
-	for (auto heap : UsedHeaps)
-		sm_RetiredDescriptorHeaps[idx].push(std::make_pair(FenceValue, heap));
+	ID3D12DescriptorHeap* HeapPtr = GetOrCreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+	return DescriptorHandle(HeapPtr->GetCPUDescriptorHandleForHeapStart(), HeapPtr->GetGPUDescriptorHandleForHeapStart());
 }
 
-void DynamicDescriptorHeap::RetireCurrentHeap(void)
+uint32_t DynamicDescriptorHeap::RequestChunk(D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
 {
-	if (m_CurrentOffset == 0)
+	auto lock = std::unique_lock{ sm_Mutex };
+
+	uint32_t idx = HeapType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
+
+	// Every chunk is referenced by command lists still in flight. Batched lists only reach the GPU
+	// when their queue is flushed, and other threads may batch more while this one waits.
+	while (sm_AvailableChunks[idx].empty())
 	{
-		ASSERT(m_CurrentHeapPtr == nullptr);
-		return;
+		// Nothing submitted will ever return a chunk, so waiting would never end. This fails in release
+		// builds as well rather than hang.
+		if (sm_ReleasingChunks[idx] == 0)
+		{
+			Utility::Printf("All dynamic {} descriptor chunks are held by contexts that haven't been finished\n",
+				idx == 1 ? "sampler" : "CBV/SRV/UAV");
+			__debugbreak();
+			std::abort();
+		}
+
+		lock.unlock();
+		g_CommandManager.FlushAll();
+		lock.lock();
+
+		sm_ChunkReleased.wait_for(lock, std::chrono::milliseconds(1), [idx] { return !sm_AvailableChunks[idx].empty(); });
 	}
 
-	ASSERT(m_CurrentHeapPtr != nullptr);
-	m_RetireHeaps.push_back(m_CurrentHeapPtr);
-	m_CurrentHeapPtr = nullptr;
-	m_CurrentOffset = 0;
+	uint32_t Chunk = sm_AvailableChunks[idx].front();
+	sm_AvailableChunks[idx].pop();
+	return Chunk;
 }
 
-void DynamicDescriptorHeap::RetireUsedHeaps(uint64_t fenceValue)
+void DynamicDescriptorHeap::DiscardChunks(D3D12_DESCRIPTOR_HEAP_TYPE HeapType, uint64_t FenceValue, const std::vector<uint32_t>& UsedChunks)
 {
-	DiscardDescriptorHeaps(m_DescriptorType, fenceValue, m_RetireHeaps);
-	m_RetireHeaps.clear();
-}
+	if (UsedChunks.empty())
+		return;
+
+	uint32_t idx = HeapType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0;
 
-inline ID3D12DescriptorHeap* DynamicDescriptorHeap::GetHeapPointer()
-{
-	if (m_CurrentHeapPtr == nullptr)
 	{
-		ASSERT(m_CurrentOffset == 0);
-		m_CurrentHeapPtr = RequestDescriptorHeap(m_DescriptorType);
-		m_FirstDescriptor = DescriptorHandle(
-			m_CurrentHeapPtr->GetCPUDescriptorHandleForHeapStart(),
-			m_CurrentHeapPtr->GetGPUDescriptorHandleForHeapStart());
+		auto lg = std::lock_guard{ sm_Mutex };
+		sm_ReleasingChunks[idx] += static_cast<uint32_t>(UsedChunks.size());
 	}
 
-	return m_CurrentHeapPtr;
+	// Chunks only become available once the GPU is done with them
+	g_CommandManager.OnFenceComplete(FenceValue, [idx, UsedChunks]
+	{
+		{
+			auto lg = std::lock_guard{ sm_Mutex };
+			for (auto Chunk : UsedChunks)
+				sm_AvailableChunks[idx].push(Chunk);
+			sm_ReleasingChunks[idx] -= static_cast<uint32_t>(UsedChunks.size());
+		}
+		sm_ChunkReleased.notify_all();
+	});
+}
+
+void DynamicDescriptorHeap::RetireCurrentChunk(void)
+{
+	// An untouched chunk stays with the context for its next command list
+	if (m_CurrentOffset == 0)
+		return;
+
+	ASSERT(m_CurrentChunk != kNoChunk);
+	m_RetiredChunks.push_back(m_CurrentChunk);
+	m_CurrentChunk = kNoChunk;
+	m_CurrentOffset = 0;
+}
+
+void DynamicDescriptorHeap::RetireUsedChunks(uint64_t fenceValue)
+{
+	DiscardChunks(m_DescriptorType, fenceValue, m_RetiredChunks);
+	m_RetiredChunks.clear();
 }
 
 void DynamicDescriptorHeap::CopyAndBindStagedTables(DescriptorHandleCache& HandleCache, ID3D12GraphicsCommandList* CmdList, void(__stdcall ID3D12GraphicsCommandList::* SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
 {
 	uint32_t NeededSize = HandleCache.ComputeStagedSize();
+	ASSERT(NeededSize <= m_ChunkSize, "Descriptor tables don't fit in a heap chunk");
+
+	// Tables already bound from the previous chunk stay valid since the heap itself doesn't change
 	if (!HasSpace(NeededSize))
 	{
-		RetireCurrentHeap();
-		UnbindAllValid();
-		NeededSize = HandleCache.ComputeStagedSize();
+		RetireCurrentChunk();
+		m_CurrentChunk = RequestChunk(m_DescriptorType);
 	}
 
-	// This can trigger the creation of a new heap
-	m_OwningContext.SetDescriptorHeap(m_DescriptorType, GetHeapPointer());
+	// Only rebinds if the context switched to a user heap in the meantime
+	m_OwningContext.SetDescriptorHeap(m_DescriptorType, m_HeapPtr);
 	HandleCache.CopyAndBindStaleTables(m_DescriptorType, m_DescriptorSize, Allocate(NeededSize), CmdList, SetFunc);
 }
 
-void DynamicDescriptorHeap::UnbindAllValid(void)
-{
-	m_GraphicsHandleCache.UnbindAllValid();
-	m_ComputeHandleCache.UnbindAllValid();
-}
-
 uint32_t DynamicDescriptorHeap::DescriptorHandleCache::ComputeStagedSize()
 {
 	uint32_t NeededSpace = 0;
@@ -238,20 +288,6 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 		Type);
 }
 
-void DynamicDescriptorHeap::DescriptorHandleCache::UnbindAllValid()
-{
-	m_StaleRootParamsBitMap = 0;
-
-	unsigned long TableParams = m_RootDescriptorTablesBitMap;
-	unsigned long RootIndex;
-	while (_BitScanForward(&RootIndex, TableParams))
-	{
-		TableParams ^= (1 << RootIndex);
-		if (m_RootDescriptorTable[RootIndex].AssignedHandlesBitMap != 0)
-			m_StaleRootParamsBitMap |= (1 << RootIndex);
-	}
-}
-
 void DynamicDescriptorHeap::DescriptorHandleCache::StageDescriptorHandles(UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[])
 {
 	ASSERT(((1 << RootIndex) & m_RootDescriptorTablesBitMap) != 0, "Root parameter is not a CBV_SRV_UAV descriptortable");
@@ -4,22 +4,29 @@
 #include "RootSignature.h"
 #include <vector>
 #include <queue>
+#include <condition_variable>
 
 namespace Graphics
 {
 	extern ID3D12Device* g_Device;
 }
 
+// Stages descriptor tables for a context and copies them into the shader-visible heap of their type
+// when a draw or dispatch needs them. There is a single such heap per type, shared by all contexts
+// and bound once per command list. It is carved into fixed-size chunks that contexts grab one at a
+// time and allocate from linearly; used chunks go back to the end of the free ring once the GPU
+// has finished the command list that referenced them.
 class DynamicDescriptorHeap
 {
 public:
 	DynamicDescriptorHeap(CommandContext& OwningContext, D3D12_DESCRIPTOR_HEAP_TYPE HeapType);
 
-	static void DestroyAll(void)
-	{
-		for (auto& pool : sm_DescriptorHeapPool)
-			pool.clear();
-	}
+	static void DestroyAll(void);
+
+	ID3D12DescriptorHeap* GetHeapPointer(void) const { return m_HeapPtr; }
+
+	// The front of the sampler heap is kept out of the ring for the shared sampler table
+	static DescriptorHandle GetSharedSamplerTable(void);
 
 	void CleanupUsedHeaps(uint64_t fenceValue);
 
@@ -57,22 +64,36 @@ public:
 
 private:
 
-	static const uint32_t kNumDescriptorsPerHeap = 1024;
+	// The largest heaps every device supports
+	static const uint32_t kNumViewDescriptors = D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1;
+	static const uint32_t kNumSamplerDescriptors = D3D12_MAX_SHADER_VISIBLE_SAMPLER_HEAP_SIZE;
+	// A chunk must hold the largest set of tables committed at once. Sampler chunks are small so the
+	// sampler heap is split into enough of them for every context that can be recording at once; the
+	// shared sampler table is bound from the start of the heap and doesn't take a chunk.
+	static const uint32_t kViewChunkSize = 1024;
+	static const uint32_t kSamplerChunkSize = 16;
+	static const uint32_t kNoChunk = ~0u;
+
 	static std::mutex sm_Mutex;
-	static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool[2];
-	static std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> sm_RetiredDescriptorHeaps[2];
-	static std::queue<ID3D12DescriptorHeap*> sm_AvailableDescriptorHeaps[2];
+	static std::condition_variable sm_ChunkReleased;
+	static Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> sm_DescriptorHeap[2];
+	static std::queue<uint32_t> sm_AvailableChunks[2];
+	// Chunks of submitted command lists that return once the GPU is done with them
+	static uint32_t sm_ReleasingChunks[2];
 
-	static ID3D12DescriptorHeap* RequestDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType);
-	static void DiscardDescriptorHeaps(D3D12_DESCRIPTOR_HEAP_TYPE HeapType, uint64_t FenceValueForReset, const std::vector<ID3D12DescriptorHeap*>& UsedHeaps);
+	static ID3D12DescriptorHeap* GetOrCreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType);
+	static uint32_t RequestChunk(D3D12_DESCRIPTOR_HEAP_TYPE HeapType);
+	static void DiscardChunks(D3D12_DESCRIPTOR_HEAP_TYPE HeapType, uint64_t FenceValueForReset, const std::vector<uint32_t>& UsedChunks);
 
 	CommandContext& m_OwningContext;
-	ID3D12DescriptorHeap* m_CurrentHeapPtr = nullptr;
 	const D3D12_DESCRIPTOR_HEAP_TYPE m_DescriptorType;
+	ID3D12DescriptorHeap* m_HeapPtr;
+	DescriptorHandle m_FirstDescriptor;
 	uint32_t m_DescriptorSize;
+	uint32_t m_ChunkSize;
+	uint32_t m_CurrentChunk = kNoChunk;
 	uint32_t m_CurrentOffset = 0;
-	DescriptorHandle m_FirstDescriptor;
-	std::vector<ID3D12DescriptorHeap*> m_RetireHeaps;
+	std::vector<uint32_t> m_RetiredChunks;
 
 	struct DescriptorTableCache
 	{
@@ -103,7 +124,6 @@ private:
 		DescriptorTableCache m_RootDescriptorTable[kMaxNumDescriptorTables];
 		D3D12_CPU_DESCRIPTOR_HANDLE m_HandleCache[kMaxNumDescriptors];
 
-		void UnbindAllValid();
 		void StageDescriptorHandles(UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[]);
 		void ParseRootSignature(D3D12_DESCRIPTOR_HEAP_TYPE Type, const RootSignature& RootSig);
 	};
@@ -113,23 +133,20 @@ private:
 
 	bool HasSpace(uint32_t Count)
 	{
-		return (m_CurrentHeapPtr != nullptr && m_CurrentOffset + Count <= kNumDescriptorsPerHeap);
+		return (m_CurrentChunk != kNoChunk && m_CurrentOffset + Count <= m_ChunkSize);
 	}
 
-	void RetireCurrentHeap(void);
-	void RetireUsedHeaps(uint64_t fenceValue);
-	ID3D12DescriptorHeap* GetHeapPointer();
+	void RetireCurrentChunk(void);
+	void RetireUsedChunks(uint64_t fenceValue);
 
 	DescriptorHandle Allocate(UINT Count)
 	{
-		DescriptorHandle ret = m_FirstDescriptor + m_CurrentOffset * m_DescriptorSize;
+		DescriptorHandle ret = m_FirstDescriptor + (m_CurrentChunk * m_ChunkSize + m_CurrentOffset) * m_DescriptorSize;
 		m_CurrentOffset += Count;
 		return ret;
 	}
 
 	void CopyAndBindStagedTables(DescriptorHandleCache& HandleCache, ID3D12GraphicsCommandList* CmdList,
 		void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::* SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE));
-
-	void UnbindAllValid(void);
 };
 
@@ -4,6 +4,7 @@
 #include "GameInput.h"
 #include "GpuTimeManager.h"
 #include "CommandContext.h"
+#include "ResidencyManager.h"
 
 using namespace Graphics;
 using namespace GraphRenderer;
@@ -55,6 +56,25 @@ public:
 	const float* GetHistory(void) const { return m_ExtendedHistory; }
 	uint32_t GetHistoryLength(void) const { return kExtendedHistorySize; }
 
+	// Value Fraction of the extended history doesn't exceed; hitches show up in the high ones
+	float GetPercentile(float Fraction) const
+	{
+		float Sorted[kExtendedHistorySize];
+		uint32_t ValidCount = 0;
+		for (float val : m_ExtendedHistory)
+		{
+			if (val > 0.0f)
+				Sorted[ValidCount++] = val;
+		}
+
+		if (ValidCount == 0)
+			return 0.0f;
+
+		const uint32_t Rank = min(ValidCount - 1, (uint32_t)(Fraction * ValidCount));
+		nth_element(Sorted, Sorted + Rank, Sorted + ValidCount);
+		return Sorted[Rank];
+	}
+
 private:
 	static const uint32_t kHistorySize = 64;
 	static const uint32_t kExtendedHistorySize = 256;
@@ -248,6 +268,8 @@ public:
 		s_FrameDelta.RecordStat(FrameIndex, GpuTimeManager::GetTime(0));
 		GpuTimeManager::EndReadBack();
 
+		s_FrameTime.RecordStat(FrameIndex, Graphics::GetFrameTime() * 1000.0f);
+
 		float TotalCpuTime, TotalGpuTime;
 		sm_RootScope.SumInclusiveTimes(TotalCpuTime, TotalGpuTime);
 		s_TotalCpuTime.RecordStat(FrameIndex, TotalCpuTime);
@@ -259,6 +281,7 @@ public:
 	static float GetTotalCpuTime(void) { return s_TotalCpuTime.GetAvg(); }
 	static float GetTotalGpuTime(void) { return s_TotalGpuTime.GetAvg(); }
 	static float GetFrameDelta(void) { return s_FrameDelta.GetAvg(); }
+	static float GetFrameTimePercentile(float Fraction) { return s_FrameTime.GetPercentile(Fraction); }
 
 	static void Display(TextContext& Text, float x)
 	{
@@ -305,6 +328,7 @@ private:
 	static StatHistory s_TotalCpuTime;
 	static StatHistory s_TotalGpuTime;
 	static StatHistory s_FrameDelta;
+	static StatHistory s_FrameTime;
 	static NestedTimingTree sm_RootScope;
 	static NestedTimingTree* sm_CurrentNode;
 	static NestedTimingTree* sm_SelectedScope;
@@ -425,6 +449,7 @@ void NestedTimingTree::StoreToGraph(void)
 StatHistory NestedTimingTree::s_TotalCpuTime;
 StatHistory NestedTimingTree::s_TotalGpuTime;
 StatHistory NestedTimingTree::s_FrameDelta;
+StatHistory NestedTimingTree::s_FrameTime;
 NestedTimingTree NestedTimingTree::sm_RootScope(L"");
 NestedTimingTree* NestedTimingTree::sm_CurrentNode = &NestedTimingTree::sm_RootScope;
 NestedTimingTree* NestedTimingTree::sm_SelectedScope = &NestedTimingTree::sm_RootScope;
@@ -465,8 +490,16 @@ namespace EngineProfiling
 		float gpuTime = NestedTimingTree::GetTotalGpuTime();
 		float frameRate = 1.0f / NestedTimingTree::GetFrameDelta();
 
-		Text.DrawFormattedString("CPU {:7.3f} ms, GPU {:7.3f} ms, {} Hz\n", //? format correctly
-			cpuTime, gpuTime, (uint32_t)(frameRate + 0.5f));
+		Text.DrawFormattedString("CPU {:7.3f} ms, GPU {:7.3f} ms, {} Hz, input to present {:6.2f} ms\n", //? format correctly
+			cpuTime, gpuTime, (uint32_t)(frameRate + 0.5f), Graphics::GetInputLatency());
+
+		Text.DrawFormattedString("Frame time p50 {:6.2f} ms, p95 {:6.2f} ms, p99 {:6.2f} ms\n",
+			NestedTimingTree::GetFrameTimePercentile(0.5f), NestedTimingTree::GetFrameTimePercentile(0.95f),
+			NestedTimingTree::GetFrameTimePercentile(0.99f));
+
+		const auto Residency = g_ResidencyManager.GetStats();
+		if (Residency.Budget > 0)
+			Text.DrawFormattedString("VRAM {} / {} MB, {} MB evicted\n", Residency.CurrentUsage >> 20, Residency.Budget >> 20, Residency.EvictedBytes >> 20);
 	}
 
 	void DisplayPerfGraph(GraphicsContext& Context)
@@ -5,8 +5,14 @@
 #include "GameInput.h"
 #include "BufferManager.h"
 #include "CommandContext.h"
+#include "GeometryPool.h"
+#include "GraphicsBackend.h"
+
+#include <shellapi.h>
+#include <optional>
 
 #pragma comment(lib, "runtimeobject.lib")
+#pragma comment(lib, "shell32.lib")
 
 namespace GameCore
 {
@@ -16,7 +22,8 @@ namespace GameCore
     {
         Graphics::Initialize();
         SystemTime::Initialize();
-        GameInput::Initialize();
+        if (!Graphics::g_Headless)
+            GameInput::Initialize();
         EngineTuning::Initialize();
 
         game.Startup();
@@ -26,18 +33,24 @@ namespace GameCore
     {
         game.Cleanup();
 
-        GameInput::Shutdown();
+        if (!Graphics::g_Headless)
+            GameInput::Shutdown();
     }
 
     bool UpdateApplication(IGameApp& game)
     {
+        Graphics::WaitForNextFrame();
+
         EngineProfiling::Update();
 
         float DeltaTime = Graphics::GetFrameTime();
 
-        GameInput::Update(DeltaTime);
+        if (!Graphics::g_Headless)
+            GameInput::Update(DeltaTime);
         EngineTuning::Update(DeltaTime);
 
+        Graphics::g_GeometryPool.Compact();
+
         game.Update(DeltaTime);
         game.RenderScene();
 
@@ -68,8 +81,106 @@ namespace GameCore
 
     LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
+    struct LaunchOptions
+    {
+        // Frames to run without a window, 0 runs the windowed application
+        uint32_t HeadlessFrames = 0;
+        std::optional<eBackend> Backend;
+    };
+
+    // Parses "-headless [frames]" and "-backend hardware|warp|recording". Returns false after
+    // printing the reason if the command line is invalid.
+    bool ParseCommandLine(LaunchOptions& Options)
+    {
+        int ArgCount = 0;
+        LPWSTR* Args = CommandLineToArgvW(GetCommandLineW(), &ArgCount);
+        if (Args == nullptr)
+            return true;
+
+        bool Valid = true;
+        for (int i = 1; i < ArgCount && Valid; ++i)
+        {
+            if (_wcsicmp(Args[i], L"-headless") == 0)
+            {
+                Options.HeadlessFrames = 1;
+                if (i + 1 == ArgCount || Args[i + 1][0] == L'-')
+                    continue;
+
+                const wchar_t* Value = Args[++i];
+                wchar_t* End = nullptr;
+                errno = 0;
+                const long FrameCount = wcstol(Value, &End, 10);
+                if (End == Value || *End != L'\0' || errno == ERANGE || FrameCount <= 0)
+                {
+                    Utility::Printf(L"Invalid headless frame count '{}', expected a positive number\n", Value);
+                    Valid = false;
+                }
+                else
+                    Options.HeadlessFrames = static_cast<uint32_t>(FrameCount);
+            }
+            else if (_wcsicmp(Args[i], L"-backend") == 0)
+            {
+                const wchar_t* Value = i + 1 < ArgCount ? Args[++i] : L"";
+                if (_wcsicmp(Value, L"hardware") == 0)
+                    Options.Backend = eBackend::kHardware;
+                else if (_wcsicmp(Value, L"warp") == 0)
+                    Options.Backend = eBackend::kWarp;
+                else if (_wcsicmp(Value, L"recording") == 0)
+                    Options.Backend = eBackend::kRecording;
+                else
+                {
+                    Utility::Printf(L"Invalid backend '{}', expected hardware, warp or recording\n", Value);
+                    Valid = false;
+                }
+            }
+        }
+
+        LocalFree(Args);
+
+        if (Valid && Options.Backend == eBackend::kRecording && Options.HeadlessFrames == 0)
+        {
+            Utility::Print("The recording backend can't present, it requires -headless\n");
+            Valid = false;
+        }
+        return Valid;
+    }
+
+    void RunApplicationHeadless(IGameApp& app, uint32_t FrameCount)
+    {
+        Microsoft::WRL::Wrappers::RoInitializeWrapper InitializeWinRT(RO_INIT_MULTITHREADED);
+        ASSERT_SUCCEEDED(InitializeWinRT);
+
+        Graphics::g_Headless = true;
+
+        InitializeApplication(app);
+
+        for (uint32_t Frame = 0; Frame < FrameCount; ++Frame)
+        {
+            if (!UpdateApplication(app))
+                break;
+        }
+
+        Graphics::Terminate();
+        TerminateApplication(app);
+        Graphics::Shutdown();
+    }
+
     void RunApplication([[maybe_unused]] IGameApp& app, const wchar_t* className)
     {
+        LaunchOptions Options;
+        if (!ParseCommandLine(Options))
+            return;
+
+        if (Options.HeadlessFrames > 0)
+        {
+            // Headless runs default to WARP so they don't depend on the machine's GPU
+            g_BackendType = Options.Backend.value_or(eBackend::kWarp);
+            RunApplicationHeadless(app, Options.HeadlessFrames);
+            return;
+        }
+
+        g_BackendType = Options.Backend.value_or(eBackend::kHardware);
+
         Microsoft::WRL::Wrappers::RoInitializeWrapper InitializeWinRT(RO_INIT_MULTITHREADED);
         ASSERT_SUCCEEDED(InitializeWinRT);
 
@@ -21,7 +21,13 @@ namespace GameCore
         virtual void RenderUI(class GraphicsContext&) {};
     };
 
+    // Runs the application in a window, or headless when the command line contains
+    // "-headless <frame count>".
     void RunApplication(IGameApp& app, const wchar_t* className);
+
+    // Runs the application without a window or input for FrameCount frames (or until
+    // IsDone), see Graphics::g_Headless.
+    void RunApplicationHeadless(IGameApp& app, uint32_t FrameCount);
 }
 
 #if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
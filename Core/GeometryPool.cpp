@@ -0,0 +1,363 @@
+#include "pch.h"
+#include "GeometryPool.h"
+#include "GraphicsCore.h"
+#include "CommandContext.h"
+#include "CommandListManager.h"
+#include "EngineTuning.h"
+
+#include <ranges>
+
+namespace Graphics
+{
+	GeometryPool g_GeometryPool;
+}
+
+using namespace Graphics;
+
+namespace
+{
+	constexpr size_t kScratchBufferSize = 4 * 1024 * 1024;
+
+	NumVar CompactionBudget("Graphics/Geometry Pool/Compaction KB per frame", 1024.0f, 0.0f, kScratchBufferSize / 1024.0f, 256.0f);
+}
+
+void GeometryRangeAllocator::Reset(size_t Size)
+{
+	m_Size = Size;
+	m_FreeRanges.clear();
+	m_LiveBlocks.clear();
+	m_RetiredRanges.clear();
+	m_PendingMoves.clear();
+	m_FreeSize = 0;
+
+	if (Size > 0)
+		InsertFreeRange(0, Size);
+}
+
+GeometryRangeAllocator::Block* GeometryRangeAllocator::Allocate(size_t Size, size_t Alignment, bool Relocatable)
+{
+	ASSERT(Size > 0 && Alignment > 0);
+
+	const auto Offset = TakeFreeRange(Size, Alignment, SIZE_MAX);
+	if (Offset == SIZE_MAX)
+		return nullptr;
+
+	auto* NewBlock = new Block{ .Offset = Offset, .Size = Size, .Alignment = Alignment, .Relocatable = Relocatable };
+	m_LiveBlocks.emplace(Offset, NewBlock);
+	return NewBlock;
+}
+
+void GeometryRangeAllocator::Free(Block* Freed, uint64_t RetireFence)
+{
+	m_LiveBlocks.erase(Freed->Offset);
+	RetireRange(Freed->Offset, Freed->Size, RetireFence);
+
+	if (Freed->PendingOffset != SIZE_MAX)
+	{
+		RetireRange(Freed->PendingOffset, Freed->Size, RetireFence);
+		std::erase(m_PendingMoves, Freed);
+	}
+
+	delete Freed;
+}
+
+std::vector<GeometryRangeAllocator::Block*> GeometryRangeAllocator::PlanMoves(size_t MaxBytes)
+{
+	auto Moves = std::vector<Block*>();
+	size_t MovedBytes = 0;
+	for (auto it = m_LiveBlocks.rbegin(); it != m_LiveBlocks.rend() && MovedBytes < MaxBytes; ++it)
+	{
+		auto* Moved = it->second;
+		if (!Moved->Relocatable || Moved->PendingOffset != SIZE_MAX || (MovedBytes > 0 && MovedBytes + Moved->Size > MaxBytes))
+			continue;
+
+		const auto NewOffset = TakeFreeRange(Moved->Size, Moved->Alignment, Moved->Offset);
+		if (NewOffset == SIZE_MAX)
+			continue;
+
+		Moved->PendingOffset = NewOffset;
+		Moves.push_back(Moved);
+		MovedBytes += Moved->Size;
+	}
+	return Moves;
+}
+
+void GeometryRangeAllocator::CommitMoves(const std::vector<Block*>& Moves, uint64_t Fence)
+{
+	for (auto* Moved : Moves)
+	{
+		ASSERT(Moved->PendingOffset != SIZE_MAX);
+		Moved->PendingFence = Fence;
+		m_PendingMoves.push_back(Moved);
+	}
+}
+
+void GeometryRangeAllocator::CompleteMoves(const FenceCompleteFn& IsComplete, uint64_t RetireFence)
+{
+	while (!m_PendingMoves.empty() && IsComplete(m_PendingMoves.front()->PendingFence))
+	{
+		auto* Moved = m_PendingMoves.front();
+		m_PendingMoves.pop_front();
+
+		// Draws recorded before the switch may still read from the old range
+		RetireRange(Moved->Offset, Moved->Size, RetireFence);
+
+		m_LiveBlocks.erase(Moved->Offset);
+		Moved->Offset = std::exchange(Moved->PendingOffset, SIZE_MAX);
+		Moved->PendingFence = 0;
+		m_LiveBlocks.emplace(Moved->Offset, Moved);
+	}
+}
+
+void GeometryRangeAllocator::ReclaimRetiredRanges(const FenceCompleteFn& IsComplete)
+{
+	while (!m_RetiredRanges.empty() && IsComplete(m_RetiredRanges.front().Fence))
+	{
+		const auto Retired = m_RetiredRanges.front();
+		InsertFreeRange(Retired.Offset, Retired.Size);
+		m_RetiredRanges.pop_front();
+	}
+}
+
+size_t GeometryRangeAllocator::GetLargestFreeRange(void) const
+{
+	size_t Largest = 0;
+	for (const auto& [Offset, Size] : m_FreeRanges)
+		Largest = std::max(Largest, Size);
+	return Largest;
+}
+
+void GeometryRangeAllocator::RetireRange(size_t Offset, size_t Size, uint64_t RetireFence)
+{
+	if (RetireFence == 0)
+		InsertFreeRange(Offset, Size);
+	else
+		m_RetiredRanges.push_back({ RetireFence, Offset, Size });
+}
+
+size_t GeometryRangeAllocator::TakeFreeRange(size_t Size, size_t Alignment, size_t Limit)
+{
+	// First fit
+	for (auto it = m_FreeRanges.begin(); it != m_FreeRanges.end() && it->first < Limit; ++it)
+	{
+		const auto [RangeOffset, RangeSize] = *it;
+		const auto AlignedOffset = (RangeOffset + Alignment - 1) / Alignment * Alignment;
+		if (AlignedOffset + Size > RangeOffset + RangeSize || AlignedOffset + Size > Limit)
+			continue;
+
+		m_FreeRanges.erase(it);
+		if (AlignedOffset > RangeOffset)
+			m_FreeRanges.emplace(RangeOffset, AlignedOffset - RangeOffset);
+		if (AlignedOffset + Size < RangeOffset + RangeSize)
+			m_FreeRanges.emplace(AlignedOffset + Size, RangeOffset + RangeSize - AlignedOffset - Size);
+
+		m_FreeSize -= Size;
+		return AlignedOffset;
+	}
+
+	return SIZE_MAX;
+}
+
+void GeometryRangeAllocator::InsertFreeRange(size_t Offset, size_t Size)
+{
+	m_FreeSize += Size;
+
+	auto Next = m_FreeRanges.lower_bound(Offset);
+
+	// Coalesce with the preceding range
+	if (Next != m_FreeRanges.begin())
+	{
+		auto Prev = std::prev(Next);
+		ASSERT(Prev->first + Prev->second <= Offset, "Double free in geometry pool");
+		if (Prev->first + Prev->second == Offset)
+		{
+			Offset = Prev->first;
+			Size += Prev->second;
+			m_FreeRanges.erase(Prev);
+		}
+	}
+
+	// Coalesce with the following range
+	if (Next != m_FreeRanges.end())
+	{
+		ASSERT(Offset + Size <= Next->first, "Double free in geometry pool");
+		if (Offset + Size == Next->first)
+		{
+			Size += Next->second;
+			m_FreeRanges.erase(Next);
+		}
+	}
+
+	m_FreeRanges.emplace(Offset, Size);
+}
+
+void GeometryPool::Create(const std::wstring& Name, size_t ByteSize)
+{
+	ASSERT(ByteSize % 4 == 0, "Geometry pool size has to be a multiple of 4 bytes");
+
+	auto lg = std::lock_guard{ m_Mutex };
+
+	m_Buffer.Create(Name, ByteSize / 4, 4);
+	m_ScratchBuffer.Create(Name + L" scratch", kScratchBufferSize / 4, 4);
+	m_Ranges.Reset(ByteSize);
+}
+
+void GeometryPool::Destroy(void)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	m_Buffer.Destroy();
+	m_ScratchBuffer.Destroy();
+	m_Ranges.Reset(0);
+}
+
+GeometryAllocation GeometryPool::Allocate(size_t Size, size_t Alignment, bool Relocatable)
+{
+	ASSERT(Size > 0 && Alignment > 0);
+
+	auto lg = std::lock_guard{ m_Mutex };
+
+	m_Ranges.ReclaimRetiredRanges(IsFenceComplete);
+
+	auto* NewBlock = m_Ranges.Allocate(Size, Alignment, Relocatable);
+	if (NewBlock == nullptr && m_Ranges.HasRetiredRanges())
+	{
+		// Retired ranges only wait for work that was submitted before they were freed
+		auto& Queue = g_CommandManager.GetQueue();
+		Queue.WaitForFence(Queue.IncrementFence());
+		m_Ranges.ReclaimRetiredRanges(IsFenceComplete);
+		NewBlock = m_Ranges.Allocate(Size, Alignment, Relocatable);
+	}
+
+	if (NewBlock == nullptr)
+	{
+		ASSERT(false, "Geometry pool is out of memory");
+		return GeometryAllocation();
+	}
+
+	return GeometryAllocation(*this, NewBlock);
+}
+
+GeometryAllocation GeometryPool::Upload(const void* Data, size_t Size, size_t Alignment, bool Relocatable)
+{
+	auto Allocation = Allocate(Size, Alignment, Relocatable);
+	if (Allocation.IsValid())
+	{
+		// The pool is in use by the graphics queue, so it is written to there rather than on the copy queue
+		auto& Context = CommandContext::Begin();
+		Context.WriteBuffer(m_Buffer, Allocation.GetOffset(), Data, Size);
+		Context.TransitionResource(m_Buffer, D3D12_RESOURCE_STATE_GENERIC_READ, true);
+		Context.Finish();
+	}
+	return Allocation;
+}
+
+size_t GeometryPool::GetFreeSize(void) const
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	return m_Ranges.GetFreeSize();
+}
+
+size_t GeometryPool::GetLargestFreeRange(void) const
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	return m_Ranges.GetLargestFreeRange();
+}
+
+void GeometryPool::Compact(void)
+{
+	Compact(static_cast<size_t>(CompactionBudget * 1024.0f));
+}
+
+void GeometryPool::Compact(size_t MaxBytes)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	if (m_Buffer.GetResource() == nullptr)
+		return;
+
+	m_Ranges.CompleteMoves(IsFenceComplete, GetRetireFence());
+	m_Ranges.ReclaimRetiredRanges(IsFenceComplete);
+
+	// Move the highest allocations into the lowest holes they fit, so free space gathers at the end
+	const auto Moves = m_Ranges.PlanMoves(MaxBytes);
+	if (Moves.empty())
+		return;
+
+	// Copies go through the scratch buffer in passes that fill it at most once, with allocations
+	// larger than it split across passes. Source and destination ranges never overlap.
+	struct Chunk
+	{
+		size_t Source;
+		size_t Destination;
+		size_t Size;
+	};
+	auto Chunks = std::vector<Chunk>();
+	for (auto* Moved : Moves)
+	{
+		for (size_t Copied = 0; Copied < Moved->Size; Copied += kScratchBufferSize)
+			Chunks.push_back({ Moved->Offset + Copied, Moved->PendingOffset + Copied, std::min(kScratchBufferSize, Moved->Size - Copied) });
+	}
+
+	auto& Context = CommandContext::Begin(L"Geometry pool compaction");
+
+	for (auto First = Chunks.begin(); First != Chunks.end();)
+	{
+		auto Last = First;
+		for (size_t ScratchSize = 0; Last != Chunks.end() && ScratchSize + Last->Size <= kScratchBufferSize; ++Last)
+			ScratchSize += Last->Size;
+
+		Context.TransitionResource(m_Buffer, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		Context.TransitionResource(m_ScratchBuffer, D3D12_RESOURCE_STATE_COPY_DEST, true);
+		for (size_t ScratchOffset = 0; const auto& Copy : std::ranges::subrange(First, Last))
+		{
+			Context.CopyBufferRegion(m_ScratchBuffer, ScratchOffset, m_Buffer, Copy.Source, Copy.Size);
+			ScratchOffset += Copy.Size;
+		}
+
+		Context.TransitionResource(m_Buffer, D3D12_RESOURCE_STATE_COPY_DEST);
+		Context.TransitionResource(m_ScratchBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE, true);
+		for (size_t ScratchOffset = 0; const auto& Copy : std::ranges::subrange(First, Last))
+		{
+			Context.CopyBufferRegion(m_Buffer, Copy.Destination, m_ScratchBuffer, ScratchOffset, Copy.Size);
+			ScratchOffset += Copy.Size;
+		}
+
+		First = Last;
+	}
+
+	Context.TransitionResource(m_Buffer, D3D12_RESOURCE_STATE_GENERIC_READ, true);
+
+	m_Ranges.CommitMoves(Moves, Context.Finish());
+}
+
+void GeometryPool::Free(Block* Freed)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	// The pool is already gone (e.g. geometry outliving the graphics shutdown)
+	if (m_Buffer.GetResource() == nullptr)
+	{
+		delete Freed;
+		return;
+	}
+
+	m_Ranges.Free(Freed, GetRetireFence());
+}
+
+uint64_t GeometryPool::GetRetireFence(void)
+{
+	auto& Queue = g_CommandManager.GetQueue();
+	if (!Queue.IsReady())
+		return 0;
+
+	// Frames in flight may still read the range. Tagging it with the next fence value instead of
+	// signalling a new one keeps frees from adding a Signal each; the range becomes reusable once
+	// the next submission has completed.
+	return Queue.GetNextFenceValue();
+}
+
+bool GeometryPool::IsFenceComplete(uint64_t FenceValue)
+{
+	return g_CommandManager.IsFenceComplete(FenceValue);
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "GpuBuffer.h"
+
+class GeometryPool;
+
+// Range bookkeeping of the geometry pool: an offset-ordered free list coalesced on release, the live
+// blocks, freed ranges waiting for a fence and moves waiting for their copy. Fences are plain values
+// checked with a caller-provided predicate, so it runs without a device.
+class GeometryRangeAllocator
+{
+public:
+	struct Block
+	{
+		size_t Offset;
+		size_t Size;
+		size_t Alignment;
+		bool Relocatable;
+
+		// Destination of a move that is still being copied on the GPU
+		size_t PendingOffset = SIZE_MAX;
+		uint64_t PendingFence = 0;
+	};
+
+	struct RetiredRange
+	{
+		uint64_t Fence;
+		size_t Offset;
+		size_t Size;
+	};
+
+	using FenceCompleteFn = std::function<bool(uint64_t FenceValue)>;
+
+	// Forgets all ranges and makes Size bytes free. Blocks still handed out stay with their owners.
+	void Reset(size_t Size);
+
+	// Returns null when no free range fits
+	Block* Allocate(size_t Size, size_t Alignment, bool Relocatable);
+	// Deletes the block. Its ranges become free once RetireFence is complete, right away if it is 0.
+	void Free(Block* Freed, uint64_t RetireFence);
+
+	// Picks relocatable blocks to move towards the beginning, the highest first into the lowest range
+	// they fit, MaxBytes in total except for a first block larger than that. Sets their PendingOffset.
+	std::vector<Block*> PlanMoves(size_t MaxBytes);
+	// The copies of planned moves complete with Fence
+	void CommitMoves(const std::vector<Block*>& Moves, uint64_t Fence);
+	// Switches blocks whose copy has completed to their new offset and retires their old range
+	void CompleteMoves(const FenceCompleteFn& IsComplete, uint64_t RetireFence);
+	void ReclaimRetiredRanges(const FenceCompleteFn& IsComplete);
+
+	bool HasRetiredRanges(void) const { return !m_RetiredRanges.empty(); }
+	size_t GetSize(void) const { return m_Size; }
+	size_t GetFreeSize(void) const { return m_FreeSize; }
+	size_t GetLargestFreeRange(void) const;
+
+	const std::map<size_t, size_t>& GetFreeRanges(void) const { return m_FreeRanges; }
+	const std::map<size_t, Block*>& GetLiveBlocks(void) const { return m_LiveBlocks; }
+	const std::deque<RetiredRange>& GetRetiredRanges(void) const { return m_RetiredRanges; }
+
+private:
+	void RetireRange(size_t Offset, size_t Size, uint64_t RetireFence);
+	void InsertFreeRange(size_t Offset, size_t Size);
+	// Finds the first free range that can hold Size bytes at an aligned offset below Limit and takes it out
+	size_t TakeFreeRange(size_t Size, size_t Alignment, size_t Limit);
+
+	size_t m_Size = 0;
+	std::map<size_t, size_t> m_FreeRanges;	// offset -> size
+	std::map<size_t, Block*> m_LiveBlocks;	// offset -> block
+	std::deque<RetiredRange> m_RetiredRanges;
+	std::deque<Block*> m_PendingMoves;
+	size_t m_FreeSize = 0;
+};
+
+// Owning handle of a range in the geometry pool. The range is returned to the pool when the handle
+// is destroyed, but only reused once the GPU has finished all work submitted up to that point.
+// Relocatable allocations may be moved by GeometryPool::Compact, so their offset must be re-read
+// (and any cached views patched) before recording draws.
+class GeometryAllocation
+{
+	friend GeometryPool;
+
+public:
+	GeometryAllocation() = default;
+	~GeometryAllocation() { Free(); }
+
+	GeometryAllocation(const GeometryAllocation&) = delete;
+	GeometryAllocation& operator=(const GeometryAllocation&) = delete;
+
+	GeometryAllocation(GeometryAllocation&& Other) noexcept
+		: m_Pool(std::exchange(Other.m_Pool, nullptr)), m_Block(std::exchange(Other.m_Block, nullptr)) {}
+	GeometryAllocation& operator=(GeometryAllocation&& Other) noexcept
+	{
+		Free();
+		m_Pool = std::exchange(Other.m_Pool, nullptr);
+		m_Block = std::exchange(Other.m_Block, nullptr);
+		return *this;
+	}
+
+	void Free(void);
+
+	bool IsValid(void) const { return m_Block != nullptr; }
+	size_t GetOffset(void) const;
+	size_t GetSize(void) const;
+
+	// Offset is relative to the beginning of the allocation
+	D3D12_VERTEX_BUFFER_VIEW VertexBufferView(size_t Offset, size_t Size, size_t Stride) const;
+	D3D12_INDEX_BUFFER_VIEW IndexBufferView(size_t Offset, size_t Size, bool b32Bit = false) const;
+
+private:
+	using Block = GeometryRangeAllocator::Block;
+
+	GeometryAllocation(GeometryPool& Pool, Block* Block) : m_Pool(&Pool), m_Block(Block) {}
+
+	GeometryPool* m_Pool = nullptr;
+	Block* m_Block = nullptr;
+};
+
+// A single large buffer that vertex and index data of all meshes is suballocated from, so draws of
+// different meshes share one vertex/index buffer binding. The ranges are kept by a
+// GeometryRangeAllocator, the pool adds the buffer, the fences and the copies of moves.
+class GeometryPool
+{
+	friend GeometryAllocation;
+
+public:
+	GeometryPool() = default;
+	~GeometryPool() { Destroy(); }
+
+	void Create(const std::wstring& Name, size_t ByteSize);
+	void Destroy(void);
+
+	// Alignment doesn't have to be a power of two, so vertices can be aligned to their stride and
+	// addressed with BaseVertexLocation
+	GeometryAllocation Allocate(size_t Size, size_t Alignment = 4, bool Relocatable = false);
+	GeometryAllocation Upload(const void* Data, size_t Size, size_t Alignment = 4, bool Relocatable = false);
+
+	// Incrementally moves relocatable allocations towards the beginning of the pool, copying at most
+	// MaxBytes this call. An allocation larger than MaxBytes is still moved when it is the first
+	// candidate, so it doesn't block compaction forever. A moved allocation reports its new offset only once the copy has completed
+	// on the GPU; its old range is then retired like a freed one.
+	void Compact(size_t MaxBytes);
+	void Compact(void);
+
+	GpuBuffer& GetBuffer(void) { return m_Buffer; }
+	size_t GetFreeSize(void) const;
+	size_t GetLargestFreeRange(void) const;
+
+	// Views over the whole pool, offset by BaseVertexLocation/StartIndexLocation of a draw
+	D3D12_VERTEX_BUFFER_VIEW VertexBufferView(size_t Stride) const { return m_Buffer.VertexBufferView(0, m_Buffer.GetBufferSize(), Stride); }
+	D3D12_INDEX_BUFFER_VIEW IndexBufferView(bool b32Bit) const { return m_Buffer.IndexBufferView(0, m_Buffer.GetBufferSize(), b32Bit); }
+
+private:
+	using Block = GeometryRangeAllocator::Block;
+
+	void Free(Block* Freed);
+	// Fence value after which ranges freed now are no longer read, 0 before the queue exists
+	static uint64_t GetRetireFence(void);
+	static bool IsFenceComplete(uint64_t FenceValue);
+
+	ByteAddressBuffer m_Buffer;
+	// Moves go through the scratch buffer, as a buffer can't be copy source and destination at once
+	ByteAddressBuffer m_ScratchBuffer;
+
+	mutable std::mutex m_Mutex;
+	GeometryRangeAllocator m_Ranges;
+};
+
+namespace Graphics
+{
+	extern GeometryPool g_GeometryPool;
+}
+
+inline void GeometryAllocation::Free(void)
+{
+	if (m_Block != nullptr)
+		std::exchange(m_Pool, nullptr)->Free(std::exchange(m_Block, nullptr));
+}
+
+// The offset changes when a move completes, which happens under the pool lock
+inline size_t GeometryAllocation::GetOffset(void) const
+{
+	ASSERT(m_Block != nullptr);
+	auto lg = std::lock_guard{ m_Pool->m_Mutex };
+	return m_Block->Offset;
+}
+
+inline size_t GeometryAllocation::GetSize(void) const
+{
+	ASSERT(m_Block != nullptr);
+	return m_Block->Size;
+}
+
+inline D3D12_VERTEX_BUFFER_VIEW GeometryAllocation::VertexBufferView(size_t Offset, size_t Size, size_t Stride) const
+{
+	ASSERT(m_Block != nullptr && Offset + Size <= m_Block->Size);
+	return m_Pool->m_Buffer.VertexBufferView(GetOffset() + Offset, Size, Stride);
+}
+
+inline D3D12_INDEX_BUFFER_VIEW GeometryAllocation::IndexBufferView(size_t Offset, size_t Size, bool b32Bit) const
+{
+	ASSERT(m_Block != nullptr && Offset + Size <= m_Block->Size);
+	return m_Pool->m_Buffer.IndexBufferView(GetOffset() + Offset, Size, b32Bit);
+}
@@ -12,22 +12,18 @@ void GpuBuffer::Create([[maybe_unused]] const std::wstring& name, size_t NumElem
 
 	Destroy();
 
+	// A new resource starts out unused, whatever state the previous one was left in
+	m_UsageState = D3D12_RESOURCE_STATE_COMMON;
+	m_SubresourceStates.clear();
+
 	m_ElementCount = NumElements;
 	m_ElementSize = ElementSize;
 	m_BufferSize = NumElements * ElementSize;
 
 	const auto ResourceDesc = DescribeBuffer();
 
-	const auto HeapProps = D3D12_HEAP_PROPERTIES{
-		.Type = D3D12_HEAP_TYPE_DEFAULT,
-		.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-		.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
-		.CreationNodeMask = 1,
-		.VisibleNodeMask = 1
-	};
-
-	ASSERT_SUCCEEDED(g_Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE,
-		&ResourceDesc, m_UsageState, nullptr, IID_PPV_ARGS(&m_pResource)));
+	m_pResource.Attach(g_GpuHeapAllocator.CreateResource(D3D12_HEAP_TYPE_DEFAULT, ResourceDesc,
+		m_UsageState, nullptr, m_Allocation));
 
 	m_GpuVirtualAddress = m_pResource->GetGPUVirtualAddress();
 
@@ -41,6 +37,15 @@ void GpuBuffer::Create([[maybe_unused]] const std::wstring& name, size_t NumElem
 	CreateDerivedViews();
 }
 
+void GpuBuffer::Destroy(void)
+{
+	GpuResource::Destroy();
+	FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_SRV);
+	FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_UAV);
+	m_SRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	m_UAV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+}
+
 auto GpuBuffer::CreateConstantBufferView(size_t Offset, size_t Size) const -> D3D12_CPU_DESCRIPTOR_HANDLE
 {
 	ASSERT(Offset + Size <= m_BufferSize);
@@ -10,8 +10,16 @@ class GpuBuffer : public GpuResource
 public:
 	virtual ~GpuBuffer() { Destroy(); }
 
-	GpuBuffer(GpuBuffer&&) = default;
-	GpuBuffer& operator=(GpuBuffer&&) = default;
+	// The views travel with the resource; whatever the target held is released by the source
+	GpuBuffer(GpuBuffer&& Other) noexcept : GpuResource(std::move(Other)) { SwapContents(Other); }
+	GpuBuffer& operator=(GpuBuffer&& Other) noexcept
+	{
+		GpuResource::operator=(std::move(Other));
+		SwapContents(Other);
+		return *this;
+	}
+
+	void Destroy(void) override;
 
 	// Create a buffer. If inital data is provided, it will be copied into the buffer using the default command context.
 	void Create(const std::wstring& name, size_t NumElements, size_t ElementSize, const void* initialData = nullptr);
@@ -47,6 +55,16 @@ protected:
 	auto DescribeBuffer(void) const -> D3D12_RESOURCE_DESC;
 	virtual void CreateDerivedViews(void) = 0;
 
+	void SwapContents(GpuBuffer& Other) noexcept
+	{
+		std::swap(m_UAV, Other.m_UAV);
+		std::swap(m_SRV, Other.m_SRV);
+		std::swap(m_BufferSize, Other.m_BufferSize);
+		std::swap(m_ElementCount, Other.m_ElementCount);
+		std::swap(m_ElementSize, Other.m_ElementSize);
+		std::swap(m_ResourceFlags, Other.m_ResourceFlags);
+	}
+
 	D3D12_CPU_DESCRIPTOR_HANDLE m_UAV = { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN };
 	D3D12_CPU_DESCRIPTOR_HANDLE m_SRV = { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN };
 
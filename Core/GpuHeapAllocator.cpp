@@ -0,0 +1,339 @@
+#include "pch.h"
+#include "GpuHeapAllocator.h"
+#include "GraphicsCore.h"
+#include "CommandListManager.h"
+#include "ResidencyManager.h"
+#include "Math/Common.h"
+
+namespace Graphics
+{
+	GpuHeapAllocator g_GpuHeapAllocator;
+}
+
+using namespace Graphics;
+
+namespace
+{
+	const uint64_t kMinBlockSize = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	// 64MB default heaps, 16MB upload heaps
+	const uint32_t kDefaultHeapOrder = 10;
+	const uint32_t kUploadHeapOrder = 8;
+	// Anything larger than this share of a heap gets a committed resource instead
+	const uint32_t kMaxPlacedFraction = 4;
+}
+
+BuddyAllocator::BuddyAllocator(uint64_t MinBlockSize, uint32_t MaxOrder)
+	: m_MinBlockSize(MinBlockSize), m_MaxOrder(MaxOrder), m_FreeBlocks(MaxOrder + 1)
+{
+	ASSERT(Math::IsPowerOfTwo(MinBlockSize));
+	m_FreeBlocks[MaxOrder].insert(0);
+}
+
+uint64_t BuddyAllocator::Allocate(uint64_t Size, uint64_t Alignment)
+{
+	const uint32_t Order = GetOrder(Size, Alignment);
+	if (Order > m_MaxOrder)
+		return kInvalidOffset;
+
+	uint32_t FreeOrder = Order;
+	while (FreeOrder <= m_MaxOrder && m_FreeBlocks[FreeOrder].empty())
+		++FreeOrder;
+
+	if (FreeOrder > m_MaxOrder)
+		return kInvalidOffset;
+
+	const uint64_t Offset = *m_FreeBlocks[FreeOrder].begin();
+	m_FreeBlocks[FreeOrder].erase(m_FreeBlocks[FreeOrder].begin());
+
+	// Split down to the requested order, the upper halves stay free
+	while (FreeOrder > Order)
+	{
+		--FreeOrder;
+		m_FreeBlocks[FreeOrder].insert(Offset + (m_MinBlockSize << FreeOrder));
+	}
+
+	m_AllocatedSize += m_MinBlockSize << Order;
+	return Offset;
+}
+
+void BuddyAllocator::Free(uint64_t Offset, uint64_t Size, uint64_t Alignment)
+{
+	uint32_t Order = GetOrder(Size, Alignment);
+	ASSERT(Order <= m_MaxOrder && Offset % (m_MinBlockSize << Order) == 0);
+	ASSERT(m_AllocatedSize >= m_MinBlockSize << Order);
+
+	m_AllocatedSize -= m_MinBlockSize << Order;
+
+	while (Order < m_MaxOrder)
+	{
+		const uint64_t Buddy = Offset ^ (m_MinBlockSize << Order);
+		const auto It = m_FreeBlocks[Order].find(Buddy);
+		if (It == m_FreeBlocks[Order].end())
+			break;
+
+		m_FreeBlocks[Order].erase(It);
+		Offset = std::min(Offset, Buddy);
+		++Order;
+	}
+
+	m_FreeBlocks[Order].insert(Offset);
+}
+
+uint32_t BuddyAllocator::GetOrder(uint64_t Size, uint64_t Alignment) const
+{
+	return Math::Log2(Math::DivideByMultiple(std::max(Size, Alignment), m_MinBlockSize));
+}
+
+GpuHeapAllocation::~GpuHeapAllocation()
+{
+	g_GpuHeapAllocator.Free(*this);
+}
+
+bool GpuHeapAllocator::sm_Destroyed = false;
+
+void GpuHeapAllocator::Create(ID3D12Device* Device)
+{
+	ASSERT(m_Device == nullptr);
+	m_Device = Device;
+	sm_Destroyed = false;
+
+	D3D12_FEATURE_DATA_D3D12_OPTIONS Options = {};
+	if (SUCCEEDED(Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &Options, sizeof(Options))))
+		m_HeapTier = Options.ResourceHeapTier;
+
+	// Heaps that may hold textures start on the MSAA placement alignment so MSAA targets can go anywhere in them
+	m_Pools[kBuffers] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, kDefaultHeapOrder };
+	m_Pools[kRtDsTextures] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES, D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT, kDefaultHeapOrder };
+	m_Pools[kTextures] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT, kDefaultHeapOrder };
+	m_Pools[kUploadBuffers] = { D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, kUploadHeapOrder };
+
+	if (m_HeapTier >= D3D12_RESOURCE_HEAP_TIER_2)
+	{
+		m_Pools[kBuffers].Flags = D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+		m_Pools[kBuffers].Alignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+	}
+}
+
+void GpuHeapAllocator::Destroy(void)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	sm_Destroyed = true;
+	m_PendingFrees.clear();
+	for (auto& Pool : m_Pools)
+		Pool.Blocks.clear();
+	m_Stats = {};
+	m_Device = nullptr;
+}
+
+ID3D12Resource* GpuHeapAllocator::CreateResource(D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc,
+	D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* ClearValue, GpuHeapAllocation& Allocation)
+{
+	ASSERT(m_Device != nullptr);
+	ASSERT(Allocation.Size == 0, "Allocation still holds memory");
+
+	const auto Info = m_Device->GetResourceAllocationInfo(1, 1, &Desc);
+	ASSERT(Info.SizeInBytes != UINT64_MAX, "Invalid resource description");
+
+	ID3D12Resource* Resource = nullptr;
+
+	if (HeapType == D3D12_HEAP_TYPE_DEFAULT || HeapType == D3D12_HEAP_TYPE_UPLOAD)
+	{
+		HeapBlock* Block = nullptr;
+		uint64_t Offset = BuddyAllocator::kInvalidOffset;
+
+		{
+			auto lg = std::lock_guard{ m_Mutex };
+
+			auto& Pool = GetPool(HeapType, Desc);
+			ASSERT(Info.Alignment <= Pool.Alignment);
+
+			if (Info.SizeInBytes <= (kMinBlockSize << Pool.MaxOrder) / kMaxPlacedFraction)
+			{
+				for (auto& Candidate : Pool.Blocks)
+				{
+					Offset = Candidate->Allocator.Allocate(Info.SizeInBytes, Info.Alignment);
+					if (Offset != BuddyAllocator::kInvalidOffset)
+					{
+						Block = Candidate.get();
+						break;
+					}
+				}
+
+				if (Block == nullptr)
+				{
+					Block = CreateBlock(Pool);
+					Offset = Block->Allocator.Allocate(Info.SizeInBytes, Info.Alignment);
+					ASSERT(Offset != BuddyAllocator::kInvalidOffset);
+				}
+
+				++m_Stats.NumPlaced;
+				m_Stats.PlacedBytes += Block->Allocator.GetBlockSize(Info.SizeInBytes, Info.Alignment);
+				g_ResidencyManager.Pin(Block->Heap.Get());
+			}
+		}
+
+		// The range is ours, so the block can't be released while the resource is placed
+		if (Block != nullptr)
+		{
+			ASSERT_SUCCEEDED(m_Device->CreatePlacedResource(Block->Heap.Get(), Offset, &Desc,
+				InitialState, ClearValue, IID_PPV_ARGS(&Resource)));
+
+			Allocation.Block = Block;
+			Allocation.Offset = Offset;
+			Allocation.Size = Info.SizeInBytes;
+			Allocation.Alignment = Info.Alignment;
+			Allocation.Pageable = Block->Heap.Get();
+			return Resource;
+		}
+	}
+
+	const auto HeapProps = CD3DX12_HEAP_PROPERTIES(HeapType);
+	ASSERT_SUCCEEDED(m_Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &Desc,
+		InitialState, ClearValue, IID_PPV_ARGS(&Resource)));
+
+	Allocation.Size = Info.SizeInBytes;
+	Allocation.Pageable = Resource;
+	g_ResidencyManager.Track(Resource, Info.SizeInBytes);
+	g_ResidencyManager.Pin(Resource);
+
+	auto lg = std::lock_guard{ m_Mutex };
+	++m_Stats.NumCommitted;
+	m_Stats.CommittedBytes += Info.SizeInBytes;
+
+	return Resource;
+}
+
+void GpuHeapAllocator::Free(GpuHeapAllocation& Allocation)
+{
+	if (Allocation.Size != 0 && !sm_Destroyed)
+	{
+		auto lg = std::lock_guard{ m_Mutex };
+
+		if (Allocation.Block == nullptr)
+		{
+			--m_Stats.NumCommitted;
+			m_Stats.CommittedBytes -= Allocation.Size;
+			g_ResidencyManager.Untrack(Allocation.Pageable);
+		}
+		else
+		{
+			const uint64_t BlockSize = Allocation.Block->Allocator.GetBlockSize(Allocation.Size, Allocation.Alignment);
+			m_PendingFrees.push_back({ Allocation.Block, Allocation.Offset, Allocation.Size, Allocation.Alignment, !Allocation.Evictable });
+			--m_Stats.NumPlaced;
+			m_Stats.PlacedBytes -= BlockSize;
+			m_Stats.PendingFreeBytes += BlockSize;
+		}
+	}
+
+	// Not assigned an empty allocation, the temporary would take this one over and free it again
+	Allocation.Block = nullptr;
+	Allocation.Offset = 0;
+	Allocation.Size = 0;
+	Allocation.Alignment = 0;
+	Allocation.Pageable = nullptr;
+	Allocation.Evictable = false;
+}
+
+void GpuHeapAllocator::AllowEviction(GpuHeapAllocation& Allocation)
+{
+	if (Allocation.Pageable == nullptr || Allocation.Evictable || sm_Destroyed)
+		return;
+
+	Allocation.Evictable = true;
+	g_ResidencyManager.Unpin(Allocation.Pageable);
+}
+
+void GpuHeapAllocator::EndFrame(uint64_t FrameFenceValue)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	if (m_PendingFrees.empty())
+		return;
+
+	g_CommandManager.OnFenceComplete(FrameFenceValue, [this, Frees = std::move(m_PendingFrees)]
+	{
+		auto lg = std::lock_guard{ m_Mutex };
+		if (sm_Destroyed)
+			return;
+
+		for (const auto& Range : Frees)
+			ReleaseBlockRange(Range);
+	});
+	m_PendingFrees.clear();
+}
+
+GpuHeapAllocator::Stats GpuHeapAllocator::GetStats(void) const
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	return m_Stats;
+}
+
+GpuHeapAllocator::Pool& GpuHeapAllocator::GetPool(D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc)
+{
+	if (HeapType == D3D12_HEAP_TYPE_UPLOAD)
+	{
+		ASSERT(Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER, "Only buffers can be placed in upload heaps");
+		return m_Pools[kUploadBuffers];
+	}
+
+	if (m_HeapTier >= D3D12_RESOURCE_HEAP_TIER_2 || Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+		return m_Pools[kBuffers];
+
+	if (Desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+		return m_Pools[kRtDsTextures];
+
+	return m_Pools[kTextures];
+}
+
+HeapBlock* GpuHeapAllocator::CreateBlock(Pool& Pool)
+{
+	const auto HeapDesc = D3D12_HEAP_DESC{
+		.SizeInBytes = kMinBlockSize << Pool.MaxOrder,
+		.Properties = CD3DX12_HEAP_PROPERTIES(Pool.Type),
+		.Alignment = Pool.Alignment,
+		.Flags = Pool.Flags
+	};
+
+	auto Block = std::make_unique<HeapBlock>(kMinBlockSize, Pool.MaxOrder);
+	ASSERT_SUCCEEDED(m_Device->CreateHeap(&HeapDesc, IID_PPV_ARGS(&Block->Heap)));
+
+#ifndef RELEASE
+	Block->Heap->SetName(L"GpuHeapAllocator Heap");
+#endif
+
+	++m_Stats.NumHeaps;
+	m_Stats.HeapBytes += HeapDesc.SizeInBytes;
+	g_ResidencyManager.Track(Block->Heap.Get(), HeapDesc.SizeInBytes);
+
+	return Pool.Blocks.emplace_back(std::move(Block)).get();
+}
+
+void GpuHeapAllocator::ReleaseBlockRange(const PendingFree& Range)
+{
+	auto& Allocator = Range.Block->Allocator;
+	Allocator.Free(Range.Offset, Range.Size, Range.Alignment);
+	m_Stats.PendingFreeBytes -= Allocator.GetBlockSize(Range.Size, Range.Alignment);
+	if (Range.Pinned)
+		g_ResidencyManager.Unpin(Range.Block->Heap.Get());
+
+	if (!Allocator.IsEmpty())
+		return;
+
+	// Empty heaps go back to the system, except the last one of each pool to avoid churn
+	for (auto& Pool : m_Pools)
+	{
+		const auto It = std::ranges::find_if(Pool.Blocks, [&](const auto& Block) { return Block.get() == Range.Block; });
+		if (It == Pool.Blocks.end())
+			continue;
+
+		if (Pool.Blocks.size() > 1)
+		{
+			--m_Stats.NumHeaps;
+			m_Stats.HeapBytes -= Allocator.GetTotalSize();
+			g_ResidencyManager.Untrack(Range.Block->Heap.Get());
+			Pool.Blocks.erase(It);
+		}
+		return;
+	}
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// Power-of-two suballocator over MinBlockSize << MaxOrder bytes. Blocks are split in halves on
+// allocation and merged with their buddy on free, and since a block of order k is aligned to its
+// own size any alignment up to the rounded size comes for free. Only bookkeeping, no GPU objects.
+class BuddyAllocator
+{
+public:
+	static const uint64_t kInvalidOffset = ~0ull;
+
+	BuddyAllocator(uint64_t MinBlockSize, uint32_t MaxOrder);
+
+	// Returns kInvalidOffset when no block of the rounded size is free
+	uint64_t Allocate(uint64_t Size, uint64_t Alignment);
+	// Size and Alignment must match the allocation
+	void Free(uint64_t Offset, uint64_t Size, uint64_t Alignment);
+
+	uint64_t GetBlockSize(uint64_t Size, uint64_t Alignment) const { return m_MinBlockSize << GetOrder(Size, Alignment); }
+	uint64_t GetTotalSize(void) const { return m_MinBlockSize << m_MaxOrder; }
+	uint64_t GetAllocatedSize(void) const { return m_AllocatedSize; }
+	bool IsEmpty(void) const { return m_AllocatedSize == 0; }
+
+private:
+	uint32_t GetOrder(uint64_t Size, uint64_t Alignment) const;
+
+	uint64_t m_MinBlockSize;
+	uint32_t m_MaxOrder;
+	uint64_t m_AllocatedSize = 0;
+	// Offsets of the free blocks of each order, lowest first so allocations pack towards the start
+	std::vector<std::set<uint64_t>> m_FreeBlocks;
+};
+
+struct HeapBlock
+{
+	HeapBlock(uint64_t MinBlockSize, uint32_t MaxOrder) : Allocator(MinBlockSize, MaxOrder) {}
+
+	Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+	BuddyAllocator Allocator;
+};
+
+struct GpuHeapAllocation
+{
+	GpuHeapAllocation() = default;
+	// Returns the memory to g_GpuHeapAllocator; the resource placed in it must be released already
+	~GpuHeapAllocation();
+
+	// Each allocation has exactly one owner, a moved-from one is empty
+	GpuHeapAllocation(GpuHeapAllocation&& Other) noexcept { *this = std::move(Other); }
+	GpuHeapAllocation& operator=(GpuHeapAllocation&& Other) noexcept
+	{
+		std::swap(Block, Other.Block);
+		std::swap(Offset, Other.Offset);
+		std::swap(Size, Other.Size);
+		std::swap(Alignment, Other.Alignment);
+		std::swap(Pageable, Other.Pageable);
+		std::swap(Evictable, Other.Evictable);
+		return *this;
+	}
+
+	// Null for resources that got a committed heap of their own
+	HeapBlock* Block = nullptr;
+	uint64_t Offset = 0;
+	// As reported by GetResourceAllocationInfo, zero when nothing is allocated
+	uint64_t Size = 0;
+	uint64_t Alignment = 0;
+	// The heap or committed resource the residency manager tracks the memory by
+	ID3D12Pageable* Pageable = nullptr;
+	bool Evictable = false;
+};
+
+// Places resources in large ID3D12Heaps instead of giving each one a committed resource. Heaps are
+// pooled by heap type and, on resource heap tier 1, by what they may hold (buffers, render target
+// and depth stencil textures, other textures). Resources too large to share a heap stay committed.
+//
+// Like descriptors, freed memory is only reused once the frame that freed it has completed, but
+// the resource itself must already be released: a new one may be placed over it after that.
+class GpuHeapAllocator
+{
+public:
+	struct Stats
+	{
+		uint32_t NumHeaps;
+		uint64_t HeapBytes;
+		uint32_t NumPlaced;
+		uint64_t PlacedBytes;
+		uint64_t PendingFreeBytes;
+		uint32_t NumCommitted;
+		uint64_t CommittedBytes;
+	};
+
+	void Create(ID3D12Device* Device);
+	void Destroy(void);
+
+	// Returns a new reference. Heap types other than DEFAULT and UPLOAD are always committed.
+	ID3D12Resource* CreateResource(D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc,
+		D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* ClearValue, GpuHeapAllocation& Allocation);
+
+	// The resource placed in the allocation must have been released already
+	void Free(GpuHeapAllocation& Allocation);
+
+	// Unpins the allocation's memory in the residency manager, see ResidencyManager
+	void AllowEviction(GpuHeapAllocation& Allocation);
+
+	// Called by Graphics::Present: memory freed during the frame becomes reusable once FrameFenceValue is reached
+	void EndFrame(uint64_t FrameFenceValue);
+
+	Stats GetStats(void) const;
+
+private:
+	// On tier 2 all default heap resources share the kBuffers pool
+	enum PoolType { kBuffers, kRtDsTextures, kTextures, kUploadBuffers, kNumPools };
+
+	struct Pool
+	{
+		D3D12_HEAP_TYPE Type;
+		D3D12_HEAP_FLAGS Flags;
+		uint64_t Alignment;
+		// Heaps are kMinBlockSize << MaxOrder bytes
+		uint32_t MaxOrder;
+		std::vector<std::unique_ptr<HeapBlock>> Blocks;
+	};
+
+	// What is left of an allocation once its owner let go of it
+	struct PendingFree
+	{
+		HeapBlock* Block;
+		uint64_t Offset;
+		uint64_t Size;
+		uint64_t Alignment;
+		bool Pinned;
+	};
+
+	Pool& GetPool(D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc);
+	HeapBlock* CreateBlock(Pool& Pool);
+	void ReleaseBlockRange(const PendingFree& Range);
+
+	// Resources destroyed after Destroy have nothing left to return their memory to
+	static bool sm_Destroyed;
+
+	ID3D12Device* m_Device = nullptr;
+	D3D12_RESOURCE_HEAP_TIER m_HeapTier = D3D12_RESOURCE_HEAP_TIER_1;
+	Pool m_Pools[kNumPools] = {};
+
+	mutable std::mutex m_Mutex;
+	std::vector<PendingFree> m_PendingFrees;
+	Stats m_Stats = {};
+};
+
+namespace Graphics
+{
+	extern GpuHeapAllocator g_GpuHeapAllocator;
+}
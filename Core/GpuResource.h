@@ -1,24 +1,38 @@
 #pragma once
 
 #include <d3d12.h>
+#include <vector>
+
+#include "GpuHeapAllocator.h"
 
 class GpuResource
 {
 	friend class CommandContext;
 	friend class GraphicsContext;
 	friend class ComputeContext;
+	friend class UploadManager;
+	friend class CommandTrace;
 
 public:
 	GpuResource() = default;
 
-	GpuResource(ID3D12Resource* pResource, D3D12_RESOURCE_STATES CurrentState) :
+	GpuResource(ID3D12Resource* pResource, D3D12_RESOURCE_STATES CurrentState, GpuHeapAllocation&& Allocation = {}) :
 		m_pResource(pResource),
-		m_UsageState(CurrentState)
+		m_UsageState(CurrentState),
+		m_Allocation(std::move(Allocation))
 	{}
 
+	// Releases the resource before the memory it is placed in
+	virtual ~GpuResource() { GpuResource::Destroy(); }
+
+	// Resources are kept in containers by value, e.g. the textures of a model
+	GpuResource(GpuResource&&) = default;
+	GpuResource& operator=(GpuResource&&) = default;
+
 	virtual void Destroy()
 	{
 		m_pResource = nullptr;
+		Graphics::g_GpuHeapAllocator.Free(m_Allocation);
 		m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
 		if (m_UserAllocatedMemory != nullptr)
 		{
@@ -35,11 +49,18 @@ public:
 
 	D3D12_GPU_VIRTUAL_ADDRESS GetGpuVirtualAddress() const { return m_GpuVirtualAddress; }
 
+	// Lets the residency manager page the resource's memory out while it isn't used. Every use then
+	// has to be marked on the context that records it, see CommandContext::MarkUsed.
+	void AllowEviction() { Graphics::g_GpuHeapAllocator.AllowEviction(m_Allocation); }
+
 protected:
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_pResource;
 	D3D12_RESOURCE_STATES m_UsageState = D3D12_RESOURCE_STATE_COMMON;
-	D3D12_RESOURCE_STATES m_TransitioningState = (D3D12_RESOURCE_STATES)-1;
+	// State of each subresource while they differ, m_UsageState is only meaningful when this is empty
+	std::vector<D3D12_RESOURCE_STATES> m_SubresourceStates;
 	D3D12_GPU_VIRTUAL_ADDRESS m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
+	// Where the resource's memory came from, see GpuHeapAllocator::CreateResource
+	GpuHeapAllocation m_Allocation;
 
 	// When using VirtualAlloc() to allocate memory directly, record the allocation here so that it can be freed.  The
 	// GpuVirtualAddress may be offset from the true allocation start.
@@ -0,0 +1,148 @@
+#include "pch.h"
+#include "GraphicsBackend.h"
+#include "RecordingDevice.h"
+
+#include <dxgi1_6.h>
+
+using Microsoft::WRL::ComPtr;
+
+namespace Graphics
+{
+	eBackend g_BackendType = eBackend::kHardware;
+	GraphicsBackend* g_Backend = nullptr;
+}
+
+using namespace Graphics;
+
+namespace
+{
+	class D3D12Backend : public GraphicsBackend
+	{
+	public:
+		explicit D3D12Backend(bool UseWarp) : m_UseWarp(UseWarp) {}
+
+		HRESULT CreateDevice(ID3D12Device** Device, IDXGIAdapter3** Adapter) override
+		{
+			ComPtr<ID3D12Device> pDevice;
+
+#if _DEBUG
+			ComPtr<ID3D12Debug> debugInterface;
+			if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugInterface))))
+				debugInterface->EnableDebugLayer();
+			else
+				Utility::Print("WARNING: Unable to enable D3D12 debug validation layer\n");
+#endif // _DEBUG
+
+			ASSERT_SUCCEEDED(CreateDXGIFactory2(0, IID_PPV_ARGS(&m_Factory)));
+
+			ComPtr<IDXGIAdapter1> pAdapter;
+
+			if (!m_UseWarp)
+			{
+				SIZE_T MaxSize = 0;
+				ComPtr<ID3D12Device> pBestDevice;
+
+				for (auto Idx = 0; DXGI_ERROR_NOT_FOUND != m_Factory->EnumAdapters1(Idx, &pAdapter); ++Idx)
+				{
+					DXGI_ADAPTER_DESC1 desc;
+					pAdapter->GetDesc1(&desc);
+					if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)
+						continue;
+
+					if (desc.DedicatedVideoMemory > MaxSize && SUCCEEDED(D3D12CreateDevice(pAdapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&pDevice))))
+					{
+						pAdapter->GetDesc1(&desc);
+						Utility::Printf(L"D3D12-capable hardware found:  {} ({} MB)\n", desc.Description, desc.DedicatedVideoMemory >> 20);
+						MaxSize = desc.DedicatedVideoMemory;
+						pBestDevice = pDevice;
+					}
+				}
+
+				pDevice = pBestDevice;
+			}
+
+			if (pDevice == nullptr)
+			{
+				if (m_UseWarp)
+					Utility::Print("WARP software adapter requested. Initializing...\n");
+				else
+					Utility::Print("Failed to find a hardware adapter. Falling back to WARP.\n");
+				ASSERT_SUCCEEDED(m_Factory->EnumWarpAdapter(IID_PPV_ARGS(&pAdapter)));
+				ASSERT_SUCCEEDED(D3D12CreateDevice(pAdapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&pDevice)));
+			}
+#ifndef RELEASE
+			else
+			{
+				bool DeveloperModeEnabled = false;
+
+				HKEY hKey;
+				LSTATUS result = RegOpenKeyEx(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\AppModelUnlock", 0, KEY_READ, &hKey);
+				if (result == ERROR_SUCCESS)
+				{
+					DWORD keyValue, keySize = sizeof(DWORD);
+					result = RegQueryValueEx(hKey, L"AllowDevelopmentWithoutDevLicense", 0, NULL, (byte*)&keyValue, &keySize);
+					if (result == ERROR_SUCCESS && keyValue == 1)
+						DeveloperModeEnabled = true;
+					RegCloseKey(hKey);
+				}
+
+				WARN_ONCE_IF_NOT(DeveloperModeEnabled, "Enabled Developer Mode on Windows 10 to get consistent profiling results");
+			}
+#endif // !RELEASE
+
+			// The adapter the device was created on, pAdapter is whichever was enumerated last
+			if (FAILED(m_Factory->EnumAdapterByLuid(pDevice->GetAdapterLuid(), __uuidof(IDXGIAdapter3), reinterpret_cast<void**>(Adapter))))
+				Utility::Print("WARNING: Unable to query the video memory budget, resources won't be evicted\n");
+
+			*Device = pDevice.Detach();
+			return S_OK;
+		}
+
+		HRESULT SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC& Desc, ID3DBlob** Blob, ID3DBlob** ErrorBlob) override
+		{
+			return D3D12SerializeRootSignature(&Desc, D3D_ROOT_SIGNATURE_VERSION_1, Blob, ErrorBlob);
+		}
+
+		HRESULT CreateSwapChain(HWND Window, ID3D12CommandQueue* Queue, const DXGI_SWAP_CHAIN_DESC1& Desc, IDXGISwapChain1** SwapChain) override
+		{
+			return m_Factory->CreateSwapChainForHwnd(Queue, Window, &Desc, nullptr, nullptr, SwapChain);
+		}
+
+	private:
+		const bool m_UseWarp;
+		ComPtr<IDXGIFactory4> m_Factory;
+	};
+
+	class RecordingBackend : public GraphicsBackend
+	{
+	public:
+		HRESULT CreateDevice(ID3D12Device** Device, IDXGIAdapter3** Adapter) override
+		{
+			Utility::Print("Recording backend requested, commands won't be executed\n");
+			*Adapter = nullptr;
+			return Recording::CreateDevice(Device);
+		}
+
+		HRESULT SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC& Desc, ID3DBlob** Blob, ID3DBlob** ErrorBlob) override
+		{
+			if (ErrorBlob != nullptr)
+				*ErrorBlob = nullptr;
+			return Recording::SerializeRootSignature(Desc, Blob);
+		}
+
+		HRESULT CreateSwapChain(HWND, ID3D12CommandQueue*, const DXGI_SWAP_CHAIN_DESC1&, IDXGISwapChain1**) override
+		{
+			return E_NOTIMPL;
+		}
+	};
+}
+
+std::unique_ptr<GraphicsBackend> Graphics::CreateBackend(eBackend Type)
+{
+	switch (Type)
+	{
+		case eBackend::kRecording: return std::make_unique<RecordingBackend>();
+		case eBackend::kWarp: return std::make_unique<D3D12Backend>(true);
+		default: return std::make_unique<D3D12Backend>(false);
+	}
+}
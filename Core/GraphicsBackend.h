@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+
+struct IDXGIAdapter3;
+struct IDXGISwapChain1;
+struct DXGI_SWAP_CHAIN_DESC1;
+
+// The entry points the engine needs from the graphics runtime besides the methods of the device.
+// Everything else goes through the ID3D12Device and the objects it creates, so the backend decides
+// what the engine talks to: the D3D12 runtime on a hardware or WARP adapter, or a recording device
+// that needs neither a GPU nor a driver (see RecordingDevice.h).
+class GraphicsBackend
+{
+public:
+	virtual ~GraphicsBackend() = default;
+
+	// Adapter is left null when the backend has no DXGI adapter, i.e. no video memory budget
+	virtual HRESULT CreateDevice(ID3D12Device** Device, IDXGIAdapter3** Adapter) = 0;
+	virtual HRESULT SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC& Desc, ID3DBlob** Blob, ID3DBlob** ErrorBlob) = 0;
+	// Returns E_NOTIMPL if the backend can't present, it can then only run headless
+	virtual HRESULT CreateSwapChain(HWND Window, ID3D12CommandQueue* Queue, const DXGI_SWAP_CHAIN_DESC1& Desc, IDXGISwapChain1** SwapChain) = 0;
+};
+
+namespace Graphics
+{
+	enum class eBackend { kHardware, kWarp, kRecording };
+
+	// Selects the backend Initialize creates the device with
+	extern eBackend g_BackendType;
+	extern GraphicsBackend* g_Backend;
+
+	std::unique_ptr<GraphicsBackend> CreateBackend(eBackend Type);
+}
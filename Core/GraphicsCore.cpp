@@ -11,6 +11,13 @@
 #include "CommandListManager.h"
 #include "RootSignature.h"
 #include "GraphRenderer.h"
+#include "GeometryPool.h"
+#include "CommandTrace.h"
+#include "UploadManager.h"
+#include "PipelineCache.h"
+#include "GpuHeapAllocator.h"
+#include "ResidencyManager.h"
+#include "GraphicsBackend.h"
 
 #include <dxgi1_6.h>
 
@@ -23,6 +30,8 @@
 #include "CompiledShaders/SharpeningUpsamplePS.h"
 
 #define SWAP_CHAIN_BUFFER_COUNT 3
+#define MAX_FRAMES_IN_FLIGHT 3
+#define SWAP_CHAIN_FLAGS (DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH | DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT)
 
 DXGI_FORMAT SwapChainFormat = DXGI_FORMAT_R10G10B10A2_UNORM;
 
@@ -45,6 +54,16 @@ namespace
 
 	BoolVar s_LimitTo30Hz("Timing/Limit To 30Hz", false);
 	BoolVar s_DropRandomFrames("Timing/Drop Random Frames", false);
+
+	// How many frames the CPU may record ahead of the one the GPU is working on
+	NumVar s_FramesInFlight("Timing/Frames In Flight", 2.0f, 1.0f, MAX_FRAMES_IN_FLIGHT, 1.0f);
+	uint32_t s_MaxFrameLatency = 0;
+	HANDLE s_FrameLatencyWaitable = nullptr;
+	// Graphics queue fence value signaled after each of the last frames was presented
+	uint64_t s_FrameFences[MAX_FRAMES_IN_FLIGHT] = {};
+
+	int64_t s_InputTick = 0;
+	float s_InputLatency = 0.0f;
 }
 
 namespace Graphics
@@ -122,6 +141,10 @@ namespace Graphics
 	ContextManager g_ContextManager;
 
 	ComPtr<IDXGISwapChain1> s_SwapChain1 = nullptr;
+	ComPtr<IDXGISwapChain2> s_SwapChain2 = nullptr;
+	bool g_Headless = false;
+	bool s_Initialized = false;
+	std::unique_ptr<GraphicsBackend> s_Backend;
 
 	DescriptorAllocator g_DescriptorAllocator[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES] =
 	{
@@ -131,6 +154,39 @@ namespace Graphics
 		D3D12_DESCRIPTOR_HEAP_TYPE_DSV,
 	};
 
+	void PrintDescriptorUsage(void*)
+	{
+		const char* TypeNames[] = { "CBV/SRV/UAV", "Sampler", "RTV", "DSV" };
+		for (uint32_t Type = 0; Type < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++Type)
+		{
+			const auto Stats = g_DescriptorAllocator[Type].GetStats();
+			Utility::Printf("{} descriptors: {} heaps, {} allocated, {} free, {} pending free\n", TypeNames[Type],
+				Stats.NumHeaps, Stats.NumAllocated, Stats.NumFree, Stats.NumPendingFree);
+		}
+	}
+
+	CallbackTrigger s_PrintDescriptorUsage("Graphics/Print Descriptor Usage", PrintDescriptorUsage);
+
+	void PrintHeapUsage(void*)
+	{
+		const auto Stats = g_GpuHeapAllocator.GetStats();
+		Utility::Printf("GPU heaps: {} heaps ({} MB), {} placed ({} MB), {} MB pending free, {} committed ({} MB)\n",
+			Stats.NumHeaps, Stats.HeapBytes >> 20, Stats.NumPlaced, Stats.PlacedBytes >> 20, Stats.PendingFreeBytes >> 20,
+			Stats.NumCommitted, Stats.CommittedBytes >> 20);
+	}
+
+	CallbackTrigger s_PrintHeapUsage("Graphics/Print Heap Usage", PrintHeapUsage);
+
+	void PrintResidency(void*)
+	{
+		const auto Stats = g_ResidencyManager.GetStats();
+		Utility::Printf("Video memory: {} MB used of {} MB budget, {} objects tracked ({} MB), {} MB evicted, {} evictions, {} paged back in\n",
+			Stats.CurrentUsage >> 20, Stats.Budget >> 20, Stats.NumTracked, Stats.TrackedBytes >> 20, Stats.EvictedBytes >> 20,
+			Stats.NumEvictions, Stats.NumMadeResident);
+	}
+
+	CallbackTrigger s_PrintResidency("Graphics/Print Residency", PrintResidency);
+
 	RootSignature s_PresentRS;
 	GraphicsPSO s_BlendUIPSO;
 	GraphicsPSO PresentSDRPS;
@@ -157,82 +213,16 @@ namespace Graphics
 
 void Graphics::Initialize(void)
 {
-	ASSERT(s_SwapChain1 == nullptr, "Graphics has already been initialized");
-
-	ComPtr<ID3D12Device> pDevice;
-
-#if _DEBUG
-	ComPtr<ID3D12Debug> debugInterface;
-	if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugInterface))))
-		debugInterface->EnableDebugLayer();
-	else
-		Utility::Print("WARNING: Unable to enable D3D12 debug validation layer\n");
-#endif // _DEBUG
-
-	//! EnableExperimentalShaderModels();
-
-	ComPtr<IDXGIFactory4> dxgiFactory;
-	ASSERT_SUCCEEDED(CreateDXGIFactory2(0, IID_PPV_ARGS(&dxgiFactory)));
-
-	ComPtr<IDXGIAdapter1> pAdapter;
-
-	static const bool bUseWarpDriver = false;
-
-	if (!bUseWarpDriver)
-	{
-		SIZE_T MaxSize = 0;
-
-		for (auto Idx = 0; DXGI_ERROR_NOT_FOUND != dxgiFactory->EnumAdapters1(Idx, &pAdapter); ++Idx)
-		{
-			DXGI_ADAPTER_DESC1 desc;
-			pAdapter->GetDesc1(&desc);
-			if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)
-				continue;
-
-			if (desc.DedicatedVideoMemory > MaxSize && SUCCEEDED(D3D12CreateDevice(pAdapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&pDevice))))
-			{
-				pAdapter->GetDesc1(&desc);
-				Utility::Printf(L"D3D12-capable hardware found:  {} ({} MB)\n", desc.Description, desc.DedicatedVideoMemory >> 20);
-				MaxSize = desc.DedicatedVideoMemory;
-			}
-		}
-
-		if (MaxSize > 0)
-			g_Device = pDevice.Detach();
-	}
-
-	if (g_Device == nullptr)
-	{
-		if (bUseWarpDriver)
-			Utility::Print("WARP software adapter requested. Initializing...\n");
-		else
-			Utility::Print("Failed to find a hardware adapter. Falling back to WARP.\n");
-		ASSERT_SUCCEEDED(dxgiFactory->EnumWarpAdapter(IID_PPV_ARGS(&pAdapter)));
-		ASSERT_SUCCEEDED(D3D12CreateDevice(pAdapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&pDevice)));
-		g_Device = pDevice.Detach();
-	}
-#ifndef RELEASE
-	else
-	{
-		bool DeveloperModeEnabled = false;
+	ASSERT(!s_Initialized, "Graphics has already been initialized");
+	s_Initialized = true;
 
-		HKEY hKey;
-		LSTATUS result = RegOpenKeyEx(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\AppModelUnlock", 0, KEY_READ, &hKey);
-		if (result == ERROR_SUCCESS)
-		{
-			DWORD keyValue, keySize = sizeof(DWORD);
-			result = RegQueryValueEx(hKey, L"AllowDevelopmentWithoutDevLicense", 0, NULL, (byte*)&keyValue, &keySize);
-			if (result == ERROR_SUCCESS && keyValue == 1)
-				DeveloperModeEnabled = true;
-			RegCloseKey(hKey);
-		}
+	ASSERT(g_Headless || g_BackendType != eBackend::kRecording, "The recording backend can't present");
 
-		WARN_ONCE_IF_NOT(DeveloperModeEnabled, "Enabled Developer Mode on Windows 10 to get consistent profiling results");
+	s_Backend = CreateBackend(g_BackendType);
+	g_Backend = s_Backend.get();
 
-		/*if (DeveloperModeEnabled)
-			g_Device->SetStablePowerState(TRUE);*/
-	}
-#endif // !RELEASE
+	ComPtr<IDXGIAdapter3> pAdapter3;
+	ASSERT_SUCCEEDED(g_Backend->CreateDevice(&g_Device, &pAdapter3));
 
 #if _DEBUG
 	ID3D12InfoQueue* pInfoQueue = nullptr;
@@ -311,27 +301,46 @@ void Graphics::Initialize(void)
 		}
 	}
 
+	g_ResidencyManager.Create(g_Device, pAdapter3.Get());
+	g_GpuHeapAllocator.Create(g_Device);
 	g_CommandManager.Create(g_Device);
+	g_UploadManager.Create(L"Upload staging ring", 64 * 1024 * 1024);
+	PipelineCache::Initialize(L"PipelineCache.bin");
 
-	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-	swapChainDesc.Width = g_DisplayWidth;
-	swapChainDesc.Height = g_DisplayHeight;
-	swapChainDesc.Format = SwapChainFormat;
-	swapChainDesc.Scaling = DXGI_SCALING_NONE;
-	swapChainDesc.SampleDesc.Quality = 0;
-	swapChainDesc.SampleDesc.Count = 1;
-	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapChainDesc.BufferCount = SWAP_CHAIN_BUFFER_COUNT;
-	swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
-	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
-
-	ASSERT_SUCCEEDED(dxgiFactory->CreateSwapChainForHwnd(g_CommandManager.GetCommandQueue(), GameCore::g_hWnd, &swapChainDesc, nullptr, nullptr, &s_SwapChain1));
-
-	for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+	if (g_Headless)
 	{
-		ComPtr<ID3D12Resource> DisplayPlane;
-		ASSERT_SUCCEEDED(s_SwapChain1->GetBuffer(i, IID_PPV_ARGS(&DisplayPlane)));
-		g_DisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", DisplayPlane.Detach());
+		for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+			g_DisplayPlane[i].Create(L"Headless Display Plane", g_DisplayWidth, g_DisplayHeight, 1, SwapChainFormat);
+	}
+	else
+	{
+		DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+		swapChainDesc.Width = g_DisplayWidth;
+		swapChainDesc.Height = g_DisplayHeight;
+		swapChainDesc.Format = SwapChainFormat;
+		swapChainDesc.Scaling = DXGI_SCALING_NONE;
+		swapChainDesc.SampleDesc.Quality = 0;
+		swapChainDesc.SampleDesc.Count = 1;
+		swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		swapChainDesc.BufferCount = SWAP_CHAIN_BUFFER_COUNT;
+		swapChainDesc.Flags = SWAP_CHAIN_FLAGS;
+		swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+
+		ASSERT_SUCCEEDED(g_Backend->CreateSwapChain(GameCore::g_hWnd, g_CommandManager.GetCommandQueue(), swapChainDesc, &s_SwapChain1));
+
+		// The waitable object is signaled whenever the swap chain can take another frame, which
+		// replaces DXGI blocking in Present with a wait before the frame has sampled its input
+		ASSERT_SUCCEEDED(s_SwapChain1.As(&s_SwapChain2));
+		s_MaxFrameLatency = (uint32_t)(float)s_FramesInFlight;
+		ASSERT_SUCCEEDED(s_SwapChain2->SetMaximumFrameLatency(s_MaxFrameLatency));
+		s_FrameLatencyWaitable = s_SwapChain2->GetFrameLatencyWaitableObject();
+
+		for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+		{
+			ComPtr<ID3D12Resource> DisplayPlane;
+			ASSERT_SUCCEEDED(s_SwapChain1->GetBuffer(i, IID_PPV_ARGS(&DisplayPlane)));
+			g_DisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", DisplayPlane.Detach());
+		}
 	}
 
 	InitializeCommonState();
@@ -385,6 +394,7 @@ void Graphics::Initialize(void)
 	g_PreDisplayBuffer.Create(L"PreDisplay Buffer", g_DisplayWidth, g_DisplayHeight, 1, SwapChainFormat);
 
 	GpuTimeManager::Initialize(4096);
+	g_GeometryPool.Create(L"Geometry pool", 128 * 1024 * 1024);
 	SetNativeResolution();
 	//!
 	TextRenderer::Initialize();
@@ -394,7 +404,7 @@ void Graphics::Initialize(void)
 
 void Graphics::Resize(uint32_t width, uint32_t height)
 {
-	ASSERT(s_SwapChain1 != nullptr);
+	ASSERT(s_Initialized);
 
 	// Check for invalid windows dimensions
 	if (width == 0 || height == 0)
@@ -416,13 +426,21 @@ void Graphics::Resize(uint32_t width, uint32_t height)
 	for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
 		g_DisplayPlane[i].Destroy();
 
-	ASSERT_SUCCEEDED(s_SwapChain1->ResizeBuffers(SWAP_CHAIN_BUFFER_COUNT, width, height, SwapChainFormat, 0));
-
-	for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+	if (g_Headless)
+	{
+		for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+			g_DisplayPlane[i].Create(L"Headless Display Plane", width, height, 1, SwapChainFormat);
+	}
+	else
 	{
-		ComPtr<ID3D12Resource> DisplayPlane;
-		ASSERT_SUCCEEDED(s_SwapChain1->GetBuffer(i, IID_PPV_ARGS(&DisplayPlane)));
-		g_DisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", DisplayPlane.Detach());
+		ASSERT_SUCCEEDED(s_SwapChain1->ResizeBuffers(SWAP_CHAIN_BUFFER_COUNT, width, height, SwapChainFormat, SWAP_CHAIN_FLAGS));
+
+		for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+		{
+			ComPtr<ID3D12Resource> DisplayPlane;
+			ASSERT_SUCCEEDED(s_SwapChain1->GetBuffer(i, IID_PPV_ARGS(&DisplayPlane)));
+			g_DisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", DisplayPlane.Detach());
+		}
 	}
 
 	g_CurrentBuffer = 0;
@@ -434,16 +452,29 @@ void Graphics::Resize(uint32_t width, uint32_t height)
 void Graphics::Terminate(void)
 {
 	g_CommandManager.IdleGPU();
-	s_SwapChain1->SetFullscreenState(FALSE, nullptr);
+	if (s_SwapChain1 != nullptr)
+		s_SwapChain1->SetFullscreenState(FALSE, nullptr);
 }
 
 void Graphics::Shutdown(void)
 {
-	CommandContext::DestroyAllContexts();
+	// Objects created for a loaded command trace are released while the device still exists
+	g_CommandTrace.Clear();
+	g_UploadManager.Destroy();
+	// Stops the fence watchers, which may still be returning pages and heaps to the context pools
 	g_CommandManager.Shutdown();
+	CommandContext::DestroyAllContexts();
 	GpuTimeManager::Shutdown();
+	if (s_FrameLatencyWaitable != nullptr)
+	{
+		CloseHandle(s_FrameLatencyWaitable);
+		s_FrameLatencyWaitable = nullptr;
+	}
+	s_SwapChain2.Reset();
 	s_SwapChain1.Reset();
+	// Pipelines still compiling in the background must be done before the cache is saved
 	PSO::DestroyAll();
+	PipelineCache::Shutdown();
 	RootSignature::DestroyAll();
 	DescriptorAllocator::DestroyAll();
 
@@ -458,6 +489,9 @@ void Graphics::Shutdown(void)
 		plane.Destroy();
 
 	g_PreDisplayBuffer.Destroy();
+	g_GeometryPool.Destroy();
+	g_GpuHeapAllocator.Destroy();
+	g_ResidencyManager.Destroy();
 
 #ifdef _DEBUG
 	auto debugInterface = ComPtr<ID3D12DebugDevice>{};
@@ -466,6 +500,9 @@ void Graphics::Shutdown(void)
 #endif // _DEBUG
 
 	SAFE_RELEASE(g_Device);
+	g_Backend = nullptr;
+	s_Backend.reset();
+	s_Initialized = false;
 }
 
 void Graphics::PreparePresentLDR(void)
@@ -473,6 +510,8 @@ void Graphics::PreparePresentLDR(void)
 	GraphicsContext& Context = GraphicsContext::Begin(L"Present");
 
 	Context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	// The overlay is only read once upsampling is done, CompositeOverlays completes the transition
+	Context.BeginResourceTransition(g_OverlayBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 	
 	Context.SetRootSignature(s_PresentRS);
 	Context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -561,10 +600,26 @@ void Graphics::Present(void)
 
 	UINT PresentInterval = s_EnableVSync ? std::min(4, (int)Round(s_FrameTime * 60.0f)) : 0;
 
-	s_SwapChain1->Present(PresentInterval, 0);
+	g_CommandManager.FlushAll();
+	if (!g_Headless)
+		s_SwapChain1->Present(PresentInterval, 0);
+
+	// Also bounds how far ahead the CPU runs without a swap chain, see WaitForNextFrame
+	s_FrameFences[s_FrameIndex % MAX_FRAMES_IN_FLIGHT] = g_CommandManager.GetQueue().IncrementFence();
+
+	for (auto& Allocator : g_DescriptorAllocator)
+		Allocator.EndFrame(s_FrameFences[s_FrameIndex % MAX_FRAMES_IN_FLIGHT]);
+	g_GpuHeapAllocator.EndFrame(s_FrameFences[s_FrameIndex % MAX_FRAMES_IN_FLIGHT]);
+	g_ResidencyManager.EndFrame(s_FrameFences[s_FrameIndex % MAX_FRAMES_IN_FLIGHT]);
 
 	int64_t CurrentTick = SystemTime::GetCurrentTick();
 
+	if (s_InputTick != 0)
+	{
+		const float InputLatency = (float)SystemTime::TimeBetweenTicks(s_InputTick, CurrentTick) * 1000.0f;
+		s_InputLatency = s_InputLatency == 0.0f ? InputLatency : s_InputLatency * 0.9f + InputLatency * 0.1f;
+	}
+
 	if (s_EnableVSync)
 	{
 		// With VSync enabled, the time step between frames becomes a multiple of 16.666 ms.  We need
@@ -585,11 +640,38 @@ void Graphics::Present(void)
 	s_FrameStartTick = CurrentTick;
 
 	++s_FrameIndex;
+	g_CommandTrace.EndFrame();
 	//! TemporalEffects::Update((uint32_t)s_FrameIndex);
 
 	SetNativeResolution();
 }
 
+void Graphics::WaitForNextFrame(void)
+{
+	const uint32_t FramesInFlight = (uint32_t)(float)s_FramesInFlight;
+
+	if (s_SwapChain2 != nullptr && FramesInFlight != s_MaxFrameLatency)
+	{
+		ASSERT_SUCCEEDED(s_SwapChain2->SetMaximumFrameLatency(FramesInFlight));
+		s_MaxFrameLatency = FramesInFlight;
+	}
+
+	if (s_FrameLatencyWaitable != nullptr)
+		WaitForSingleObjectEx(s_FrameLatencyWaitable, 1000, TRUE);
+
+	// The swap chain only counts presents, the GPU may still be working on older frames whose
+	// allocators and upload pages this one would otherwise pile onto
+	if (s_FrameIndex >= FramesInFlight)
+		g_CommandManager.WaitForFence(s_FrameFences[(s_FrameIndex - FramesInFlight) % MAX_FRAMES_IN_FLIGHT]);
+
+	s_InputTick = SystemTime::GetCurrentTick();
+}
+
+float Graphics::GetInputLatency(void)
+{
+	return s_InputLatency;
+}
+
 uint64_t Graphics::GetFrameCount(void)
 {
 	return s_FrameIndex;
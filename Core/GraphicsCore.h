@@ -24,10 +24,19 @@ namespace Graphics
 
 	using Microsoft::WRL::ComPtr;
 
+	// When set before Initialize, the engine runs without a window or swap chain, on the backend
+	// selected by g_BackendType (WARP or the recording device).  The display planes are ordinary
+	// render targets and Present only submits the final composite, so the whole CPU submission
+	// path can run on machines without a GPU (e.g. build agents).
+	extern bool g_Headless;
+
 	void Initialize(void);
 	void Resize(uint32_t width, uint32_t height);
 	void Terminate(void);
 	void Shutdown(void);
+	// Blocks until the swap chain and the frames-in-flight limit allow another frame to start.
+	// Called right before input is sampled, so the frame's input-to-present latency is minimal.
+	void WaitForNextFrame(void);
 	void Present(void);
 
 	extern uint32_t g_DisplayWidth;
@@ -40,6 +49,8 @@ namespace Graphics
 	extern ContextManager g_ContextManager;
 
 	float GetFrameTime(void);
+	// Smoothed time in milliseconds from WaitForNextFrame returning to Present returning
+	float GetInputLatency(void);
 
 	extern DescriptorAllocator g_DescriptorAllocator[];
 	inline D3D12_CPU_DESCRIPTOR_HANDLE AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE Type, UINT Count = 1)
@@ -47,5 +58,11 @@ namespace Graphics
 		return g_DescriptorAllocator[Type].Allocate(Count);
 	}
 
+	// The handle is reused once the GPU has finished the current frame
+	inline void FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE Type, D3D12_CPU_DESCRIPTOR_HANDLE Handle, UINT Count = 1)
+	{
+		g_DescriptorAllocator[Type].Free(Handle, Count);
+	}
+
 	enum eResolution { k720p, k900p, k1080p, k1440p, k1800p, k2160p };
 }
\ No newline at end of file
@@ -19,12 +19,6 @@ LinearAllocationPage* LinearAllocatorPageManager::RequestPage(void)
 {
 	auto lg = lock_guard{ m_Mutex };
 
-	while (!m_RetiredPages.empty() && g_CommandManager.IsFenceComplete(m_RetiredPages.front().first))
-	{
-		m_AvailablePages.push(m_RetiredPages.front().second);
-		m_RetiredPages.pop();
-	}
-
 	LinearAllocationPage* PagePtr = nullptr;
 
 	if (!m_AvailablePages.empty())
@@ -43,12 +37,7 @@ LinearAllocationPage* LinearAllocatorPageManager::RequestPage(void)
 
 LinearAllocationPage* LinearAllocatorPageManager::CreateNewPage(size_t PageSize)
 {
-	D3D12_HEAP_PROPERTIES HeapProps;
-	HeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	HeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	HeapProps.CreationNodeMask = 1;
-	HeapProps.VisibleNodeMask = 1;
-
+	D3D12_HEAP_TYPE HeapType;
 	D3D12_RESOURCE_DESC ResourceDesc;
 	ResourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
 	ResourceDesc.Alignment = 0;
@@ -63,50 +52,51 @@ LinearAllocationPage* LinearAllocatorPageManager::CreateNewPage(size_t PageSize)
 
 	if (m_AllocationType == kGpuExclusive)
 	{
-		HeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+		HeapType = D3D12_HEAP_TYPE_DEFAULT;
 		ResourceDesc.Width = PageSize == 0 ? kGpuAllocatorPageSize : PageSize;
 		ResourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 		DefaultUsage = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
 	}
 	else
 	{
-		HeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+		HeapType = D3D12_HEAP_TYPE_UPLOAD;
 		ResourceDesc.Width = PageSize == 0 ? kCpuAllocatorPageSize : PageSize;
 		ResourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 		DefaultUsage = D3D12_RESOURCE_STATE_GENERIC_READ;
 	}
 
-	ID3D12Resource* pBuffer;
-	ASSERT_SUCCEEDED(g_Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE,
-		&ResourceDesc, DefaultUsage, nullptr, IID_PPV_ARGS(&pBuffer)));
+	GpuHeapAllocation Allocation;
+	ID3D12Resource* pBuffer = g_GpuHeapAllocator.CreateResource(HeapType, ResourceDesc, DefaultUsage, nullptr, Allocation);
 
 	pBuffer->SetName(L"LinearAllocator Page");
 
-	return new LinearAllocationPage(pBuffer, DefaultUsage);
+	return new LinearAllocationPage(pBuffer, DefaultUsage, std::move(Allocation));
 }
 
 void LinearAllocatorPageManager::DiscardPages(uint64_t FenceID, const std::vector<LinearAllocationPage*>& UsedPages)
 {
-	auto lg = lock_guard{ m_Mutex };
-	for (auto page : UsedPages)
-		m_RetiredPages.push(make_pair(FenceID, page));
+	// Pages only become available once the GPU is done with them
+	g_CommandManager.OnFenceComplete(FenceID, [this, UsedPages]
+	{
+		auto lg = lock_guard{ m_Mutex };
+		for (auto page : UsedPages)
+			m_AvailablePages.push(page);
+	});
 }
 
 void LinearAllocatorPageManager::FreeLargePages(uint64_t FenceID, const std::vector<LinearAllocationPage*>& LargePages)
 {
-	auto lg = lock_guard{ m_Mutex };
+	if (LargePages.empty())
+		return;
 
 	for (auto& page : LargePages)
-	{
 		page->Unmap();
-		m_DeletionQueue.push(make_pair(FenceID, page));
-	}
 
-	while (!m_DeletionQueue.empty() && g_CommandManager.IsFenceComplete(m_DeletionQueue.front().first))
+	g_CommandManager.OnFenceComplete(FenceID, [LargePages]
 	{
-		delete m_DeletionQueue.front().second;
-		m_DeletionQueue.pop();
-	}
+		for (auto page : LargePages)
+			delete page;
+	});
 }
 
 LinearAllocatorPageManager LinearAllocator::sm_PageManager[2];
@@ -22,7 +22,8 @@ struct DynAlloc
 class LinearAllocationPage : public GpuResource
 {
 public:
-	LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage) : GpuResource(pResource, Usage)
+	LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage, GpuHeapAllocation&& Allocation)
+		: GpuResource(pResource, Usage, std::move(Allocation))
 	{
 		m_GpuVirtualAddress = m_pResource->GetGPUVirtualAddress();
 		m_pResource->Map(0, nullptr, &m_CpuVirtualAddress);
@@ -31,6 +32,7 @@ public:
 	~LinearAllocationPage()
 	{
 		Unmap();
+		Destroy();
 	}
 
 	void Map(void)
@@ -89,8 +91,6 @@ private:
 
 	LinearAllocatorType m_AllocationType;
 	std::vector<std::unique_ptr<LinearAllocationPage>> m_PagePool;
-	std::queue<std::pair<uint64_t, LinearAllocationPage*>> m_RetiredPages;
-	std::queue<std::pair<uint64_t, LinearAllocationPage*>> m_DeletionQueue;
 	std::queue<LinearAllocationPage*> m_AvailablePages;
 	std::mutex m_Mutex;
 };
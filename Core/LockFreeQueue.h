@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+// Bounded multi-producer multi-consumer FIFO that never takes a lock. Every cell carries a sequence
+// number telling producers and consumers whose turn it is, so a push or pop is a single CAS on the
+// shared position in the uncontended case (Dmitry Vyukov's bounded MPMC queue).
+template <typename T, size_t Capacity>
+class LockFreeQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+	LockFreeQueue() : m_Cells(std::make_unique<Cell[]>(Capacity))
+	{
+		for (size_t i = 0; i < Capacity; ++i)
+			m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+	}
+
+	LockFreeQueue(const LockFreeQueue&) = delete;
+	LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+	// Returns false when the queue is full
+	bool TryPush(const T& Value)
+	{
+		Cell* Target;
+		size_t Position = m_EnqueuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Target = &m_Cells[Position & (Capacity - 1)];
+			const size_t Sequence = Target->Sequence.load(std::memory_order_acquire);
+			const auto Difference = static_cast<intptr_t>(Sequence) - static_cast<intptr_t>(Position);
+
+			if (Difference == 0)
+			{
+				if (m_EnqueuePosition.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (Difference < 0)
+				return false;
+			else
+				Position = m_EnqueuePosition.load(std::memory_order_relaxed);
+		}
+
+		Target->Value = Value;
+		Target->Sequence.store(Position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false when the queue is empty
+	bool TryPop(T& Value)
+	{
+		Cell* Source;
+		size_t Position = m_DequeuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Source = &m_Cells[Position & (Capacity - 1)];
+			const size_t Sequence = Source->Sequence.load(std::memory_order_acquire);
+			const auto Difference = static_cast<intptr_t>(Sequence) - static_cast<intptr_t>(Position + 1);
+
+			if (Difference == 0)
+			{
+				if (m_DequeuePosition.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (Difference < 0)
+				return false;
+			else
+				Position = m_DequeuePosition.load(std::memory_order_relaxed);
+		}
+
+		Value = Source->Value;
+		Source->Sequence.store(Position + Capacity, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> Sequence;
+		T Value;
+	};
+
+	std::unique_ptr<Cell[]> m_Cells;
+	// Producers and consumers each hammer their own position, keep them off each other's cache line
+	alignas(64) std::atomic<size_t> m_EnqueuePosition = 0;
+	alignas(64) std::atomic<size_t> m_DequeuePosition = 0;
+};
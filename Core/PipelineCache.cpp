@@ -0,0 +1,220 @@
+#include "pch.h"
+#include "PipelineCache.h"
+#include "GraphicsCore.h"
+#include "FileUtility.h"
+#include "Hash.h"
+
+#include <fstream>
+#include <shared_mutex>
+
+using namespace Graphics;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t NumPipelines;
+		uint32_t Reserved;
+	};
+
+	constexpr uint32_t kMagic = 'CPSP';
+	constexpr uint32_t kVersion = 1;
+
+	std::wstring s_FileName;
+	ComPtr<ID3D12Device1> s_Device1;
+	ComPtr<ID3D12PipelineLibrary> s_Library;
+	// The library reads pipelines straight out of the blob it was created from
+	Utility::ByteArray s_LibraryBlob;
+	uint32_t s_NumLoadedPipelines = 0;
+
+	// Loads and stores may run concurrently, serializing may not
+	std::shared_mutex s_LibraryMutex;
+
+	std::mutex s_SessionMutex;
+	std::vector<std::pair<std::wstring, ComPtr<ID3D12PipelineState>>> s_SessionPipelines;
+	uint32_t s_NumCompiledPipelines = 0;
+
+	size_t HashBytecode(const D3D12_SHADER_BYTECODE& Bytecode, size_t Hash)
+	{
+		ASSERT(Bytecode.BytecodeLength % 4 == 0);
+		return Utility::HashState((const uint32_t*)Bytecode.pShaderBytecode, Bytecode.BytecodeLength / 4, Hash);
+	}
+
+	size_t HashString(const char* String, size_t Hash)
+	{
+		for (; *String != '\0'; ++String)
+			Hash = 16777619U * Hash ^ (uint8_t)*String;
+		return Hash;
+	}
+
+	size_t HashGraphicsDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, size_t RootSignatureHash)
+	{
+		auto Stripped = Desc;
+		Stripped.pRootSignature = nullptr;
+		Stripped.VS = Stripped.PS = Stripped.DS = Stripped.HS = Stripped.GS = {};
+		Stripped.StreamOutput = {};
+		Stripped.InputLayout.pInputElementDescs = nullptr;
+		Stripped.CachedPSO = {};
+
+		size_t Hash = Utility::HashState(&Stripped, 1, RootSignatureHash);
+		for (const auto& Shader : { Desc.VS, Desc.PS, Desc.DS, Desc.HS, Desc.GS })
+			Hash = HashBytecode(Shader, Hash);
+
+		for (UINT i = 0; i < Desc.InputLayout.NumElements; ++i)
+		{
+			auto Element = Desc.InputLayout.pInputElementDescs[i];
+			Hash = HashString(Element.SemanticName, Hash);
+			Element.SemanticName = nullptr;
+			Hash = Utility::HashState(&Element, 1, Hash);
+		}
+
+		return Hash;
+	}
+
+	size_t HashComputeDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, size_t RootSignatureHash)
+	{
+		auto Stripped = Desc;
+		Stripped.pRootSignature = nullptr;
+		Stripped.CS = {};
+		Stripped.CachedPSO = {};
+
+		return HashBytecode(Desc.CS, Utility::HashState(&Stripped, 1, RootSignatureHash));
+	}
+
+	void AddToSession(const std::wstring& Name, ID3D12PipelineState* PSO, bool Compiled)
+	{
+		auto lg = std::lock_guard{ s_SessionMutex };
+		s_SessionPipelines.emplace_back(Name, PSO);
+		if (Compiled)
+			++s_NumCompiledPipelines;
+	}
+
+	template <typename Desc, typename LoadFn, typename CreateFn>
+	ID3D12PipelineState* LoadOrCreate(const Desc& PSODesc, size_t Hash, LoadFn&& Load, CreateFn&& Create)
+	{
+		const auto Name = fmt::format(L"{:016x}", Hash);
+
+		ID3D12PipelineState* PSO = nullptr;
+		if (s_Library != nullptr)
+		{
+			auto lg = std::shared_lock{ s_LibraryMutex };
+			// Fails for names that aren't in the library and for descriptions that don't match the stored one
+			if (SUCCEEDED(Load(Name.c_str(), &PSODesc, IID_PPV_ARGS(&PSO))))
+			{
+				AddToSession(Name, PSO, false);
+				return PSO;
+			}
+		}
+
+		// Failures are left to the caller, which falls back to another pipeline
+		const HRESULT hr = Create(&PSODesc, IID_PPV_ARGS(&PSO));
+		if (FAILED(hr))
+		{
+			Utility::Printf(L"Failed to create pipeline {}: 0x{:08x}\n", Name, static_cast<uint32_t>(hr));
+			return nullptr;
+		}
+
+		if (s_Library != nullptr)
+			AddToSession(Name, PSO, true);
+
+		return PSO;
+	}
+}
+
+void PipelineCache::Initialize(const std::wstring& FileName)
+{
+	s_FileName = FileName;
+
+	D3D12_FEATURE_DATA_SHADER_CACHE ShaderCache = {};
+	if (FAILED(g_Device->QueryInterface(IID_PPV_ARGS(&s_Device1))) ||
+		FAILED(g_Device->CheckFeatureSupport(D3D12_FEATURE_SHADER_CACHE, &ShaderCache, sizeof(ShaderCache))) ||
+		(ShaderCache.SupportFlags & D3D12_SHADER_CACHE_SUPPORT_LIBRARY) == 0)
+	{
+		Utility::Print("Pipeline libraries are not supported, pipelines will be compiled on every launch\n");
+		s_Device1 = nullptr;
+		return;
+	}
+
+	s_LibraryBlob = Utility::ReadFileSync(FileName);
+	if (s_LibraryBlob->size() > sizeof(FileHeader))
+	{
+		const auto& Header = *reinterpret_cast<const FileHeader*>(s_LibraryBlob->data());
+		if (Header.Magic == kMagic && Header.Version == kVersion)
+		{
+			// Also fails with D3D12_ERROR_DRIVER_VERSION_MISMATCH or D3D12_ERROR_ADAPTER_NOT_FOUND for
+			// a library written by another driver or on another adapter
+			const HRESULT hr = s_Device1->CreatePipelineLibrary(s_LibraryBlob->data() + sizeof(FileHeader),
+				s_LibraryBlob->size() - sizeof(FileHeader), IID_PPV_ARGS(&s_Library));
+			if (SUCCEEDED(hr))
+				s_NumLoadedPipelines = Header.NumPipelines;
+			else
+				Utility::Printf(L"Discarding pipeline cache {} (0x{:08x})\n", FileName, (uint32_t)hr);
+		}
+	}
+
+	if (s_Library == nullptr)
+	{
+		s_LibraryBlob = Utility::NullFile;
+		s_NumLoadedPipelines = 0;
+		ASSERT_SUCCEEDED(s_Device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&s_Library)));
+	}
+}
+
+void PipelineCache::Shutdown(void)
+{
+	if (s_Library != nullptr)
+	{
+		auto lg = std::unique_lock{ s_LibraryMutex };
+		auto SessionLock = std::lock_guard{ s_SessionMutex };
+
+		// Nothing to write when every pipeline came from the file and the file held no others
+		if (s_NumCompiledPipelines > 0 || s_SessionPipelines.size() != s_NumLoadedPipelines)
+		{
+			auto Library = ComPtr<ID3D12PipelineLibrary>();
+			ASSERT_SUCCEEDED(s_Device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&Library)));
+
+			// The same description may have been finalized by several PSO objects, keep the first
+			uint32_t NumPipelines = 0;
+			for (const auto& [Name, PSO] : s_SessionPipelines)
+			{
+				if (SUCCEEDED(Library->StorePipeline(Name.c_str(), PSO.Get())))
+					++NumPipelines;
+			}
+
+			auto Blob = std::vector<uint8_t>(sizeof(FileHeader) + Library->GetSerializedSize());
+			ASSERT_SUCCEEDED(Library->Serialize(Blob.data() + sizeof(FileHeader), Blob.size() - sizeof(FileHeader)));
+			*reinterpret_cast<FileHeader*>(Blob.data()) = { kMagic, kVersion, NumPipelines, 0 };
+
+			std::ofstream File(s_FileName, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (File)
+				File.write(reinterpret_cast<const char*>(Blob.data()), Blob.size());
+			else
+				Utility::Printf(L"Couldn't write pipeline cache {}\n", s_FileName);
+		}
+
+		s_SessionPipelines.clear();
+		s_NumCompiledPipelines = 0;
+	}
+
+	s_Library = nullptr;
+	s_LibraryBlob = nullptr;
+	s_Device1 = nullptr;
+	s_NumLoadedPipelines = 0;
+}
+
+ID3D12PipelineState* PipelineCache::CreateGraphicsPipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, size_t RootSignatureHash)
+{
+	return LoadOrCreate(Desc, HashGraphicsDesc(Desc, RootSignatureHash),
+		[](auto... Args) { return s_Library->LoadGraphicsPipeline(Args...); },
+		[](auto... Args) { return g_Device->CreateGraphicsPipelineState(Args...); });
+}
+
+ID3D12PipelineState* PipelineCache::CreateComputePipeline(const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, size_t RootSignatureHash)
+{
+	return LoadOrCreate(Desc, HashComputeDesc(Desc, RootSignatureHash),
+		[](auto... Args) { return s_Library->LoadComputePipeline(Args...); },
+		[](auto... Args) { return g_Device->CreateComputePipelineState(Args...); });
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "pch.h"
+
+// Persists compiled pipeline state objects across launches in an ID3D12PipelineLibrary stored on
+// disk. Pipelines are named after a hash of their description in which shader bytecode, input
+// layout and root signature are hashed by content rather than by address, so names stay valid from
+// one run to the next.
+//
+// The runtime rejects a library written by another driver or adapter, in which case the cache
+// starts out empty. On shutdown the library is rewritten from the pipelines used in this session
+// only, which drops entries for shaders or states that no longer exist.
+namespace PipelineCache
+{
+	void Initialize(const std::wstring& FileName);
+	void Shutdown(void);
+
+	// Loads the pipeline from the library, or compiles and stores it. RootSignatureHash identifies
+	// the content of Desc.pRootSignature. The returned reference is owned by the caller; null if
+	// creating the pipeline failed.
+	ID3D12PipelineState* CreateGraphicsPipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc, size_t RootSignatureHash);
+	ID3D12PipelineState* CreateComputePipeline(const D3D12_COMPUTE_PIPELINE_STATE_DESC& Desc, size_t RootSignatureHash);
+}
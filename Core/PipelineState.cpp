@@ -3,21 +3,32 @@
 #include "PipelineState.h"
 #include "RootSignature.h"
 #include "Hash.h"
-
-#include <map>
+#include "PipelineCache.h"
+#include "StateObjectCache.h"
 
 using Math::IsAligned;
 using namespace Graphics;
 using Microsoft::WRL::ComPtr;
 using namespace std;
 
-static map<size_t, ComPtr<ID3D12PipelineState>> s_GraphicsPSOHashMap;
-static map<size_t, ComPtr<ID3D12PipelineState>> s_ComputePSOHashMap;
+static StateObjectCache<ID3D12PipelineState> s_GraphicsPSOCache;
+static StateObjectCache<ID3D12PipelineState> s_ComputePSOCache;
+
+// FinalizeAsync compiles on the PPL worker threads, Finalize on the calling thread
+static void ScheduleCompile(function<void()>&& Compile) { concurrency::create_task(std::move(Compile)); }
+static void RunCompile(function<void()>&& Compile) { Compile(); }
 
 void PSO::DestroyAll(void)
 {
-	s_GraphicsPSOHashMap.clear();
-	s_ComputePSOHashMap.clear();
+	// Clearing waits for background compilations that are still running
+	s_GraphicsPSOCache.Clear();
+	s_ComputePSOCache.Clear();
+}
+
+void PSO::WaitForCompile(void) const
+{
+	// Another thread may still be compiling the same pipeline asynchronously
+	ASSERT(m_PSO->Wait() != nullptr || m_Fallback != nullptr, "Pipeline creation failed and there is no fallback");
 }
 
 void GraphicsPSO::SetBlendState(const D3D12_BLEND_DESC& BlendDesc)
@@ -78,7 +89,7 @@ void GraphicsPSO::SetInputLayout(UINT NumElements, const D3D12_INPUT_ELEMENT_DES
 		m_InputLayouts = nullptr;
 }
 
-void GraphicsPSO::Finalize()
+void GraphicsPSO::Finalize(bool Async)
 {
 	m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
 	ASSERT(m_PSODesc.pRootSignature != nullptr);
@@ -86,35 +97,22 @@ void GraphicsPSO::Finalize()
 	m_PSODesc.InputLayout.pInputElementDescs = nullptr;
 	size_t HashCode = Utility::HashState(&m_PSODesc);
 	HashCode = Utility::HashState(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements, HashCode);
+
+	auto Key = vector<uint8_t>();
+	AppendStateKey(Key, &m_PSODesc);
+	AppendStateKey(Key, m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements);
+
 	m_PSODesc.InputLayout.pInputElementDescs = m_InputLayouts.get();
 
-	ID3D12PipelineState** PSORef = nullptr;
-	bool firstCompile = false;
+	// The worker gets its own copy of the description; the input layout it points to is shared
+	auto Create = [Desc = m_PSODesc, InputLayouts = m_InputLayouts, RootSignatureHash = m_RootSignature->GetHash()]
 	{
-		static mutex s_HashMapMutex;
-		lock_guard<mutex> CS(s_HashMapMutex);
-		auto iter = s_GraphicsPSOHashMap.find(HashCode);
-
-		if (iter == s_GraphicsPSOHashMap.end())
-		{
-			firstCompile = true;
-			PSORef = s_GraphicsPSOHashMap[HashCode].GetAddressOf();
-		}
-		else
-			PSORef = iter->second.GetAddressOf();
-	}
+		return PipelineCache::CreateGraphicsPipeline(Desc, RootSignatureHash);
+	};
 
-	if (firstCompile)
-	{
-		ASSERT_SUCCEEDED(g_Device->CreateGraphicsPipelineState(&m_PSODesc, IID_PPV_ARGS(&m_PSO)));
-		s_GraphicsPSOHashMap[HashCode].Attach(m_PSO);
-	}
-	else
-	{
-		while (*PSORef == nullptr)
-			this_thread::yield();
-		m_PSO = *PSORef;
-	}
+	m_PSO = &s_GraphicsPSOCache.GetOrCreateAsync(HashCode, std::move(Key), std::move(Create), Async ? ScheduleCompile : RunCompile);
+	if (!Async)
+		WaitForCompile();
 }
 
 ComputePSO::ComputePSO()
@@ -123,39 +121,22 @@ ComputePSO::ComputePSO()
 	m_PSODesc.NodeMask = 1;
 }
 
-void ComputePSO::Finalize()
+void ComputePSO::Finalize(bool Async)
 {
 	// Make sure the root signature is finalized first
 	m_PSODesc.pRootSignature = m_RootSignature->GetSignature();
 	ASSERT(m_PSODesc.pRootSignature != nullptr);
 	size_t HashCode = Utility::HashState(&m_PSODesc);
 
-	ID3D12PipelineState** PSORef = nullptr;
-	bool firstCompile = false;
-	{
-		static mutex s_HashMapMutex;
-		lock_guard CS(s_HashMapMutex);
-		auto iter = s_ComputePSOHashMap.find(HashCode);
-
-		// Reserve space so the next inquiry will find that someone got here first.
-		if (iter == s_ComputePSOHashMap.end())
-		{
-			firstCompile = true;
-			PSORef = s_ComputePSOHashMap[HashCode].GetAddressOf();
-		}
-		else
-			PSORef = iter->second.GetAddressOf();
-	}
+	auto Key = vector<uint8_t>();
+	AppendStateKey(Key, &m_PSODesc);
 
-	if (firstCompile)
+	auto Create = [Desc = m_PSODesc, RootSignatureHash = m_RootSignature->GetHash()]
 	{
-		ASSERT_SUCCEEDED(g_Device->CreateComputePipelineState(&m_PSODesc, IID_PPV_ARGS(&m_PSO)));
-		s_ComputePSOHashMap[HashCode].Attach(m_PSO);
-	}
-	else
-	{
-		while (*PSORef == nullptr)
-			this_thread::yield();
-		m_PSO = *PSORef;
-	}
+		return PipelineCache::CreateComputePipeline(Desc, RootSignatureHash);
+	};
+
+	m_PSO = &s_ComputePSOCache.GetOrCreateAsync(HashCode, std::move(Key), std::move(Create), Async ? ScheduleCompile : RunCompile);
+	if (!Async)
+		WaitForCompile();
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "pch.h"
+#include "StateObjectCache.h"
 
 class CommandContext;
 class RootSignature;
@@ -21,12 +22,40 @@ public:
 		m_RootSignature = &BindMappings;
 	}
 
-	ID3D12PipelineState* GetPipelineStateObject(void) const { return m_PSO; }
+	const RootSignature* GetRootSignature(void) const { return m_RootSignature; }
+
+	// Null until the pipeline is finalized, while FinalizeAsync is still compiling it, and if
+	// creating it failed
+	ID3D12PipelineState* GetPipelineStateObject(void) const
+	{
+		return m_PSO != nullptr ? m_PSO->Get() : nullptr;
+	}
+
+	bool IsReady(void) const { return GetPipelineStateObject() != nullptr; }
+	bool HasFailed(void) const { return m_PSO != nullptr && m_PSO->HasFailed(); }
+
+	// Bound in place of this pipeline until it is ready, or for good if it failed to compile.
+	// Without a fallback, draws and dispatches issued meanwhile are skipped. The fallback must
+	// outlive this object.
+	void SetFallback(const PSO& Fallback) { m_Fallback = &Fallback; }
+
+	// The pipeline command lists bind for this object: its own once ready, else its fallback's
+	ID3D12PipelineState* ResolvePipelineState(void) const
+	{
+		ID3D12PipelineState* PipelineState = GetPipelineStateObject();
+		if (PipelineState == nullptr && m_Fallback != nullptr)
+			PipelineState = m_Fallback->ResolvePipelineState();
+		return PipelineState;
+	}
 
 protected:
 	const RootSignature* m_RootSignature = nullptr;
+	const PSO* m_Fallback = nullptr;
+
+	void WaitForCompile(void) const;
 
-	ID3D12PipelineState* m_PSO;
+	// Points into the shared pipeline cache, which owns the object
+	const StateObjectCache<ID3D12PipelineState>::Slot* m_PSO = nullptr;
 };
 
 class GraphicsPSO : public PSO
@@ -49,9 +78,14 @@ public:
 	void SetHullShader(const void* Binary, size_t Size) { m_PSODesc.HS = CD3DX12_SHADER_BYTECODE(Binary, Size); }
 	void SetDomainShader(const void* Binary, size_t Size) { m_PSODesc.DS = CD3DX12_SHADER_BYTECODE(Binary, Size); }
 
-	void Finalize();
+	void Finalize() { Finalize(false); }
+
+	// Returns right away and compiles the pipeline on a worker thread; see SetFallback
+	void FinalizeAsync() { Finalize(true); }
 
 private:
+	void Finalize(bool Async);
+
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC m_PSODesc = {
 		.SampleMask = 0xFFFFFFFFu,
 		.InputLayout = {.NumElements = 0},
@@ -71,8 +105,11 @@ public:
 	void SetComputeShader(const void* Binary, size_t Size) { m_PSODesc.CS = CD3DX12_SHADER_BYTECODE(const_cast<void*>(Binary), Size); }
 	void SetComputeShader(const D3D12_SHADER_BYTECODE& Binary) { m_PSODesc.CS = Binary; }
 
-	void Finalize();
+	void Finalize() { Finalize(false); }
+	void FinalizeAsync() { Finalize(true); }
 
 private:
+	void Finalize(bool Async);
+
 	D3D12_COMPUTE_PIPELINE_STATE_DESC m_PSODesc;
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "pch.h"
 #include "PixelBuffer.h"
+#include "GraphicsCore.h"
+#include "CommandContext.h"
 
 D3D12_RESOURCE_DESC PixelBuffer::DescribeTex2D(uint32_t Width, uint32_t Height, uint32_t DepthOrArraySize, uint32_t NumMips, DXGI_FORMAT Format, UINT Flags)
 {
@@ -41,13 +43,13 @@ void PixelBuffer::AssociateWithResource([[maybe_unused]] ID3D12Device* Device, [
 #endif // !RELEASE
 }
 
-void PixelBuffer::CreateTextureResource(ID3D12Device* Device, [[maybe_unused]] const std::wstring& Name, const D3D12_RESOURCE_DESC& ResourceDesc, D3D12_CLEAR_VALUE ClearValue, [[maybe_unused]] D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr)
+void PixelBuffer::CreateTextureResource([[maybe_unused]] ID3D12Device* Device, [[maybe_unused]] const std::wstring& Name, const D3D12_RESOURCE_DESC& ResourceDesc, D3D12_CLEAR_VALUE ClearValue, [[maybe_unused]] D3D12_GPU_VIRTUAL_ADDRESS VidMemPtr)
 {
     Destroy();
 
-    CD3DX12_HEAP_PROPERTIES HeapProps(D3D12_HEAP_TYPE_DEFAULT);
-    ASSERT_SUCCEEDED(Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE,
-        &ResourceDesc, D3D12_RESOURCE_STATE_COMMON, &ClearValue, IID_PPV_ARGS(&m_pResource)));
+    ASSERT(Device == Graphics::g_Device);
+    m_pResource.Attach(Graphics::g_GpuHeapAllocator.CreateResource(D3D12_HEAP_TYPE_DEFAULT, ResourceDesc,
+        D3D12_RESOURCE_STATE_COMMON, &ClearValue, m_Allocation));
     
     m_UsageState = D3D12_RESOURCE_STATE_COMMON;
     m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
@@ -55,6 +57,16 @@ void PixelBuffer::CreateTextureResource(ID3D12Device* Device, [[maybe_unused]] c
 #ifndef RELEASE
     m_pResource->SetName(Name.c_str());
 #endif // !RELEASE
+
+    // Placed render targets and depth buffers may alias memory of earlier resources, so they are
+    // discarded before anything else touches them
+    if (m_Allocation.Block != nullptr &&
+        (ResourceDesc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)))
+    {
+        auto& Context = GraphicsContext::Begin(L"Discard Placed Target");
+        Context.DiscardResource(*this);
+        Context.Finish();
+    }
 }
 
 DXGI_FORMAT PixelBuffer::GetBaseFormat(DXGI_FORMAT defaultFormat)
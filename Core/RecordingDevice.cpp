@@ -0,0 +1,1080 @@
+#include "pch.h"
+#include "RecordingDevice.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <type_traits>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	constexpr UINT kDescriptorSize = 32;
+
+	// What a descriptor was created as, enough to tell which resource a descriptor table points at
+	struct Descriptor
+	{
+		enum Kind : uint32_t { kNull, kCBV, kSRV, kUAV, kRTV, kDSV, kSampler };
+
+		Kind Type;
+		uint32_t Format;
+		ID3D12Resource* Resource;
+		ID3D12Resource* CounterResource;
+		D3D12_GPU_VIRTUAL_ADDRESS BufferLocation;
+	};
+	static_assert(sizeof(Descriptor) == kDescriptorSize);
+
+	Descriptor* ToDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE Handle, UINT Index = 0)
+	{
+		return reinterpret_cast<Descriptor*>(Handle.ptr) + Index;
+	}
+
+	struct AlignedFree
+	{
+		void operator()(uint8_t* Memory) const { _aligned_free(Memory); }
+	};
+	using CpuMemory = std::unique_ptr<uint8_t[], AlignedFree>;
+
+	CpuMemory AllocateCpuMemory(UINT64 Size)
+	{
+		auto Memory = CpuMemory(static_cast<uint8_t*>(_aligned_malloc(static_cast<size_t>(Size), 4096)));
+		ASSERT(Memory != nullptr, "Out of memory for a CPU visible resource");
+		return Memory;
+	}
+
+	bool IsCpuVisible(const D3D12_HEAP_PROPERTIES& Properties)
+	{
+		if (Properties.Type == D3D12_HEAP_TYPE_CUSTOM)
+			return Properties.CPUPageProperty == D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE || Properties.CPUPageProperty == D3D12_CPU_PAGE_PROPERTY_WRITE_BACK;
+		return Properties.Type == D3D12_HEAP_TYPE_UPLOAD || Properties.Type == D3D12_HEAP_TYPE_READBACK;
+	}
+
+	struct FormatLayout
+	{
+		UINT BlockSize;
+		UINT BytesPerBlock;
+	};
+
+	FormatLayout GetFormatLayout(DXGI_FORMAT Format)
+	{
+		auto InRange = [Format](DXGI_FORMAT First, DXGI_FORMAT Last) { return Format >= First && Format <= Last; };
+
+		if (InRange(DXGI_FORMAT_BC1_TYPELESS, DXGI_FORMAT_BC1_UNORM_SRGB) || InRange(DXGI_FORMAT_BC4_TYPELESS, DXGI_FORMAT_BC4_SNORM))
+			return { 4, 8 };
+		if (InRange(DXGI_FORMAT_BC2_TYPELESS, DXGI_FORMAT_BC3_UNORM_SRGB) || InRange(DXGI_FORMAT_BC5_TYPELESS, DXGI_FORMAT_BC5_SNORM) ||
+			InRange(DXGI_FORMAT_BC6H_TYPELESS, DXGI_FORMAT_BC7_UNORM_SRGB))
+			return { 4, 16 };
+		if (InRange(DXGI_FORMAT_R32G32B32A32_TYPELESS, DXGI_FORMAT_R32G32B32A32_SINT))
+			return { 1, 16 };
+		if (InRange(DXGI_FORMAT_R32G32B32_TYPELESS, DXGI_FORMAT_R32G32B32_SINT))
+			return { 1, 12 };
+		if (InRange(DXGI_FORMAT_R16G16B16A16_TYPELESS, DXGI_FORMAT_X32_TYPELESS_G8X24_UINT))
+			return { 1, 8 };
+		if (InRange(DXGI_FORMAT_R8G8_TYPELESS, DXGI_FORMAT_R16_SINT) || InRange(DXGI_FORMAT_B5G6R5_UNORM, DXGI_FORMAT_B5G5R5A1_UNORM) ||
+			Format == DXGI_FORMAT_B4G4R4A4_UNORM)
+			return { 1, 2 };
+		if (InRange(DXGI_FORMAT_R8_TYPELESS, DXGI_FORMAT_A8_UNORM))
+			return { 1, 1 };
+		return { 1, 4 };
+	}
+
+	UINT GetMipLevels(const D3D12_RESOURCE_DESC& Desc)
+	{
+		if (Desc.MipLevels != 0)
+			return Desc.MipLevels;
+
+		UINT64 Size = std::max<UINT64>(Desc.Width, Desc.Height);
+		if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+			Size = std::max<UINT64>(Size, Desc.DepthOrArraySize);
+
+		UINT MipLevels = 1;
+		while (Size > 1)
+		{
+			Size >>= 1;
+			++MipLevels;
+		}
+		return MipLevels;
+	}
+
+	UINT GetSubresourceCount(const D3D12_RESOURCE_DESC& Desc)
+	{
+		if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			return 1;
+		return GetMipLevels(Desc) * (Desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1u : Desc.DepthOrArraySize);
+	}
+
+	// Row-major layouts with the pitch and placement alignments D3D12 requires. Returns the size
+	// from BaseOffset to the end of the last subresource.
+	UINT64 ComputeFootprints(const D3D12_RESOURCE_DESC& Desc, UINT FirstSubresource, UINT NumSubresources, UINT64 BaseOffset,
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT* pLayouts, UINT* pNumRows, UINT64* pRowSizeInBytes)
+	{
+		if (Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+		{
+			if (pLayouts != nullptr)
+			{
+				const auto RowPitch = static_cast<UINT>(Math::AlignUp(Desc.Width, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT));
+				pLayouts[0] = { BaseOffset, { DXGI_FORMAT_UNKNOWN, static_cast<UINT>(Desc.Width), 1, 1, RowPitch } };
+			}
+			if (pNumRows != nullptr)
+				pNumRows[0] = 1;
+			if (pRowSizeInBytes != nullptr)
+				pRowSizeInBytes[0] = Desc.Width;
+			return Desc.Width;
+		}
+
+		const UINT MipLevels = GetMipLevels(Desc);
+		const auto [BlockSize, BytesPerBlock] = GetFormatLayout(Desc.Format);
+
+		UINT64 Offset = BaseOffset;
+		UINT64 End = BaseOffset;
+		for (UINT i = 0; i < NumSubresources; ++i)
+		{
+			const UINT Mip = (FirstSubresource + i) % MipLevels;
+			const UINT Width = Math::AlignUp(std::max(1u, static_cast<UINT>(Desc.Width >> Mip)), BlockSize);
+			const UINT Height = Math::AlignUp(std::max(1u, Desc.Height >> Mip), BlockSize);
+			const UINT Depth = Desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? std::max(1u, static_cast<UINT>(Desc.DepthOrArraySize) >> Mip) : 1u;
+			const UINT NumRows = Height / BlockSize;
+			const UINT64 RowSize = UINT64(Width / BlockSize) * BytesPerBlock;
+			const auto RowPitch = static_cast<UINT>(Math::AlignUp(RowSize, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT));
+
+			Offset = Math::AlignUp(Offset, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+			if (pLayouts != nullptr)
+				pLayouts[i] = { Offset, { Desc.Format, Width, Height, Depth, RowPitch } };
+			if (pNumRows != nullptr)
+				pNumRows[i] = NumRows;
+			if (pRowSizeInBytes != nullptr)
+				pRowSizeInBytes[i] = RowSize;
+
+			End = Offset + UINT64(RowPitch) * (NumRows * Depth - 1) + RowSize;
+			Offset += UINT64(RowPitch) * NumRows * Depth;
+		}
+
+		return End - BaseOffset;
+	}
+
+	UINT64 GetResourceSize(const D3D12_RESOURCE_DESC& Desc)
+	{
+		return ComputeFootprints(Desc, 0, GetSubresourceCount(Desc), 0, nullptr, nullptr, nullptr);
+	}
+
+	// IUnknown of an object implementing a single chain of interfaces
+	template <typename Interface>
+	class ComObject : public Interface
+	{
+	public:
+		ComObject() = default;
+		virtual ~ComObject() = default;
+
+		ComObject(const ComObject&) = delete;
+		ComObject& operator=(const ComObject&) = delete;
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+		{
+			if (ppvObject == nullptr)
+				return E_POINTER;
+
+			if (!Implements(riid))
+			{
+				*ppvObject = nullptr;
+				return E_NOINTERFACE;
+			}
+
+			AddRef();
+			*ppvObject = static_cast<Interface*>(this);
+			return S_OK;
+		}
+
+		ULONG STDMETHODCALLTYPE AddRef(void) override
+		{
+			return ++m_RefCount;
+		}
+
+		ULONG STDMETHODCALLTYPE Release(void) override
+		{
+			const ULONG RefCount = --m_RefCount;
+			if (RefCount == 0)
+				delete this;
+			return RefCount;
+		}
+
+	protected:
+		virtual bool Implements(REFIID riid) const
+		{
+			if (riid == __uuidof(IUnknown) || riid == __uuidof(Interface))
+				return true;
+			if constexpr (std::is_base_of_v<ID3D12Object, Interface>)
+			{
+				if (riid == __uuidof(ID3D12Object))
+					return true;
+			}
+			if constexpr (std::is_base_of_v<ID3D12DeviceChild, Interface>)
+			{
+				if (riid == __uuidof(ID3D12DeviceChild))
+					return true;
+			}
+			if constexpr (std::is_base_of_v<ID3D12Pageable, Interface>)
+			{
+				if (riid == __uuidof(ID3D12Pageable))
+					return true;
+			}
+			if constexpr (std::is_base_of_v<ID3D12CommandList, Interface>)
+			{
+				if (riid == __uuidof(ID3D12CommandList))
+					return true;
+			}
+			return false;
+		}
+
+	private:
+		std::atomic<ULONG> m_RefCount = 1;
+	};
+
+	template <typename Interface>
+	class Object : public ComObject<Interface>
+	{
+	public:
+		HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT* pDataSize, void* pData) override
+		{
+			auto lg = std::lock_guard{ m_PrivateDataMutex };
+
+			for (const auto& [Guid, Data] : m_PrivateData)
+			{
+				if (Guid != guid)
+					continue;
+
+				if (pData != nullptr && *pDataSize < Data.size())
+					return DXGI_ERROR_MORE_DATA;
+				if (pData != nullptr)
+					std::memcpy(pData, Data.data(), Data.size());
+				*pDataSize = static_cast<UINT>(Data.size());
+				return S_OK;
+			}
+
+			*pDataSize = 0;
+			return DXGI_ERROR_NOT_FOUND;
+		}
+
+		HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT DataSize, const void* pData) override
+		{
+			auto lg = std::lock_guard{ m_PrivateDataMutex };
+
+			std::erase_if(m_PrivateData, [&](const auto& Entry) { return Entry.first == guid; });
+			if (pData != nullptr)
+			{
+				const auto* Bytes = static_cast<const uint8_t*>(pData);
+				m_PrivateData.emplace_back(guid, std::vector<uint8_t>(Bytes, Bytes + DataSize));
+			}
+			return S_OK;
+		}
+
+		HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) override
+		{
+			return E_NOTIMPL;
+		}
+
+		HRESULT STDMETHODCALLTYPE SetName(LPCWSTR Name) override
+		{
+			const auto Size = static_cast<UINT>((wcslen(Name) + 1) * sizeof(wchar_t));
+			return SetPrivateData(WKPDID_D3DDebugObjectNameW, Size, Name);
+		}
+
+	private:
+		std::mutex m_PrivateDataMutex;
+		std::vector<std::pair<GUID, std::vector<uint8_t>>> m_PrivateData;
+	};
+
+	template <typename Interface>
+	class Child : public Object<Interface>
+	{
+	public:
+		explicit Child(ID3D12Device* Owner) : m_Owner(Owner) {}
+
+		HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** ppvDevice) override
+		{
+			return m_Owner->QueryInterface(riid, ppvDevice);
+		}
+
+	private:
+		ComPtr<ID3D12Device> m_Owner;
+	};
+
+	// Hands out the requested interface of a new object, which starts out with one reference
+	HRESULT Return(IUnknown* NewObject, REFIID riid, void** ppvObject)
+	{
+		if (ppvObject == nullptr)
+		{
+			NewObject->Release();
+			return S_FALSE;
+		}
+
+		const HRESULT hr = NewObject->QueryInterface(riid, ppvObject);
+		NewObject->Release();
+		return hr;
+	}
+
+	class Blob : public ComObject<ID3DBlob>
+	{
+	public:
+		explicit Blob(std::vector<uint8_t> Data) : m_Data(std::move(Data)) {}
+
+		LPVOID STDMETHODCALLTYPE GetBufferPointer(void) override { return m_Data.data(); }
+		SIZE_T STDMETHODCALLTYPE GetBufferSize(void) override { return m_Data.size(); }
+
+	private:
+		std::vector<uint8_t> m_Data;
+	};
+
+	class Fence : public Child<ID3D12Fence>
+	{
+	public:
+		Fence(ID3D12Device* Owner, UINT64 InitialValue) : Child(Owner), m_Value(InitialValue) {}
+
+		UINT64 STDMETHODCALLTYPE GetCompletedValue(void) override
+		{
+			return m_Value.load(std::memory_order_acquire);
+		}
+
+		HRESULT STDMETHODCALLTYPE SetEventOnCompletion(UINT64 Value, HANDLE hEvent) override
+		{
+			auto Lock = std::unique_lock{ m_Mutex };
+
+			if (hEvent == nullptr)
+				m_Reached.wait(Lock, [&] { return m_Value.load() >= Value; });
+			else if (m_Value.load() >= Value)
+				SetEvent(hEvent);
+			else
+				m_Events.emplace_back(Value, hEvent);
+			return S_OK;
+		}
+
+		HRESULT STDMETHODCALLTYPE Signal(UINT64 Value) override
+		{
+			{
+				auto lg = std::lock_guard{ m_Mutex };
+				m_Value.store(Value, std::memory_order_release);
+				std::erase_if(m_Events, [&](const auto& Event)
+				{
+					if (Event.first > Value)
+						return false;
+					SetEvent(Event.second);
+					return true;
+				});
+			}
+			m_Reached.notify_all();
+			return S_OK;
+		}
+
+		// Blocks until the fence has reached Value or Stop is set
+		void Wait(UINT64 Value, const std::atomic<bool>& Stop)
+		{
+			auto Lock = std::unique_lock{ m_Mutex };
+			while (m_Value.load() < Value && !Stop)
+				m_Reached.wait_for(Lock, std::chrono::milliseconds(10));
+		}
+
+	private:
+		std::mutex m_Mutex;
+		std::condition_variable m_Reached;
+		std::atomic<UINT64> m_Value;
+		std::vector<std::pair<UINT64, HANDLE>> m_Events;
+	};
+
+	class Heap : public Child<ID3D12Heap>
+	{
+	public:
+		Heap(ID3D12Device* Owner, const D3D12_HEAP_DESC& Desc, D3D12_GPU_VIRTUAL_ADDRESS Address)
+			: Child(Owner), m_Desc(Desc), m_Address(Address)
+		{
+			if (IsCpuVisible(Desc.Properties))
+				m_Memory = AllocateCpuMemory(Desc.SizeInBytes);
+		}
+
+		D3D12_HEAP_DESC STDMETHODCALLTYPE GetDesc(void) override { return m_Desc; }
+
+		D3D12_GPU_VIRTUAL_ADDRESS GetAddress(void) const { return m_Address; }
+		uint8_t* GetCpuAddress(void) const { return m_Memory.get(); }
+
+	private:
+		const D3D12_HEAP_DESC m_Desc;
+		const D3D12_GPU_VIRTUAL_ADDRESS m_Address;
+		CpuMemory m_Memory;
+	};
+
+	class Resource : public Child<ID3D12Resource>
+	{
+	public:
+		// A committed resource owns its CPU memory if it has any, a placed one points into its heap's
+		Resource(ID3D12Device* Owner, const D3D12_RESOURCE_DESC& Desc, const D3D12_HEAP_PROPERTIES& Properties, D3D12_HEAP_FLAGS Flags,
+			D3D12_GPU_VIRTUAL_ADDRESS Address, Heap* PlacedIn = nullptr, UINT64 HeapOffset = 0)
+			: Child(Owner), m_Desc(Desc), m_Properties(Properties), m_Flags(Flags), m_Address(Address), m_Heap(PlacedIn)
+		{
+			if (PlacedIn != nullptr)
+				m_CpuAddress = PlacedIn->GetCpuAddress() != nullptr ? PlacedIn->GetCpuAddress() + HeapOffset : nullptr;
+			else if (IsCpuVisible(Properties))
+			{
+				m_Memory = AllocateCpuMemory(GetResourceSize(Desc));
+				m_CpuAddress = m_Memory.get();
+			}
+		}
+
+		HRESULT STDMETHODCALLTYPE Map(UINT, const D3D12_RANGE*, void** ppData) override
+		{
+			if (m_CpuAddress == nullptr)
+				return E_INVALIDARG;
+			if (ppData != nullptr)
+				*ppData = m_CpuAddress;
+			return S_OK;
+		}
+
+		void STDMETHODCALLTYPE Unmap(UINT, const D3D12_RANGE*) override {}
+
+		D3D12_RESOURCE_DESC STDMETHODCALLTYPE GetDesc(void) override { return m_Desc; }
+
+		D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE GetGPUVirtualAddress(void) override
+		{
+			return m_Desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER ? m_Address : 0;
+		}
+
+		HRESULT STDMETHODCALLTYPE WriteToSubresource(UINT, const D3D12_BOX*, const void*, UINT, UINT) override
+		{
+			return E_NOTIMPL;
+		}
+
+		HRESULT STDMETHODCALLTYPE ReadFromSubresource(void*, UINT, UINT, UINT, const D3D12_BOX*) override
+		{
+			return E_NOTIMPL;
+		}
+
+		HRESULT STDMETHODCALLTYPE GetHeapProperties(D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS* pHeapFlags) override
+		{
+			if (pHeapProperties != nullptr)
+				*pHeapProperties = m_Properties;
+			if (pHeapFlags != nullptr)
+				*pHeapFlags = m_Flags;
+			return S_OK;
+		}
+
+	private:
+		const D3D12_RESOURCE_DESC m_Desc;
+		const D3D12_HEAP_PROPERTIES m_Properties;
+		const D3D12_HEAP_FLAGS m_Flags;
+		const D3D12_GPU_VIRTUAL_ADDRESS m_Address;
+		ComPtr<ID3D12Heap> m_Heap;
+		CpuMemory m_Memory;
+		uint8_t* m_CpuAddress = nullptr;
+	};
+
+	class DescriptorHeap : public Child<ID3D12DescriptorHeap>
+	{
+	public:
+		DescriptorHeap(ID3D12Device* Owner, const D3D12_DESCRIPTOR_HEAP_DESC& Desc, D3D12_GPU_VIRTUAL_ADDRESS Address)
+			: Child(Owner), m_Desc(Desc), m_Address(Address), m_Descriptors(std::make_unique<Descriptor[]>(Desc.NumDescriptors)) {}
+
+		D3D12_DESCRIPTOR_HEAP_DESC STDMETHODCALLTYPE GetDesc(void) override { return m_Desc; }
+
+		D3D12_CPU_DESCRIPTOR_HANDLE STDMETHODCALLTYPE GetCPUDescriptorHandleForHeapStart(void) override
+		{
+			return { reinterpret_cast<SIZE_T>(m_Descriptors.get()) };
+		}
+
+		D3D12_GPU_DESCRIPTOR_HANDLE STDMETHODCALLTYPE GetGPUDescriptorHandleForHeapStart(void) override
+		{
+			return { m_Address };
+		}
+
+	private:
+		const D3D12_DESCRIPTOR_HEAP_DESC m_Desc;
+		const D3D12_GPU_VIRTUAL_ADDRESS m_Address;
+		std::unique_ptr<Descriptor[]> m_Descriptors;
+	};
+
+	class CommandAllocator : public Child<ID3D12CommandAllocator>
+	{
+	public:
+		using Child::Child;
+
+		HRESULT STDMETHODCALLTYPE Reset(void) override { return S_OK; }
+	};
+
+	class PipelineState : public Child<ID3D12PipelineState>
+	{
+	public:
+		using Child::Child;
+
+		HRESULT STDMETHODCALLTYPE GetCachedBlob(ID3DBlob**) override { return E_NOTIMPL; }
+	};
+
+	class RootSignature : public Child<ID3D12RootSignature>
+	{
+	public:
+		using Child::Child;
+	};
+
+	class QueryHeap : public Child<ID3D12QueryHeap>
+	{
+	public:
+		using Child::Child;
+	};
+
+	class CommandSignature : public Child<ID3D12CommandSignature>
+	{
+	public:
+		using Child::Child;
+	};
+
+	class CommandList : public Child<ID3D12GraphicsCommandList>
+	{
+	public:
+		CommandList(ID3D12Device* Owner, D3D12_COMMAND_LIST_TYPE Type) : Child(Owner), m_Recorded{ Type, {} } {}
+
+		const Recording::CommandList& GetRecorded(void) const { return m_Recorded; }
+
+		D3D12_COMMAND_LIST_TYPE STDMETHODCALLTYPE GetType(void) override { return m_Recorded.Type; }
+
+		HRESULT STDMETHODCALLTYPE Close(void) override { return S_OK; }
+
+		HRESULT STDMETHODCALLTYPE Reset(ID3D12CommandAllocator*, ID3D12PipelineState*) override
+		{
+			m_Recorded.Commands.clear();
+			return S_OK;
+		}
+
+		void STDMETHODCALLTYPE ClearState(ID3D12PipelineState*) override { Record("ClearState"); }
+		void STDMETHODCALLTYPE DrawInstanced(UINT, UINT, UINT, UINT) override { Record("DrawInstanced"); }
+		void STDMETHODCALLTYPE DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT) override { Record("DrawIndexedInstanced"); }
+		void STDMETHODCALLTYPE Dispatch(UINT, UINT, UINT) override { Record("Dispatch"); }
+		void STDMETHODCALLTYPE CopyBufferRegion(ID3D12Resource*, UINT64, ID3D12Resource*, UINT64, UINT64) override { Record("CopyBufferRegion"); }
+		void STDMETHODCALLTYPE CopyTextureRegion(const D3D12_TEXTURE_COPY_LOCATION*, UINT, UINT, UINT, const D3D12_TEXTURE_COPY_LOCATION*, const D3D12_BOX*) override { Record("CopyTextureRegion"); }
+		void STDMETHODCALLTYPE CopyResource(ID3D12Resource*, ID3D12Resource*) override { Record("CopyResource"); }
+		void STDMETHODCALLTYPE CopyTiles(ID3D12Resource*, const D3D12_TILED_RESOURCE_COORDINATE*, const D3D12_TILE_REGION_SIZE*, ID3D12Resource*, UINT64, D3D12_TILE_COPY_FLAGS) override { Record("CopyTiles"); }
+		void STDMETHODCALLTYPE ResolveSubresource(ID3D12Resource*, UINT, ID3D12Resource*, UINT, DXGI_FORMAT) override { Record("ResolveSubresource"); }
+		void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY) override { Record("IASetPrimitiveTopology"); }
+		void STDMETHODCALLTYPE RSSetViewports(UINT, const D3D12_VIEWPORT*) override { Record("RSSetViewports"); }
+		void STDMETHODCALLTYPE RSSetScissorRects(UINT, const D3D12_RECT*) override { Record("RSSetScissorRects"); }
+		void STDMETHODCALLTYPE OMSetBlendFactor(const FLOAT[4]) override { Record("OMSetBlendFactor"); }
+		void STDMETHODCALLTYPE OMSetStencilRef(UINT) override { Record("OMSetStencilRef"); }
+		void STDMETHODCALLTYPE SetPipelineState(ID3D12PipelineState*) override { Record("SetPipelineState"); }
+
+		void STDMETHODCALLTYPE ResourceBarrier(UINT NumBarriers, const D3D12_RESOURCE_BARRIER* pBarriers) override
+		{
+			m_Recorded.Commands.push_back({ "ResourceBarrier", std::vector<D3D12_RESOURCE_BARRIER>(pBarriers, pBarriers + NumBarriers) });
+		}
+
+		void STDMETHODCALLTYPE ExecuteBundle(ID3D12GraphicsCommandList*) override { Record("ExecuteBundle"); }
+		void STDMETHODCALLTYPE SetDescriptorHeaps(UINT, ID3D12DescriptorHeap* const*) override { Record("SetDescriptorHeaps"); }
+		void STDMETHODCALLTYPE SetComputeRootSignature(ID3D12RootSignature*) override { Record("SetComputeRootSignature"); }
+		void STDMETHODCALLTYPE SetGraphicsRootSignature(ID3D12RootSignature*) override { Record("SetGraphicsRootSignature"); }
+		void STDMETHODCALLTYPE SetComputeRootDescriptorTable(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) override { Record("SetComputeRootDescriptorTable"); }
+		void STDMETHODCALLTYPE SetGraphicsRootDescriptorTable(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) override { Record("SetGraphicsRootDescriptorTable"); }
+		void STDMETHODCALLTYPE SetComputeRoot32BitConstant(UINT, UINT, UINT) override { Record("SetComputeRoot32BitConstant"); }
+		void STDMETHODCALLTYPE SetGraphicsRoot32BitConstant(UINT, UINT, UINT) override { Record("SetGraphicsRoot32BitConstant"); }
+		void STDMETHODCALLTYPE SetComputeRoot32BitConstants(UINT, UINT, const void*, UINT) override { Record("SetComputeRoot32BitConstants"); }
+		void STDMETHODCALLTYPE SetGraphicsRoot32BitConstants(UINT, UINT, const void*, UINT) override { Record("SetGraphicsRoot32BitConstants"); }
+		void STDMETHODCALLTYPE SetComputeRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { Record("SetComputeRootConstantBufferView"); }
+		void STDMETHODCALLTYPE SetGraphicsRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { Record("SetGraphicsRootConstantBufferView"); }
+		void STDMETHODCALLTYPE SetComputeRootShaderResourceView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { Record("SetComputeRootShaderResourceView"); }
+		void STDMETHODCALLTYPE SetGraphicsRootShaderResourceView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { Record("SetGraphicsRootShaderResourceView"); }
+		void STDMETHODCALLTYPE SetComputeRootUnorderedAccessView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { Record("SetComputeRootUnorderedAccessView"); }
+		void STDMETHODCALLTYPE SetGraphicsRootUnorderedAccessView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { Record("SetGraphicsRootUnorderedAccessView"); }
+		void STDMETHODCALLTYPE IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW*) override { Record("IASetIndexBuffer"); }
+		void STDMETHODCALLTYPE IASetVertexBuffers(UINT, UINT, const D3D12_VERTEX_BUFFER_VIEW*) override { Record("IASetVertexBuffers"); }
+		void STDMETHODCALLTYPE SOSetTargets(UINT, UINT, const D3D12_STREAM_OUTPUT_BUFFER_VIEW*) override { Record("SOSetTargets"); }
+		void STDMETHODCALLTYPE OMSetRenderTargets(UINT, const D3D12_CPU_DESCRIPTOR_HANDLE*, BOOL, const D3D12_CPU_DESCRIPTOR_HANDLE*) override { Record("OMSetRenderTargets"); }
+		void STDMETHODCALLTYPE ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_CLEAR_FLAGS, FLOAT, UINT8, UINT, const D3D12_RECT*) override { Record("ClearDepthStencilView"); }
+		void STDMETHODCALLTYPE ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE, const FLOAT[4], UINT, const D3D12_RECT*) override { Record("ClearRenderTargetView"); }
+		void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(D3D12_GPU_DESCRIPTOR_HANDLE, D3D12_CPU_DESCRIPTOR_HANDLE, ID3D12Resource*, const UINT[4], UINT, const D3D12_RECT*) override { Record("ClearUnorderedAccessViewUint"); }
+		void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(D3D12_GPU_DESCRIPTOR_HANDLE, D3D12_CPU_DESCRIPTOR_HANDLE, ID3D12Resource*, const FLOAT[4], UINT, const D3D12_RECT*) override { Record("ClearUnorderedAccessViewFloat"); }
+		void STDMETHODCALLTYPE DiscardResource(ID3D12Resource*, const D3D12_DISCARD_REGION*) override { Record("DiscardResource"); }
+		void STDMETHODCALLTYPE BeginQuery(ID3D12QueryHeap*, D3D12_QUERY_TYPE, UINT) override { Record("BeginQuery"); }
+		void STDMETHODCALLTYPE EndQuery(ID3D12QueryHeap*, D3D12_QUERY_TYPE, UINT) override { Record("EndQuery"); }
+		void STDMETHODCALLTYPE ResolveQueryData(ID3D12QueryHeap*, D3D12_QUERY_TYPE, UINT, UINT, ID3D12Resource*, UINT64) override { Record("ResolveQueryData"); }
+		void STDMETHODCALLTYPE SetPredication(ID3D12Resource*, UINT64, D3D12_PREDICATION_OP) override { Record("SetPredication"); }
+		void STDMETHODCALLTYPE SetMarker(UINT, const void*, UINT) override { Record("SetMarker"); }
+		void STDMETHODCALLTYPE BeginEvent(UINT, const void*, UINT) override { Record("BeginEvent"); }
+		void STDMETHODCALLTYPE EndEvent(void) override { Record("EndEvent"); }
+		void STDMETHODCALLTYPE ExecuteIndirect(ID3D12CommandSignature*, UINT, ID3D12Resource*, UINT64, ID3D12Resource*, UINT64) override { Record("ExecuteIndirect"); }
+
+	private:
+		void Record(const char* Name)
+		{
+			m_Recorded.Commands.push_back({ Name, {} });
+		}
+
+		Recording::CommandList m_Recorded;
+	};
+
+	class __declspec(uuid("6b1f3c52-8a0e-4f7d-9b33-2d41c5e7a9f0")) RecordingDevice;
+
+	class CommandQueue : public Child<ID3D12CommandQueue>
+	{
+	public:
+		CommandQueue(RecordingDevice& Owner, const D3D12_COMMAND_QUEUE_DESC& Desc);
+
+		~CommandQueue() override
+		{
+			{
+				auto lg = std::lock_guard{ m_Mutex };
+				m_Stop = true;
+			}
+			m_Wake.notify_one();
+			m_Worker.join();
+		}
+
+		void STDMETHODCALLTYPE UpdateTileMappings(ID3D12Resource*, UINT, const D3D12_TILED_RESOURCE_COORDINATE*, const D3D12_TILE_REGION_SIZE*,
+			ID3D12Heap*, UINT, const D3D12_TILE_RANGE_FLAGS*, const UINT*, const UINT*, D3D12_TILE_MAPPING_FLAGS) override {}
+		void STDMETHODCALLTYPE CopyTileMappings(ID3D12Resource*, const D3D12_TILED_RESOURCE_COORDINATE*, ID3D12Resource*,
+			const D3D12_TILED_RESOURCE_COORDINATE*, const D3D12_TILE_REGION_SIZE*, D3D12_TILE_MAPPING_FLAGS) override {}
+
+		void STDMETHODCALLTYPE ExecuteCommandLists(UINT NumCommandLists, ID3D12CommandList* const* ppCommandLists) override;
+
+		void STDMETHODCALLTYPE SetMarker(UINT, const void*, UINT) override {}
+		void STDMETHODCALLTYPE BeginEvent(UINT, const void*, UINT) override {}
+		void STDMETHODCALLTYPE EndEvent(void) override {}
+
+		HRESULT STDMETHODCALLTYPE Signal(ID3D12Fence* pFence, UINT64 Value) override;
+		HRESULT STDMETHODCALLTYPE Wait(ID3D12Fence* pFence, UINT64 Value) override;
+
+		HRESULT STDMETHODCALLTYPE GetTimestampFrequency(UINT64* pFrequency) override
+		{
+			*pFrequency = 1000000;
+			return S_OK;
+		}
+
+		HRESULT STDMETHODCALLTYPE GetClockCalibration(UINT64* pGpuTimestamp, UINT64* pCpuTimestamp) override
+		{
+			LARGE_INTEGER Counter, Frequency;
+			QueryPerformanceCounter(&Counter);
+			QueryPerformanceFrequency(&Frequency);
+			*pCpuTimestamp = static_cast<UINT64>(Counter.QuadPart);
+			*pGpuTimestamp = static_cast<UINT64>(Counter.QuadPart / Frequency.QuadPart * 1000000 + Counter.QuadPart % Frequency.QuadPart * 1000000 / Frequency.QuadPart);
+			return S_OK;
+		}
+
+		D3D12_COMMAND_QUEUE_DESC STDMETHODCALLTYPE GetDesc(void) override { return m_Desc; }
+
+	private:
+		// Command lists have no work to retire, only signals and waits need to run in order
+		struct Operation
+		{
+			bool IsWait;
+			ComPtr<ID3D12Fence> Target;
+			UINT64 Value;
+		};
+
+		void Enqueue(Operation&& Op)
+		{
+			{
+				auto lg = std::lock_guard{ m_Mutex };
+				m_Operations.push_back(std::move(Op));
+			}
+			m_Wake.notify_one();
+		}
+
+		void Run(void)
+		{
+			for (;;)
+			{
+				auto Lock = std::unique_lock{ m_Mutex };
+				m_Wake.wait(Lock, [&] { return m_Stop || !m_Operations.empty(); });
+				if (m_Stop)
+					return;
+
+				auto Op = std::move(m_Operations.front());
+				m_Operations.pop_front();
+				Lock.unlock();
+
+				auto* Target = static_cast<Fence*>(Op.Target.Get());
+				if (Op.IsWait)
+					Target->Wait(Op.Value, m_Stop);
+				else
+					Target->Signal(Op.Value);
+			}
+		}
+
+		RecordingDevice& m_Device;
+		const D3D12_COMMAND_QUEUE_DESC m_Desc;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_Wake;
+		std::deque<Operation> m_Operations;
+		std::atomic<bool> m_Stop = false;
+		std::thread m_Worker;
+	};
+
+	class __declspec(uuid("6b1f3c52-8a0e-4f7d-9b33-2d41c5e7a9f0")) RecordingDevice : public Object<ID3D12Device>
+	{
+	public:
+		void SetSubmitObserver(Recording::SubmitObserver Observer)
+		{
+			auto lg = std::lock_guard{ m_ObserverMutex };
+			m_Observer = std::move(Observer);
+		}
+
+		void NotifySubmit(D3D12_COMMAND_LIST_TYPE QueueType, std::span<const Recording::CommandList* const> Lists)
+		{
+			Recording::SubmitObserver Observer;
+			{
+				auto lg = std::lock_guard{ m_ObserverMutex };
+				Observer = m_Observer;
+			}
+			if (Observer)
+				Observer(QueueType, Lists);
+		}
+
+		void SetQueueObserver(Recording::QueueObserver Observer)
+		{
+			auto lg = std::lock_guard{ m_ObserverMutex };
+			m_QueueObserver = std::move(Observer);
+		}
+
+		void NotifyQueueOperation(const Recording::QueueOperation& Operation)
+		{
+			Recording::QueueObserver Observer;
+			{
+				auto lg = std::lock_guard{ m_ObserverMutex };
+				Observer = m_QueueObserver;
+			}
+			if (Observer)
+				Observer(Operation);
+		}
+
+		UINT STDMETHODCALLTYPE GetNodeCount(void) override { return 1; }
+
+		HRESULT STDMETHODCALLTYPE CreateCommandQueue(const D3D12_COMMAND_QUEUE_DESC* pDesc, REFIID riid, void** ppCommandQueue) override
+		{
+			return Return(new CommandQueue(*this, *pDesc), riid, ppCommandQueue);
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE, REFIID riid, void** ppCommandAllocator) override
+		{
+			return Return(new CommandAllocator(this), riid, ppCommandAllocator);
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC*, REFIID riid, void** ppPipelineState) override
+		{
+			return Return(new PipelineState(this), riid, ppPipelineState);
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC*, REFIID riid, void** ppPipelineState) override
+		{
+			return Return(new PipelineState(this), riid, ppPipelineState);
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateCommandList(UINT, D3D12_COMMAND_LIST_TYPE type, ID3D12CommandAllocator*, ID3D12PipelineState*, REFIID riid, void** ppCommandList) override
+		{
+			return Return(new CommandList(this, type), riid, ppCommandList);
+		}
+
+		HRESULT STDMETHODCALLTYPE CheckFeatureSupport(D3D12_FEATURE Feature, void* pFeatureSupportData, UINT FeatureSupportDataSize) override
+		{
+			switch (Feature)
+			{
+				case D3D12_FEATURE_D3D12_OPTIONS:
+				{
+					if (FeatureSupportDataSize != sizeof(D3D12_FEATURE_DATA_D3D12_OPTIONS))
+						return E_INVALIDARG;
+
+					auto& Options = *static_cast<D3D12_FEATURE_DATA_D3D12_OPTIONS*>(pFeatureSupportData);
+					Options = {};
+					Options.ResourceBindingTier = D3D12_RESOURCE_BINDING_TIER_3;
+					Options.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+					return S_OK;
+				}
+
+				case D3D12_FEATURE_FORMAT_SUPPORT:
+				{
+					if (FeatureSupportDataSize != sizeof(D3D12_FEATURE_DATA_FORMAT_SUPPORT))
+						return E_INVALIDARG;
+
+					// Every format can be created, typed UAV loads are reported missing so the engine takes its fallbacks
+					auto& Support = *static_cast<D3D12_FEATURE_DATA_FORMAT_SUPPORT*>(pFeatureSupportData);
+					Support.Support1 = D3D12_FORMAT_SUPPORT1_BUFFER | D3D12_FORMAT_SUPPORT1_TEXTURE1D | D3D12_FORMAT_SUPPORT1_TEXTURE2D |
+						D3D12_FORMAT_SUPPORT1_TEXTURE3D | D3D12_FORMAT_SUPPORT1_TEXTURECUBE | D3D12_FORMAT_SUPPORT1_SHADER_LOAD |
+						D3D12_FORMAT_SUPPORT1_SHADER_SAMPLE | D3D12_FORMAT_SUPPORT1_MIP | D3D12_FORMAT_SUPPORT1_RENDER_TARGET |
+						D3D12_FORMAT_SUPPORT1_BLENDABLE | D3D12_FORMAT_SUPPORT1_DEPTH_STENCIL | D3D12_FORMAT_SUPPORT1_TYPED_UNORDERED_ACCESS_VIEW;
+					Support.Support2 = D3D12_FORMAT_SUPPORT2_NONE;
+					return S_OK;
+				}
+
+				default:
+					return E_INVALIDARG;
+			}
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateDescriptorHeap(const D3D12_DESCRIPTOR_HEAP_DESC* pDescriptorHeapDesc, REFIID riid, void** ppvHeap) override
+		{
+			const bool ShaderVisible = (pDescriptorHeapDesc->Flags & D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE) != 0;
+			const auto Address = ShaderVisible ? AllocateAddress(UINT64(pDescriptorHeapDesc->NumDescriptors) * kDescriptorSize) : 0;
+			return Return(new DescriptorHeap(this, *pDescriptorHeapDesc, Address), riid, ppvHeap);
+		}
+
+		UINT STDMETHODCALLTYPE GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE) override
+		{
+			return kDescriptorSize;
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateRootSignature(UINT, const void*, SIZE_T, REFIID riid, void** ppvRootSignature) override
+		{
+			return Return(new RootSignature(this), riid, ppvRootSignature);
+		}
+
+		void STDMETHODCALLTYPE CreateConstantBufferView(const D3D12_CONSTANT_BUFFER_VIEW_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override
+		{
+			*ToDescriptor(DestDescriptor) = { Descriptor::kCBV, 0, nullptr, nullptr, pDesc != nullptr ? pDesc->BufferLocation : 0 };
+		}
+
+		void STDMETHODCALLTYPE CreateShaderResourceView(ID3D12Resource* pResource, const D3D12_SHADER_RESOURCE_VIEW_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override
+		{
+			*ToDescriptor(DestDescriptor) = { Descriptor::kSRV, pDesc != nullptr ? uint32_t(pDesc->Format) : 0u, pResource, nullptr, 0 };
+		}
+
+		void STDMETHODCALLTYPE CreateUnorderedAccessView(ID3D12Resource* pResource, ID3D12Resource* pCounterResource, const D3D12_UNORDERED_ACCESS_VIEW_DESC* pDesc,
+			D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override
+		{
+			*ToDescriptor(DestDescriptor) = { Descriptor::kUAV, pDesc != nullptr ? uint32_t(pDesc->Format) : 0u, pResource, pCounterResource, 0 };
+		}
+
+		void STDMETHODCALLTYPE CreateRenderTargetView(ID3D12Resource* pResource, const D3D12_RENDER_TARGET_VIEW_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override
+		{
+			*ToDescriptor(DestDescriptor) = { Descriptor::kRTV, pDesc != nullptr ? uint32_t(pDesc->Format) : 0u, pResource, nullptr, 0 };
+		}
+
+		void STDMETHODCALLTYPE CreateDepthStencilView(ID3D12Resource* pResource, const D3D12_DEPTH_STENCIL_VIEW_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override
+		{
+			*ToDescriptor(DestDescriptor) = { Descriptor::kDSV, pDesc != nullptr ? uint32_t(pDesc->Format) : 0u, pResource, nullptr, 0 };
+		}
+
+		void STDMETHODCALLTYPE CreateSampler(const D3D12_SAMPLER_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override
+		{
+			*ToDescriptor(DestDescriptor) = { Descriptor::kSampler, uint32_t(pDesc->Filter), nullptr, nullptr, 0 };
+		}
+
+		void STDMETHODCALLTYPE CopyDescriptors(UINT NumDestDescriptorRanges, const D3D12_CPU_DESCRIPTOR_HANDLE* pDestDescriptorRangeStarts, const UINT* pDestDescriptorRangeSizes,
+			UINT NumSrcDescriptorRanges, const D3D12_CPU_DESCRIPTOR_HANDLE* pSrcDescriptorRangeStarts, const UINT* pSrcDescriptorRangeSizes,
+			D3D12_DESCRIPTOR_HEAP_TYPE) override
+		{
+			// Both sides are one sequence of descriptors, their ranges don't have to line up
+			UINT DestRange = 0;
+			UINT DestIndex = 0;
+			for (UINT SrcRange = 0; SrcRange < NumSrcDescriptorRanges; ++SrcRange)
+			{
+				const UINT SrcSize = pSrcDescriptorRangeSizes != nullptr ? pSrcDescriptorRangeSizes[SrcRange] : 1;
+				for (UINT SrcIndex = 0; SrcIndex < SrcSize; ++SrcIndex)
+				{
+					while (DestRange < NumDestDescriptorRanges && DestIndex == (pDestDescriptorRangeSizes != nullptr ? pDestDescriptorRangeSizes[DestRange] : 1))
+					{
+						++DestRange;
+						DestIndex = 0;
+					}
+					if (DestRange == NumDestDescriptorRanges)
+						return;
+
+					*ToDescriptor(pDestDescriptorRangeStarts[DestRange], DestIndex++) = *ToDescriptor(pSrcDescriptorRangeStarts[SrcRange], SrcIndex);
+				}
+			}
+		}
+
+		void STDMETHODCALLTYPE CopyDescriptorsSimple(UINT NumDescriptors, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptorRangeStart,
+			D3D12_CPU_DESCRIPTOR_HANDLE SrcDescriptorRangeStart, D3D12_DESCRIPTOR_HEAP_TYPE) override
+		{
+			std::memmove(ToDescriptor(DestDescriptorRangeStart), ToDescriptor(SrcDescriptorRangeStart), size_t(NumDescriptors) * kDescriptorSize);
+		}
+
+		D3D12_RESOURCE_ALLOCATION_INFO STDMETHODCALLTYPE GetResourceAllocationInfo(UINT, UINT numResourceDescs, const D3D12_RESOURCE_DESC* pResourceDescs) override
+		{
+			D3D12_RESOURCE_ALLOCATION_INFO Info = { 0, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT };
+			for (UINT i = 0; i < numResourceDescs; ++i)
+			{
+				const auto& Desc = pResourceDescs[i];
+				UINT64 Alignment = Desc.Alignment;
+				if (Alignment == 0)
+					Alignment = Desc.SampleDesc.Count > 1 ? D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+				Info.SizeInBytes = Math::AlignUp(Info.SizeInBytes, Alignment) + Math::AlignUp(GetResourceSize(Desc), Alignment);
+				Info.Alignment = std::max(Info.Alignment, Alignment);
+			}
+			return Info;
+		}
+
+		D3D12_HEAP_PROPERTIES STDMETHODCALLTYPE GetCustomHeapProperties(UINT, D3D12_HEAP_TYPE heapType) override
+		{
+			D3D12_HEAP_PROPERTIES Properties = { D3D12_HEAP_TYPE_CUSTOM, D3D12_CPU_PAGE_PROPERTY_NOT_AVAILABLE, D3D12_MEMORY_POOL_L1, 1, 1 };
+			if (heapType == D3D12_HEAP_TYPE_UPLOAD)
+				Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE;
+			else if (heapType == D3D12_HEAP_TYPE_READBACK)
+				Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_WRITE_BACK;
+			if (heapType != D3D12_HEAP_TYPE_DEFAULT)
+				Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_L0;
+			return Properties;
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateCommittedResource(const D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS HeapFlags, const D3D12_RESOURCE_DESC* pDesc,
+			D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE*, REFIID riidResource, void** ppvResource) override
+		{
+			const auto Address = AllocateAddress(GetResourceSize(*pDesc));
+			return Return(new Resource(this, *pDesc, *pHeapProperties, HeapFlags, Address), riidResource, ppvResource);
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateHeap(const D3D12_HEAP_DESC* pDesc, REFIID riid, void** ppvHeap) override
+		{
+			return Return(new Heap(this, *pDesc, AllocateAddress(pDesc->SizeInBytes)), riid, ppvHeap);
+		}
+
+		HRESULT STDMETHODCALLTYPE CreatePlacedResource(ID3D12Heap* pHeap, UINT64 HeapOffset, const D3D12_RESOURCE_DESC* pDesc,
+			D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE*, REFIID riid, void** ppvResource) override
+		{
+			auto* PlacedIn = static_cast<Heap*>(pHeap);
+			const auto HeapDesc = PlacedIn->GetDesc();
+			if (HeapOffset + GetResourceSize(*pDesc) > HeapDesc.SizeInBytes)
+				return E_INVALIDARG;
+
+			return Return(new Resource(this, *pDesc, HeapDesc.Properties, HeapDesc.Flags, PlacedIn->GetAddress() + HeapOffset, PlacedIn, HeapOffset),
+				riid, ppvResource);
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateReservedResource(const D3D12_RESOURCE_DESC*, D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE*, REFIID, void**) override
+		{
+			return E_NOTIMPL;
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateSharedHandle(ID3D12DeviceChild*, const SECURITY_ATTRIBUTES*, DWORD, LPCWSTR, HANDLE*) override
+		{
+			return E_NOTIMPL;
+		}
+
+		HRESULT STDMETHODCALLTYPE OpenSharedHandle(HANDLE, REFIID, void**) override
+		{
+			return E_NOTIMPL;
+		}
+
+		HRESULT STDMETHODCALLTYPE OpenSharedHandleByName(LPCWSTR, DWORD, HANDLE*) override
+		{
+			return E_NOTIMPL;
+		}
+
+		HRESULT STDMETHODCALLTYPE MakeResident(UINT, ID3D12Pageable* const*) override { return S_OK; }
+		HRESULT STDMETHODCALLTYPE Evict(UINT, ID3D12Pageable* const*) override { return S_OK; }
+
+		HRESULT STDMETHODCALLTYPE CreateFence(UINT64 InitialValue, D3D12_FENCE_FLAGS, REFIID riid, void** ppFence) override
+		{
+			return Return(new Fence(this, InitialValue), riid, ppFence);
+		}
+
+		HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason(void) override { return S_OK; }
+
+		void STDMETHODCALLTYPE GetCopyableFootprints(const D3D12_RESOURCE_DESC* pResourceDesc, UINT FirstSubresource, UINT NumSubresources, UINT64 BaseOffset,
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT* pLayouts, UINT* pNumRows, UINT64* pRowSizeInBytes, UINT64* pTotalBytes) override
+		{
+			const auto TotalBytes = ComputeFootprints(*pResourceDesc, FirstSubresource, NumSubresources, BaseOffset, pLayouts, pNumRows, pRowSizeInBytes);
+			if (pTotalBytes != nullptr)
+				*pTotalBytes = TotalBytes;
+		}
+
+		HRESULT STDMETHODCALLTYPE CreateQueryHeap(const D3D12_QUERY_HEAP_DESC*, REFIID riid, void** ppvHeap) override
+		{
+			return Return(new QueryHeap(this), riid, ppvHeap);
+		}
+
+		HRESULT STDMETHODCALLTYPE SetStablePowerState(BOOL) override { return S_OK; }
+
+		HRESULT STDMETHODCALLTYPE CreateCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC*, ID3D12RootSignature*, REFIID riid, void** ppvCommandSignature) override
+		{
+			return Return(new CommandSignature(this), riid, ppvCommandSignature);
+		}
+
+		void STDMETHODCALLTYPE GetResourceTiling(ID3D12Resource*, UINT* pNumTilesForEntireResource, D3D12_PACKED_MIP_INFO* pPackedMipDesc,
+			D3D12_TILE_SHAPE* pStandardTileShapeForNonPackedMips, UINT* pNumSubresourceTilings, UINT, D3D12_SUBRESOURCE_TILING*) override
+		{
+			if (pNumTilesForEntireResource != nullptr)
+				*pNumTilesForEntireResource = 0;
+			if (pPackedMipDesc != nullptr)
+				*pPackedMipDesc = {};
+			if (pStandardTileShapeForNonPackedMips != nullptr)
+				*pStandardTileShapeForNonPackedMips = {};
+			if (pNumSubresourceTilings != nullptr)
+				*pNumSubresourceTilings = 0;
+		}
+
+		LUID STDMETHODCALLTYPE GetAdapterLuid(void) override { return {}; }
+
+	protected:
+		bool Implements(REFIID riid) const override
+		{
+			return riid == __uuidof(RecordingDevice) || Object::Implements(riid);
+		}
+
+	private:
+		// Addresses are never reused, which keeps them unique for the lifetime of the device
+		D3D12_GPU_VIRTUAL_ADDRESS AllocateAddress(UINT64 Size)
+		{
+			return m_NextAddress.fetch_add(Math::AlignUp(std::max<UINT64>(Size, 1), D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT));
+		}
+
+		std::atomic<D3D12_GPU_VIRTUAL_ADDRESS> m_NextAddress = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+		std::mutex m_ObserverMutex;
+		Recording::SubmitObserver m_Observer;
+		Recording::QueueObserver m_QueueObserver;
+	};
+
+	CommandQueue::CommandQueue(RecordingDevice& Owner, const D3D12_COMMAND_QUEUE_DESC& Desc)
+		: Child(&Owner), m_Device(Owner), m_Desc(Desc)
+	{
+		m_Worker = std::thread(&CommandQueue::Run, this);
+	}
+
+	void CommandQueue::ExecuteCommandLists(UINT NumCommandLists, ID3D12CommandList* const* ppCommandLists)
+	{
+		auto Lists = std::vector<const Recording::CommandList*>(NumCommandLists);
+		for (UINT i = 0; i < NumCommandLists; ++i)
+			Lists[i] = &static_cast<CommandList*>(ppCommandLists[i])->GetRecorded();
+
+		m_Device.NotifySubmit(m_Desc.Type, Lists);
+		m_Device.NotifyQueueOperation({ Recording::QueueOperation::Kind::Execute, m_Desc.Type, nullptr, NumCommandLists });
+	}
+
+	HRESULT CommandQueue::Signal(ID3D12Fence* pFence, UINT64 Value)
+	{
+		m_Device.NotifyQueueOperation({ Recording::QueueOperation::Kind::Signal, m_Desc.Type, pFence, Value });
+		Enqueue({ false, pFence, Value });
+		return S_OK;
+	}
+
+	HRESULT CommandQueue::Wait(ID3D12Fence* pFence, UINT64 Value)
+	{
+		m_Device.NotifyQueueOperation({ Recording::QueueOperation::Kind::Wait, m_Desc.Type, pFence, Value });
+		Enqueue({ true, pFence, Value });
+		return S_OK;
+	}
+}
+
+HRESULT Recording::CreateDevice(ID3D12Device** Device)
+{
+	*Device = new RecordingDevice();
+	return S_OK;
+}
+
+HRESULT Recording::SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC& Desc, ID3DBlob** Blob)
+{
+	// Root signatures are never parsed by the recording device, the blob only has to exist
+	const uint32_t Header[] = { Desc.NumParameters, Desc.NumStaticSamplers, static_cast<uint32_t>(Desc.Flags) };
+	const auto* Bytes = reinterpret_cast<const uint8_t*>(Header);
+	*Blob = new ::Blob(std::vector<uint8_t>(Bytes, Bytes + sizeof(Header)));
+	return S_OK;
+}
+
+void Recording::SetSubmitObserver(ID3D12Device* Device, SubmitObserver Observer)
+{
+	ComPtr<ID3D12Device> Recorder;
+	ASSERT_SUCCEEDED(Device->QueryInterface(__uuidof(RecordingDevice), &Recorder), "Not a recording device");
+	static_cast<RecordingDevice*>(Recorder.Get())->SetSubmitObserver(std::move(Observer));
+}
+
+void Recording::SetQueueObserver(ID3D12Device* Device, QueueObserver Observer)
+{
+	ComPtr<ID3D12Device> Recorder;
+	ASSERT_SUCCEEDED(Device->QueryInterface(__uuidof(RecordingDevice), &Recorder), "Not a recording device");
+	static_cast<RecordingDevice*>(Recorder.Get())->SetQueueObserver(std::move(Observer));
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <vector>
+
+// A device that implements the D3D12 interfaces the engine uses without a GPU or a driver, so the
+// CPU side of the engine can be run and inspected anywhere. Command lists record which commands
+// were issued instead of executing them, with barriers kept in full. Each queue retires its
+// submissions, signals and waits in order on a worker thread, so fences and cross-queue waits
+// behave as on a GPU that finishes work instantly. Upload and readback memory is CPU memory, other
+// resources have no storage and descriptors only remember the resource they point at.
+namespace Recording
+{
+	struct Command
+	{
+		// The ID3D12GraphicsCommandList method that was called
+		const char* Name;
+		// The barriers of a ResourceBarrier call
+		std::vector<D3D12_RESOURCE_BARRIER> Barriers;
+	};
+
+	struct CommandList
+	{
+		D3D12_COMMAND_LIST_TYPE Type;
+		std::vector<Command> Commands;
+	};
+
+	// Called on the submitting thread for every ExecuteCommandLists, before the lists can be reset
+	using SubmitObserver = std::function<void(D3D12_COMMAND_LIST_TYPE QueueType, std::span<const CommandList* const> Lists)>;
+
+	// A submission, signal or wait as its queue received it
+	struct QueueOperation
+	{
+		enum class Kind { Execute, Signal, Wait };
+
+		Kind Type;
+		D3D12_COMMAND_LIST_TYPE Queue;
+		// The fence a signal or wait is for, null for submissions
+		ID3D12Fence* Fence;
+		// The value signaled or waited for, the number of lists of a submission
+		UINT64 Value;
+	};
+
+	// Called on the issuing thread for every operation, in the order each queue receives them
+	using QueueObserver = std::function<void(const QueueOperation& Operation)>;
+
+	HRESULT CreateDevice(ID3D12Device** Device);
+	HRESULT SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC& Desc, ID3DBlob** Blob);
+
+	// Replace the observers of all queues of a recording device, nullptr removes them
+	void SetSubmitObserver(ID3D12Device* Device, SubmitObserver Observer);
+	void SetQueueObserver(ID3D12Device* Device, QueueObserver Observer);
+}
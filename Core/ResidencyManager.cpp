@@ -0,0 +1,127 @@
+#include "pch.h"
+#include "ResidencyManager.h"
+#include "GraphicsCore.h"
+#include "CommandListManager.h"
+
+namespace Graphics
+{
+	ResidencyManager g_ResidencyManager;
+}
+
+using namespace Graphics;
+
+void ResidencyManager::Create(ID3D12Device* Device, IDXGIAdapter3* Adapter)
+{
+	ASSERT(m_Device == nullptr);
+	m_Device = Device;
+	m_Adapter = Adapter;
+	m_CurrentFrame = 1;
+	m_LastCompletedFrame = 0;
+}
+
+void ResidencyManager::Destroy(void)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	m_Policy.Clear();
+	m_FrameFences.clear();
+	m_Adapter = nullptr;
+	m_Device = nullptr;
+	m_Stats = {};
+}
+
+void ResidencyManager::Track(ID3D12Pageable* Object, uint64_t Size)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	m_Policy.Insert(Object, Size, m_CurrentFrame);
+}
+
+void ResidencyManager::Untrack(ID3D12Pageable* Object)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	m_Policy.Remove(Object);
+}
+
+void ResidencyManager::Pin(ID3D12Pageable* Object)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	m_Policy.Pin(Object);
+	if (m_Policy.Touch(Object, m_CurrentFrame))
+	{
+		ASSERT_SUCCEEDED(m_Device->MakeResident(1, &Object));
+		++m_Stats.NumMadeResident;
+	}
+}
+
+void ResidencyManager::Unpin(ID3D12Pageable* Object)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	m_Policy.Unpin(Object);
+}
+
+void ResidencyManager::MakeResident(const std::vector<ID3D12Pageable*>& Objects)
+{
+	if (Objects.empty())
+		return;
+
+	std::vector<ID3D12Pageable*> Evicted;
+
+	// Paging in happens under the lock, otherwise EndFrame could pick an object again in between
+	auto lg = std::lock_guard{ m_Mutex };
+
+	for (auto Object : Objects)
+	{
+		if (m_Policy.Touch(Object, m_CurrentFrame))
+			Evicted.push_back(Object);
+	}
+
+	if (!Evicted.empty())
+	{
+		ASSERT_SUCCEEDED(m_Device->MakeResident((UINT)Evicted.size(), Evicted.data()));
+		m_Stats.NumMadeResident += Evicted.size();
+	}
+}
+
+void ResidencyManager::EndFrame(uint64_t FrameFenceValue)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	m_FrameFences.emplace_back(m_CurrentFrame++, FrameFenceValue);
+	while (!m_FrameFences.empty() && g_CommandManager.IsFenceComplete(m_FrameFences.front().second))
+	{
+		m_LastCompletedFrame = m_FrameFences.front().first;
+		m_FrameFences.pop_front();
+	}
+
+	if (m_Adapter == nullptr)
+		return;
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO MemoryInfo = {};
+	if (FAILED(m_Adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &MemoryInfo)))
+		return;
+
+	m_Stats.Budget = MemoryInfo.Budget;
+	m_Stats.CurrentUsage = MemoryInfo.CurrentUsage;
+
+	if (MemoryInfo.CurrentUsage <= MemoryInfo.Budget)
+		return;
+
+	auto Victims = m_Policy.Evict(MemoryInfo.CurrentUsage - MemoryInfo.Budget, m_LastCompletedFrame);
+	if (Victims.empty())
+		return;
+
+	ASSERT_SUCCEEDED(m_Device->Evict((UINT)Victims.size(), Victims.data()));
+	m_Stats.NumEvictions += Victims.size();
+}
+
+ResidencyManager::Stats ResidencyManager::GetStats(void) const
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	auto Stats = m_Stats;
+	Stats.NumTracked = (uint32_t)m_Policy.GetCount();
+	Stats.TrackedBytes = m_Policy.GetTotalSize();
+	Stats.EvictedBytes = m_Policy.GetEvictedSize();
+	return Stats;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <d3d12.h>
+#include <dxgi1_4.h>
+#include <wrl.h>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Orders tracked objects from least to most recently used and picks what to evict. It only keeps
+// the books, so the policy can be driven without a device; ResidencyManager does the paging.
+template <typename Key>
+class LruResidencyPolicy
+{
+public:
+	// New objects count as used in Frame, so they aren't evicted before anything had a chance to use them
+	void Insert(Key Object, uint64_t Size, uint64_t Frame)
+	{
+		ASSERT(!m_Entries.contains(Object));
+		m_Order.push_back({ Object, Size, Frame, 0, true });
+		m_Entries.emplace(Object, std::prev(m_Order.end()));
+		m_TotalSize += Size;
+	}
+
+	void Remove(Key Object)
+	{
+		const auto It = m_Entries.find(Object);
+		if (It == m_Entries.end())
+			return;
+
+		m_TotalSize -= It->second->Size;
+		if (!It->second->Resident)
+			m_EvictedSize -= It->second->Size;
+		m_Order.erase(It->second);
+		m_Entries.erase(It);
+	}
+
+	// Stamps the object with Frame and moves it to the most recently used end. Returns whether it was
+	// evicted and has to be made resident again; it counts as resident from here on.
+	bool Touch(Key Object, uint64_t Frame)
+	{
+		const auto It = m_Entries.find(Object);
+		if (It == m_Entries.end())
+			return false;
+
+		auto& Entry = *It->second;
+		Entry.LastUsedFrame = std::max(Entry.LastUsedFrame, Frame);
+		m_Order.splice(m_Order.end(), m_Order, It->second);
+
+		if (Entry.Resident)
+			return false;
+
+		Entry.Resident = true;
+		m_EvictedSize -= Entry.Size;
+		return true;
+	}
+
+	// Pinned objects are never picked for eviction
+	void Pin(Key Object) { ++m_Entries.at(Object)->NumPins; }
+	void Unpin(Key Object)
+	{
+		auto& Entry = *m_Entries.at(Object);
+		ASSERT(Entry.NumPins > 0);
+		--Entry.NumPins;
+	}
+
+	// Picks resident, unpinned objects last used no later than LastCompletedFrame, least recently used
+	// first, until they add up to BytesToFree or nothing else qualifies, and marks them evicted
+	std::vector<Key> Evict(uint64_t BytesToFree, uint64_t LastCompletedFrame)
+	{
+		std::vector<Key> Victims;
+		uint64_t FreedSize = 0;
+
+		for (auto& Entry : m_Order)
+		{
+			if (FreedSize >= BytesToFree || Entry.LastUsedFrame > LastCompletedFrame)
+				break;
+
+			if (!Entry.Resident || Entry.NumPins > 0)
+				continue;
+
+			Entry.Resident = false;
+			FreedSize += Entry.Size;
+			Victims.push_back(Entry.Object);
+		}
+
+		m_EvictedSize += FreedSize;
+		return Victims;
+	}
+
+	void Clear(void)
+	{
+		m_Order.clear();
+		m_Entries.clear();
+		m_TotalSize = m_EvictedSize = 0;
+	}
+
+	bool IsResident(Key Object) const { return m_Entries.at(Object)->Resident; }
+	size_t GetCount(void) const { return m_Entries.size(); }
+	uint64_t GetTotalSize(void) const { return m_TotalSize; }
+	uint64_t GetEvictedSize(void) const { return m_EvictedSize; }
+
+private:
+	struct Entry
+	{
+		Key Object;
+		uint64_t Size;
+		uint64_t LastUsedFrame;
+		uint32_t NumPins;
+		bool Resident;
+	};
+
+	std::list<Entry> m_Order;
+	std::unordered_map<Key, typename std::list<Entry>::iterator> m_Entries;
+	uint64_t m_TotalSize = 0;
+	uint64_t m_EvictedSize = 0;
+};
+
+// Keeps the heaps and committed resources made by GpuHeapAllocator within the adapter's local
+// memory budget. Every frame the budget is queried and, while usage exceeds it, the least recently
+// used objects whose last frame has completed on the GPU are evicted. Contexts make the objects they
+// marked resident again before their command list is submitted.
+//
+// Most resources are bound through descriptors that can't be traced back to them, so objects start
+// out pinned and never evicted. Resources whose every use is marked opt in with AllowEviction.
+class ResidencyManager
+{
+public:
+	struct Stats
+	{
+		uint64_t Budget;
+		uint64_t CurrentUsage;
+		uint32_t NumTracked;
+		uint64_t TrackedBytes;
+		uint64_t EvictedBytes;
+		uint64_t NumEvictions;
+		uint64_t NumMadeResident;
+	};
+
+	// Without an adapter to query the budget of nothing is ever evicted
+	void Create(ID3D12Device* Device, IDXGIAdapter3* Adapter);
+	void Destroy(void);
+
+	void Track(ID3D12Pageable* Object, uint64_t Size);
+	void Untrack(ID3D12Pageable* Object);
+
+	// Pinning makes the object resident right away if it was evicted
+	void Pin(ID3D12Pageable* Object);
+	void Unpin(ID3D12Pageable* Object);
+
+	// Stamps the objects with the current frame and makes the evicted ones resident again. Called by
+	// CommandContext::Finish before the command list is submitted; untracked objects are ignored.
+	void MakeResident(const std::vector<ID3D12Pageable*>& Objects);
+
+	// Called by Graphics::Present with the fence value that completes the frame
+	void EndFrame(uint64_t FrameFenceValue);
+
+	Stats GetStats(void) const;
+
+private:
+	ID3D12Device* m_Device = nullptr;
+	Microsoft::WRL::ComPtr<IDXGIAdapter3> m_Adapter;
+
+	mutable std::mutex m_Mutex;
+	LruResidencyPolicy<ID3D12Pageable*> m_Policy;
+	// Frames run from 1, the fence values of those the GPU may still be working on are kept in order
+	uint64_t m_CurrentFrame = 1;
+	uint64_t m_LastCompletedFrame = 0;
+	std::deque<std::pair<uint64_t, uint64_t>> m_FrameFences;
+	Stats m_Stats = {};
+};
+
+namespace Graphics
+{
+	extern ResidencyManager g_ResidencyManager;
+}
@@ -1,19 +1,19 @@
 #include "pch.h"
 #include "RootSignature.h"
 #include "GraphicsCore.h"
+#include "GraphicsBackend.h"
 #include "Hash.h"
-
-#include <map>
+#include "StateObjectCache.h"
 
 using namespace Graphics;
 using namespace std;
 using Microsoft::WRL::ComPtr;
 
-static std::map<size_t, ComPtr<ID3D12RootSignature>> s_RootSignatureHashMap;
+static StateObjectCache<ID3D12RootSignature> s_RootSignatureCache;
 
 void RootSignature::DestroyAll(void)
 {
-	s_RootSignatureHashMap.clear();
+	s_RootSignatureCache.Clear();
 }
 
 void RootSignature::InitStaticSampler(UINT Register, const D3D12_SAMPLER_DESC& NonStaticSamplerDesc, D3D12_SHADER_VISIBILITY Visibility)
@@ -89,6 +89,11 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 	size_t HashCode = Utility::HashState(&RootDesc.Flags);
 	HashCode = Utility::HashState(RootDesc.pStaticSamplers, m_NumSamplers, HashCode);
 
+	// The hashed state, plus the visibility and range count of tables that the hash leaves out
+	auto Key = vector<uint8_t>();
+	AppendStateKey(Key, &RootDesc.Flags);
+	AppendStateKey(Key, RootDesc.pStaticSamplers, m_NumSamplers);
+
 	for (UINT Param = 0; Param < m_NumParameters; ++Param)
 	{
 		const D3D12_ROOT_PARAMETER& RootParam = RootDesc.pParameters[Param];
@@ -100,6 +105,9 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 
 			HashCode = Utility::HashState(RootParam.DescriptorTable.pDescriptorRanges,
 				RootParam.DescriptorTable.NumDescriptorRanges, HashCode);
+			AppendStateKey(Key, &RootParam.ShaderVisibility);
+			AppendStateKey(Key, &RootParam.DescriptorTable.NumDescriptorRanges);
+			AppendStateKey(Key, RootParam.DescriptorTable.pDescriptorRanges, RootParam.DescriptorTable.NumDescriptorRanges);
 
 			// We keep track of sampler descriptor tables separately from CBV_SRV_UAV descriptor tables
 			if (RootParam.DescriptorTable.pDescriptorRanges->RangeType == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER)
@@ -111,47 +119,26 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 				m_DescriptorTableSize[Param] += RootParam.DescriptorTable.pDescriptorRanges[TableRange].NumDescriptors;
 		}
 		else
-			HashCode = Utility::HashState(&RootParam, 1, HashCode);
-	}
-
-	ID3D12RootSignature** RSRef = nullptr;
-	bool firstCompile = false;
-	{
-		static mutex s_HashMapMutex;
-		lock_guard<mutex> CS(s_HashMapMutex);
-		auto iter = s_RootSignatureHashMap.find(HashCode);
-
-		// Reserve space so the next inquiry will find that someone got here first.
-		if (iter == s_RootSignatureHashMap.end())
 		{
-			RSRef = s_RootSignatureHashMap[HashCode].GetAddressOf();
-			firstCompile = true;
+			HashCode = Utility::HashState(&RootParam, 1, HashCode);
+			AppendStateKey(Key, &RootParam);
 		}
-		else
-			RSRef = iter->second.GetAddressOf();
 	}
 
-	if (firstCompile)
+	m_Signature = s_RootSignatureCache.GetOrCreate(HashCode, std::move(Key), [&]
 	{
 		ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
 
-		ASSERT_SUCCEEDED(D3D12SerializeRootSignature(&RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-			pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf())); //? won't referencing work?
+		ASSERT_SUCCEEDED(g_Backend->SerializeRootSignature(RootDesc, pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf()));
 
+		ID3D12RootSignature* Signature = nullptr;
 		ASSERT_SUCCEEDED(g_Device->CreateRootSignature(1, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize(),
-			IID_PPV_ARGS(&m_Signature)));
-
-		m_Signature->SetName(name.c_str());
+			IID_PPV_ARGS(&Signature)));
 
-		s_RootSignatureHashMap[HashCode].Attach(m_Signature);
-		ASSERT(*RSRef == m_Signature);
-	}
-	else
-	{
-		while (*RSRef == nullptr)
-			this_thread::yield();
-		m_Signature = *RSRef;
-	}
+		Signature->SetName(name.c_str());
+		return Signature;
+	});
 
+	m_Hash = HashCode;
 	m_Finalized = TRUE;
 }
@@ -92,6 +92,7 @@ protected:
 class RootSignature
 {
 	friend class DynamicDescriptorHeap;
+	friend class CommandTrace;
 
 public:
 	RootSignature(UINT NumRootParams = 0, UINT NumStaticSamplers = 0) : m_NumParameters(NumRootParams)
@@ -129,6 +130,8 @@ public:
 	void Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAGS Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
 	ID3D12RootSignature* GetSignature() const { return m_Signature; }
+	// Hash of the description the signature was created from, stable across launches
+	size_t GetHash() const { return m_Hash; }
 
 protected:
 	BOOL m_Finalized = FALSE;
@@ -141,5 +144,6 @@ protected:
 	std::unique_ptr<RootParameter[]> m_ParamArray;
 	std::unique_ptr<D3D12_STATIC_SAMPLER_DESC[]> m_SamplerArray;
 	ID3D12RootSignature* m_Signature;
+	size_t m_Hash = 0;
 };
 
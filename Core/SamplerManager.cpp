@@ -1,32 +1,99 @@
 #include "pch.h"
 #include "SamplerManager.h"
 #include "GraphicsCore.h"
+#include "DynamicDescriptorHeap.h"
 #include "Hash.h"
 
+#include <shared_mutex>
+#include <unordered_map>
+
 using namespace Graphics;
 
 namespace
 {
-    // access not protected by mutex?
-    std::map<size_t, D3D12_CPU_DESCRIPTOR_HANDLE> s_SamplerCache;
+    const uint32_t kNotShared = ~0u;
+
+    struct CachedSampler
+    {
+        D3D12_SAMPLER_DESC Desc;
+        D3D12_CPU_DESCRIPTOR_HANDLE Handle;
+        uint32_t TableIndex;
+    };
+
+    // Entries match on the full description, the hash only picks the bucket
+    std::shared_mutex s_CacheMutex;
+    std::unordered_multimap<size_t, CachedSampler> s_SamplerCache;
+    uint32_t s_NumSharedSamplers = 0;
+
+    CachedSampler* FindSampler(size_t Hash, const D3D12_SAMPLER_DESC& Desc)
+    {
+        const auto [Begin, End] = s_SamplerCache.equal_range(Hash);
+        for (auto it = Begin; it != End; ++it)
+        {
+            if (std::memcmp(&it->second.Desc, &Desc, sizeof(Desc)) == 0)
+                return &it->second;
+        }
+        return nullptr;
+    }
+
+    CachedSampler GetOrCreateSampler(const D3D12_SAMPLER_DESC& Desc, bool Shared)
+    {
+        const size_t Hash = Utility::HashState(&Desc);
+
+        {
+            auto lock = std::shared_lock{ s_CacheMutex };
+            const CachedSampler* Sampler = FindSampler(Hash, Desc);
+            if (Sampler != nullptr && (!Shared || Sampler->TableIndex != kNotShared))
+                return *Sampler;
+        }
+
+        auto lock = std::unique_lock{ s_CacheMutex };
+
+        // Another thread may have added it since the lookup above
+        CachedSampler* Sampler = FindSampler(Hash, Desc);
+        if (Sampler == nullptr)
+        {
+            const auto Handle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+            g_Device->CreateSampler(&Desc, Handle);
+            Sampler = &s_SamplerCache.emplace(Hash, CachedSampler{ Desc, Handle, kNotShared })->second;
+        }
+
+        if (Shared && Sampler->TableIndex == kNotShared)
+        {
+            ASSERT(s_NumSharedSamplers < kNumSharedSamplers, "Shared sampler table is full");
+            if (s_NumSharedSamplers < kNumSharedSamplers)
+            {
+                Sampler->TableIndex = s_NumSharedSamplers++;
+
+                const UINT DescriptorSize = g_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+                const auto Table = DynamicDescriptorHeap::GetSharedSamplerTable();
+                g_Device->CopyDescriptorsSimple(1, (Table + Sampler->TableIndex * DescriptorSize).GetCpuHandle(),
+                    Sampler->Handle, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+            }
+        }
+
+        return *Sampler;
+    }
 }
 
 D3D12_CPU_DESCRIPTOR_HANDLE SamplerDesc::CreateDescriptor()
 {
-    size_t hashValue = Utility::HashState(this);
-    auto iter = s_SamplerCache.find(hashValue);
-    if (iter != s_SamplerCache.end())
-    {
-        return iter->second;
-    }
+    return GetOrCreateSampler(*this, false).Handle;
+}
 
-    D3D12_CPU_DESCRIPTOR_HANDLE Handle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
-    g_Device->CreateSampler(this, Handle);
-    //? Never put into map?
-    return Handle;
+uint32_t SamplerDesc::GetSharedTableIndex()
+{
+    const uint32_t TableIndex = GetOrCreateSampler(*this, true).TableIndex;
+    // Falls back to the first shared sampler when the table has overflowed
+    return TableIndex != kNotShared ? TableIndex : 0;
 }
 
 void SamplerDesc::CreateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& Handle)
 {
     g_Device->CreateSampler(this, Handle);
 }
+
+D3D12_GPU_DESCRIPTOR_HANDLE Graphics::GetSharedSamplerTable(void)
+{
+    return DynamicDescriptorHeap::GetSharedSamplerTable().GetGpuHandle();
+}
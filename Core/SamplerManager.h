@@ -44,6 +44,19 @@ public:
 	// Allocate new descriptor as needed; return handle to existing descriptor when possible
 	D3D12_CPU_DESCRIPTOR_HANDLE CreateDescriptor();
 
+	// Slot of this sampler in the shared sampler table, adding it on first use. Shaders indexing the
+	// table let everything drawn with shared samplers bind one table instead of copying descriptors.
+	uint32_t GetSharedTableIndex();
+
 	// Create descriptor in-place (no deduplication)
 	void CreateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& Handle);
-};
\ No newline at end of file
+};
+
+namespace Graphics
+{
+	// Size of the shared sampler table
+	constexpr uint32_t kNumSharedSamplers = 128;
+
+	// Start of the shared sampler table in the shader-visible sampler heap every context binds
+	D3D12_GPU_DESCRIPTOR_HANDLE GetSharedSamplerTable(void);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Appends the raw bytes of state descriptions to a cache key
+template <typename T>
+inline void AppendStateKey(std::vector<uint8_t>& Key, const T* State, size_t Count = 1)
+{
+	static_assert(std::is_trivially_copyable_v<T>);
+	const auto Bytes = reinterpret_cast<const uint8_t*>(State);
+	Key.insert(Key.end(), Bytes, Bytes + sizeof(T) * Count);
+}
+
+// Thread-safe cache of D3D12 objects created from a state description. Lookups go by the hash of
+// the description, but an entry only matches when its full key compares equal, so two descriptions
+// with the same hash get distinct objects. The map is split into independently locked shards, and
+// threads asking for an object that is still being created block on its entry instead of spinning.
+template <typename T, size_t NumShards = 16>
+class StateObjectCache
+{
+	struct Entry;
+
+public:
+	// Where the object of an entry shows up. Stays valid until Clear.
+	struct Slot
+	{
+		// Null until the object has been published, and for good if Create failed
+		std::atomic<T*> Object = nullptr;
+		std::atomic<bool> Done = false;
+
+		T* Get(void) const { return Object.load(std::memory_order_acquire); }
+		bool IsDone(void) const { return Done.load(std::memory_order_acquire); }
+		bool HasFailed(void) const { return IsDone() && Get() == nullptr; }
+
+		// Blocks until Create has returned; null if it failed
+		T* Wait(void) const
+		{
+			Done.wait(false, std::memory_order_acquire);
+			return Get();
+		}
+	};
+
+	// Returns the object for Key, calling Create on the first request for it. Create returns a new
+	// reference, which the cache takes over, or null if it failed.
+	template <typename CreateFn>
+	T* GetOrCreate(size_t Hash, std::vector<uint8_t>&& Key, CreateFn&& Create)
+	{
+		return GetOrCreateSlot(Hash, std::move(Key), std::forward<CreateFn>(Create)).Wait();
+	}
+
+	// Like GetOrCreate, but returns the slot, which is done by the time this returns
+	template <typename CreateFn>
+	const Slot& GetOrCreateSlot(size_t Hash, std::vector<uint8_t>&& Key, CreateFn&& Create)
+	{
+		auto [Found, IsCreator] = FindOrInsert(Hash, std::move(Key));
+
+		if (IsCreator)
+			Publish(*Found, Create());
+		else
+			Found->Published.Wait();
+
+		return Found->Published;
+	}
+
+	// Returns the slot for Key without waiting for its object. On the first request for Key, Schedule
+	// is handed a task that creates the object with Create and publishes it; it may run it on any thread.
+	template <typename CreateFn, typename ScheduleFn>
+	const Slot& GetOrCreateAsync(size_t Hash, std::vector<uint8_t>&& Key, CreateFn&& Create, ScheduleFn&& Schedule)
+	{
+		auto [Found, IsCreator] = FindOrInsert(Hash, std::move(Key));
+
+		if (IsCreator)
+			Schedule([Found, Create = std::forward<CreateFn>(Create)] { Publish(*Found, Create()); });
+
+		return Found->Published;
+	}
+
+	// Waits for objects that are still being created before releasing everything
+	void Clear(void)
+	{
+		for (auto& Shard : m_Shards)
+		{
+			auto lg = std::lock_guard{ Shard.Mutex };
+			for (const auto& [Hash, Pending] : Shard.Entries)
+				Pending->Published.Wait();
+			Shard.Entries.clear();
+		}
+	}
+
+private:
+	struct Entry
+	{
+		explicit Entry(std::vector<uint8_t>&& Key) : Key(std::move(Key)) {}
+
+		const std::vector<uint8_t> Key;
+		Microsoft::WRL::ComPtr<T> Object;
+		Slot Published;
+	};
+
+	struct alignas(64) Shard
+	{
+		std::mutex Mutex;
+		std::unordered_multimap<size_t, std::unique_ptr<Entry>> Entries;
+	};
+
+	static void Publish(Entry& Target, T* Object)
+	{
+		Target.Object.Attach(Object);
+		Target.Published.Object.store(Object, std::memory_order_release);
+		Target.Published.Done.store(true, std::memory_order_release);
+		Target.Published.Done.notify_all();
+	}
+
+	std::pair<Entry*, bool> FindOrInsert(size_t Hash, std::vector<uint8_t>&& Key)
+	{
+		auto& Shard = m_Shards[Hash % NumShards];
+
+		Entry* Found = nullptr;
+		bool IsCreator = false;
+		{
+			auto lg = std::lock_guard{ Shard.Mutex };
+
+			const auto [Begin, End] = Shard.Entries.equal_range(Hash);
+			for (auto it = Begin; it != End && Found == nullptr; ++it)
+			{
+				if (it->second->Key == Key)
+					Found = it->second.get();
+			}
+
+			if (Found == nullptr)
+			{
+				auto NewEntry = std::make_unique<Entry>(std::move(Key));
+				Found = NewEntry.get();
+				Shard.Entries.emplace(Hash, std::move(NewEntry));
+				IsCreator = true;
+			}
+		}
+
+		return { Found, IsCreator };
+	}
+
+	Shard m_Shards[NumShards];
+};
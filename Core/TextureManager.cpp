@@ -13,6 +13,13 @@ static UINT BytesPerPixel(DXGI_FORMAT Format)
 	return (UINT)BitsPerPixel(Format) / 8;
 }
 
+void Texture::Destroy()
+{
+	GpuResource::Destroy();
+	FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hCpuDescriptorHandle);
+	m_hCpuDescriptorHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+}
+
 void Texture::Create(size_t Pitch, size_t Width, size_t Height, DXGI_FORMAT Format, const void* InitData)
 {
 	m_UsageState = D3D12_RESOURCE_STATE_COPY_DEST;
@@ -29,15 +36,11 @@ void Texture::Create(size_t Pitch, size_t Width, size_t Height, DXGI_FORMAT Form
 	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-	D3D12_HEAP_PROPERTIES HeapProps;
-	HeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-	HeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	HeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	HeapProps.CreationNodeMask = 1;
-	HeapProps.VisibleNodeMask = 1;
-
-	ASSERT_SUCCEEDED(g_Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &texDesc,
-		m_UsageState, nullptr, IID_PPV_ARGS(m_pResource.ReleaseAndGetAddressOf())));
+	// The previous texture's memory goes back to the heap it was placed in
+	m_pResource = nullptr;
+	g_GpuHeapAllocator.Free(m_Allocation);
+	m_pResource.Attach(g_GpuHeapAllocator.CreateResource(D3D12_HEAP_TYPE_DEFAULT, texDesc,
+		m_UsageState, nullptr, m_Allocation));
 
 	m_pResource->SetName(L"Texture");
 
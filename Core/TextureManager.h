@@ -11,6 +11,16 @@ class Texture : public GpuResource
 public:
 	Texture() = default;
 	Texture(D3D12_CPU_DESCRIPTOR_HANDLE Handle) : m_hCpuDescriptorHandle(Handle) {}
+	virtual ~Texture() { Destroy(); }
+
+	// The SRV travels with the resource; whatever the target held is released by the source
+	Texture(Texture&& Other) noexcept : GpuResource(std::move(Other)) { std::swap(m_hCpuDescriptorHandle, Other.m_hCpuDescriptorHandle); }
+	Texture& operator=(Texture&& Other) noexcept
+	{
+		GpuResource::operator=(std::move(Other));
+		std::swap(m_hCpuDescriptorHandle, Other.m_hCpuDescriptorHandle);
+		return *this;
+	}
 
 	void Create(size_t Pitch, size_t Width, size_t Height, DXGI_FORMAT Format, const void* InitData);
 	void Create(size_t Width, size_t Height, DXGI_FORMAT Format, const void* InitData)
@@ -18,16 +28,11 @@ public:
 		Create(Width, Width, Height, Format, InitData);
 	}
 
-	virtual void Destroy() override
-	{
-		GpuResource::Destroy();
-		//? This leaks descriptor handles. We should really give it back to be reused
-		m_hCpuDescriptorHandle.ptr = 0;
-	}
+	virtual void Destroy() override;
 
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV() const { return m_hCpuDescriptorHandle; }
 
-	bool operator!() { return m_hCpuDescriptorHandle.ptr == 0; }
+	bool operator!() { return m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN; }
 
 protected:
 	D3D12_CPU_DESCRIPTOR_HANDLE m_hCpuDescriptorHandle = { D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN };
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+// One Queue per producing thread, so producers never contend with each other. Queues are linked
+// into a lock-free list on first use and live as long as the owner. ForEach must not run while
+// any producer does, e.g. the consumer merges them once per frame after the producers are done.
+template <typename Queue>
+class ThreadLocalQueues
+{
+	struct Node
+	{
+		std::thread::id ThreadId;
+		Queue Data;
+		Node* Next = nullptr;
+	};
+
+public:
+	ThreadLocalQueues() = default;
+	~ThreadLocalQueues()
+	{
+		auto* Head = m_Head.exchange(nullptr);
+		while (Head != nullptr)
+			delete std::exchange(Head, Head->Next);
+	}
+
+	ThreadLocalQueues(const ThreadLocalQueues&) = delete;
+	ThreadLocalQueues& operator=(const ThreadLocalQueues&) = delete;
+
+	// Returns the calling thread's queue
+	Queue& Local(void)
+	{
+		// Fast path: the thread already used this instance last
+		thread_local struct {
+			uint64_t OwnerId = 0;
+			Queue* Data = nullptr;
+		} Cache;
+
+		if (Cache.OwnerId == m_Id)
+			return *Cache.Data;
+
+		const auto ThreadId = std::this_thread::get_id();
+
+		// Nodes are never unlinked while the owner lives, so the list can be walked without locking
+		auto* Head = m_Head.load(std::memory_order_acquire);
+		for (auto* It = Head; It != nullptr; It = It->Next)
+		{
+			if (It->ThreadId == ThreadId)
+			{
+				Cache = { m_Id, &It->Data };
+				return It->Data;
+			}
+		}
+
+		auto* NewNode = new Node{ .ThreadId = ThreadId, .Data = {}, .Next = Head };
+		while (!m_Head.compare_exchange_weak(NewNode->Next, NewNode, std::memory_order_release, std::memory_order_acquire));
+
+		Cache = { m_Id, &NewNode->Data };
+		return NewNode->Data;
+	}
+
+	template <typename Function>
+	void ForEach(Function&& Fn)
+	{
+		for (auto* It = m_Head.load(std::memory_order_acquire); It != nullptr; It = It->Next)
+			Fn(It->Data);
+	}
+
+	template <typename Function>
+	void ForEach(Function&& Fn) const
+	{
+		for (const auto* It = m_Head.load(std::memory_order_acquire); It != nullptr; It = It->Next)
+			Fn(It->Data);
+	}
+
+private:
+	std::atomic<Node*> m_Head = nullptr;
+	// Distinguishes owners in the per-thread cache, even if one is reallocated at the same address
+	const uint64_t m_Id = ++s_IdCounter;
+	inline static std::atomic<uint64_t> s_IdCounter = 0;
+};
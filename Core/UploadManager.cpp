@@ -0,0 +1,294 @@
+#include "pch.h"
+#include "UploadManager.h"
+#include "GraphicsCore.h"
+#include "CommandListManager.h"
+#include "Math/Common.h"
+
+namespace Graphics
+{
+	UploadManager g_UploadManager;
+}
+
+using namespace Graphics;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	ComPtr<ID3D12Resource> CreateUploadBuffer([[maybe_unused]] const std::wstring& Name, size_t ByteSize)
+	{
+		const auto HeapProps = D3D12_HEAP_PROPERTIES{
+			.Type = D3D12_HEAP_TYPE_UPLOAD,
+			.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+			.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+			.CreationNodeMask = 1,
+			.VisibleNodeMask = 1
+		};
+
+		const auto ResourceDesc = D3D12_RESOURCE_DESC{
+			.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+			.Alignment = 0,
+			.Width = ByteSize,
+			.Height = 1,
+			.DepthOrArraySize = 1,
+			.MipLevels = 1,
+			.Format = DXGI_FORMAT_UNKNOWN,
+			.SampleDesc = { 1, 0 },
+			.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+			.Flags = D3D12_RESOURCE_FLAG_NONE
+		};
+
+		auto Buffer = ComPtr<ID3D12Resource>{};
+		ASSERT_SUCCEEDED(g_Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE,
+			&ResourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&Buffer)));
+
+#ifndef RELEASE
+		Buffer->SetName(Name.c_str());
+#endif
+
+		return Buffer;
+	}
+}
+
+void UploadManager::Create(const std::wstring& Name, size_t StagingSize)
+{
+	ASSERT(m_Staging == nullptr);
+	ASSERT(StagingSize % D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT == 0);
+
+	m_Staging = CreateUploadBuffer(Name, StagingSize);
+	m_StagingSize = StagingSize;
+	m_RingHead = m_RingTail = 0;
+
+	// Upload heaps can stay mapped for their whole lifetime
+	ASSERT_SUCCEEDED(m_Staging->Map(0, nullptr, reinterpret_cast<void**>(&m_StagingCpuAddress)));
+}
+
+void UploadManager::Destroy(void)
+{
+	if (m_Staging == nullptr)
+		return;
+
+	{
+		auto lg = std::lock_guard{ m_Mutex };
+		FlushBatch();
+	}
+
+	g_CommandManager.IdleGPU();
+
+	m_InFlightBatches.clear();
+	m_PendingTransitions.clear();
+	m_UnsyncedFenceValue = 0;
+	m_RingHead = m_RingTail = 0;
+	m_Staging->Unmap(0, nullptr);
+	m_StagingCpuAddress = nullptr;
+	m_Staging = nullptr;
+	m_StagingSize = 0;
+}
+
+uint64_t UploadManager::UploadBuffer(GpuResource& Dest, size_t DestOffset, const void* Data, size_t NumBytes, D3D12_RESOURCE_STATES FinalState)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	const auto [Staging, StagingOffset] = AllocateStaging(NumBytes);
+	if (Staging == m_Staging.Get())
+	{
+		memcpy(m_StagingCpuAddress + StagingOffset, Data, NumBytes);
+	}
+	else
+	{
+		void* CpuAddress = nullptr;
+		ASSERT_SUCCEEDED(Staging->Map(0, nullptr, &CpuAddress));
+		memcpy(CpuAddress, Data, NumBytes);
+		Staging->Unmap(0, nullptr);
+	}
+
+	BeginUpload(Dest, FinalState);
+	m_CommandList->CopyBufferRegion(Dest.GetResource(), DestOffset, Staging, StagingOffset, NumBytes);
+
+	return m_OpenBatch.Ticket;
+}
+
+uint64_t UploadManager::UploadTexture(GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[], D3D12_RESOURCE_STATES FinalState)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	const auto NumBytes = GetRequiredIntermediateSize(Dest.GetResource(), FirstSubresource, NumSubresources);
+	const auto [Staging, StagingOffset] = AllocateStaging(NumBytes);
+
+	BeginUpload(Dest, FinalState);
+	UpdateSubresources(m_CommandList, Dest.GetResource(), Staging, StagingOffset, FirstSubresource, NumSubresources, SubData);
+
+	return m_OpenBatch.Ticket;
+}
+
+void UploadManager::Flush(void)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+	FlushBatch();
+	SyncGraphicsQueue();
+}
+
+bool UploadManager::IsComplete(uint64_t Ticket)
+{
+	auto lg = std::lock_guard{ m_Mutex };
+
+	if (Ticket >= m_OpenBatch.Ticket)
+		return false;
+
+	RetireCompletedBatches();
+	return m_InFlightBatches.empty() || Ticket < m_InFlightBatches.front().Ticket;
+}
+
+void UploadManager::WaitForUpload(uint64_t Ticket)
+{
+	uint64_t FenceValue = 0;
+
+	{
+		auto lg = std::lock_guard{ m_Mutex };
+
+		if (Ticket == m_OpenBatch.Ticket)
+			FlushBatch();
+
+		for (const auto& Submitted : m_InFlightBatches)
+		{
+			if (Submitted.Ticket == Ticket)
+				FenceValue = Submitted.FenceValue;
+		}
+	}
+
+	if (FenceValue != 0)
+		g_CommandManager.WaitForFence(FenceValue);
+}
+
+std::pair<ID3D12Resource*, size_t> UploadManager::AllocateStaging(size_t NumBytes)
+{
+	ASSERT(m_Staging != nullptr, "Upload manager used before it was created");
+
+	NumBytes = Math::AlignUp(NumBytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+	auto AllocateTemporary = [this](size_t Size) -> std::pair<ID3D12Resource*, size_t>
+	{
+		auto& Buffer = m_OpenBatch.TemporaryBuffers.emplace_back(CreateUploadBuffer(L"UploadManager temporary buffer", Size));
+		return { Buffer.Get(), 0 };
+	};
+
+	if (NumBytes > m_StagingSize)
+		return AllocateTemporary(NumBytes);
+
+	for (;;)
+	{
+		RetireCompletedBatches();
+
+		// Nothing recorded or in flight uses the ring, so all of it is free again
+		if (m_InFlightBatches.empty() && m_CommandList == nullptr)
+			m_RingHead = m_RingTail = 0;
+
+		// Allocations don't wrap around the end of the ring, they skip to its beginning
+		uint64_t Head = m_RingHead;
+		const size_t Remaining = m_StagingSize - Head % m_StagingSize;
+		if (NumBytes > Remaining)
+			Head += Remaining;
+
+		if (Head + NumBytes - m_RingTail <= m_StagingSize)
+		{
+			m_RingHead = Head + NumBytes;
+			return { m_Staging.Get(), Head % m_StagingSize };
+		}
+
+		// The ring is full of copies that haven't completed yet. The open batch has to be submitted
+		// before anything it holds can be waited for.
+		if (m_InFlightBatches.empty())
+			FlushBatch();
+
+		// Nothing left to wait for, the request can't be placed in the ring and gets a buffer of its own
+		if (m_InFlightBatches.empty())
+			return AllocateTemporary(NumBytes);
+
+		g_CommandManager.WaitForFence(m_InFlightBatches.front().FenceValue);
+	}
+}
+
+void UploadManager::BeginUpload(GpuResource& Dest, D3D12_RESOURCE_STATES FinalState)
+{
+	ASSERT(Dest.m_SubresourceStates.empty() && (Dest.m_UsageState == D3D12_RESOURCE_STATE_COMMON ||
+		Dest.m_UsageState == D3D12_RESOURCE_STATE_COPY_DEST), "Only resources not in use by the GPU can be uploaded to on the copy queue");
+
+	if (m_CommandList == nullptr)
+	{
+		CommandQueue& CopyQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COPY);
+		m_Allocator = CopyQueue.RequestAllocator();
+		m_CommandList = CopyQueue.RequestCommandList(m_Allocator);
+	}
+
+	// Resources are promoted to COPY_DEST by the copy and decay back to COMMON once it has completed;
+	// any work recorded from now on already sees the state the graphics queue leaves them in
+	Dest.m_UsageState = FinalState;
+	m_PendingTransitions.push_back({ Dest.m_pResource, FinalState });
+}
+
+void UploadManager::FlushBatch(void)
+{
+	if (m_CommandList == nullptr)
+		return;
+
+	CommandQueue& CopyQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COPY);
+
+	m_OpenBatch.FenceValue = CopyQueue.SubmitCommandList(m_CommandList);
+	CopyQueue.DiscardAllocator(m_OpenBatch.FenceValue, m_Allocator);
+	m_CommandList = nullptr;
+	m_Allocator = nullptr;
+	m_OpenBatch.RingEnd = m_RingHead;
+	m_UnsyncedFenceValue = m_OpenBatch.FenceValue;
+
+	const auto Ticket = m_OpenBatch.Ticket;
+	m_InFlightBatches.push_back(std::move(m_OpenBatch));
+	m_OpenBatch = { Ticket + 1 };
+}
+
+void UploadManager::SyncGraphicsQueue(void)
+{
+	if (m_UnsyncedFenceValue == 0)
+		return;
+
+	CommandQueue& CopyQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COPY);
+	CommandQueue& GraphicsQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+	// Copies complete in order, so waiting for the last one covers every batch before it
+	GraphicsQueue.WaitForQueue(CopyQueue, m_UnsyncedFenceValue);
+	m_UnsyncedFenceValue = 0;
+
+	auto Barriers = std::vector<D3D12_RESOURCE_BARRIER>();
+	Barriers.reserve(m_PendingTransitions.size());
+	for (const auto& Pending : m_PendingTransitions)
+	{
+		if (Pending.FinalState == D3D12_RESOURCE_STATE_COMMON)
+			continue;
+
+		auto& Barrier = Barriers.emplace_back();
+		Barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		Barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		Barrier.Transition.pResource = Pending.Resource.Get();
+		Barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+		Barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COMMON;
+		Barrier.Transition.StateAfter = Pending.FinalState;
+	}
+	m_PendingTransitions.clear();
+
+	if (!Barriers.empty())
+	{
+		auto Allocator = GraphicsQueue.RequestAllocator();
+		auto List = GraphicsQueue.RequestCommandList(Allocator);
+		List->ResourceBarrier(static_cast<UINT>(Barriers.size()), Barriers.data());
+		GraphicsQueue.DiscardAllocator(GraphicsQueue.SubmitCommandList(List), Allocator);
+	}
+}
+
+void UploadManager::RetireCompletedBatches(void)
+{
+	CommandQueue& CopyQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COPY);
+
+	while (!m_InFlightBatches.empty() && CopyQueue.IsFenceComplete(m_InFlightBatches.front().FenceValue))
+	{
+		m_RingTail = m_InFlightBatches.front().RingEnd;
+		m_InFlightBatches.pop_front();
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+
+#include "GpuResource.h"
+
+// Uploads initial data of new resources on the copy queue instead of stalling the CPU on the
+// graphics queue for each one. Data is staged in a persistently mapped ring buffer and the copies
+// are batched into one command list that is only submitted when the manager is flushed, which every
+// context on the graphics queue does before it is submitted itself.
+//
+// Copy queues can't leave resources in read states, so uploaded resources decay to COMMON and the
+// transition to their final state is recorded on the graphics queue right behind a GPU-side wait for
+// the copies. That wait is only added when graphics work is submitted after new uploads, batches
+// submitted in between share it. Work on other queues that reads them has to wait for the upload's
+// ticket itself.
+class UploadManager
+{
+public:
+	UploadManager() = default;
+	~UploadManager() { Destroy(); }
+
+	void Create(const std::wstring& Name, size_t StagingSize);
+	void Destroy(void);
+
+	// The destination must be in COMMON or COPY_DEST, i.e. not in use by the GPU. It is tracked in
+	// FinalState from here on. Returns a ticket for IsComplete and WaitForUpload.
+	uint64_t UploadBuffer(GpuResource& Dest, size_t DestOffset, const void* Data, size_t NumBytes,
+		D3D12_RESOURCE_STATES FinalState = D3D12_RESOURCE_STATE_GENERIC_READ);
+	uint64_t UploadTexture(GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[],
+		D3D12_RESOURCE_STATES FinalState = D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	// Submits the pending copies and makes the graphics queue wait for every upload it hasn't waited
+	// for yet. Called before graphics work that may read them is submitted.
+	void Flush(void);
+
+	bool IsComplete(uint64_t Ticket);
+	void WaitForUpload(uint64_t Ticket);
+
+private:
+	struct Batch
+	{
+		uint64_t Ticket;
+		uint64_t FenceValue;
+		uint64_t RingEnd;
+		// Uploads too large for the ring get a buffer of their own, released with the batch
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> TemporaryBuffers;
+	};
+
+	struct PendingTransition
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		D3D12_RESOURCE_STATES FinalState;
+	};
+
+	// Returns the staging buffer and offset of NumBytes of upload memory recorded into the open batch
+	std::pair<ID3D12Resource*, size_t> AllocateStaging(size_t NumBytes);
+	void BeginUpload(GpuResource& Dest, D3D12_RESOURCE_STATES FinalState);
+	void FlushBatch(void);
+	void SyncGraphicsQueue(void);
+	void RetireCompletedBatches(void);
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_Staging;
+	uint8_t* m_StagingCpuAddress = nullptr;
+	size_t m_StagingSize = 0;
+
+	// Ring positions only grow while uploads are pending, the physical offset is taken modulo the
+	// staging size
+	uint64_t m_RingHead = 0;
+	uint64_t m_RingTail = 0;
+
+	ID3D12GraphicsCommandList* m_CommandList = nullptr;
+	ID3D12CommandAllocator* m_Allocator = nullptr;
+	Batch m_OpenBatch = { 1 };
+	// Transitions of submitted and open batches the graphics queue hasn't recorded yet
+	std::vector<PendingTransition> m_PendingTransitions;
+	// Last submitted copy the graphics queue hasn't waited for, 0 if there is none
+	uint64_t m_UnsyncedFenceValue = 0;
+	std::deque<Batch> m_InFlightBatches;
+
+	std::mutex m_Mutex;
+};
+
+namespace Graphics
+{
+	extern UploadManager g_UploadManager;
+}
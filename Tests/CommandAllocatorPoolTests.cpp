@@ -0,0 +1,105 @@
+#include "TestFramework.h"
+#include "RecordingEngine.h"
+
+#include "RecordingDevice.h"
+#include "CommandAllocatorPool.h"
+#include "CommandListManager.h"
+#include "CommandContext.h"
+
+#include <barrier>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	Microsoft::WRL::ComPtr<ID3D12Device> CreateRecordingDevice(void)
+	{
+		Microsoft::WRL::ComPtr<ID3D12Device> Device;
+		CHECK(SUCCEEDED(Recording::CreateDevice(&Device)));
+		return Device;
+	}
+}
+
+TEST(AllocatorsOfExitedThreadsAreShared)
+{
+	auto Device = CreateRecordingDevice();
+	CommandAllocatorPool Pool(D3D12_COMMAND_LIST_TYPE_DIRECT);
+	Pool.Create(Device.Get());
+
+	// Fewer than a thread keeps to itself, so they only reach other threads when that thread exits
+	std::thread([&Pool]
+	{
+		ID3D12CommandAllocator* Allocators[4];
+		for (auto& Allocator : Allocators)
+			Allocator = Pool.RequestAllocator(0);
+		for (auto Allocator : Allocators)
+			Pool.DiscardAllocator(1, Allocator);
+	}).join();
+
+	CHECK_EQUAL(4u, Pool.Size());
+	for (int i = 0; i < 4; ++i)
+		Pool.RequestAllocator(1);
+	CHECK_EQUAL(4u, Pool.Size());
+
+	Pool.Shutdown();
+}
+
+TEST(AllocatorsOverflowTheSharedQueue)
+{
+	// More than the lock-free queue holds
+	constexpr size_t kNumAllocators = 5000;
+
+	auto Device = CreateRecordingDevice();
+	CommandAllocatorPool Pool(D3D12_COMMAND_LIST_TYPE_DIRECT);
+	Pool.Create(Device.Get());
+
+	std::vector<ID3D12CommandAllocator*> Allocators(kNumAllocators);
+	for (auto& Allocator : Allocators)
+		Allocator = Pool.RequestAllocator(0);
+	for (auto Allocator : Allocators)
+		Pool.DiscardAllocator(1, Allocator);
+
+	// Every one of them is reused, none is lost when the queue is full
+	for (auto& Allocator : Allocators)
+		Allocator = Pool.RequestAllocator(1);
+	CHECK_EQUAL(kNumAllocators, Pool.Size());
+
+	Pool.Shutdown();
+}
+
+BENCHMARK(BeginAndFinishContextsOn16Threads)
+{
+	constexpr int kNumThreads = 16;
+	constexpr int kContextsPerThread = 10000;
+	// Contexts finished between queue flushes, like the lists of one frame
+	constexpr int kContextsPerFlush = 64;
+
+	Testing::InitializeGraphics();
+
+	std::barrier Start(kNumThreads + 1);
+	std::vector<std::thread> Threads;
+	for (int t = 0; t < kNumThreads; ++t)
+	{
+		Threads.emplace_back([&Start]
+		{
+			Start.arrive_and_wait();
+			for (int i = 0; i < kContextsPerThread; ++i)
+			{
+				GraphicsContext::Begin().Finish();
+				if (i % kContextsPerFlush == kContextsPerFlush - 1)
+					Graphics::g_CommandManager.GetQueue().Flush();
+			}
+		});
+	}
+
+	Start.arrive_and_wait();
+	const auto StartTime = std::chrono::steady_clock::now();
+	for (auto& Thread : Threads)
+		Thread.join();
+	const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+
+	Graphics::g_CommandManager.IdleGPU();
+
+	std::printf("  %.0f contexts per second\n", kNumThreads * kContextsPerThread / Elapsed.count());
+}
@@ -0,0 +1,192 @@
+#include "TestFramework.h"
+#include "RecordingEngine.h"
+
+#include "RecordingDevice.h"
+#include "CommandListManager.h"
+#include "CommandContext.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace Graphics;
+using Recording::QueueOperation;
+
+namespace
+{
+	// Records the submissions, signals and waits of all queues while it is alive
+	class QueueTimeline
+	{
+	public:
+		QueueTimeline()
+		{
+			Recording::SetQueueObserver(g_Device, [this](const QueueOperation& Operation)
+			{
+				auto lg = std::lock_guard{ m_Mutex };
+				m_Operations.push_back(Operation);
+			});
+		}
+
+		~QueueTimeline() { Recording::SetQueueObserver(g_Device, nullptr); }
+
+		// Position of the first matching operation, or the number of operations if there is none
+		size_t Find(QueueOperation::Kind Type, D3D12_COMMAND_LIST_TYPE Queue, UINT64 Value = 0)
+		{
+			auto lg = std::lock_guard{ m_Mutex };
+			const auto It = std::ranges::find_if(m_Operations, [&](const QueueOperation& Operation)
+			{
+				return Operation.Type == Type && Operation.Queue == Queue &&
+					(Type == QueueOperation::Kind::Execute || Operation.Value == Value);
+			});
+			return static_cast<size_t>(It - m_Operations.begin());
+		}
+
+		size_t Count(QueueOperation::Kind Type, D3D12_COMMAND_LIST_TYPE Queue)
+		{
+			auto lg = std::lock_guard{ m_Mutex };
+			return static_cast<size_t>(std::ranges::count_if(m_Operations, [&](const QueueOperation& Operation)
+			{
+				return Operation.Type == Type && Operation.Queue == Queue;
+			}));
+		}
+
+		size_t Size(void)
+		{
+			auto lg = std::lock_guard{ m_Mutex };
+			return m_Operations.size();
+		}
+
+	private:
+		std::mutex m_Mutex;
+		std::vector<QueueOperation> m_Operations;
+	};
+
+	// Holds the compute queue back until it is released, like a GPU still busy with earlier work
+	class ComputeGate
+	{
+	public:
+		ComputeGate()
+		{
+			ASSERT_SUCCEEDED(g_Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_Fence)));
+			g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE).GetCommandQueue()->Wait(m_Fence.Get(), 1);
+		}
+
+		~ComputeGate() { Release(); }
+
+		void Release(void) { m_Fence->Signal(1); }
+
+	private:
+		Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
+	};
+
+	// Submits an empty compute list and returns the fence value it completes with
+	uint64_t ProduceOnComputeQueue(bool Flush)
+	{
+		const uint64_t FenceValue = ComputeContext::Begin(L"", true).Finish();
+		if (Flush)
+			g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE).Flush();
+		return FenceValue;
+	}
+}
+
+TEST(CrossQueueWaitFlushesThePendingProducerValue)
+{
+	Testing::InitializeGraphics();
+	ComputeGate Gate;
+	QueueTimeline Timeline;
+
+	// Batched, so nothing signals the producer's fence value yet
+	const uint64_t Produced = ProduceOnComputeQueue(false);
+	CHECK_EQUAL(Timeline.Size(), Timeline.Find(QueueOperation::Kind::Signal, D3D12_COMMAND_LIST_TYPE_COMPUTE, Produced));
+
+	g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_DIRECT).StallForFence(Produced);
+
+	// A wait for a value nothing signals yet would never be satisfied
+	const size_t Signal = Timeline.Find(QueueOperation::Kind::Signal, D3D12_COMMAND_LIST_TYPE_COMPUTE, Produced);
+	const size_t Wait = Timeline.Find(QueueOperation::Kind::Wait, D3D12_COMMAND_LIST_TYPE_DIRECT, Produced);
+	CHECK(Wait < Timeline.Size());
+	CHECK(Signal < Wait);
+
+	Gate.Release();
+	g_CommandManager.IdleGPU();
+}
+
+TEST(CrossQueueWaitSubmitsThisQueuesPendingListsFirst)
+{
+	Testing::InitializeGraphics();
+	ComputeGate Gate;
+	QueueTimeline Timeline;
+
+	const uint64_t Produced = ProduceOnComputeQueue(true);
+	// Recorded before the wait was needed, so it mustn't be held back by it
+	const uint64_t Consumed = GraphicsContext::Begin().Finish();
+
+	CommandQueue& GraphicsQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_DIRECT);
+	GraphicsQueue.WaitForQueue(g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE), Produced);
+
+	const size_t Execute = Timeline.Find(QueueOperation::Kind::Execute, D3D12_COMMAND_LIST_TYPE_DIRECT);
+	const size_t Signal = Timeline.Find(QueueOperation::Kind::Signal, D3D12_COMMAND_LIST_TYPE_DIRECT, Consumed);
+	const size_t Wait = Timeline.Find(QueueOperation::Kind::Wait, D3D12_COMMAND_LIST_TYPE_DIRECT, Produced);
+	CHECK(Wait < Timeline.Size());
+	CHECK(Execute < Wait);
+	CHECK(Signal < Wait);
+
+	// The earlier work completes although the producer is still held back
+	GraphicsQueue.WaitForFence(Consumed);
+	CHECK(!g_CommandManager.IsFenceComplete(Produced));
+
+	Gate.Release();
+	g_CommandManager.IdleGPU();
+}
+
+TEST(CrossQueueWaitSkipsSatisfiedAndCoveredWaits)
+{
+	Testing::InitializeGraphics();
+	CommandQueue& GraphicsQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_DIRECT);
+	CommandQueue& ComputeQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE);
+
+	const uint64_t Completed = ProduceOnComputeQueue(true);
+	ComputeQueue.WaitForFence(Completed);
+
+	ComputeGate Gate;
+	const uint64_t Earlier = ProduceOnComputeQueue(true);
+	const uint64_t Later = ProduceOnComputeQueue(true);
+	{
+		QueueTimeline Timeline;
+
+		// Already reached, nothing to wait for on the GPU
+		GraphicsQueue.WaitForQueue(ComputeQueue, Completed);
+		CHECK_EQUAL(0u, Timeline.Count(QueueOperation::Kind::Wait, D3D12_COMMAND_LIST_TYPE_DIRECT));
+
+		GraphicsQueue.WaitForQueue(ComputeQueue, Later);
+		GraphicsQueue.WaitForQueue(ComputeQueue, Later);
+		// Covered by the wait for the later value
+		GraphicsQueue.WaitForQueue(ComputeQueue, Earlier);
+		CHECK_EQUAL(1u, Timeline.Count(QueueOperation::Kind::Wait, D3D12_COMMAND_LIST_TYPE_DIRECT));
+	}
+
+	Gate.Release();
+	g_CommandManager.IdleGPU();
+}
+
+TEST(CrossQueueConsumerDoesNotRetireBeforeTheProducer)
+{
+	Testing::InitializeGraphics();
+	CommandQueue& GraphicsQueue = g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_DIRECT);
+
+	ComputeGate Gate;
+	const uint64_t Produced = ProduceOnComputeQueue(true);
+
+	GraphicsQueue.StallForFence(Produced);
+	GraphicsContext::Begin().Finish();
+	const uint64_t Consumed = GraphicsQueue.Flush();
+
+	// The recording queues retire everything instantly, only the wait can hold the consumer back
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(!GraphicsQueue.IsFenceComplete(Consumed));
+	CHECK(!g_CommandManager.IsFenceComplete(Produced));
+
+	Gate.Release();
+	GraphicsQueue.WaitForFence(Consumed);
+	CHECK(g_CommandManager.IsFenceComplete(Produced));
+}
@@ -0,0 +1,306 @@
+#include "TestFramework.h"
+
+#include "pch.h"
+#include "GeometryPool.h"
+
+#include <random>
+
+namespace
+{
+	constexpr size_t kPoolSize = 16 * 1024 * 1024;
+	constexpr size_t kCompactionBudget = 256 * 1024;
+	// Frames the simulated GPU runs behind the CPU
+	constexpr uint64_t kFrameLatency = 2;
+
+	// Stands in for the graphics queue fence: everything tagged during a frame completes kFrameLatency
+	// frames later
+	struct SimulatedFence
+	{
+		uint64_t Next = 1;
+		uint64_t Completed = 0;
+
+		GeometryRangeAllocator::FenceCompleteFn IsComplete(void) const
+		{
+			return [this](uint64_t FenceValue) { return FenceValue <= Completed; };
+		}
+
+		void EndFrame(void)
+		{
+			++Next;
+			Completed = std::max(Completed, Next > kFrameLatency ? Next - kFrameLatency : 0);
+		}
+
+		void Drain(void) { Completed = Next; }
+	};
+
+	// Runs one frame of compaction the way GeometryPool::Compact does, with the copy finishing on Fence.Next
+	void Compact(GeometryRangeAllocator& Ranges, const SimulatedFence& Fence, size_t MaxBytes)
+	{
+		Ranges.CompleteMoves(Fence.IsComplete(), Fence.Next);
+		Ranges.ReclaimRetiredRanges(Fence.IsComplete());
+		Ranges.CommitMoves(Ranges.PlanMoves(MaxBytes), Fence.Next);
+	}
+
+	// Every byte is free, live, the destination of a pending move or retired, and exactly one of those
+	bool CheckRanges(const GeometryRangeAllocator& Ranges)
+	{
+		auto Used = std::vector<std::pair<size_t, size_t>>();
+		size_t FreeSize = 0;
+		for (const auto& [Offset, Size] : Ranges.GetFreeRanges())
+		{
+			Used.emplace_back(Offset, Size);
+			FreeSize += Size;
+		}
+		for (const auto& [Offset, Block] : Ranges.GetLiveBlocks())
+		{
+			if (Offset != Block->Offset)
+				return false;
+			Used.emplace_back(Block->Offset, Block->Size);
+			if (Block->PendingOffset != SIZE_MAX)
+				Used.emplace_back(Block->PendingOffset, Block->Size);
+		}
+		for (const auto& Retired : Ranges.GetRetiredRanges())
+			Used.emplace_back(Retired.Offset, Retired.Size);
+
+		std::ranges::sort(Used);
+
+		size_t End = 0;
+		size_t TotalSize = 0;
+		for (const auto& [Offset, Size] : Used)
+		{
+			if (Offset < End)
+				return false;
+			End = Offset + Size;
+			TotalSize += Size;
+		}
+
+		return End <= Ranges.GetSize() && TotalSize == Ranges.GetSize() && FreeSize == Ranges.GetFreeSize();
+	}
+
+	double GetFragmentation(const GeometryRangeAllocator& Ranges)
+	{
+		return Ranges.GetFreeSize() == 0 ? 0.0 : 1.0 - double(Ranges.GetLargestFreeRange()) / double(Ranges.GetFreeSize());
+	}
+
+	void FreeAll(GeometryRangeAllocator& Ranges, std::vector<GeometryRangeAllocator::Block*>& Blocks, uint64_t RetireFence)
+	{
+		for (auto* Block : Blocks)
+			Ranges.Free(Block, RetireFence);
+		Blocks.clear();
+	}
+
+	GeometryRangeAllocator::Block* AllocateRandom(GeometryRangeAllocator& Ranges, std::mt19937& Random)
+	{
+		// Vertex strides and index sizes, not all of them powers of two
+		constexpr size_t kAlignments[] = { 2, 4, 12, 16, 32, 48 };
+
+		const auto Size = std::uniform_int_distribution<size_t>(1, 128)(Random) * 1024 + std::uniform_int_distribution<size_t>(0, 255)(Random) * 4;
+		const auto Alignment = kAlignments[std::uniform_int_distribution<size_t>(0, std::size(kAlignments) - 1)(Random)];
+		return Ranges.Allocate(Size, Alignment, true);
+	}
+}
+
+TEST(GeometryRangeAllocatorCoalescesFreedRanges)
+{
+	GeometryRangeAllocator Ranges;
+	Ranges.Reset(4096);
+
+	auto* First = Ranges.Allocate(1024, 4, false);
+	auto* Second = Ranges.Allocate(1024, 4, false);
+	auto* Third = Ranges.Allocate(1024, 4, false);
+	CHECK_EQUAL(1024u, Second->Offset);
+	CHECK_EQUAL(1024u, Ranges.GetFreeSize());
+
+	// Freed without a fence, the ranges are reusable right away and merge with their neighbours
+	Ranges.Free(First, 0);
+	Ranges.Free(Third, 0);
+	CHECK_EQUAL(2048u, Ranges.GetLargestFreeRange());
+	Ranges.Free(Second, 0);
+	CHECK_EQUAL(1u, Ranges.GetFreeRanges().size());
+	CHECK_EQUAL(4096u, Ranges.GetLargestFreeRange());
+	CHECK(CheckRanges(Ranges));
+}
+
+TEST(GeometryRangeAllocatorKeepsRetiredRangesUntilTheirFence)
+{
+	GeometryRangeAllocator Ranges;
+	Ranges.Reset(2048);
+	SimulatedFence Fence;
+
+	auto* Block = Ranges.Allocate(2048, 4, false);
+	Ranges.Free(Block, Fence.Next);
+	CHECK(Ranges.HasRetiredRanges());
+	CHECK(CheckRanges(Ranges));
+
+	// The range may still be read by frames in flight
+	Ranges.ReclaimRetiredRanges(Fence.IsComplete());
+	CHECK(Ranges.Allocate(16, 4, false) == nullptr);
+
+	Fence.Drain();
+	Ranges.ReclaimRetiredRanges(Fence.IsComplete());
+	CHECK(!Ranges.HasRetiredRanges());
+	CHECK_EQUAL(2048u, Ranges.GetFreeSize());
+}
+
+TEST(GeometryRangeAllocatorMovesOnlyOnceTheCopyHasCompleted)
+{
+	GeometryRangeAllocator Ranges;
+	Ranges.Reset(4096);
+	SimulatedFence Fence;
+
+	auto* Hole = Ranges.Allocate(1024, 4, false);
+	auto* Pinned = Ranges.Allocate(1024, 4, false);
+	auto* Moved = Ranges.Allocate(1024, 4, true);
+	Ranges.Free(Hole, 0);
+
+	const auto Moves = Ranges.PlanMoves(kCompactionBudget);
+	CHECK_EQUAL(1u, Moves.size());
+	CHECK(Moves.front() == Moved);
+	CHECK_EQUAL(2048u, Moved->Offset);
+	CHECK_EQUAL(0u, Moved->PendingOffset);
+	Ranges.CommitMoves(Moves, Fence.Next);
+	CHECK(CheckRanges(Ranges));
+
+	// The block keeps its old offset while the copy may still be running
+	Ranges.CompleteMoves(Fence.IsComplete(), Fence.Next);
+	CHECK_EQUAL(2048u, Moved->Offset);
+
+	Fence.EndFrame();
+	Fence.Drain();
+	Ranges.CompleteMoves(Fence.IsComplete(), Fence.Next);
+	CHECK_EQUAL(0u, Moved->Offset);
+	CHECK_EQUAL(SIZE_MAX, Moved->PendingOffset);
+	CHECK(CheckRanges(Ranges));
+
+	// The old range is retired like a freed one
+	Fence.EndFrame();
+	Fence.Drain();
+	Ranges.ReclaimRetiredRanges(Fence.IsComplete());
+	CHECK_EQUAL(2048u, Ranges.GetLargestFreeRange());
+
+	Ranges.Free(Pinned, 0);
+	Ranges.Free(Moved, 0);
+	CHECK_EQUAL(4096u, Ranges.GetLargestFreeRange());
+}
+
+TEST(GeometryRangeAllocatorFreesBlocksWithPendingMoves)
+{
+	GeometryRangeAllocator Ranges;
+	Ranges.Reset(4096);
+	SimulatedFence Fence;
+
+	auto* Hole = Ranges.Allocate(2048, 4, false);
+	auto* Moved = Ranges.Allocate(1024, 4, true);
+	Ranges.Free(Hole, 0);
+	Compact(Ranges, Fence, kCompactionBudget);
+
+	// Both the source and the destination of the copy are retired
+	Ranges.Free(Moved, Fence.Next);
+	CHECK(CheckRanges(Ranges));
+	Fence.Drain();
+	Compact(Ranges, Fence, kCompactionBudget);
+	CHECK_EQUAL(4096u, Ranges.GetFreeSize());
+	CHECK_EQUAL(1u, Ranges.GetFreeRanges().size());
+}
+
+// Thousands of frames of streaming geometry in and out while compacting every frame
+TEST(GeometryRangeAllocatorSurvivesLoadUnloadCycles)
+{
+	GeometryRangeAllocator Ranges;
+	Ranges.Reset(kPoolSize);
+	SimulatedFence Fence;
+	std::mt19937 Random(1234);
+
+	auto Blocks = std::vector<GeometryRangeAllocator::Block*>();
+	size_t FailedAllocations = 0;
+	bool RangesValid = true;
+
+	for (int Frame = 0; Frame < 5000; ++Frame)
+	{
+		Ranges.ReclaimRetiredRanges(Fence.IsComplete());
+
+		// Loads and unloads come in bursts, so the pool goes through fuller and emptier phases
+		const bool Loading = (Frame / 250) % 2 == 0;
+		for (int i = std::uniform_int_distribution<int>(0, 8)(Random); i > 0; --i)
+		{
+			if (Blocks.empty() || std::bernoulli_distribution(Loading ? 0.8 : 0.2)(Random))
+			{
+				if (auto* Block = AllocateRandom(Ranges, Random))
+					Blocks.push_back(Block);
+				else
+					++FailedAllocations;
+			}
+			else
+			{
+				const auto Index = std::uniform_int_distribution<size_t>(0, Blocks.size() - 1)(Random);
+				Ranges.Free(Blocks[Index], Fence.Next);
+				Blocks[Index] = Blocks.back();
+				Blocks.pop_back();
+			}
+		}
+
+		Compact(Ranges, Fence, kCompactionBudget);
+		RangesValid = RangesValid && CheckRanges(Ranges);
+		Fence.EndFrame();
+	}
+
+	CHECK(RangesValid);
+	CHECK(FailedAllocations > 0);	// The pool has been full at times
+
+	FreeAll(Ranges, Blocks, Fence.Next);
+	Fence.Drain();
+	Compact(Ranges, Fence, kCompactionBudget);
+	CHECK_EQUAL(kPoolSize, Ranges.GetFreeSize());
+	CHECK_EQUAL(kPoolSize, Ranges.GetLargestFreeRange());
+}
+
+TEST(GeometryRangeAllocatorCompactionReducesFragmentation)
+{
+	GeometryRangeAllocator Ranges;
+	Ranges.Reset(kPoolSize);
+	SimulatedFence Fence;
+	std::mt19937 Random(5678);
+
+	// Fill the pool, then unload a random half of it
+	auto Blocks = std::vector<GeometryRangeAllocator::Block*>();
+	while (auto* Block = AllocateRandom(Ranges, Random))
+		Blocks.push_back(Block);
+	std::ranges::shuffle(Blocks, Random);
+	for (size_t i = Blocks.size() / 2; i < Blocks.size(); ++i)
+		Ranges.Free(Blocks[i], 0);
+	Blocks.resize(Blocks.size() / 2);
+
+	const double InitialFragmentation = GetFragmentation(Ranges);
+	CHECK(InitialFragmentation > 0.9);
+
+	// Measured once each frame's moves and their retired ranges have settled
+	double Fragmentation = InitialFragmentation;
+	bool RangesValid = true;
+	bool Decreasing = true;
+	for (int Frame = 0; Frame < 1000; ++Frame)
+	{
+		Compact(Ranges, Fence, kCompactionBudget);
+		RangesValid = RangesValid && CheckRanges(Ranges);
+		Fence.EndFrame();
+
+		if (Frame % kFrameLatency == 0)
+		{
+			Fence.Drain();
+			Ranges.CompleteMoves(Fence.IsComplete(), 0);
+			Ranges.ReclaimRetiredRanges(Fence.IsComplete());
+
+			const double Current = GetFragmentation(Ranges);
+			Decreasing = Decreasing && Current <= Fragmentation;
+			Fragmentation = Current;
+		}
+	}
+
+	CHECK(RangesValid);
+	CHECK(Decreasing);
+	// Holes too small for any block above them are left behind
+	CHECK(Fragmentation < InitialFragmentation / 4);
+
+	FreeAll(Ranges, Blocks, 0);
+	CHECK(CheckRanges(Ranges));
+	CHECK_EQUAL(kPoolSize, Ranges.GetLargestFreeRange());
+}
@@ -0,0 +1,131 @@
+#include "TestFramework.h"
+#include "RecordingEngine.h"
+
+#include "RecordingDevice.h"
+#include "GpuHeapAllocator.h"
+#include "CommandListManager.h"
+#include "ColorBuffer.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace
+{
+	// 16 blocks of 256 bytes
+	constexpr uint64_t kMinBlockSize = 256;
+	constexpr uint32_t kMaxOrder = 4;
+	constexpr uint64_t kTotalSize = kMinBlockSize << kMaxOrder;
+}
+
+TEST(BuddyAllocatorSplitsLargerBlocks)
+{
+	BuddyAllocator Allocator(kMinBlockSize, kMaxOrder);
+
+	CHECK_EQUAL(0u, Allocator.Allocate(256, 256));
+	// The halves left over by splitting the whole range are handed out before anything else is split
+	CHECK_EQUAL(256u, Allocator.Allocate(100, 1));
+	CHECK_EQUAL(512u, Allocator.Allocate(512, 256));
+	CHECK_EQUAL(1024u, Allocator.Allocate(1024, 256));
+	CHECK_EQUAL(2048u, Allocator.Allocate(2048, 256));
+	CHECK_EQUAL(kTotalSize, Allocator.GetAllocatedSize());
+}
+
+TEST(BuddyAllocatorCoalescesFreedBuddies)
+{
+	BuddyAllocator Allocator(kMinBlockSize, kMaxOrder);
+
+	uint64_t Offsets[4];
+	for (auto& Offset : Offsets)
+		Offset = Allocator.Allocate(1024, 256);
+
+	// 1024 and 2048 aren't buddies, so no 2048 byte block forms
+	Allocator.Free(Offsets[1], 1024, 256);
+	Allocator.Free(Offsets[2], 1024, 256);
+	CHECK_EQUAL(BuddyAllocator::kInvalidOffset, Allocator.Allocate(2048, 256));
+
+	Allocator.Free(Offsets[0], 1024, 256);
+	CHECK_EQUAL(0u, Allocator.Allocate(2048, 256));
+	Allocator.Free(0, 2048, 256);
+
+	// Freeing the last block merges everything back into the whole range
+	Allocator.Free(Offsets[3], 1024, 256);
+	CHECK(Allocator.IsEmpty());
+	CHECK_EQUAL(0u, Allocator.Allocate(kTotalSize, 256));
+}
+
+TEST(BuddyAllocatorAlignsToTheBlockSize)
+{
+	BuddyAllocator Allocator(kMinBlockSize, kMaxOrder);
+
+	CHECK_EQUAL(0u, Allocator.Allocate(256, 256));
+
+	// A small allocation with a large alignment takes a block of the alignment's size
+	const uint64_t Aligned = Allocator.Allocate(256, 1024);
+	CHECK_EQUAL(1024u, Aligned);
+	CHECK_EQUAL(1024u, Allocator.GetBlockSize(256, 1024));
+
+	// Sizes round up to the next power of two
+	const uint64_t Rounded = Allocator.Allocate(600, 256);
+	CHECK_EQUAL(2048u, Rounded);
+	CHECK_EQUAL(1024u, Allocator.GetBlockSize(600, 256));
+	CHECK_EQUAL(256u + 1024u + 1024u, Allocator.GetAllocatedSize());
+}
+
+TEST(BuddyAllocatorReportsExhaustion)
+{
+	BuddyAllocator Allocator(kMinBlockSize, kMaxOrder);
+
+	CHECK_EQUAL(BuddyAllocator::kInvalidOffset, Allocator.Allocate(kTotalSize * 2, 256));
+
+	for (uint64_t i = 0; i < kTotalSize / kMinBlockSize; ++i)
+		CHECK_EQUAL(i * kMinBlockSize, Allocator.Allocate(kMinBlockSize, 256));
+	CHECK_EQUAL(BuddyAllocator::kInvalidOffset, Allocator.Allocate(kMinBlockSize, 256));
+
+	// A freed block is the only one available again
+	Allocator.Free(768, kMinBlockSize, 256);
+	CHECK_EQUAL(768u, Allocator.Allocate(kMinBlockSize, 256));
+	CHECK_EQUAL(BuddyAllocator::kInvalidOffset, Allocator.Allocate(kMinBlockSize, 256));
+}
+
+TEST(PlacedResourcesAreFreedWithoutDestroy)
+{
+	Testing::InitializeGraphics();
+	const auto Before = Graphics::g_GpuHeapAllocator.GetStats();
+
+	{
+		ColorBuffer Target;
+		Target.Create(L"Placed test target", 16, 16, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+		CHECK_EQUAL(Before.NumPlaced + 1, Graphics::g_GpuHeapAllocator.GetStats().NumPlaced);
+	}
+
+	const auto After = Graphics::g_GpuHeapAllocator.GetStats();
+	CHECK_EQUAL(Before.NumPlaced, After.NumPlaced);
+	CHECK_EQUAL(Before.PlacedBytes, After.PlacedBytes);
+}
+
+TEST(PlacedTargetsAreDiscardedFirst)
+{
+	Testing::InitializeGraphics();
+
+	std::atomic<uint32_t> NumDiscards = 0;
+	Recording::SetSubmitObserver(Graphics::g_Device, [&NumDiscards](D3D12_COMMAND_LIST_TYPE, std::span<const Recording::CommandList* const> Lists)
+	{
+		for (const auto* List : Lists)
+		{
+			for (const auto& Command : List->Commands)
+			{
+				if (std::strcmp(Command.Name, "DiscardResource") == 0)
+					++NumDiscards;
+			}
+		}
+	});
+
+	ColorBuffer Target;
+	Target.Create(L"Placed test target", 16, 16, 1, DXGI_FORMAT_R8G8B8A8_UNORM);
+	Graphics::g_CommandManager.IdleGPU();
+
+	Recording::SetSubmitObserver(Graphics::g_Device, nullptr);
+
+	CHECK_EQUAL(1u, NumDiscards.load());
+	Target.Destroy();
+}
@@ -0,0 +1,36 @@
+#include "TestFramework.h"
+
+#include <chrono>
+#include <cstring>
+
+// Usage: Tests [-benchmark] [name filter]
+int main(int argc, char** argv)
+{
+	bool RunBenchmarks = false;
+	std::string_view Filter;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "-benchmark") == 0)
+			RunBenchmarks = true;
+		else
+			Filter = argv[i];
+	}
+
+	int Run = 0;
+	for (const auto& Test : Testing::GetRegistry())
+	{
+		if (Test.IsBenchmark != RunBenchmarks || Test.Name.find(Filter) == std::string_view::npos)
+			continue;
+
+		std::printf("%.*s\n", static_cast<int>(Test.Name.size()), Test.Name.data());
+		const int FailuresBefore = Testing::GetFailureCount();
+		const auto Start = std::chrono::steady_clock::now();
+		Test.Run();
+		const std::chrono::duration<double, std::milli> Elapsed = std::chrono::steady_clock::now() - Start;
+		std::printf("  %s (%.2f ms)\n", Testing::GetFailureCount() == FailuresBefore ? "passed" : "FAILED", Elapsed.count());
+		++Run;
+	}
+
+	std::printf("%d run, %d failed checks\n", Run, Testing::GetFailureCount());
+	return Testing::GetFailureCount();
+}
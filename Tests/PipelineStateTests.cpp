@@ -0,0 +1,75 @@
+#include "TestFramework.h"
+#include "RecordingEngine.h"
+
+#include "StateObjectCache.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+
+#include <barrier>
+#include <chrono>
+#include <thread>
+
+TEST(FailedPipelineCreationDoesNotBlockWaiters)
+{
+	StateObjectCache<ID3D12PipelineState> Cache;
+	auto FailedCreate = []() -> ID3D12PipelineState* { return nullptr; };
+	auto MakeKey = [] { return std::vector<uint8_t>{ 1, 2, 3 }; };
+
+	// The compile runs on another thread, which fails while a synchronous request for the same key waits
+	std::thread Worker;
+	const auto& Slot = Cache.GetOrCreateAsync(1, MakeKey(), FailedCreate, [&Worker](auto&& Compile)
+	{
+		Worker = std::thread(std::move(Compile));
+	});
+	CHECK(Cache.GetOrCreate(1, MakeKey(), FailedCreate) == nullptr);
+	Worker.join();
+
+	CHECK(Slot.IsDone());
+	CHECK(Slot.HasFailed());
+	CHECK(&Cache.GetOrCreateSlot(1, MakeKey(), FailedCreate) == &Slot);
+
+	Cache.Clear();
+}
+
+BENCHMARK(FinalizePipelinesOn16Threads)
+{
+	constexpr int kNumThreads = 16;
+	constexpr int kFinalizesPerThread = 10000;
+	// Fewer pipelines than finalizes, so threads both create pipelines and find ones others created
+	constexpr uint32_t kNumPipelines = 512;
+
+	Testing::InitializeGraphics();
+
+	RootSignature Signature(0);
+	Signature.Finalize(L"Benchmark root signature");
+
+	// The recording device doesn't compile shaders; distinct bytecode only makes distinct pipelines
+	std::vector<uint32_t> Shaders(kNumPipelines);
+	for (uint32_t i = 0; i < kNumPipelines; ++i)
+		Shaders[i] = i;
+
+	std::barrier Start(kNumThreads + 1);
+	std::vector<std::thread> Threads;
+	for (int t = 0; t < kNumThreads; ++t)
+	{
+		Threads.emplace_back([&Start, &Signature, &Shaders, t]
+		{
+			Start.arrive_and_wait();
+			for (int i = 0; i < kFinalizesPerThread; ++i)
+			{
+				ComputePSO Pipeline;
+				Pipeline.SetRootSignature(Signature);
+				Pipeline.SetComputeShader(&Shaders[(t * 97 + i) % kNumPipelines], sizeof(uint32_t));
+				Pipeline.Finalize();
+			}
+		});
+	}
+
+	Start.arrive_and_wait();
+	const auto StartTime = std::chrono::steady_clock::now();
+	for (auto& Thread : Threads)
+		Thread.join();
+	const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - StartTime;
+
+	std::printf("  %.0f finalizes per second\n", kNumThreads * kFinalizesPerThread / Elapsed.count());
+}
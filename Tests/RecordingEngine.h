@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pch.h"
+#include "GraphicsCore.h"
+#include "GraphicsBackend.h"
+
+namespace Testing
+{
+	// Starts the engine headless on the recording backend the first time a test needs it; it shuts
+	// down when the test run exits
+	inline void InitializeGraphics(void)
+	{
+		static struct Engine
+		{
+			Engine()
+			{
+				Graphics::g_Headless = true;
+				Graphics::g_BackendType = Graphics::eBackend::kRecording;
+				Graphics::Initialize();
+			}
+			~Engine()
+			{
+				Graphics::Terminate();
+				Graphics::Shutdown();
+			}
+		} s_Engine;
+	}
+}
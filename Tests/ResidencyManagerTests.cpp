@@ -0,0 +1,84 @@
+#include "TestFramework.h"
+
+#include "pch.h"
+#include "ResidencyManager.h"
+
+namespace
+{
+	using Policy = LruResidencyPolicy<int>;
+
+	constexpr uint64_t kSize = 16;
+
+	bool Equal(const std::vector<int>& Victims, std::initializer_list<int> Expected)
+	{
+		return std::ranges::equal(Victims, Expected);
+	}
+}
+
+TEST(ResidencyEvictsLeastRecentlyUsedFirst)
+{
+	Policy Lru;
+	for (int Object = 1; Object <= 4; ++Object)
+		Lru.Insert(Object, kSize, 1);
+
+	// Using an object moves it behind everything that wasn't used since
+	Lru.Touch(1, 2);
+	Lru.Touch(3, 2);
+
+	CHECK(Equal(Lru.Evict(kSize * 3, 2), { 2, 4, 1 }));
+	CHECK(!Lru.IsResident(2));
+	CHECK(Lru.IsResident(3));
+	CHECK_EQUAL(kSize * 3, Lru.GetEvictedSize());
+
+	// Evicted objects aren't picked again
+	CHECK(Equal(Lru.Evict(kSize * 4, 2), { 3 }));
+}
+
+TEST(ResidencyEvictsOnlyEnoughToFreeTheRequestedBytes)
+{
+	Policy Lru;
+	Lru.Insert(1, kSize, 1);
+	Lru.Insert(2, kSize * 4, 1);
+	Lru.Insert(3, kSize, 1);
+
+	CHECK(Equal(Lru.Evict(kSize + 1, 1), { 1, 2 }));
+	CHECK(Equal(Lru.Evict(0, 1), {}));
+	CHECK(Lru.IsResident(3));
+}
+
+TEST(ResidencyNeverEvictsPinnedOrInFlightObjects)
+{
+	Policy Lru;
+	for (int Object = 1; Object <= 3; ++Object)
+		Lru.Insert(Object, kSize, 1);
+
+	Lru.Pin(1);
+	// Used in a frame the GPU hasn't completed yet
+	Lru.Touch(3, 3);
+
+	CHECK(Equal(Lru.Evict(kSize * 3, 2), { 2 }));
+
+	Lru.Unpin(1);
+	CHECK(Equal(Lru.Evict(kSize * 3, 2), { 1 }));
+	CHECK(Equal(Lru.Evict(kSize * 3, 3), { 3 }));
+}
+
+TEST(ResidencyTouchMakesEvictedObjectsResident)
+{
+	Policy Lru;
+	Lru.Insert(1, kSize, 1);
+	Lru.Insert(2, kSize, 1);
+	CHECK(Equal(Lru.Evict(kSize * 2, 1), { 1, 2 }));
+
+	// Only the first use after an eviction has to page the object back in
+	CHECK(Lru.Touch(1, 2));
+	CHECK(!Lru.Touch(1, 2));
+	CHECK(Lru.IsResident(1));
+	CHECK_EQUAL(kSize, Lru.GetEvictedSize());
+
+	// Removing an evicted object takes it out of the evicted bytes as well
+	Lru.Remove(2);
+	CHECK_EQUAL(0u, Lru.GetEvictedSize());
+	CHECK_EQUAL(kSize, Lru.GetTotalSize());
+	CHECK_EQUAL(1u, Lru.GetCount());
+}
@@ -0,0 +1,303 @@
+#include "TestFramework.h"
+#include "RecordingEngine.h"
+
+#include "RecordingDevice.h"
+#include "CommandContext.h"
+#include "ColorBuffer.h"
+
+#include <atomic>
+#include <cstring>
+
+using namespace Graphics;
+
+namespace
+{
+	// Collects the barriers on one resource of every command list submitted while it is alive, one
+	// entry per list that has any
+	class BarrierCapture
+	{
+	public:
+		explicit BarrierCapture(const GpuResource& Resource) : m_Resource(Resource.GetResource())
+		{
+			Recording::SetSubmitObserver(g_Device, [this](D3D12_COMMAND_LIST_TYPE, std::span<const Recording::CommandList* const> Lists)
+			{
+				auto lg = std::lock_guard{ m_Mutex };
+				for (const auto* List : Lists)
+				{
+					std::vector<D3D12_RESOURCE_BARRIER> Barriers;
+					for (const auto& Command : List->Commands)
+					{
+						if (std::strcmp(Command.Name, "ResourceBarrier") != 0)
+							continue;
+						for (const auto& Barrier : Command.Barriers)
+						{
+							if (Touches(Barrier))
+								Barriers.push_back(Barrier);
+						}
+					}
+					if (!Barriers.empty())
+						m_Lists.push_back(std::move(Barriers));
+				}
+			});
+		}
+
+		~BarrierCapture() { Recording::SetSubmitObserver(g_Device, nullptr); }
+
+		std::vector<std::vector<D3D12_RESOURCE_BARRIER>> GetLists(void)
+		{
+			auto lg = std::lock_guard{ m_Mutex };
+			return m_Lists;
+		}
+
+	private:
+		bool Touches(const D3D12_RESOURCE_BARRIER& Barrier) const
+		{
+			if (Barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
+				return Barrier.Transition.pResource == m_Resource;
+			if (Barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV)
+				return Barrier.UAV.pResource == m_Resource;
+			return false;
+		}
+
+		ID3D12Resource* m_Resource;
+		std::mutex m_Mutex;
+		std::vector<std::vector<D3D12_RESOURCE_BARRIER>> m_Lists;
+	};
+
+	bool IsTransition(const D3D12_RESOURCE_BARRIER& Barrier, D3D12_RESOURCE_STATES Before, D3D12_RESOURCE_STATES After,
+		D3D12_RESOURCE_BARRIER_FLAGS Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE)
+	{
+		return Barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && Barrier.Flags == Flags &&
+			Barrier.Transition.StateBefore == Before && Barrier.Transition.StateAfter == After;
+	}
+
+	// Every END_ONLY barrier must follow a BEGIN_ONLY of the same transition in the same list
+	bool SplitBarriersArePaired(const std::vector<D3D12_RESOURCE_BARRIER>& Barriers)
+	{
+		int Open = 0;
+		for (const auto& Barrier : Barriers)
+		{
+			if (Barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+				++Open;
+			else if (Barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY && --Open < 0)
+				return false;
+		}
+		return Open == 0;
+	}
+
+	// A render target in RENDER_TARGET state, with the barrier that put it there already submitted
+	void CreateTarget(ColorBuffer& Target, uint32_t NumMips = 1)
+	{
+		Testing::InitializeGraphics();
+		Target.Create(L"Barrier test target", 16, 16, NumMips, DXGI_FORMAT_R8G8B8A8_UNORM);
+
+		auto& Context = GraphicsContext::Begin();
+		Context.TransitionResource(Target, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
+		Context.Finish(true);
+	}
+}
+
+TEST(SplitTransitionEndsWhenTheStateIsNeeded)
+{
+	ColorBuffer Target;
+	CreateTarget(Target);
+	{
+		BarrierCapture Capture(Target);
+
+		auto& Context = GraphicsContext::Begin();
+		Context.BeginResourceTransition(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		Context.TransitionResource(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		Context.Finish(true);
+
+		const auto Lists = Capture.GetLists();
+		CHECK_EQUAL(1u, Lists.size());
+		if (Lists.size() == 1)
+		{
+			const auto& Barriers = Lists[0];
+			CHECK_EQUAL(2u, Barriers.size());
+			if (Barriers.size() == 2)
+			{
+				CHECK(IsTransition(Barriers[0], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+				CHECK(IsTransition(Barriers[1], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+			}
+		}
+	}
+	Target.Destroy();
+}
+
+TEST(SplitTransitionEndsBeforeMovingOn)
+{
+	ColorBuffer Target;
+	CreateTarget(Target);
+	{
+		BarrierCapture Capture(Target);
+
+		auto& Context = GraphicsContext::Begin();
+		Context.BeginResourceTransition(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		Context.TransitionResource(Target, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		Context.Finish(true);
+
+		const auto Lists = Capture.GetLists();
+		CHECK_EQUAL(1u, Lists.size());
+		if (Lists.size() == 1)
+		{
+			const auto& Barriers = Lists[0];
+			CHECK_EQUAL(3u, Barriers.size());
+			if (Barriers.size() == 3)
+			{
+				CHECK(IsTransition(Barriers[1], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+				CHECK(IsTransition(Barriers[2], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE));
+			}
+		}
+	}
+	Target.Destroy();
+}
+
+TEST(FinishEndsPendingSplitTransitions)
+{
+	ColorBuffer Target;
+	CreateTarget(Target);
+	{
+		BarrierCapture Capture(Target);
+
+		auto& Context = GraphicsContext::Begin();
+		Context.BeginResourceTransition(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		Context.Finish(true);
+
+		const auto Lists = Capture.GetLists();
+		CHECK_EQUAL(1u, Lists.size());
+		for (const auto& Barriers : Lists)
+		{
+			CHECK_EQUAL(2u, Barriers.size());
+			CHECK(SplitBarriersArePaired(Barriers));
+		}
+	}
+	Target.Destroy();
+}
+
+TEST(SplitTransitionStaysInTheContextThatBeganIt)
+{
+	ColorBuffer Target;
+	CreateTarget(Target);
+	{
+		BarrierCapture Capture(Target);
+
+		// Another context using the resource meanwhile must not end the split in its own list
+		auto& First = GraphicsContext::Begin();
+		First.BeginResourceTransition(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, true);
+		auto& Second = GraphicsContext::Begin();
+		Second.TransitionResource(Target, D3D12_RESOURCE_STATE_COPY_SOURCE, true);
+		Second.TransitionResource(Target, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		Second.Finish(true);
+		First.Finish(true);
+
+		const auto Lists = Capture.GetLists();
+		CHECK_EQUAL(2u, Lists.size());
+		for (const auto& Barriers : Lists)
+			CHECK(SplitBarriersArePaired(Barriers));
+	}
+	Target.Destroy();
+}
+
+TEST(ContextsFinishedOutOfRecordingOrderAreFixedUp)
+{
+	ColorBuffer Target;
+	CreateTarget(Target);
+	{
+		BarrierCapture Capture(Target);
+
+		// Both contexts assume the resource is in RENDER_TARGET, the second one is finished first as it
+		// could be when recording in parallel
+		auto& First = GraphicsContext::Begin();
+		First.TransitionResource(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, true);
+		auto& Second = GraphicsContext::Begin();
+		Second.TransitionResource(Target, D3D12_RESOURCE_STATE_COPY_SOURCE, true);
+		Second.Finish();
+		First.Finish(true);
+
+		// The first context's list gets a list of its own ahead of it, moving the resource back
+		const auto Lists = Capture.GetLists();
+		CHECK_EQUAL(3u, Lists.size());
+		if (Lists.size() == 3)
+		{
+			CHECK_EQUAL(1u, Lists[0].size());
+			CHECK(IsTransition(Lists[0].front(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE));
+			CHECK_EQUAL(1u, Lists[1].size());
+			CHECK(IsTransition(Lists[1].front(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+			CHECK_EQUAL(1u, Lists[2].size());
+			CHECK(IsTransition(Lists[2].front(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+		}
+
+		// The resource ends up in the state of the context finished last
+		auto& Next = GraphicsContext::Begin();
+		Next.TransitionResource(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		Next.Finish(true);
+		CHECK_EQUAL(3u, Capture.GetLists().size());
+	}
+	Target.Destroy();
+}
+
+TEST(SubresourceTransitionsAreMergedBack)
+{
+	ColorBuffer Target;
+	CreateTarget(Target, 3);
+	{
+		BarrierCapture Capture(Target);
+
+		auto& Context = GraphicsContext::Begin();
+		Context.TransitionSubresource(Target, 1, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		Context.TransitionResource(Target, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		Context.Finish(true);
+
+		// Only the subresources that weren't in COPY_SOURCE yet move, one barrier each
+		const auto Lists = Capture.GetLists();
+		CHECK_EQUAL(1u, Lists.size());
+		if (Lists.size() == 1)
+		{
+			const auto& Barriers = Lists[0];
+			CHECK_EQUAL(3u, Barriers.size());
+			for (const auto& Barrier : Barriers)
+				CHECK(IsTransition(Barrier, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE));
+			if (Barriers.size() == 3)
+			{
+				CHECK_EQUAL(1u, Barriers[0].Transition.Subresource);
+				CHECK_EQUAL(0u, Barriers[1].Transition.Subresource);
+				CHECK_EQUAL(2u, Barriers[2].Transition.Subresource);
+			}
+		}
+	}
+	Target.Destroy();
+}
+
+TEST(BarrierBatchesAreUnbounded)
+{
+	constexpr uint32_t kNumTargets = 40;
+
+	Testing::InitializeGraphics();
+	std::vector<ColorBuffer> Targets(kNumTargets);
+	for (auto& Target : Targets)
+		CreateTarget(Target);
+
+	std::atomic<size_t> LargestBatch = 0;
+	Recording::SetSubmitObserver(g_Device, [&LargestBatch](D3D12_COMMAND_LIST_TYPE, std::span<const Recording::CommandList* const> Lists)
+	{
+		for (const auto* List : Lists)
+		{
+			for (const auto& Command : List->Commands)
+				LargestBatch = std::max(LargestBatch.load(), Command.Barriers.size());
+		}
+	});
+
+	auto& Context = GraphicsContext::Begin();
+	for (auto& Target : Targets)
+		Context.TransitionResource(Target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	Context.Finish(true);
+
+	Recording::SetSubmitObserver(g_Device, nullptr);
+
+	// All transitions were flushed together, more than the old fixed-size buffer could hold
+	CHECK(LargestBatch >= kNumTargets);
+
+	for (auto& Target : Targets)
+		Target.Destroy();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// Minimal self-registering test harness. Tests run by default, benchmarks only with -benchmark.
+namespace Testing
+{
+	struct TestCase
+	{
+		std::string_view Name;
+		std::function<void()> Run;
+		bool IsBenchmark;
+	};
+
+	inline std::vector<TestCase>& GetRegistry(void)
+	{
+		static std::vector<TestCase> s_Registry;
+		return s_Registry;
+	}
+
+	inline int& GetFailureCount(void)
+	{
+		static int s_Failures = 0;
+		return s_Failures;
+	}
+
+	struct Registrar
+	{
+		Registrar(std::string_view Name, std::function<void()> Run, bool IsBenchmark)
+		{
+			GetRegistry().push_back({ Name, std::move(Run), IsBenchmark });
+		}
+	};
+
+	inline void ReportFailure(const char* File, int Line, const char* Expression)
+	{
+		std::printf("  %s(%d): CHECK(%s) failed\n", File, Line, Expression);
+		++GetFailureCount();
+	}
+}
+
+#define TEST_CASE_IMPL(Name, IsBenchmark) \
+	static void Name(void); \
+	static Testing::Registrar s_Registrar_##Name(#Name, Name, IsBenchmark); \
+	static void Name(void)
+
+#define TEST(Name) TEST_CASE_IMPL(Name, false)
+#define BENCHMARK(Name) TEST_CASE_IMPL(Name, true)
+
+#define CHECK(Expression) \
+	do { if (!(Expression)) Testing::ReportFailure(__FILE__, __LINE__, #Expression); } while (0)
+
+#define CHECK_EQUAL(Expected, Actual) CHECK((Expected) == (Actual))
@@ -0,0 +1,93 @@
+#include "TestFramework.h"
+
+#include "ThreadLocalQueues.h"
+
+#include <barrier>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct Entry
+	{
+		uint32_t Producer;
+		uint32_t Sequence;
+	};
+
+	using EntryQueue = std::vector<Entry>;
+
+	constexpr uint32_t kProducerCount = 16;
+	constexpr uint32_t kEntriesPerProducer = 100000;
+
+	// Runs kProducerCount threads that start together and push into the shared queues
+	void Produce(ThreadLocalQueues<EntryQueue>& Queues, uint32_t EntryCount)
+	{
+		std::barrier Start(kProducerCount);
+		std::vector<std::jthread> Producers;
+		for (uint32_t Producer = 0; Producer < kProducerCount; ++Producer)
+		{
+			Producers.emplace_back([&, Producer] {
+				Start.arrive_and_wait();
+				for (uint32_t i = 0; i < EntryCount; ++i)
+					Queues.Local().push_back({ Producer, i });
+			});
+		}
+	}
+}
+
+TEST(ThreadLocalQueues_NoEntriesLostUnderContention)
+{
+	ThreadLocalQueues<EntryQueue> Queues;
+	Produce(Queues, kEntriesPerProducer);
+
+	size_t QueueCount = 0;
+	size_t Total = 0;
+	std::vector<uint32_t> NextSequence(kProducerCount, 0);
+	bool InOrder = true;
+	Queues.ForEach([&](const EntryQueue& Queue) {
+		++QueueCount;
+		Total += Queue.size();
+		for (const auto& Item : Queue)
+			InOrder &= Item.Sequence == NextSequence[Item.Producer]++;
+	});
+
+	CHECK_EQUAL(kProducerCount, QueueCount);
+	CHECK_EQUAL(size_t(kProducerCount) * kEntriesPerProducer, Total);
+	CHECK(InOrder);
+	for (uint32_t Count : NextSequence)
+		CHECK_EQUAL(kEntriesPerProducer, Count);
+}
+
+TEST(ThreadLocalQueues_QueueIsReusedAcrossFrames)
+{
+	ThreadLocalQueues<EntryQueue> Queues;
+	for (int Frame = 0; Frame < 4; ++Frame)
+	{
+		Produce(Queues, 1000);
+
+		size_t Total = 0;
+		Queues.ForEach([&](EntryQueue& Queue) {
+			Total += Queue.size();
+			Queue.clear();
+		});
+		CHECK_EQUAL(size_t(kProducerCount) * 1000, Total);
+	}
+
+	// A thread never owns more than one queue; ids of exited threads may be recycled
+	size_t QueueCount = 0;
+	Queues.ForEach([&](const EntryQueue&) { ++QueueCount; });
+	CHECK(QueueCount >= kProducerCount && QueueCount <= size_t(4) * kProducerCount);
+}
+
+TEST(ThreadLocalQueues_InstancesAreIndependent)
+{
+	ThreadLocalQueues<EntryQueue> First;
+	ThreadLocalQueues<EntryQueue> Second;
+	First.Local().push_back({ 0, 0 });
+	Second.Local().push_back({ 0, 1 });
+	First.Local().push_back({ 0, 2 });
+
+	CHECK_EQUAL(size_t(2), First.Local().size());
+	CHECK_EQUAL(size_t(1), Second.Local().size());
+	CHECK_EQUAL(1u, Second.Local()[0].Sequence);
+}
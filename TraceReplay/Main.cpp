@@ -0,0 +1,48 @@
+#include "pch.h"
+#include "GraphicsCore.h"
+#include "GraphicsBackend.h"
+#include "CommandTrace.h"
+#include "SystemTime.h"
+
+// Replays a command trace saved with "Graphics/Command Trace/Save" on the recording backend and
+// prints the CPU time per frame, so submission cost can be profiled without the scene or a GPU.
+//
+// Usage: TraceReplay <trace file> [loops]
+int wmain(int argc, wchar_t** argv)
+{
+	if (argc < 2 || argc > 3)
+	{
+		Utility::Print("Usage: TraceReplay <trace file> [loops]\n");
+		return 1;
+	}
+
+	uint32_t Loops = 100;
+	if (argc == 3)
+	{
+		wchar_t* End = nullptr;
+		errno = 0;
+		const long Value = wcstol(argv[2], &End, 10);
+		if (End == argv[2] || *End != L'\0' || errno == ERANGE || Value <= 0)
+		{
+			Utility::Printf(L"Invalid loop count '{}', expected a positive number\n", argv[2]);
+			return 1;
+		}
+		Loops = static_cast<uint32_t>(Value);
+	}
+
+	Microsoft::WRL::Wrappers::RoInitializeWrapper InitializeWinRT(RO_INIT_MULTITHREADED);
+	ASSERT_SUCCEEDED(InitializeWinRT);
+
+	Graphics::g_Headless = true;
+	Graphics::g_BackendType = Graphics::eBackend::kRecording;
+	Graphics::Initialize();
+	SystemTime::Initialize();
+
+	const bool Loaded = Graphics::g_CommandTrace.Load(argv[1]);
+	if (Loaded)
+		Graphics::g_CommandTrace.Replay(Loops);
+
+	Graphics::Terminate();
+	Graphics::Shutdown();
+	return Loaded ? 0 : 1;
+}